@@ -0,0 +1,418 @@
+/* File:     caPutJsonLogFormat.cpp
+ *
+ * Direct JSON writer for the put logger.
+ * For more information refer to the header file.
+ */
+
+// Standard library imports
+#include <cstring>
+#include <string>
+
+// Epics Base imports
+#include <epicsStdio.h>
+#include <epicsMath.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <yajl_gen.h>        // for EPICS_YAJL_VERSION
+
+// This module imports
+#define epicsExportSharedSymbols
+#include "caPutLogIdent.h"
+#include "caPutLogNum.h"
+#include "caPutJsonLogFormat.h"
+
+#define isDbrNumeric(type) ((type) > DBR_STRING && (type) <= DBR_ENUM)
+
+// Longest DBR_CHAR string the yajl path writes (its conversion buffer)
+#define MAX_CHAR_STRING (MAX_STRING_SIZE > MAX_ARRAY_SIZE_BYTES \
+                        ? MAX_STRING_SIZE : MAX_ARRAY_SIZE_BYTES)
+
+// yajl 1 escapes '/' in strings, yajl 2 doesn't by default
+#ifdef EPICS_YAJL_VERSION
+#define ESCAPE_SOLIDUS 0
+#else
+#define ESCAPE_SOLIDUS 1
+#endif
+
+namespace {
+
+template <typename U>
+void appendDigits(std::string &out, U v)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+
+    do {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+template <typename S, typename U>
+void appendSigned(std::string &out, S v)
+{
+    if (v < 0) {
+        out += '-';
+        appendDigits<U>(out, U(0) - static_cast<U>(v));
+    } else {
+        appendDigits<U>(out, static_cast<U>(v));
+    }
+}
+
+// Same as fieldVal2Str(): "%.8g" / "%.17g" and ".0" if it looks like an integer
+void appendFloat(std::string &out, const char *fmt, double v)
+{
+    char buf[32];
+    int len = epicsSnprintf(buf, sizeof(buf), fmt, v);
+
+    if (len <= 0)
+        return;
+    out.append(buf, len);
+    if (strspn(buf, "0123456789-") == static_cast<size_t>(len))
+        out.append(".0", 2);
+}
+
+// Shortest round trip, same as fieldVal2Str() in that mode
+void appendShortest(std::string &out, epicsFloat32 v)
+{
+    char buf[caPutLogNumBufSize];
+    out.append(buf, caPutLogFormatFloat(buf, v, 1));
+}
+
+void appendShortest(std::string &out, epicsFloat64 v)
+{
+    char buf[caPutLogNumBufSize];
+    out.append(buf, caPutLogFormatDouble(buf, v, 1));
+}
+
+// Special values are written as strings, like testForSpecialValues() does
+bool appendSpecial(std::string &out, double v)
+{
+    if (isnan(v))
+        out.append("\"Nan\"", 5);
+    else if (isinf(v) && v > 0)
+        out.append("\"Infinity\"", 10);
+    else if (isinf(v) && v < 0)
+        out.append("\"-Infinity\"", 11);
+    else
+        return false;
+    return true;
+}
+
+/*
+ * How an element of each type is written: plain() as fieldVal2Str() does,
+ * element() checks for special values first where there can be any
+ */
+template <typename T> struct JsonNumber;
+
+template <> struct JsonNumber<epicsUInt8> {
+    static void plain(std::string &out, epicsUInt8 v, caPutLogNumFmt) { appendDigits<epicsUInt32>(out, v); }
+    static void element(std::string &out, epicsUInt8 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsInt16> {
+    static void plain(std::string &out, epicsInt16 v, caPutLogNumFmt) { appendSigned<epicsInt32, epicsUInt32>(out, v); }
+    static void element(std::string &out, epicsInt16 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsUInt16> {
+    static void plain(std::string &out, epicsUInt16 v, caPutLogNumFmt) { appendDigits<epicsUInt32>(out, v); }
+    static void element(std::string &out, epicsUInt16 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsInt32> {
+    static void plain(std::string &out, epicsInt32 v, caPutLogNumFmt) { appendSigned<epicsInt32, epicsUInt32>(out, v); }
+    static void element(std::string &out, epicsInt32 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsUInt32> {
+    static void plain(std::string &out, epicsUInt32 v, caPutLogNumFmt) { appendDigits<epicsUInt32>(out, v); }
+    static void element(std::string &out, epicsUInt32 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsInt64> {
+    static void plain(std::string &out, epicsInt64 v, caPutLogNumFmt) { appendSigned<epicsInt64, epicsUInt64>(out, v); }
+    static void element(std::string &out, epicsInt64 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsUInt64> {
+    static void plain(std::string &out, epicsUInt64 v, caPutLogNumFmt) { appendDigits<epicsUInt64>(out, v); }
+    static void element(std::string &out, epicsUInt64 v, caPutLogNumFmt fmt) { plain(out, v, fmt); }
+};
+template <> struct JsonNumber<epicsFloat32> {
+    static void plain(std::string &out, epicsFloat32 v, caPutLogNumFmt fmt) {
+        if (fmt == caPutLogNumShortest) appendShortest(out, v);
+        else appendFloat(out, "%.8g", v);
+    }
+    static void element(std::string &out, epicsFloat32 v, caPutLogNumFmt fmt) {
+        if (!appendSpecial(out, v)) plain(out, v, fmt);
+    }
+};
+template <> struct JsonNumber<epicsFloat64> {
+    static void plain(std::string &out, epicsFloat64 v, caPutLogNumFmt fmt) {
+        if (fmt == caPutLogNumShortest) appendShortest(out, v);
+        else appendFloat(out, "%.17g", v);
+    }
+    static void element(std::string &out, epicsFloat64 v, caPutLogNumFmt fmt) {
+        if (!appendSpecial(out, v)) plain(out, v, fmt);
+    }
+};
+
+// Quote and escape a string the way yajl_gen_string() does
+void appendString(std::string &out, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t beg = 0;
+
+    out += '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+
+        if (c >= 0x20 && c != '"' && c != '\\' && !(ESCAPE_SOLIDUS && c == '/'))
+            continue;
+        out.append(s + beg, i - beg);
+        beg = i + 1;
+        switch (c) {
+            case '\r': out.append("\\r", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '/':  out.append("\\/", 2); break;
+            case '"':  out.append("\\\"", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            default: {
+                const char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                out.append(u, sizeof(u));
+            }
+        }
+    }
+    out.append(s + beg, len - beg);
+    out += '"';
+}
+
+// Length of a string of at most max characters
+size_t boundedLength(const char *s, size_t max)
+{
+    const void *end = memchr(s, 0, max);
+    return end ? static_cast<const char *>(end) - s : max;
+}
+
+const char *timeFmtNames[] = {"date-time", "iso8601", "epoch-ns"};
+
+// Everything up to the host, for the time formats that take a strftime format
+const char *timePrefix[] = {
+    "{\"date\":\"%Y-%m-%d\",\"time\":\"%H:%M:%S.%03f\"",
+    "{\"timestamp\":\"%Y-%m-%dT%H:%M:%S.%06fZ\"",
+    NULL
+};
+
+} // namespace
+
+CaPutJsonLogFormat::CaPutJsonLogFormat()
+    : numFmt(caPutLogNumShortest)
+{
+    msg.reserve(1024);
+    setTimeFmt(timeDateTime);
+}
+
+void CaPutJsonLogFormat::setTimeFmt(timeFmt_t fmt)
+{
+    timeFmt = fmt;
+    if (timePrefix[fmt])
+        caPutLogTimeCompile(&timeCache, timePrefix[fmt], fmt == timeIso8601);
+}
+
+int CaPutJsonLogFormat::timeFmtFromName(const char *name)
+{
+    for (int i = 0; name && i < int(sizeof(timeFmtNames) / sizeof(timeFmtNames[0])); i++) {
+        if (strcmp(name, timeFmtNames[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *CaPutJsonLogFormat::timeFmtName(int fmt)
+{
+    if (fmt < 0 || fmt >= int(sizeof(timeFmtNames) / sizeof(timeFmtNames[0])))
+        return "unknown";
+    return timeFmtNames[fmt];
+}
+
+void CaPutJsonLogFormat::string(const char *s, size_t len)
+{
+    appendString(msg, s, len);
+}
+
+std::string CaPutJsonLogFormat::serializeMetadata(const metadata_t &metadata)
+{
+    std::string json;
+
+    for (metadata_t::const_iterator it = metadata.begin(); it != metadata.end(); ++it) {
+        json += ',';
+        appendString(json, it->first.data(), it->first.length());
+        json += ':';
+        appendString(json, it->second.data(), it->second.length());
+    }
+    return json;
+}
+
+void CaPutJsonLogFormat::integer(epicsInt64 v)
+{
+    appendSigned<epicsInt64, epicsUInt64>(msg, v);
+}
+
+template <typename T>
+void CaPutJsonLogFormat::elements(const VALUE *pval, int count)
+{
+    const T *p = reinterpret_cast<const T *>(pval);
+
+    for (int i = 0; i < count; i++) {
+        if (i) msg += ',';
+        JsonNumber<T>::element(msg, p[i], numFmt);
+    }
+}
+
+template <typename T>
+void CaPutJsonLogFormat::number(const VALUE *pval)
+{
+    JsonNumber<T>::plain(msg, *reinterpret_cast<const T *>(pval), numFmt);
+}
+
+int CaPutJsonLogFormat::value(const VALUE *pval, short type, size_t valueSize,
+                              int count, bool isArray)
+{
+    if (isArray) msg += '[';
+    switch (type) {
+        case DBR_CHAR:
+            // Long string, one JSON string even for the array form
+            string(pval->a_bytes, boundedLength(pval->a_bytes,
+                valueSize < MAX_CHAR_STRING ? valueSize : MAX_CHAR_STRING));
+            break;
+        case DBR_STRING:
+            for (int i = 0; i < count; i++) {
+                if (i) msg += ',';
+                string(pval->a_string[i], boundedLength(pval->a_string[i], MAX_STRING_SIZE));
+            }
+            break;
+        case DBR_UCHAR:     elements<epicsUInt8>(pval, count); break;
+        case DBR_SHORT:     elements<epicsInt16>(pval, count); break;
+        case DBR_USHORT:
+        case DBR_ENUM:      elements<epicsUInt16>(pval, count); break;
+        case DBR_LONG:      elements<epicsInt32>(pval, count); break;
+        case DBR_ULONG:     elements<epicsUInt32>(pval, count); break;
+#ifdef DBR_INT64
+        case DBR_INT64:     elements<epicsInt64>(pval, count); break;
+        case DBR_UINT64:    elements<epicsUInt64>(pval, count); break;
+#endif
+        case DBR_FLOAT:     elements<epicsFloat32>(pval, count); break;
+        case DBR_DOUBLE:    elements<epicsFloat64>(pval, count); break;
+        default:
+            errlogSevPrintf(errlogMajor,
+                "caPutJsonLog: failed to convert PV value to a string representation\n");
+            return -1;
+    }
+    if (isArray) msg += ']';
+    return 0;
+}
+
+// Burst min and max, unquoted like the yajl path writes them
+void CaPutJsonLogFormat::scalar(const VALUE *pval, short type, size_t valueSize)
+{
+    switch (type) {
+        case DBR_CHAR:
+            msg.append(pval->a_bytes, boundedLength(pval->a_bytes,
+                valueSize < MAX_CHAR_STRING ? valueSize : MAX_CHAR_STRING));
+            break;
+        case DBR_UCHAR:     number<epicsUInt8>(pval); break;
+        case DBR_SHORT:     number<epicsInt16>(pval); break;
+        case DBR_USHORT:
+        case DBR_ENUM:      number<epicsUInt16>(pval); break;
+        case DBR_LONG:      number<epicsInt32>(pval); break;
+        case DBR_ULONG:     number<epicsUInt32>(pval); break;
+#ifdef DBR_INT64
+        case DBR_INT64:     number<epicsInt64>(pval); break;
+        case DBR_UINT64:    number<epicsUInt64>(pval); break;
+#endif
+        case DBR_FLOAT:     number<epicsFloat32>(pval); break;
+        case DBR_DOUBLE:    number<epicsFloat64>(pval); break;
+    }
+}
+
+void CaPutJsonLogFormat::head(const LOGDATA *pLogData, const std::string &metadata)
+{
+    const epicsTimeStamp *pts = &pLogData->new_value->time;
+
+    msg.clear();
+
+    // Time of the put, the date and time text is cached for the second
+    if (timeFmt == timeEpochNs) {
+        char buf[caPutLogNumBufSize];
+        epicsUInt64 ns = (static_cast<epicsUInt64>(pts->secPastEpoch) + POSIX_TIME_AT_EPICS_EPOCH)
+            * 1000000000u + pts->nsec;
+        literal("{\"timestamp-ns\":");
+        msg.append(buf, caPutLogFormatUInt64(buf, ns));
+    } else {
+        char buf[caPutLogTimeMaxLen];
+        msg.append(buf, caPutLogTimeFormat(&timeCache, buf, sizeof(buf), pts));
+    }
+
+    // Client, quoted already if it comes from the identity table
+    literal(",\"host\":");
+    if (pLogData->ident)
+        msg.append(pLogData->ident->json_host, pLogData->ident->json_host_len);
+    else
+        string(pLogData->hostid, strlen(pLogData->hostid));
+    literal(",\"user\":");
+    if (pLogData->ident)
+        msg.append(pLogData->ident->json_user, pLogData->ident->json_user_len);
+    else
+        string(pLogData->userid, strlen(pLogData->userid));
+
+    msg.append(metadata);
+
+    literal(",\"pv\":");
+    string(pLogData->pv_name, strlen(pLogData->pv_name));
+}
+
+int CaPutJsonLogFormat::format(const VALUE *pold_value, const LOGDATA *pLogData, int burst,
+                               const VALUE *pmin, const VALUE *pmax, const std::string &metadata)
+{
+    bool isArray = pLogData->is_array != 0;
+
+    head(pLogData, metadata);
+
+    // New and old value
+    literal(",\"new\":");
+    if (value(&pLogData->new_value->value, pLogData->type, pLogData->value_size,
+            pLogData->new_log_size, isArray))
+        return -1;
+    if (isArray) {
+        literal(",\"new-size\":");
+        integer(pLogData->new_size);
+    }
+    literal(",\"old\":");
+    if (value(pold_value, pLogData->type, pLogData->value_size,
+            pLogData->old_log_size, isArray))
+        return -1;
+    if (isArray) {
+        literal(",\"old-size\":");
+        integer(pLogData->old_size);
+    }
+
+    if (burst && isDbrNumeric(pLogData->type) && !isArray) {
+        literal(",\"min\":");
+        scalar(pmin, pLogData->type, pLogData->value_size);
+        literal(",\"max\":");
+        scalar(pmax, pLogData->type, pLogData->value_size);
+        literal(",\"burst\":");
+        integer(burst);
+    }
+    msg += '}';
+    return 0;
+}
+
+void CaPutJsonLogFormat::suppressed(const LOGDATA *pLogData, const std::string &metadata)
+{
+    head(pLogData, metadata);
+    literal(",\"suppressed-pv\":");
+    integer(pLogData->suppressed_pv);
+    literal(",\"suppressed-client\":");
+    integer(pLogData->suppressed_client);
+    msg += '}';
+}
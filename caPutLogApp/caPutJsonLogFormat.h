@@ -0,0 +1,111 @@
+/* File:     caPutJsonLogFormat.h
+ *
+ * Direct JSON writer for the put logger: produces the same bytes as the
+ * yajl generator in CaPutJsonLogTask::buildJsonMsgYajl(), but writes into
+ * one buffer that is kept from message to message, emits the property
+ * names as literals and selects the code for the value type once per
+ * message instead of once per array element.
+ */
+
+#ifndef INCcaPutJsonLogFormath
+#define INCcaPutJsonLogFormath 1
+
+#include <map>
+#include <string>
+
+#include <epicsTypes.h>
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+#include "caPutLogNum.h"
+#include "caPutLogTime.h"
+
+#ifdef __cplusplus
+
+class epicsShareClass CaPutJsonLogFormat {
+public:
+    typedef std::map<std::string, std::string> metadata_t;
+
+    // How the time of the put is written
+    enum timeFmt_t {
+        timeDateTime,   // "date":"2020-08-10","time":"13:02:08.124" (local time)
+        timeIso8601,    // "timestamp":"2020-08-10T11:02:08.124567Z" (UTC)
+        timeEpochNs     // "timestamp-ns":1597057328124567890 (since 1970, UTC)
+    };
+
+    CaPutJsonLogFormat();
+
+    /**
+     * @brief Format one put as a JSON object (without a trailing newline).
+     *
+     * The result is left in message(), replacing the previous one.
+     *
+     * @param pold_value Pointer to a ::VALUE structure holding an old PV value.
+     * @param pLogData Pointer to a ::LOGDATA structure holding the new value and the other put details.
+     * @param burst Number of puts merged into this one, if any.
+     * @param pmin Pointer to a ::VALUE structure holding the min value if burst is non-zero.
+     * @param pmax Pointer to a ::VALUE structure holding the max value if burst is non-zero.
+     * @param metadata IOC metadata properties to include, as prepared by serializeMetadata().
+     * @return int 0 on success, -1 for an unsupported value type.
+     */
+    int format(const VALUE *pold_value, const LOGDATA *pLogData, int burst,
+            const VALUE *pmin, const VALUE *pmax, const std::string &metadata);
+
+    /**
+     * @brief Format the summary of the puts the rate limits dropped before
+     * this one: the put's time, client and PV with "suppressed-pv" and
+     * "suppressed-client" counts. The result is left in message().
+     */
+    void suppressed(const LOGDATA *pLogData, const std::string &metadata);
+
+    /**
+     * @brief Escape and quote metadata properties once, for splicing into
+     * every message: ,"key":"value" for each property.
+     */
+    static std::string serializeMetadata(const metadata_t &metadata);
+
+    /**
+     * @brief The buffer holding the last message. The caller may append to it,
+     * the next format() starts over.
+     */
+    std::string &message() { return msg; }
+
+    /**
+     * @brief Select how DBR_FLOAT and DBR_DOUBLE values are written: with
+     * "%.8g" / "%.17g" (caPutLogNumPrintf) or as the shortest digit string
+     * that reads back as the same value (caPutLogNumShortest, default).
+     */
+    void setNumFmt(caPutLogNumFmt fmt) { numFmt = fmt; }
+
+    /**
+     * @brief Select the time properties written, see ::timeFmt_t.
+     */
+    void setTimeFmt(timeFmt_t fmt);
+    timeFmt_t getTimeFmt() const { return timeFmt; }
+
+    /**
+     * @brief Time format names as used by the shell command ("date-time",
+     * "iso8601", "epoch-ns"); -1 if unknown.
+     */
+    static int timeFmtFromName(const char *name);
+    static const char *timeFmtName(int fmt);
+
+private:
+    std::string msg;
+    caPutLogNumFmt numFmt;
+    timeFmt_t timeFmt;
+    caPutLogTimeCache timeCache;
+
+    template <size_t N> void literal(const char (&s)[N]) { msg.append(s, N - 1); }
+    void head(const LOGDATA *pLogData, const std::string &metadata);
+    void string(const char *s, size_t len);
+    void integer(epicsInt64 v);
+    int value(const VALUE *pval, short type, size_t valueSize, int count, bool isArray);
+    template <typename T> void elements(const VALUE *pval, int count);
+    void scalar(const VALUE *pval, short type, size_t valueSize);
+    template <typename T> void number(const VALUE *pval);
+};
+
+#endif /*__cplusplus */
+
+#endif /* INCcaPutJsonLogFormath */
@@ -18,6 +18,9 @@
 #include <string>
 
 #include "caPutJsonLogTask.h"
+#include "caPutLogDeadband.h"
+#include "caPutLogFilter.h"
+#include "caPutLogRate.h"
 
 // Use colored ERROR/WARNING text if available
 #ifndef ERL_ERROR
@@ -29,26 +32,30 @@
 extern "C"
 {
     extern int caPutLogJsonMsgQueueSize;
+    extern int caPutJsonLogUseYajl;
 
     /* Initalisation */
-    int caPutJsonLogInit(const char * address, caPutJsonLogConfig config, double timeout){
+    int caPutJsonLogInit(const char * address, caPutJsonLogConfig config, double timeout, int copies){
         CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
-        if (logger != NULL) return logger->initialize(address, config, timeout);
+        if (logger != NULL) return logger->initialize(address, config, timeout, copies);
         else return -1;
     }
 
     static const iocshArg caPutJsonLogInitArg0 = {"address", iocshArgString};
     static const iocshArg caPutJsonLogInitArg1 = {"config", iocshArgInt};
     static const iocshArg caPutJsonLogInitArg2 = {"burst timeout", iocshArgDouble};
+    static const iocshArg caPutJsonLogInitArg3 = {"copies", iocshArgInt};
     static const iocshArg *const caPutJsonLogInitArgs[] = {
         &caPutJsonLogInitArg0,
         &caPutJsonLogInitArg1,
-        &caPutJsonLogInitArg2
+        &caPutJsonLogInitArg2,
+        &caPutJsonLogInitArg3
     };
-    static const iocshFuncDef caPutJsonLogInitDef = {"caPutJsonLogInit", 3, caPutJsonLogInitArgs};
+    static const iocshFuncDef caPutJsonLogInitDef = {"caPutJsonLogInit", 4, caPutJsonLogInitArgs};
     static void caPutJsonLogInitCall(const iocshArgBuf *args)
     {
-        caPutJsonLogInit(args[0].sval, static_cast<caPutJsonLogConfig>(args[1].ival), args[2].dval);
+        caPutJsonLogInit(args[0].sval, static_cast<caPutJsonLogConfig>(args[1].ival), args[2].dval,
+            args[3].ival);
     }
 
 
@@ -139,6 +146,210 @@ extern "C"
         caPutJsonLogSetBurstTimeout(args[0].dval);
     }
 
+    /* Queue limits and overflow policy */
+    int caPutJsonLogSetQueue(int messages, int bytes, const char *policy, double timeout){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setQueue(messages, bytes, policy, timeout);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetQueueArg0 = {"messages", iocshArgInt};
+    static const iocshArg caPutJsonLogSetQueueArg1 = {"bytes", iocshArgInt};
+    static const iocshArg caPutJsonLogSetQueueArg2 = {"policy", iocshArgString};
+    static const iocshArg caPutJsonLogSetQueueArg3 = {"block timeout", iocshArgDouble};
+    static const iocshArg *const caPutJsonLogSetQueueArgs[] = {
+        &caPutJsonLogSetQueueArg0,
+        &caPutJsonLogSetQueueArg1,
+        &caPutJsonLogSetQueueArg2,
+        &caPutJsonLogSetQueueArg3
+    };
+    static const iocshFuncDef caPutJsonLogSetQueueDef = {"caPutJsonLogSetQueue", 4, caPutJsonLogSetQueueArgs};
+    static void caPutJsonLogSetQueueCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetQueue(args[0].ival, args[1].ival, args[2].sval, args[3].dval);
+    }
+
+    /* Conversion of floating point values */
+    int caPutJsonLogSetNumFmt(const char *format){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setNumFmt(format);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetNumFmtArg0 = {"format", iocshArgString};
+    static const iocshArg *const caPutJsonLogSetNumFmtArgs[] = {
+        &caPutJsonLogSetNumFmtArg0
+    };
+    static const iocshFuncDef caPutJsonLogSetNumFmtDef = {"caPutJsonLogSetNumFmt", 1, caPutJsonLogSetNumFmtArgs};
+    static void caPutJsonLogSetNumFmtCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetNumFmt(args[0].sval);
+    }
+
+    /* Time properties */
+    int caPutJsonLogSetTimeFmt(const char *format){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setTimeFmt(format);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetTimeFmtArg0 = {"format", iocshArgString};
+    static const iocshArg *const caPutJsonLogSetTimeFmtArgs[] = {
+        &caPutJsonLogSetTimeFmtArg0
+    };
+    static const iocshFuncDef caPutJsonLogSetTimeFmtDef = {"caPutJsonLogSetTimeFmt", 1, caPutJsonLogSetTimeFmtArgs};
+    static void caPutJsonLogSetTimeFmtCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetTimeFmt(args[0].sval);
+    }
+
+    /* Message format for the log servers */
+    int caPutJsonLogSetFormat(const char *format){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setFormat(format);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetFormatArg0 = {"format", iocshArgString};
+    static const iocshArg *const caPutJsonLogSetFormatArgs[] = {
+        &caPutJsonLogSetFormatArg0
+    };
+    static const iocshFuncDef caPutJsonLogSetFormatDef = {"caPutJsonLogSetFormat", 1, caPutJsonLogSetFormatArgs};
+    static void caPutJsonLogSetFormatCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetFormat(args[0].sval);
+    }
+
+    /* Batches sent to the log servers */
+    int caPutJsonLogSetBatch(int bytes, double delay){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setBatch(bytes, delay);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetBatchArg0 = {"bytes", iocshArgInt};
+    static const iocshArg caPutJsonLogSetBatchArg1 = {"delay ms", iocshArgDouble};
+    static const iocshArg *const caPutJsonLogSetBatchArgs[] = {
+        &caPutJsonLogSetBatchArg0,
+        &caPutJsonLogSetBatchArg1
+    };
+    static const iocshFuncDef caPutJsonLogSetBatchDef = {"caPutJsonLogSetBatch", 2, caPutJsonLogSetBatchArgs};
+    static void caPutJsonLogSetBatchCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetBatch(args[0].ival, args[1].dval);
+    }
+
+    /* Spool for unreachable log servers */
+    int caPutJsonLogSetSpool(const char *dir, int bytes, double rate, int ack){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setSpool(dir, bytes, rate, ack);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetSpoolArg0 = {"directory", iocshArgString};
+    static const iocshArg caPutJsonLogSetSpoolArg1 = {"bytes", iocshArgInt};
+    static const iocshArg caPutJsonLogSetSpoolArg2 = {"replay rate", iocshArgDouble};
+    static const iocshArg caPutJsonLogSetSpoolArg3 = {"ack", iocshArgInt};
+    static const iocshArg *const caPutJsonLogSetSpoolArgs[] = {
+        &caPutJsonLogSetSpoolArg0,
+        &caPutJsonLogSetSpoolArg1,
+        &caPutJsonLogSetSpoolArg2,
+        &caPutJsonLogSetSpoolArg3
+    };
+    static const iocshFuncDef caPutJsonLogSetSpoolDef = {"caPutJsonLogSetSpool", 4, caPutJsonLogSetSpoolArgs};
+    static void caPutJsonLogSetSpoolCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetSpool(args[0].sval, args[1].ival, args[2].dval, args[3].ival);
+    }
+
+    /* Rolling history of the last messages */
+    int caPutJsonLogSetHistory(const char *textPV, const char *seqPV, int size){
+        CaPutJsonLogTask *logger =  CaPutJsonLogTask::getInstance();
+        if (logger != NULL)  return logger->setHistory(textPV, seqPV, size);
+        else return -1;
+    }
+
+    static const iocshArg caPutJsonLogSetHistoryArg0 = {"text PV", iocshArgString};
+    static const iocshArg caPutJsonLogSetHistoryArg1 = {"sequence PV", iocshArgString};
+    static const iocshArg caPutJsonLogSetHistoryArg2 = {"messages", iocshArgInt};
+    static const iocshArg *const caPutJsonLogSetHistoryArgs[] = {
+        &caPutJsonLogSetHistoryArg0,
+        &caPutJsonLogSetHistoryArg1,
+        &caPutJsonLogSetHistoryArg2
+    };
+    static const iocshFuncDef caPutJsonLogSetHistoryDef = {"caPutJsonLogSetHistory", 3, caPutJsonLogSetHistoryArgs};
+    static void caPutJsonLogSetHistoryCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetHistory(args[0].sval, args[1].sval, args[2].ival);
+    }
+
+    /* PV filter rules */
+    int caPutJsonLogAddFilter(const char *action, const char *pattern){
+        return caPutLogFilterAdd(action, pattern);
+    }
+
+    static const iocshArg caPutJsonLogAddFilterArg0 = {"include|exclude", iocshArgString};
+    static const iocshArg caPutJsonLogAddFilterArg1 = {"pattern", iocshArgString};
+    static const iocshArg *const caPutJsonLogAddFilterArgs[] = {
+        &caPutJsonLogAddFilterArg0,
+        &caPutJsonLogAddFilterArg1
+    };
+    static const iocshFuncDef caPutJsonLogAddFilterDef = {"caPutJsonLogAddFilter", 2, caPutJsonLogAddFilterArgs};
+    static void caPutJsonLogAddFilterCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogAddFilter(args[0].sval, args[1].sval);
+    }
+
+    int caPutJsonLogLoadFilter(const char *file){
+        return caPutLogFilterLoad(file);
+    }
+
+    static const iocshArg caPutJsonLogLoadFilterArg0 = {"file", iocshArgString};
+    static const iocshArg *const caPutJsonLogLoadFilterArgs[] = {
+        &caPutJsonLogLoadFilterArg0
+    };
+    static const iocshFuncDef caPutJsonLogLoadFilterDef = {"caPutJsonLogLoadFilter", 1, caPutJsonLogLoadFilterArgs};
+    static void caPutJsonLogLoadFilterCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogLoadFilter(args[0].sval);
+    }
+
+    /* Rate limits */
+    int caPutJsonLogSetRateLimit(const char *scope, double rate, double burst){
+        return caPutLogRateSet(scope, rate, burst);
+    }
+
+    static const iocshArg caPutJsonLogSetRateLimitArg0 = {"pv|client", iocshArgString};
+    static const iocshArg caPutJsonLogSetRateLimitArg1 = {"puts per second", iocshArgDouble};
+    static const iocshArg caPutJsonLogSetRateLimitArg2 = {"burst", iocshArgDouble};
+    static const iocshArg *const caPutJsonLogSetRateLimitArgs[] = {
+        &caPutJsonLogSetRateLimitArg0,
+        &caPutJsonLogSetRateLimitArg1,
+        &caPutJsonLogSetRateLimitArg2
+    };
+    static const iocshFuncDef caPutJsonLogSetRateLimitDef = {"caPutJsonLogSetRateLimit", 3, caPutJsonLogSetRateLimitArgs};
+    static void caPutJsonLogSetRateLimitCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetRateLimit(args[0].sval, args[1].dval, args[2].dval);
+    }
+
+    /* Deadband of the on-change mode */
+    int caPutJsonLogSetDeadband(const char *type, const char *deadband){
+        return caPutLogDeadbandSet(type, deadband);
+    }
+
+    static const iocshArg caPutJsonLogSetDeadbandArg0 = {"float|integer|all", iocshArgString};
+    static const iocshArg caPutJsonLogSetDeadbandArg1 = {"deadband", iocshArgString};
+    static const iocshArg *const caPutJsonLogSetDeadbandArgs[] = {
+        &caPutJsonLogSetDeadbandArg0,
+        &caPutJsonLogSetDeadbandArg1
+    };
+    static const iocshFuncDef caPutJsonLogSetDeadbandDef = {"caPutJsonLogSetDeadband", 2, caPutJsonLogSetDeadbandArgs};
+    static void caPutJsonLogSetDeadbandCall(const iocshArgBuf *args)
+    {
+        caPutJsonLogSetDeadband(args[0].sval, args[1].sval);
+    }
+
     /* Register JSON IOCsh commands */
     static void caPutJsonLogRegister(void)
     {
@@ -152,6 +363,17 @@ extern "C"
             iocshRegister(&caPutLogInitDef,caPutLogInitCall);
             iocshRegister(&caPutJsonLogAddMetadataDef,caPutJsonLogAddMetadataCall);
             iocshRegister(&caPutJsonLogSetBurstTimeoutDef,caPutJsonLogSetBurstTimeoutCall);
+            iocshRegister(&caPutJsonLogSetQueueDef,caPutJsonLogSetQueueCall);
+            iocshRegister(&caPutJsonLogSetNumFmtDef,caPutJsonLogSetNumFmtCall);
+            iocshRegister(&caPutJsonLogSetTimeFmtDef,caPutJsonLogSetTimeFmtCall);
+            iocshRegister(&caPutJsonLogSetFormatDef,caPutJsonLogSetFormatCall);
+            iocshRegister(&caPutJsonLogSetBatchDef,caPutJsonLogSetBatchCall);
+            iocshRegister(&caPutJsonLogSetSpoolDef,caPutJsonLogSetSpoolCall);
+            iocshRegister(&caPutJsonLogSetHistoryDef,caPutJsonLogSetHistoryCall);
+            iocshRegister(&caPutJsonLogAddFilterDef,caPutJsonLogAddFilterCall);
+            iocshRegister(&caPutJsonLogLoadFilterDef,caPutJsonLogLoadFilterCall);
+            iocshRegister(&caPutJsonLogSetRateLimitDef,caPutJsonLogSetRateLimitCall);
+            iocshRegister(&caPutJsonLogSetDeadbandDef,caPutJsonLogSetDeadbandCall);
             caPutLogRegisterDone = 2;
             break;
 
@@ -171,4 +393,5 @@ extern "C"
     epicsExportRegistrar(caPutJsonLogRegister);
 
     epicsExportAddress(int,caPutLogJsonMsgQueueSize);
+    epicsExportAddress(int,caPutJsonLogUseYajl);
 }
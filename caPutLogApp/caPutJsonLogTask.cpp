@@ -17,6 +17,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iterator>
+#include <new>
 #include <string>
 
 #ifdef _WIN32
@@ -43,13 +44,25 @@
 #define epicsExportSharedSymbols
 #include "caPutLogAs.h"
 #include "caPutLogTask.h"
+#include "caPutLogBurst.h"
+#include "caPutLogFilter.h"
+#include "caPutLogHistory.h"
+#include "caPutLogIdent.h"
+#include "caPutLogNum.h"
+#include "caPutLogPolicy.h"
+#include "caPutLogPv.h"
+#include "caPutLogRate.h"
 #include "caPutJsonLogTask.h"
 
 typedef epicsGuard<epicsMutex> guard_t;
 
 #define isDbrNumeric(type) ((type) > DBR_STRING && (type) <= DBR_ENUM)
 
+// Number of messages taken from the queue at once
+#define MAX_BATCH 32
+
 int caPutLogJsonMsgQueueSize = 1000;
+int caPutJsonLogUseYajl = 0;
 static const ENV_PARAM EPICS_CA_JSON_PUT_LOG_ADDR = {epicsStrDup("EPICS_CA_JSON_PUT_LOG_ADDR"), epicsStrDup("")};
 
 CaPutJsonLogTask * CaPutJsonLogTask::instance = NULL;
@@ -70,25 +83,36 @@ CaPutJsonLogTask *CaPutJsonLogTask::getInstance()
 }
 
 CaPutJsonLogTask::CaPutJsonLogTask()
-    : caPutJsonLogQ(caPutLogJsonMsgQueueSize, sizeof(LOGDATA *)),
+    : caPutJsonLogQ(NULL),
+        queueMaxMsgs(0),
+        queueMaxBytes(0),
+        queuePolicy(caPutLogDropNewest),
+        queueTimeout(0.0),
+        numFmt(caPutLogNumShortest),
+        timeFmt(CaPutJsonLogFormat::timeDateTime),
+        deadband(caPutLogDeadbandCreate()),
         threadId(NULL),
         taskStopper(false),
-        clients(NULL),
-        clientsMutex(),
-        pCaPutJsonLogPV(NULL)
-{ }
+        sinks(caPutLogSinkListCreate("caPutJsonLog", 0)),
+        binEncoder(NULL),
+        spoolAck(false),
+        pvSinks(caPutLogSinkListCreate("caPutJsonLogPV", 0)),
+        logPVDefined(false),
+        historyDefined(false),
+        pendingMetadata(NULL),
+        currentMetadata(new metadataSnapshot)
+{
+}
 
 CaPutJsonLogTask::~CaPutJsonLogTask()
 {
-    clientItem *client, *nextclient;
-    guard_t G(clientsMutex);
-    nextclient = clients;
-    clients = NULL;
-    while (nextclient) {
-        client = nextclient;
-        nextclient = client->next;
-        free(client);
-    }
+    caPutLogSinkListDestroy(sinks);
+    caPutLogSinkListDestroy(pvSinks);
+    caPutLogBinEncoderDestroy(binEncoder);
+    caPutLogQueueDestroy(caPutJsonLogQ);
+    caPutLogDeadbandDestroy(deadband);
+    delete static_cast<metadataSnapshot *>(pendingMetadata);
+    delete currentMetadata;
 }
 
 caPutJsonLogStatus CaPutJsonLogTask::reconfigure(caPutJsonLogConfig config, double timeout)
@@ -100,6 +124,7 @@ caPutJsonLogStatus CaPutJsonLogTask::reconfigure(caPutJsonLogConfig config, doub
     } else {
         epics::atomic::set(this->config, config);
     }
+    caPutLogAsSetMode(epics::atomic::get(this->config));
 
     this->setBurstTimeout(timeout);
 
@@ -109,13 +134,23 @@ caPutJsonLogStatus CaPutJsonLogTask::reconfigure(caPutJsonLogConfig config, doub
 caPutJsonLogStatus CaPutJsonLogTask::report(int level)
 {
 
-    if (clients != NULL) {
-        clientItem *client;
-        guard_t G(clientsMutex);
-        for (client = clients; client; client = client->next) {
-            logClientShow(client->caPutJsonLogClient, level);
-        }
+    if (caPutLogSinkCount(sinks)) {
+        caPutLogSinkShow(sinks, level);
         printf("caPutJsonLog: Total count = %d\n", epics::atomic::get(this->caPutTotalCount));
+        printf("caPutJsonLog: Client identities = %u\n", caPutLogIdentCount());
+        printf("caPutJsonLog: Number format = %s\n", caPutLogNumFmtName(this->numFmt));
+        printf("caPutJsonLog: Time format = %s\n", CaPutJsonLogFormat::timeFmtName(this->timeFmt));
+        printf("caPutJsonLog: Message format = %s\n", this->binEncoder ? "binary" : "json");
+        caPutLogFilterShow("caPutJsonLog");
+        caPutLogPolicyShow("caPutJsonLog");
+        caPutLogRateShow("caPutJsonLog");
+        caPutLogAsShow("caPutJsonLog");
+        if (this->deadband)
+            caPutLogDeadbandShow(this->deadband, "caPutJsonLog");
+        if (caPutJsonLogQ)
+            caPutLogQueueShow(caPutJsonLogQ, "caPutJsonLog");
+        if (caPutLogSinkCount(pvSinks))
+            caPutLogSinkShow(pvSinks, level);
         return caPutJsonLogSuccess;
     }
     else {
@@ -130,34 +165,67 @@ caPutJsonLogStatus CaPutJsonLogTask::addMetadata(const char *property, const cha
         errlogSevPrintf(errlogMinor, "caPutJsonLog: NULL key supplied\n");
         return caPutJsonLogError;
     }
+    guard_t G(metadataMutex);
     if (!value) {
         metadata.erase(property);
     } else
         metadata[property] = value;
+    publishMetadata();
     return caPutJsonLogSuccess;
 }
 
 bool CaPutJsonLogTask::isMetadataKey(std::string property)
 {
+    guard_t G(metadataMutex);
     return metadata.count(property) > 0;
 }
 
 void CaPutJsonLogTask::removeAllMetadata()
 {
+    guard_t G(metadataMutex);
     metadata.clear();
+    publishMetadata();
 }
 
 size_t CaPutJsonLogTask::metadataCount()
 {
+    guard_t G(metadataMutex);
     return metadata.size();
 }
 
+void CaPutJsonLogTask::publishMetadata()
+{
+    metadataSnapshot *snapshot = new metadataSnapshot;
+    EpicsAtomicPtrT old;
+
+    snapshot->map = metadata;
+    snapshot->json = CaPutJsonLogFormat::serializeMetadata(metadata);
+
+    // Replace a snapshot the worker hasn't taken yet
+    do {
+        old = epics::atomic::get(pendingMetadata);
+    } while (epics::atomic::compareAndSwap(pendingMetadata, old, snapshot) != old);
+    delete static_cast<metadataSnapshot *>(old);
+}
+
+const CaPutJsonLogTask::metadataSnapshot &CaPutJsonLogTask::takeMetadata()
+{
+    EpicsAtomicPtrT next = epics::atomic::get(pendingMetadata);
+
+    if (next && epics::atomic::compareAndSwap(pendingMetadata, next, NULL) == next) {
+        delete currentMetadata;
+        currentMetadata = static_cast<metadataSnapshot *>(next);
+    }
+    return *currentMetadata;
+}
+
 const std::map<std::string, std::string>& CaPutJsonLogTask::getMetadata()
 {
     return metadata;
 }
 
-caPutJsonLogStatus CaPutJsonLogTask::initialize(const char* addresslist, caPutJsonLogConfig config, double timeout)
+caPutJsonLogStatus CaPutJsonLogTask::initialize(const char* addresslist, caPutJsonLogConfig config, double timeout,
+                                                int copies)
 {
     caPutJsonLogStatus status;
 
@@ -192,8 +260,9 @@ caPutJsonLogStatus CaPutJsonLogTask::initialize(const char* addresslist, caPutJs
         configureServerLogging(address);
     }
     free(addresslistcopy2);
-    if (!clients)
+    if (!caPutLogSinkCount(sinks))
         return caPutJsonLogError;
+    caPutLogSinkSetCopies(sinks, copies > 0 ? copies : 0);
 
     // Start logger if not done already
     if (!threadId) {
@@ -224,6 +293,18 @@ caPutJsonLogStatus CaPutJsonLogTask::start()
         return caPutJsonLogError;
     }
 
+    // Create the queue, twice the size as room for raising the limit
+    // at run time and for puts queued beyond it with drop-oldest
+    if (!caPutJsonLogQ) {
+        caPutJsonLogQ = caPutLogQueueCreate(2 * queueSize());
+        if (!caPutJsonLogQ) {
+            errlogSevPrintf(errlogFatal, "caPutJsonLog: message queue creation failed\n");
+            return caPutJsonLogError;
+        }
+        caPutLogQueueSetLimits(caPutJsonLogQ, queueMaxMsgs ? queueMaxMsgs : queueSize(),
+            queueMaxBytes, queuePolicy, queueTimeout);
+    }
+
     // Create logging thread
     epics::atomic::set(this->taskStopper,  false);
     const char * threadName = "caPutJsonLog";
@@ -247,40 +328,16 @@ caPutJsonLogStatus CaPutJsonLogTask::stop()
     // Deregister Access Security trap
     caPutLogAsStop();
 
+    // Give the sender threads a chance to send what they have queued
+    caPutLogSinkFlush(sinks, 5.0);
+
     return caPutJsonLogSuccess;
 }
 
 caPutJsonLogStatus CaPutJsonLogTask::configureServerLogging(const char* address)
 {
-    int status;
-    struct sockaddr_in saddr;
-    clientItem** pclient;
-
-    // Parse the address
-    guard_t G(clientsMutex);
-    for (pclient = &clients; *pclient; pclient = &(*pclient)->next) {
-        if (strcmp(address, (*pclient)->address) == 0) {
-            fprintf (stderr, "caPutJsonLog: address %s already configured\n", address);
-            return caPutJsonLogSuccess;
-        }
-    }
-
-    status = aToIPAddr(address, this->default_port, &saddr);
-    if (status < 0) {
-        errlogSevPrintf(errlogMajor, "caPutJsonLog: bad address or host name\n");
+    if (caPutLogSinkAdd(sinks, address, this->default_port))
         return caPutJsonLogError;
-    }
-
-    // Create log client
-    *pclient = (clientItem*)callocMustSucceed(1,sizeof(clientItem)+strlen(address),"caPutJsonLog");
-    strcpy((*pclient)->address, address);
-    (*pclient)->caPutJsonLogClient = logClientCreate(saddr.sin_addr, ntohs(saddr.sin_port));
-    if (!(*pclient)->caPutJsonLogClient) {
-        fprintf (stderr, "caPutJsonLog: cannot create logClient %s\n", address);
-        free(*pclient);
-        *pclient = NULL;
-        return caPutJsonLogError;
-    }
     return caPutJsonLogSuccess;
 }
 
@@ -302,139 +359,238 @@ caPutJsonLogStatus CaPutJsonLogTask::configurePvLogging()
     caPutJsonLogPVEnv = std::getenv("EPICS_AS_PUT_JSON_LOG_PV");
 
     // Variable is not set, return success (Logging to a PV is disabled)
-    if (!caPutJsonLogPVEnv){
-        this->pCaPutJsonLogPV = NULL;
+    if (!caPutJsonLogPVEnv || this->logPVDefined){
         return caPutJsonLogSuccess;
     }
 
-    // Get pointer to a PV structure
-    long getpv_st;
-    this->pCaPutJsonLogPV = &this->caPutJsonLogPV;
-    getpv_st = dbNameToAddr(caPutJsonLogPVEnv, this->pCaPutJsonLogPV);
-
-    if (getpv_st) {
-        this->pCaPutJsonLogPV = NULL;
-            errlogSevPrintf(errlogMajor,
-                "caPutJsonLog: PV for CA Put Logging not found, logging to PV disabled\n");
+    // The PV is written by a sender thread of its own, see caPutLogPv.h
+    caPutLogPv *ppv = caPutLogPvCreate(caPutJsonLogPVEnv);
+    if (!ppv) {
         return caPutJsonLogError;
     }
+    caPutLogSinkAddTransport(this->pvSinks, caPutJsonLogPVEnv, &caPutLogPvTransport, ppv);
+    this->logPVDefined = true;
     return caPutJsonLogSuccess;
 }
 
-void CaPutJsonLogTask::caPutJsonLogTask(void *arg)
+void CaPutJsonLogTask::burstEmit(void *arg, const VALUE *pold_value, const LOGDATA *pLogData,
+                                int burst, const VALUE *pmin, const VALUE *pmax)
 {
+    static_cast<CaPutJsonLogTask *>(arg)->buildJsonMsg(pold_value, pLogData, burst, pmin, pmax);
+}
 
-    bool sent = false;
-    int burst = 0;
-    LOGDATA *pcurrent, *pnext;
-    VALUE old_value, max_value, min_value;
-    VALUE *pold=&old_value, *pmax=&max_value, *pmin=&min_value;
+int CaPutJsonLogTask::reportSuppressed(void *arg, const char *pvName, const char *userid,
+                                const char *hostid, const unsigned suppressed[2])
+{
+    LOGDATA *pLogData = caPutLogDataSuppressed(pvName, userid, hostid, suppressed);
 
-    epics::atomic::set(this->caPutTotalCount, 0);
+    if (!pLogData)
+        return 0;
+    static_cast<CaPutJsonLogTask *>(arg)->logSuppressed(pLogData);
+    caPutLogDataFree(pLogData);
+    return 1;
+}
 
-    // Receive 1st message
-    this->caPutJsonLogQ.receive(&pcurrent, sizeof(LOGDATA *));
-    std::memcpy(pold, &pcurrent->old_value, sizeof(VALUE));
+void CaPutJsonLogTask::caPutJsonLogTask(void *arg)
+{
+    unsigned nmsg, imsg;
+    LOGDATA *batch[MAX_BATCH];
+    caPutLogBurst *pburst;
+    double wait;
+
+    epics::atomic::set(this->caPutTotalCount, 0);
 
-    if (pcurrent->new_size > 0 && pcurrent->type != DBR_CHAR) {
-        std::memcpy(pmax, &pcurrent->new_value.value, sizeof(VALUE));
-        std::memcpy(pmin, &pcurrent->new_value.value, sizeof(VALUE));
+    // DBR_CHAR puts are never merged, and only scalar puts count as a burst
+    pburst = caPutLogBurstCreate(burstEmit, this,
+        caPutLogBurstNoMergeChar | caPutLogBurstScalarOnly);
+    if (!pburst) {
+        errlogSevPrintf(errlogFatal, "caPutJsonLog: burst filter creation failed\n");
+        return;
     }
 
     // Main loop of the logger, which accepts the caput changes and process them
     while (!(bool)epics::atomic::get(this->taskStopper))
     {
-        int msgSize;
+        // Log the bursts that have ended and the counts of suppressed puts no put
+        // took over, then wait for new puts until the next one is due
+        wait = caPutLogBurstProcess(pburst, this->burstTimeout);
+        if (epics::atomic::get(this->config) != caPutJsonLogNone)
+            wait = caPutLogRateSweep(reportSuppressed, this, wait);
+        nmsg = caPutLogQueueReceive(this->caPutJsonLogQ, batch, MAX_BATCH, wait);
 
-        // Receive new put with timeout
-        msgSize = this->caPutJsonLogQ.receive(&pnext, sizeof(LOGDATA *), this->burstTimeout);
+        int config = epics::atomic::get(this->config);
 
         // Do not log if configured as caPutJsonLogNone
-	if (epics::atomic::get(this->config) == caPutJsonLogNone){
-	    continue;
-	}
-
-        /* Timeout */
-        if (msgSize == -1) {
-            // If we have have unsent message and timeout occurred, send the cached change
-            if (!sent) {
-                buildJsonMsg(pold, pcurrent, burst, pmin, pmax);
-                std::memcpy(pold, &pcurrent->new_value.value, sizeof(VALUE));
-                sent = true;
-                burst = 0;
-            }
+        if (config == caPutJsonLogNone) {
+            for (imsg = 0; imsg < nmsg; imsg++) caPutLogDataFree(batch[imsg]);
+            caPutLogBurstDiscard(pburst);
+            continue;
         }
 
-        // Message is not the correct size
-        else if (msgSize != sizeof(LOGDATA *)) {
-            errlogSevPrintf(errlogMinor, "caPutJsonLog: discarding incomplete log data message\n");
-        }
+        for (imsg = 0; imsg < nmsg; imsg++) {
+            caPutLogDataResolve(batch[imsg]);
+            epics::atomic::increment(this->caPutTotalCount);
 
-        // Previous and new PV are the same and we are applying the burst filter
-        else if ((pnext->pfield == pcurrent->pfield)
-                    && (epics::atomic::get(this->config) != caPutJsonLogAllNoFilter)
-                    && (pcurrent->type != DBR_CHAR)) {
+            // The first put through a rate limit reports what it dropped
+            if (batch[imsg]->suppressed_pv || batch[imsg]->suppressed_client)
+                this->logSuppressed(batch[imsg]);
 
-            // Free "old" value
-            caPutLogDataFree(pcurrent);
-            pcurrent = pnext;
+            // Puts to the same PV are merged unless we log every change,
+            // the record's info tags may override both
+            caPutLogBurstPut(pburst, batch[imsg],
+                caPutLogPolicyBurst(batch[imsg], this->burstTimeout),
+                caPutLogPolicyMode(batch[imsg], config) != caPutJsonLogAllNoFilter);
+        }
+    }
+    caPutLogBurstDestroy(pburst);
+    epics::atomic::set(this->taskStopper,  false);
+    errlogSevPrintf(errlogInfo, "caPutJsonLog: log task exiting\n");
+}
 
-            epics::atomic::increment(this->caPutTotalCount);
+void CaPutJsonLogTask::addPutToQueue(LOGDATA * plogData)
+{
+    if (!this->caPutJsonLogQ) {
+        caPutLogDataFree(plogData);
+        return;
+    }
+    // The queue frees the put if it has to be dropped
+    if (caPutLogQueueSend(this->caPutJsonLogQ, plogData)) {
+        errlogSevPrintf(errlogMinor, "caPutJsonLog: message queue overflow\n");
+    }
+}
 
-            // First message after logging
-            if (sent) {
-                // Set new initial max & min values
-                std::memcpy(pmax, &pcurrent->new_value.value, sizeof(VALUE));
-                std::memcpy(pmin, &pcurrent->new_value.value, sizeof(VALUE));
+unsigned CaPutJsonLogTask::queueSize()
+{
+    return caPutLogJsonMsgQueueSize > 0 ? caPutLogJsonMsgQueueSize : 1000;
+}
 
-                sent = false;
-                burst = 0;
-            }
-            // Multiple puts within timeout
-            else {
-                if (isDbrNumeric(pcurrent->type) && pcurrent->new_size == 1) {
-                    burst++;
-                    calculateMax(pmax, &pcurrent->new_value.value, pmax, pcurrent->type);
-                    calculateMin(pmin, &pcurrent->new_value.value, pmin, pcurrent->type);
-                }
-            }
+caPutJsonLogStatus CaPutJsonLogTask::setQueue(int messages, int bytes, const char *policy, double timeout)
+{
+    int pol = caPutLogDropNewest;
+
+    if (policy && policy[0]) {
+        pol = caPutLogQueuePolicyFromName(policy);
+        if (pol < 0) {
+            errlogSevPrintf(errlogMinor,
+                "caPutJsonLog: unknown queue policy '%s' (drop-newest, drop-oldest, coalesce, block)\n",
+                policy);
+            return caPutJsonLogError;
         }
+    }
+    this->queueMaxMsgs = messages > 0 ? messages : 0;
+    this->queueMaxBytes = bytes > 0 ? bytes : 0;
+    this->queuePolicy = static_cast<caPutLogOverflowPolicy>(pol);
+    this->queueTimeout = timeout;
+
+    if (this->caPutJsonLogQ) {
+        caPutLogQueueSetLimits(this->caPutJsonLogQ,
+            queueMaxMsgs ? queueMaxMsgs : queueSize(),
+            queueMaxBytes, queuePolicy, queueTimeout);
+    }
+    return caPutJsonLogSuccess;
+}
 
-        // We log every change
-        else {
-            if (!sent) {
-                buildJsonMsg(pold, pcurrent, burst, pmin, pmax);
-                sent = true;
-            }
+caPutJsonLogStatus CaPutJsonLogTask::setNumFmt(const char *format)
+{
+    int fmt = caPutLogNumFmtFromName(format);
 
-            caPutLogDataFree(pcurrent);
-            pcurrent = pnext;
+    if (fmt < 0) {
+        errlogSevPrintf(errlogMinor,
+            "caPutJsonLog: unknown number format '%s' (printf, shortest)\n",
+            format ? format : "");
+        return caPutJsonLogError;
+    }
+    this->numFmt = static_cast<caPutLogNumFmt>(fmt);
+    return caPutJsonLogSuccess;
+}
 
-            epics::atomic::increment(this->caPutTotalCount);
+caPutJsonLogStatus CaPutJsonLogTask::setTimeFmt(const char *format)
+{
+    int fmt = CaPutJsonLogFormat::timeFmtFromName(format);
 
-            /* Set new old_value */
-            std::memcpy(pold, &pcurrent->old_value, sizeof(VALUE));
+    if (fmt < 0) {
+        errlogSevPrintf(errlogMinor,
+            "caPutJsonLog: unknown time format '%s' (date-time, iso8601, epoch-ns)\n",
+            format ? format : "");
+        return caPutJsonLogError;
+    }
+    this->timeFmt = static_cast<CaPutJsonLogFormat::timeFmt_t>(fmt);
+    return caPutJsonLogSuccess;
+}
 
-            /* Set new max & min values */
-            std::memcpy(pmax, &pcurrent->new_value.value, sizeof(VALUE));
-            std::memcpy(pmin, &pcurrent->new_value.value, sizeof(VALUE));
+caPutJsonLogStatus CaPutJsonLogTask::setFormat(const char *format)
+{
+    bool binary;
 
-            sent = false;
-            burst = 0;
-        }
+    if (format && strcmp(format, "binary") == 0) {
+        binary = true;
+    } else if (format && strcmp(format, "json") == 0) {
+        binary = false;
+    } else {
+        errlogSevPrintf(errlogMinor, "caPutJsonLog: unknown message format '%s' (json, binary)\n",
+            format ? format : "");
+        return caPutJsonLogError;
     }
-    epics::atomic::set(this->taskStopper,  false);
-    errlogSevPrintf(errlogInfo, "caPutJsonLog: log task exiting\n");
+    // The encoder's dictionary has to be there from the first connection on
+    if (caPutLogSinkCount(sinks)) {
+        errlogSevPrintf(errlogMinor, "caPutJsonLog: message format must be set before caPutJsonLogInit\n");
+        return caPutJsonLogError;
+    }
+    if (binary && this->spoolAck) {
+        errlogSevPrintf(errlogMinor,
+            "caPutJsonLog: binary format cannot be combined with a spool in ack mode\n");
+        return caPutJsonLogError;
+    }
+    if (binary && !this->binEncoder) {
+        this->binEncoder = caPutLogBinEncoderCreate();
+        caPutLogSinkSetPreamble(sinks, caPutLogBinPreamble, this->binEncoder);
+    } else if (!binary && this->binEncoder) {
+        caPutLogSinkSetPreamble(sinks, NULL, NULL);
+        caPutLogBinEncoderDestroy(this->binEncoder);
+        this->binEncoder = NULL;
+    }
+    return caPutJsonLogSuccess;
 }
 
-void CaPutJsonLogTask::addPutToQueue(LOGDATA * plogData)
+caPutJsonLogStatus CaPutJsonLogTask::setBatch(int bytes, double delay)
 {
-    if (this->caPutJsonLogQ.trySend(&plogData, sizeof(LOGDATA *))) {
-        errlogSevPrintf(errlogMinor, "caPutJsonLog: message queue overflow\n");
-        caPutLogDataFree(plogData);
+    caPutLogSinkSetBatch(sinks, bytes > 0 ? bytes : 0, delay / 1000.0);
+    return caPutJsonLogSuccess;
+}
+
+caPutJsonLogStatus CaPutJsonLogTask::setSpool(const char *dir, int bytes, double rate, int ack)
+{
+    bool on = dir && *dir;
+
+    // Acknowledgements count lines, binary frames have none
+    if (on && ack && this->binEncoder) {
+        errlogSevPrintf(errlogMinor,
+            "caPutJsonLog: spool in ack mode cannot be combined with the binary format\n");
+        return caPutJsonLogError;
     }
+    caPutLogSinkSetSpool(sinks, dir, bytes > 0 ? bytes : 0, rate, ack);
+    this->spoolAck = on && ack;
+    return caPutJsonLogSuccess;
 }
 
+caPutJsonLogStatus CaPutJsonLogTask::setHistory(const char *textPV, const char *seqPV, int size)
+{
+    if (!textPV || !textPV[0]) {
+        errlogSevPrintf(errlogMinor, "caPutJsonLog: no history PV given\n");
+        return caPutJsonLogError;
+    }
+    if (this->historyDefined) {
+        errlogSevPrintf(errlogMinor, "caPutJsonLog: history already configured\n");
+        return caPutJsonLogError;
+    }
+    caPutLogHistory *phist = caPutLogHistoryCreate(textPV, seqPV,
+        size > 0 ? size : caPutLogHistoryDefaultSize);
+    if (!phist)
+        return caPutJsonLogError;
+    caPutLogSinkAddTransport(this->pvSinks, textPV, &caPutLogHistoryTransport, phist);
+    this->historyDefined = true;
+    return caPutJsonLogSuccess;
+}
 
 #define CALL_YAJL_FUNCTION_AND_CHECK_STATUS(flag, call) \
     { \
@@ -448,6 +604,81 @@ void CaPutJsonLogTask::addPutToQueue(LOGDATA * plogData)
 
 caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const LOGDATA *pLogData,
                                 int burst, const VALUE *pmin, const VALUE *pmax)
+{
+    // Dont log duplicate values if configured so, nor numbers within their deadband
+    if (caPutLogPolicyMode(pLogData, this->config) == caPutJsonLogOnChange) {
+        if (!burst && this->compareValues(pLogData))
+            return caPutJsonLogSuccess;
+        if (this->deadband &&
+                !caPutLogDeadbandPass(this->deadband, pold_value, pLogData, burst, pmin, pmax))
+            return caPutJsonLogSuccess;
+    }
+
+    // Binary frames for the servers, JSON only if there is a PV to write
+    if (this->binEncoder) {
+        const std::string &meta = this->takeMetadata().json;
+        caPutLogBinOut out;
+
+        if (caPutLogBinEncode(this->binEncoder, pLogData, pold_value, burst, pmin, pmax,
+                meta.data(), meta.size(), &out))
+            return caPutJsonLogError;
+        if (out.sharedLen)
+            caPutLogSinkSendText(sinks, out.shared, out.sharedLen);
+        caPutLogSinkSendTextKeyed(sinks, out.put, out.putLen, caPutLogSinkKey(pLogData->pv_name));
+        if (!caPutLogSinkCount(this->pvSinks))
+            return caPutJsonLogSuccess;
+    }
+
+    std::string *json;
+    if (caPutJsonLogUseYajl) {
+        if (this->buildJsonMsgYajl(this->yajlMsg, pold_value, pLogData, burst, pmin, pmax))
+            return caPutJsonLogError;
+        json = &this->yajlMsg;
+    } else {
+        // Settings from the shell commands are taken over here, in the worker thread
+        this->jsonFormat.setNumFmt(this->numFmt);
+        if (this->jsonFormat.getTimeFmt() != this->timeFmt)
+            this->jsonFormat.setTimeFmt(this->timeFmt);
+        if (this->jsonFormat.format(pold_value, pLogData, burst, pmin, pmax,
+                this->takeMetadata().json))
+            return caPutJsonLogError;
+        json = &this->jsonFormat.message();
+    }
+
+    /* First log to a PV so we can append new line later for the logging to a server */
+    this->logToPV(*json);
+    if (!this->binEncoder) {
+        json->push_back('\n');
+        this->logToServer(*json, caPutLogSinkKey(pLogData->pv_name));
+    }
+    return caPutJsonLogSuccess;
+}
+
+void CaPutJsonLogTask::logSuppressed(const LOGDATA *pLogData)
+{
+    this->jsonFormat.setNumFmt(this->numFmt);
+    if (this->jsonFormat.getTimeFmt() != this->timeFmt)
+        this->jsonFormat.setTimeFmt(this->timeFmt);
+    const std::string &meta = this->takeMetadata().json;
+    this->jsonFormat.suppressed(pLogData, meta);
+
+    std::string &json = this->jsonFormat.message();
+    this->logToPV(json);
+    if (this->binEncoder) {
+        caPutLogBinOut out;
+
+        caPutLogBinEncodeSuppressed(this->binEncoder, pLogData, meta.data(), meta.size(), &out);
+        if (out.sharedLen)
+            caPutLogSinkSendText(sinks, out.shared, out.sharedLen);
+        caPutLogSinkSendTextKeyed(sinks, out.put, out.putLen, caPutLogSinkKey(pLogData->pv_name));
+    } else {
+        json.push_back('\n');
+        this->logToServer(json, caPutLogSinkKey(pLogData->pv_name));
+    }
+}
+
+caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsgYajl(std::string &json, const VALUE *pold_value,
+                                const LOGDATA *pLogData, int burst, const VALUE *pmin, const VALUE *pmax)
 {
     // Intermediate message build buffer
     // The longest message for the buffer can occur in the lso/lsi records which
@@ -459,12 +690,6 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
     unsigned char interBuffer[interBufferSize];
     yajl_gen_status status;
 
-    // Dont log duplicate values if configured so
-    if (this->config == caPutJsonLogOnChange && !burst) {
-        if (this->compareValues(pLogData))
-            return caPutJsonLogSuccess;
-    }
-
     // Configure yajl generator
     yajl_gen handle = yajl_gen_alloc(
 #ifndef EPICS_YAJL_VERSION
@@ -484,7 +709,7 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_date,
                             strlen(reinterpret_cast<const char *>(str_date))));
     epicsTimeToStrftime(reinterpret_cast<char *>(interBuffer), interBufferSize, "%Y-%m-%d",
-        &pLogData->new_value.time);
+        &pLogData->new_value->time);
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, interBuffer,
                             strlen(reinterpret_cast<char *>(interBuffer))));
 
@@ -493,7 +718,7 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_time,
                             strlen(reinterpret_cast<const char *>(str_time))));
     epicsTimeToStrftime(reinterpret_cast<char *>(interBuffer), interBufferSize, "%H:%M:%S.%03f",
-        &pLogData->new_value.time);
+        &pLogData->new_value->time);
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, interBuffer,
                             strlen(reinterpret_cast<char *>(interBuffer))));
 
@@ -501,21 +726,33 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
     const unsigned char str_host[] = "host";
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_host,
                             strlen(reinterpret_cast<const char *>(str_host))));
-    CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle,
+    if (pLogData->ident) {
+        // Splice in the quoted string prepared by the identity table
+        CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_number(handle,
+                            pLogData->ident->json_host, pLogData->ident->json_host_len));
+    } else {
+        CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle,
                             reinterpret_cast<const unsigned char *>(pLogData->hostid),
                             strlen(pLogData->hostid)));
+    }
 
     // Add system user
     const unsigned char str_user[] = "user";
     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_user,
                             strlen(reinterpret_cast<const char *>(str_user))));
-    CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle,
+    if (pLogData->ident) {
+        CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_number(handle,
+                            pLogData->ident->json_user, pLogData->ident->json_user_len));
+    } else {
+        CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle,
                             reinterpret_cast<const unsigned char *>(pLogData->userid),
                             strlen(pLogData->userid)));
+    }
 
     // Add metadata
-    std::map<std::string, std::string>::iterator meta_it;
-    for(meta_it = metadata.begin(); meta_it != metadata.end(); meta_it++){
+    const CaPutJsonLogFormat::metadata_t &meta = this->takeMetadata().map;
+    CaPutJsonLogFormat::metadata_t::const_iterator meta_it;
+    for(meta_it = meta.begin(); meta_it != meta.end(); meta_it++){
             CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle,
                             reinterpret_cast<const unsigned char *>(meta_it->first.c_str()),
                             meta_it->first.length()));
@@ -545,31 +782,31 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
     // We have string
     if (pLogData->type == DBR_CHAR){
         fieldVal2Str(reinterpret_cast<char *>(interBuffer), interBufferSize,
-                &pLogData->new_value.value, DBR_CHAR, 0);
+                &pLogData->new_value->value, DBR_CHAR, 0);
         CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, interBuffer,
                             strlen(reinterpret_cast<const char *>(interBuffer))));
     }
     // Arrays and scalars (all except DBR_CHAR)
     else {
         for (int i = 0; i < pLogData->new_log_size; i++) {
-            if (this->testForSpecialValues(&pLogData->new_value.value, pLogData->type, i) == svNan){
+            if (this->testForSpecialValues(&pLogData->new_value->value, pLogData->type, i) == svNan){
                 const unsigned char str_Nan[] = "Nan";
                 CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_Nan,
                             strlen(reinterpret_cast<const char *>(str_Nan))));
             }
-            else if (this->testForSpecialValues(&pLogData->new_value.value, pLogData->type, i) == svPinf){
+            else if (this->testForSpecialValues(&pLogData->new_value->value, pLogData->type, i) == svPinf){
                 const unsigned char str_pinf[] = "Infinity";
                 CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_pinf,
                             strlen(reinterpret_cast<const char *>(str_pinf))));
             }
-            else if (this->testForSpecialValues(&pLogData->new_value.value, pLogData->type, i)== svNinf){
+            else if (this->testForSpecialValues(&pLogData->new_value->value, pLogData->type, i)== svNinf){
                 const unsigned char str_ninf[] = "-Infinity";
                 CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, str_ninf,
                             strlen(reinterpret_cast<const char *>(str_ninf))));
             }
             else {
                 fieldVal2Str(reinterpret_cast<char *>(interBuffer), interBufferSize,
-                            &pLogData->new_value.value, pLogData->type, i);
+                            &pLogData->new_value->value, pLogData->type, i);
                 if (pLogData->type == DBR_STRING) {
                     CALL_YAJL_FUNCTION_AND_CHECK_STATUS(status, yajl_gen_string(handle, interBuffer,
                                 strlen(reinterpret_cast<char *>(interBuffer))));
@@ -689,132 +926,27 @@ caPutJsonLogStatus CaPutJsonLogTask::buildJsonMsg(const VALUE *pold_value, const
         len = 0;
     yajl_gen_get_buf(handle, &buf, &len);
 
-    /* Get a JSON as a string */
-    std::string json (reinterpret_cast<const char *>(buf));
-
-    /* First log to a PV so we can append new line later for the logging to a server */
-    this->logToPV(json);
-    this->logToServer(json.append("\n"));
+    json.assign(reinterpret_cast<const char *>(buf), len);
     yajl_gen_free(handle);
     return caPutJsonLogSuccess;
 }
 
-void CaPutJsonLogTask::logToServer(std::string &msg)
+void CaPutJsonLogTask::logToServer(std::string &msg, unsigned key)
 {
-    clientItem* client;
-    guard_t G(clientsMutex);
-    for (client = clients; client; client = client->next) {
-        logClientSend (client->caPutJsonLogClient, msg.c_str());
-    }
+    caPutLogSinkSendTextKeyed(sinks, msg.data(), msg.size(), key);
 }
 
 void CaPutJsonLogTask::logToPV(std::string &msg)
 {
-    if (this->pCaPutJsonLogPV != NULL) {
-        long status;
-
-        // Waveform record
-        if (this->pCaPutJsonLogPV->field_type == DBR_CHAR) {
-            status = dbPutField(this->pCaPutJsonLogPV, DBR_CHAR, msg.c_str(), msg.length());
-        }
-        // Lso/lsi records
-        else {
-            // As of EPICS base 7.0.4 this still clips at 40 characters
-            // Addint .$ or .VAL$ to the PV name, will use the waveform case and
-            // write the whole string correctly
-             status = dbPutField(this->pCaPutJsonLogPV, DBR_STRING, msg.c_str(), 1);
-        }
-
-        if (status) {
-            errlogSevPrintf(errlogMajor,
-                "caPutJsonLog: dbPutField to Log PV failed, status = %ld\n", status);
-        }
-    }
-}
-
-void CaPutJsonLogTask::calculateMin(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
-{
-    switch (type) {
-        case DBR_CHAR:
-            pres->v_int8 = std::min(pa->v_int8, pb->v_int8);
-            return;
-        case DBR_UCHAR:
-            pres->v_uint8 = std::min(pa->v_uint8, pb->v_uint8);
-            return;
-        case DBR_SHORT:
-            pres->v_int16 = std::min(pa->v_int16, pb->v_int16);
-            return;
-        case DBR_USHORT:
-        case DBR_ENUM:
-            pres->v_uint16 = std::min(pa->v_uint16, pb->v_uint16);
-            return;
-        case DBR_LONG:
-            pres->v_int32 = std::min(pa->v_int32, pb->v_int32);
-            return;
-        case DBR_ULONG:
-            pres->v_uint32 = std::min(pa->v_uint32, pb->v_uint32);
-            return;
-#ifdef DBR_INT64
-        case DBR_INT64:
-            pres->v_int64 = std::min(pa->v_int64, pb->v_int64);
-            return;
-        case DBR_UINT64:
-            pres->v_uint64 = std::min(pa->v_uint64, pb->v_uint64);
-            return;
-#endif
-        case DBR_FLOAT:
-            pres->v_float = std::min(pa->v_float, pb->v_float);
-            return;
-        case DBR_DOUBLE:
-            pres->v_double = std::min(pa->v_double, pb->v_double);
-            return;
-    }
-    memset(pres, 0, sizeof(*pres));
-}
-
-void CaPutJsonLogTask::calculateMax(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
-{
-    switch (type) {
-        case DBR_CHAR:
-            pres->v_int8 = std::max(pa->v_int8, pb->v_int8);
-            return;
-        case DBR_UCHAR:
-            pres->v_uint8 = std::max(pa->v_uint8, pb->v_uint8);
-            return;
-        case DBR_SHORT:
-            pres->v_int16 = std::max(pa->v_int16, pb->v_int16);
-            return;
-        case DBR_USHORT:
-        case DBR_ENUM:
-            pres->v_uint16 = std::max(pa->v_uint16, pb->v_uint16);
-            return;
-        case DBR_LONG:
-            pres->v_int32 = std::max(pa->v_int32, pb->v_int32);
-            return;
-        case DBR_ULONG:
-            pres->v_uint32 = std::max(pa->v_uint32, pb->v_uint32);
-            return;
-#ifdef DBR_INT64
-        case DBR_INT64:
-            pres->v_int64 = std::max(pa->v_int64, pb->v_int64);
-            return;
-        case DBR_UINT64:
-            pres->v_uint64 = std::max(pa->v_uint64, pb->v_uint64);
-            return;
-#endif
-        case DBR_FLOAT:
-            pres->v_float = std::max(pa->v_float, pb->v_float);
-            return;
-        case DBR_DOUBLE:
-            pres->v_double = std::max(pa->v_double, pb->v_double);
-            return;
-    }
-    memset(pres, 0, sizeof(*pres));
+    // A string field (lso/lsi records without .$) gets the first 39 characters,
+    // a waveform or a long string ("name.$") the whole message
+    if (caPutLogSinkCount(this->pvSinks))
+        caPutLogSinkSendText(this->pvSinks, msg.data(), msg.size());
 }
 
 bool CaPutJsonLogTask::compareValues(const LOGDATA *pLogData) {
-    const VALUE *pa = &pLogData->old_value;
-    const VALUE *pb = &pLogData->new_value.value;
+    const VALUE *pa = pLogData->old_value;
+    const VALUE *pb = &pLogData->new_value->value;
 
     if (pLogData->is_array && pLogData->old_log_size != pLogData->new_log_size)
         return false;
@@ -835,6 +967,15 @@ bool CaPutJsonLogTask::compareValues(const LOGDATA *pLogData) {
 int CaPutJsonLogTask::fieldVal2Str(char *pbuf, size_t buflen, const VALUE *pval, short type, int index)
 {
     size_t len;
+
+    if (this->numFmt == caPutLogNumShortest) {
+        char tmp[caPutLogNumBufSize];
+        int n = caPutLogFormatValue(tmp, pval, type, index, 1);
+
+        if (n >= 0) {
+            return epicsSnprintf(pbuf, buflen, "%s", tmp);
+        }
+    }
     switch (type) {
         case DBR_CHAR:
             return epicsSnprintf(pbuf, buflen, "%s", ((char *)pval));
@@ -19,13 +19,19 @@
 
 // Epics base imports
 #include <logClient.h>
-#include <epicsMessageQueue.h>
 #include <dbAddr.h>
 #include <map>
 #include <epicsThread.h>
+#include <epicsAtomic.h>
 
 // Includes from this module
 #include "caPutLogTask.h"
+#include "caPutLogQueue.h"
+#include "caPutLogSink.h"
+#include "caPutLogBin.h"
+#include "caPutLogDeadband.h"
+#include "caPutLogNum.h"
+#include "caPutJsonLogFormat.h"
 
 // Status return values
 enum caPutJsonLogStatus {
@@ -93,9 +99,12 @@ public:
      *           if port number is not specified, default value will be used.
      * @param config Configuration parameter. Valid value are -1 <= config <= 2.
      * @param timeout Burst filter timeout parameter.
+     * @param copies Number of servers each message goes to, chosen by the record name;
+     *           0 or at least the number of servers sends every message to all of them.
      * @return caPutJsonLogStatus Status code.
      */
-    caPutJsonLogStatus initialize(const char* address, caPutJsonLogConfig config, double timeout);
+    caPutJsonLogStatus initialize(const char* address, caPutJsonLogConfig config, double timeout,
+                                  int copies = 0);
 
     /**
      * @brief Add a put details packed as a ::LOGDATA structure to a queue for processing.
@@ -174,7 +183,8 @@ public:
     size_t metadataCount();
 
     /**
-     * @brief Gets the metadata list object
+     * @brief Gets the metadata list object. It is not locked against changes,
+     *      the logger itself uses a snapshot.
      *
      * @return map<string, string> the Metadata map
      */
@@ -188,6 +198,94 @@ public:
      */
     caPutJsonLogStatus setBurstTimeout(double timeout);
 
+    /**
+     * @brief Set the limits of the message queue and what to do with puts beyond them.
+     *
+     * @param messages Maximum number of queued puts, 0 for caPutLogJsonMsgQueueSize.
+     * @param bytes Maximum size of the queued puts, 0 for no limit.
+     * @param policy "drop-newest" (default), "drop-oldest", "coalesce" or "block".
+     * @param timeout Time to wait for room with the "block" policy.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setQueue(int messages, int bytes, const char *policy, double timeout);
+
+    /**
+     * @brief Select the conversion of DBR_FLOAT and DBR_DOUBLE values.
+     *
+     * @param format "shortest" (default) for the shortest digit string that
+     *      reads back as the same value, "printf" for "%.8g" / "%.17g".
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setNumFmt(const char *format);
+
+    /**
+     * @brief Select the time properties of the messages.
+     *
+     * @param format "date-time" (default) for "date" and "time" in local time,
+     *      "iso8601" for one "timestamp" in UTC, "epoch-ns" for "timestamp-ns",
+     *      nanoseconds since 1970 (UTC).
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setTimeFmt(const char *format);
+
+    /**
+     * @brief Select what is sent to the log servers. Must be called before initialize().
+     *
+     * @param format "json" (default) for one JSON line per put, "binary" for the
+     *      frames of caPutLogBin.h. The PV and the history get JSON either way.
+     *      "binary" is refused with a spool in ack mode.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setFormat(const char *format);
+
+    /**
+     * @brief Set the batches sent to each log server.
+     *
+     * @param bytes Batch size in bytes, 0 to send every message on its own.
+     * @param delay Time in milliseconds a batch is held back to fill up,
+     *      0 to send what is queued right away.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setBatch(int bytes, double delay);
+
+    /**
+     * @brief Spool the messages for log servers that cannot be reached.
+     *
+     * @param dir Directory of the spool files, NULL or empty to turn it off.
+     * @param bytes Size of each server's spool file.
+     * @param rate Messages per second replayed, 0 for no limit.
+     * @param ack Wait for the servers to acknowledge the messages; refused
+     *      with the binary format.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setSpool(const char *dir, int bytes, double rate, int ack);
+
+    /**
+     * @brief Keep a rolling history of the last messages in a char array PV.
+     *
+     * @param textPV Name of the char array PV holding the messages, one per line.
+     * @param seqPV Name of the PV getting the number of messages so far, may be empty.
+     * @param size Number of messages kept, 0 for the default of 100.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus setHistory(const char *textPV, const char *seqPV, int size);
+
+    /**
+     * @brief Build a JSON message with the yajl generator. This was the only
+     *      implementation before ::CaPutJsonLogFormat; it is used if the variable
+     *      caPutJsonLogUseYajl is set and serves as reference for the tests.
+     *
+     * @param json String the message is written to (without a trailing newline).
+     * @param pold_value Pointer to a ::VALUE structure holding an old PV value.
+     * @param pLogData Pointer to a ::LOGDATA structure holding new value and other meta databa about the put.
+     * @param burst Integer value. Indicates the number of burst of values, if any.
+     * @param pmin Pointer to a ::VALUE structure holding an min value if burst is true.
+     * @param pmax Pointer to a ::VALUE structure holding an max value if burst is true.
+     * @return int Status code.
+     */
+    caPutJsonLogStatus buildJsonMsgYajl(std::string &json, const VALUE *pold_value,
+            const LOGDATA *pLogData, int burst, const VALUE *pmin, const VALUE *pmax);
+
 private:
 
     // Singleton instance of this class.
@@ -199,29 +297,68 @@ private:
     double burstTimeout;
 
     // Interthread communication
-    epicsMessageQueue caPutJsonLogQ;
+    caPutLogQueue *caPutJsonLogQ;
+    unsigned queueMaxMsgs;
+    size_t queueMaxBytes;
+    caPutLogOverflowPolicy queuePolicy;
+    double queueTimeout;
+
+    // Conversion of numbers and time, applied by the worker thread
+    caPutLogNumFmt numFmt;
+    CaPutJsonLogFormat::timeFmt_t timeFmt;
+
+    // Last logged values for the deadband, used by the worker thread only
+    caPutLogDeadband *deadband;
 
     // Working thread
     epicsThreadId threadId;
     int taskStopper; // To modify or read this value only epicsAtomic methods should be used
 
-    //Logging to a list of servers
-    struct clientItem {
-        logClientId caPutJsonLogClient;
-        struct clientItem *next;
-        char address[1];
-    } *clients;
-    epicsMutex clientsMutex;
+    // Logging to a list of servers, each with its own queue and sender thread
+    caPutLogSinkList *sinks;
+
+    // Binary frames for the servers instead of JSON, NULL: JSON
+    caPutLogBinEncoder *binEncoder;
 
-    // Logging to a PV
-    DBADDR caPutJsonLogPV;
-    DBADDR *pCaPutJsonLogPV;
+    // A spool in ack mode is set, which rules out binEncoder
+    bool spoolAck;
+
+    // Logging to a PV and to the history PVs, each from a sender thread of its own
+    caPutLogSinkList *pvSinks;
+    bool logPVDefined;
+    bool historyDefined;
 
     // Total count of logged puts
     int caPutTotalCount; // To modify or read this value only epicsAtomic methods should be used
 
-    // IOC metadata
+    // IOC metadata, changed by the shell commands while holding metadataMutex
     std::map<std::string, std::string> metadata;
+    epicsMutex metadataMutex;
+
+    // Immutable copy of the metadata for the worker thread, with the JSON
+    // fragment spliced into every message. A new copy is handed over in
+    // pendingMetadata; whoever swaps it out of there owns it.
+    struct metadataSnapshot {
+        CaPutJsonLogFormat::metadata_t map;
+        std::string json;
+    };
+    EpicsAtomicPtrT pendingMetadata;
+    metadataSnapshot *currentMetadata;  // worker thread only
+
+    // Message buffers, reused from message to message
+    CaPutJsonLogFormat jsonFormat;
+    std::string yajlMsg;
+
+    /**
+     * @brief Build a snapshot of the metadata and hand it over to the worker,
+     *      called with metadataMutex held.
+     */
+    void publishMetadata();
+
+    /**
+     * @brief The latest metadata snapshot, for the worker thread.
+     */
+    const metadataSnapshot &takeMetadata();
 
     // Class methods (Do not allow public constructors - class is designed as singleton)
     CaPutJsonLogTask();
@@ -244,6 +381,46 @@ private:
     caPutJsonLogStatus buildJsonMsg(const VALUE *pold_value, const LOGDATA *pLogData,
             int burst, const VALUE *pmin, const VALUE *pmax);
 
+    /**
+     * @brief Log the summary of the puts the rate limits dropped before this one.
+     *      Binary servers get it as a SUPPRESSED frame.
+     *
+     * @param pLogData Pointer to a ::LOGDATA structure with suppressed counts.
+     */
+    void logSuppressed(const LOGDATA *pLogData);
+
+    /**
+     * @brief Size of the message queue from caPutLogJsonMsgQueueSize.
+     */
+    static unsigned queueSize();
+
+    /**
+     * @brief Burst filter callback, passes a finished burst on to buildJsonMsg().
+     *
+     * @param arg Pointer to the ::CaPutJsonLogTask instance.
+     * @param pold_value Pointer to a ::VALUE structure holding the value before the burst.
+     * @param pLogData Pointer to a ::LOGDATA structure holding the last put of the burst.
+     * @param burst Integer value. Indicates the number of burst of values, if any.
+     * @param pmin Pointer to a ::VALUE structure holding an min value if burst is true.
+     * @param pmax Pointer to a ::VALUE structure holding an max value if burst is true.
+     */
+    static void burstEmit(void *arg, const VALUE *pold_value, const LOGDATA *pLogData,
+            int burst, const VALUE *pmin, const VALUE *pmax);
+
+    /**
+     * @brief Callback of caPutLogRateSweep(): log a count of suppressed puts
+     *      that no put took over.
+     *
+     * @param arg Pointer to the ::CaPutJsonLogTask instance.
+     * @param pvName Name of the PV, empty for a client's count.
+     * @param userid User name, empty for a PV's count.
+     * @param hostid Host name, empty for a PV's count.
+     * @param suppressed The counts of the PV and the client.
+     * @return 1 if logged, 0 if out of memory.
+     */
+    static int reportSuppressed(void *arg, const char *pvName, const char *userid,
+            const char *hostid, const unsigned suppressed[2]);
+
     /**
      * @brief Configure logging to a server.
      *
@@ -253,11 +430,14 @@ private:
     caPutJsonLogStatus configureServerLogging(const char* address);
 
     /**
-     * @brief This method will send a message to the configured log server.
+     * @brief Queue a message for the configured log servers.
+     *
+     * The message is copied once, all servers share that copy.
      *
      * @param msg Message to be send.
+     * @param key Hash of the record name, picks the servers when sharded.
      */
-    void logToServer(std::string &msg);
+    void logToServer(std::string &msg, unsigned key);
 
     /**
      * @brief Configure logging to a PV.
@@ -267,32 +447,12 @@ private:
     caPutJsonLogStatus configurePvLogging();
 
     /**
-     * @brief Method will write a message to the configured PV.
+     * @brief Method will queue a message for the configured PV.
      *
      * @param msg Message to be written.
      */
     void logToPV(std::string &msg);
 
-    /**
-     * @brief Calculate minimum value of two ::VALUE unions.
-     *
-     * @param pres ::VALUE structure where result should be written.
-     * @param pa ::VALUE structure of the first value to be compared.
-     * @param pb ::VALUE structure of the second value to be compared.
-     * @param type EPICS DRB_* type stored in the input structures.
-     */
-    void calculateMin(VALUE *pres, const VALUE *pa, const VALUE *pb, short type);
-
-    /**
-     * @brief Calculate maximum value of two ::VALUE unions.
-     *
-     * @param pres ::VALUE structure where result should be written.
-     * @param pa ::VALUE structure of the first value to be compared.
-     * @param pb ::VALUE structure of the second value to be compared.
-     * @param type EPICS DRB_* type stored in the input structures.
-     */
-    void calculateMax(VALUE *pres, const VALUE *pa, const VALUE *pb, short type);
-
     /**
      * @brief Compare values in a LOGDATA structure and see if they are the same
      *
@@ -337,6 +497,7 @@ epicsShareFunc void caddPutToQueue(LOGDATA * plogData);
 epicsShareFunc void caPutJsonLogWorker(void *arg);
 epicsShareFunc void caPutJsonLogExit(void *arg);
 epicsShareExtern int caPutLogJsonMsgQueueSize;
+epicsShareExtern int caPutJsonLogUseYajl;
 #ifdef __cplusplus
 }
 #endif /*__cplusplus */
@@ -31,6 +31,9 @@
 #include "caPutLogAs.h"
 #include "caPutLogTask.h"
 #include "caPutLogClient.h"
+#include "caPutLogDeadband.h"
+#include "caPutLogFilter.h"
+#include "caPutLogRate.h"
 #include "caPutLog.h"
 
 #ifndef LOCAL
@@ -68,15 +71,75 @@ int caPutLogReconf (int config, double timeout)
     return caPutLogSuccess;
 }
 
+/*
+ *  caPutLogSetBatch()
+ */
+int caPutLogSetBatch (int bytes, double delay)
+{
+    caPutLogClientSetBatch(bytes > 0 ? bytes : 0, delay / 1000.0);
+    return caPutLogSuccess;
+}
+
+/*
+ *  caPutLogSetSpool()
+ */
+int caPutLogSetSpool (const char *dir, int bytes, double rate, int ack)
+{
+    caPutLogClientSetSpool(dir, bytes > 0 ? bytes : 0, rate, ack);
+    return caPutLogSuccess;
+}
+
+/*
+ *  caPutLogAddFilter()
+ */
+int caPutLogAddFilter (const char *action, const char *pattern)
+{
+    return caPutLogFilterAdd(action, pattern) ? caPutLogError : caPutLogSuccess;
+}
+
+/*
+ *  caPutLogLoadFilter()
+ */
+int caPutLogLoadFilter (const char *file)
+{
+    return caPutLogFilterLoad(file) ? caPutLogError : caPutLogSuccess;
+}
+
+/*
+ *  caPutLogSetRateLimit()
+ */
+int caPutLogSetRateLimit (const char *scope, double rate, double burst)
+{
+    return caPutLogRateSet(scope, rate, burst) ? caPutLogError : caPutLogSuccess;
+}
+
+/*
+ *  caPutLogSetDeadband()
+ */
+int caPutLogSetDeadband (const char *type, const char *deadband)
+{
+    return caPutLogDeadbandSet(type, deadband) ? caPutLogError : caPutLogSuccess;
+}
+
 static void caPutLogExitProc(void *arg)
 {
     caPutLogAsStop();
+    /* runs before the logClients' own exit handlers */
+    caPutLogClientFlush();
 }
 
 /*
  *  caPutLogInit()
  */
 int caPutLogInit (const char *addr_str, int config, double timeout)
+{
+    return caPutLogInitCopies(addr_str, config, timeout, 0);
+}
+
+/*
+ *  caPutLogInitCopies()
+ */
+int caPutLogInitCopies (const char *addr_str, int config, double timeout, int copies)
 {
     int status;
 
@@ -102,6 +165,7 @@ int caPutLogInit (const char *addr_str, int config, double timeout)
     if (status) {
         return caPutLogError;
     }
+    caPutLogClientSetCopies(copies > 0 ? copies : 0);
 
     status = caPutLogTaskStart(config, timeout);
     if (status) {
@@ -21,10 +21,65 @@ extern "C" {
 #define HAS_caPutLogInit_arg3timeout
 
 epicsShareFunc int caPutLogInit (const char *addr_str, int config, double timeout);
+/*
+ * As caPutLogInit, each message going to copies of the servers, picked by
+ * the record name (0 or at least the number of servers: all of them).
+ */
+epicsShareFunc int caPutLogInitCopies (const char *addr_str, int config,
+    double timeout, int copies);
 epicsShareFunc int caPutLogReconf (int config, double timeout);
 epicsShareFunc void caPutLogShow (int level);
 epicsShareFunc void caPutLogSetTimeFmt (const char *format);
 epicsShareFunc void caPutLogSetBurstTimeout (double timeout);
+/*
+ * Queue limits: messages (0: caPutLogMsgQueueSize), bytes (0: no limit),
+ * overflow policy "drop-newest" (default), "drop-oldest", "coalesce"
+ * or "block" with a timeout in seconds.
+ */
+epicsShareFunc int caPutLogSetQueue (int messages, int bytes,
+    const char *policy, double timeout);
+/*
+ * Conversion of numbers in the log messages: "printf" (default, "%g")
+ * or "shortest" (shortest digit string that reads back as the same value).
+ */
+epicsShareFunc int caPutLogSetNumFmt (const char *format);
+/*
+ * Batches sent to each log server: up to bytes bytes (0: every message
+ * on its own), held back up to delay milliseconds to fill up (0: send
+ * what is queued right away).
+ */
+epicsShareFunc int caPutLogSetBatch (int bytes, double delay);
+/*
+ * Spool messages for servers that cannot be reached in a file of bytes
+ * bytes in dir, replay them at up to rate messages per second (0: no
+ * limit), with acknowledgements from the servers if ack is set. Applies
+ * to the servers configured afterwards; an empty dir turns it off.
+ */
+epicsShareFunc int caPutLogSetSpool (const char *dir, int bytes, double rate, int ack);
+/*
+ * Keep the last size messages (0: 100) in the char array textPV, and the
+ * number of messages so far in seqPV (optional). Both must be local.
+ */
+epicsShareFunc int caPutLogSetHistory (const char *textPV, const char *seqPV, int size);
+/*
+ * PV filter rules, before caPutLogInit: action "include" or "exclude"
+ * and a glob or /regular expression/ matched against "record.FIELD",
+ * or a file of such lines. See caPutLogFilter.h.
+ */
+epicsShareFunc int caPutLogAddFilter (const char *action, const char *pattern);
+epicsShareFunc int caPutLogLoadFilter (const char *file);
+/*
+ * Rate limit for each PV (scope "pv") or each client ("client"): rate
+ * puts per second, bursts of up to burst puts; rate 0 lifts it. See
+ * caPutLogRate.h.
+ */
+epicsShareFunc int caPutLogSetRateLimit (const char *scope, double rate, double burst);
+/*
+ * Deadband of the on-change mode for the numbers of a type ("float",
+ * "integer" or "all"): "0.5", "2%", "MDEL", "ADEL" or "none". See
+ * caPutLogDeadband.h.
+ */
+epicsShareFunc int caPutLogSetDeadband (const char *type, const char *deadband);
 epicsShareFunc int caPutLogInitialized(void);
 
 #ifdef __cplusplus
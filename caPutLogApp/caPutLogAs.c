@@ -50,6 +50,8 @@
 #include <freeList.h>
 #include <asTrapWrite.h>
 #include <epicsVersion.h>
+#include <epicsAtomic.h>
+#include <epicsExport.h>
 
 #include "dbChannel.h"
 
@@ -57,20 +59,74 @@
 #include "caPutLog.h"
 #include "caPutLogTask.h"
 #include "caPutLogAs.h"
+#include "caPutLogIdent.h"
+#include "caPutLogFilter.h"
+#include "caPutLogPolicy.h"
+#include "caPutLogRate.h"
 
 int caPutLogRegisterDone = 0;
 
+/* Copy field values in their native type, finish them in the logger task */
+int caPutLogRawCapture = 0;
+epicsExportAddress(int, caPutLogRawCapture);
+
 static asTrapWriteId listenerId = 0;
 
-static void *logDataFreeList = 0;
+/* Mode of the logger, see caPutLogAsSetMode */
+static int trapMode = caPutLogNone;
+static size_t trapCompared, trapUnchanged;
+
+/*
+ * LOGDATA is followed by the new value (with its time stamp), the old
+ * value and the strings; each part starts on an 8 byte boundary.
+ */
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+#define NEW_VALUE_OFFSET ALIGN8(sizeof(LOGDATA))
+#define TIME_SIZE offsetof(TIME_VALUE, value)
+#define LOGDATA_SIZE(valueSize, stringSize) \
+    (NEW_VALUE_OFFSET + ALIGN8(TIME_SIZE) + 2 * (valueSize) + (stringSize))
+
+/* Smallest value, enough for any scalar and the "Not Accessible" string */
+#define MIN_VALUE_SIZE 16
+
+/* Allocation sizes, the largest one is what caPutLogDataCalloc returns */
+static const size_t sizeClasses[] = {
+    128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 1024,
+    LOGDATA_SIZE(MAX_ARRAY_SIZE_BYTES,
+        MAX_USERID_SIZE + MAX_HOSTID_SIZE + PVNAME_STRINGSZ)
+};
+#define NUM_SIZE_CLASSES (sizeof(sizeClasses) / sizeof(sizeClasses[0]))
+
+static void *logDataFreeList[NUM_SIZE_CLASSES];
 
-#define FREE_LIST_SIZE 1000
+/* Bytes the free lists get from malloc at a time */
+#define FREE_LIST_BLOCK_SIZE 32768
 
 static void caPutLogAs(asTrapWriteMessage * pmessage, int afterPut);
 static void (*psendCallback)(LOGDATA *);
 static void (*pstopCallback)() = NULL;
 
 
+void caPutLogAsSetMode(int config)
+{
+    epicsAtomicSetIntT(&trapMode, config);
+}
+
+size_t caPutLogAsUnchanged(void)
+{
+    return epicsAtomicGetSizeT(&trapUnchanged);
+}
+
+void caPutLogAsShow(const char *name)
+{
+    size_t compared = epicsAtomicGetSizeT(&trapCompared);
+
+    if (!compared)
+        return;
+    printf("%s Unchanged puts: %lu of %lu compared freed in the trap\n", name,
+        (unsigned long)caPutLogAsUnchanged(), (unsigned long)compared);
+}
+
 int caPutLogAsInit(void (*sendCallback)(LOGDATA *), void (*stopCallback)())
 {
     psendCallback = sendCallback;
@@ -81,9 +137,19 @@ int caPutLogAsInit(void (*sendCallback)(LOGDATA *), void (*stopCallback)())
         return caPutLogError;
     }
 
-    /* Initialize the free list of log elements */
-    if (!logDataFreeList) {
-        freeListInitPvt(&logDataFreeList, sizeof(LOGDATA), FREE_LIST_SIZE);
+    /* PV filter rules and record policies are fixed from now on */
+    if (caPutLogFilterCompile())
+        return caPutLogError;
+    caPutLogPolicyScan();
+
+    /* Initialize the free lists of log elements */
+    if (!logDataFreeList[0]) {
+        unsigned i;
+
+        for (i = 0; i < NUM_SIZE_CLASSES; i++) {
+            freeListInitPvt(&logDataFreeList[i], (int)sizeClasses[i],
+                (int)(FREE_LIST_BLOCK_SIZE / sizeClasses[i]) + 1);
+        }
     }
 
     /* Initialize the Trap Write Listener */
@@ -92,6 +158,7 @@ int caPutLogAsInit(void (*sendCallback)(LOGDATA *), void (*stopCallback)())
         errlogSevPrintf(errlogFatal, "caPutLog: asTrapWriteRegisterListener failed\n");
         return caPutLogError;
     }
+    caPutLogRateTrap(1);
     return caPutLogSuccess;
 }
 
@@ -104,84 +171,280 @@ void caPutLogAsStop()
     if (listenerId) {
         asTrapWriteUnregisterListener(listenerId);
         listenerId = NULL;
+        caPutLogRateTrap(0);
         errlogPrintf("caPutLog: disabled\n");
     }
 }
 
+/*
+ * Bytes needed to hold a value of the field in the given DBR type;
+ * strings of DBR_CHAR get room for a terminating NUL
+ */
+static int caPutLogValueSize(const dbAddr *paddr, short type)
+{
+    long num_elm = caPutLogMaxArraySize(type);
+
+    if (paddr->no_elements < num_elm)
+        num_elm = paddr->no_elements;
+    if (type == DBR_CHAR)
+        return (int)num_elm + 1;
+    return (int)(num_elm * dbValueSize(type));
+}
+
+/*
+ * Number of elements of the LOGDATA's type that fit into its values
+ */
+static long caPutLogValueCapacity(const LOGDATA *plogData)
+{
+    long num_elm = plogData->value_size / dbValueSize(plogData->type);
+    long max_elm = caPutLogMaxArraySize(plogData->type);
+
+    if (plogData->type == DBR_CHAR)
+        num_elm--;
+    return num_elm < max_elm ? num_elm : max_elm;
+}
+
+/*
+ * Raw capture: copy as many elements of the field as fit into the value,
+ * in the field's own type, plus the array bounds and optionally the
+ * record's time stamp, all with one lock of the record. Terminating
+ * strings is left to caPutLogDataResolve().
+ */
+static void caPutLogCapture(const dbAddr *paddr, const LOGDATA *plogData,
+    char *pbuf, int *plog_size, int *psize, epicsTimeStamp *ptime)
+{
+    dbAddr addr = *paddr;
+    rset *prset = dbGetRset(&addr);
+    long nActual = addr.no_elements;
+    long offset = 0;
+    long esize = addr.field_size;
+    long num_elm, first;
+
+    dbScanLock(addr.precord);
+    if (addr.no_elements > 1 && prset && prset->get_array_info) {
+        prset->get_array_info(&addr, &nActual, &offset);
+    }
+    num_elm = caPutLogValueCapacity(plogData);
+    if (num_elm > nActual)
+        num_elm = nActual;
+
+    if (plogData->type == DBR_STRING && esize != MAX_STRING_SIZE) {
+        /* string field of a different size, never an array */
+        if (num_elm > 1)
+            num_elm = 1;
+        memcpy(pbuf, addr.pfield, esize < MAX_STRING_SIZE ? esize : MAX_STRING_SIZE);
+    } else {
+        /* circular buffers wrap around at no_elements */
+        first = addr.no_elements - offset;
+        if (first > num_elm)
+            first = num_elm;
+        memcpy(pbuf, (char *)addr.pfield + offset * esize, first * esize);
+        if (num_elm > first)
+            memcpy(pbuf + first * esize, addr.pfield, (num_elm - first) * esize);
+    }
+    if (ptime)
+        *ptime = addr.precord->time;
+    dbScanUnlock(addr.precord);
+
+    *plog_size = (int)num_elm;
+    *psize = (int)nActual;
+}
+
+/*
+ * Whether the put left the value as it was, byte for byte over all the
+ * elements read; NaN scalars count as changed, as val_equal() of the
+ * text logger has it
+ */
+static int caPutLogDataUnchanged(const LOGDATA *plogData)
+{
+    const VALUE *pold = plogData->old_value;
+    const VALUE *pnew = &plogData->new_value->value;
+    int i, n = plogData->new_log_size;
+
+    if (plogData->old_size != plogData->new_size || plogData->old_log_size != n)
+        return FALSE;
+    switch (plogData->type) {
+    case DBR_STRING:
+        for (i = 0; i < n; i++) {
+            if (strncmp(pold->a_string[i], pnew->a_string[i], MAX_STRING_SIZE) != 0)
+                return FALSE;
+        }
+        return TRUE;
+    case DBR_FLOAT:
+        if (pnew->v_float != pnew->v_float)
+            return FALSE;
+        break;
+    case DBR_DOUBLE:
+        if (pnew->v_double != pnew->v_double)
+            return FALSE;
+        break;
+    }
+    return memcmp(pold, pnew, n * dbValueSize(plogData->type)) == 0;
+}
+
 static void caPutLogAs(asTrapWriteMessage *pmessage, int afterPut)
 {
     struct dbChannel *pchan = pmessage->serverSpecific;
     dbAddr *paddr = &pchan->addr;
     const char *pv_name = pchan->name;
+    const caPutLogPolicy *ppolicy;
+    unsigned suppressed[2];
     LOGDATA *plogData;
     long options, num_elm;
     long status;
+    short type;
     /*
      * tmp_addr is used so that we don't overwrite the original pchan when we
      * call get_array_info from caPutLogActualArraySize.
      */
     dbAddr tmp_addr;
 
-    memcpy(&tmp_addr, paddr, sizeof(dbAddr));
-
     if (!afterPut) {                    /* before put */
-        plogData = caPutLogDataCalloc();
-        if (plogData == NULL) {
-            errlogPrintf("caPutLog: memory allocation failed\n");
+        ppolicy = caPutLogPolicyGet(paddr->precord);
+        if ((ppolicy && !ppolicy->log) || !caPutLogFilterPut(paddr) ||
+                !caPutLogRatePut(paddr, pv_name, pmessage->userid, pmessage->hostid,
+                    suppressed)) {
             pmessage->userPvt = NULL;
             return;
         }
-        pmessage->userPvt = (void *)plogData;
-
-        epicsSnprintf(plogData->userid, MAX_USERID_SIZE, "%s", pmessage->userid);
-        epicsSnprintf(plogData->hostid, MAX_HOSTID_SIZE, "%s", pmessage->hostid);
-        epicsSnprintf(plogData->pv_name, PVNAME_STRINGSZ, "%s", pv_name);
+        memcpy(&tmp_addr, paddr, sizeof(dbAddr));
 
         if (VALID_DB_REQ(paddr->field_type)) {
-            plogData->type = paddr->field_type;
+            type = paddr->field_type;
         } else {
-            plogData->type = DBR_STRING;
+            type = DBR_STRING;
+        }
+
+        plogData = caPutLogDataAlloc(caPutLogValueSize(paddr, type),
+            pmessage->userid, pmessage->hostid, pv_name);
+        if (plogData == NULL) {
+            errlogPrintf("caPutLog: memory allocation failed\n");
+            /* the next put logged reports the counts instead */
+            caPutLogRateReturn(paddr, pv_name, pmessage->userid, pmessage->hostid,
+                suppressed);
+            pmessage->userPvt = NULL;
+            return;
         }
+
+        plogData->type = type;
         /* included for efficient pv-equality test: */
         plogData->pfield = paddr->pfield;
-
-        options = 0;
-        num_elm = caPutLogMaxArraySize(plogData->type);
-        status = dbGetField(
-            paddr, plogData->type, &plogData->old_value, &options, &num_elm, 0);
-        plogData->old_log_size = num_elm;
-        plogData->old_size = caPutLogActualArraySize(&tmp_addr);
         plogData->is_array = paddr->no_elements > 1 ? TRUE : FALSE;
 
-        if (status) {
-            errlogPrintf("caPutLog: dbGetField error=%ld\n", status);
-            plogData->type = DBR_STRING;
-            strcpy(plogData->old_value.v_string, "Not Accessible");
+        if (caPutLogRawCapture && type == paddr->field_type) {
+            caPutLogCapture(paddr, plogData, plogData->old_value->a_bytes,
+                &plogData->old_log_size, &plogData->old_size, NULL);
+            plogData->raw = TRUE;
         }
+        else {
+            options = 0;
+            num_elm = caPutLogValueCapacity(plogData);
+            status = dbGetField(
+                paddr, plogData->type, plogData->old_value, &options, &num_elm, 0);
+            plogData->old_log_size = num_elm;
+            plogData->old_size = caPutLogActualArraySize(&tmp_addr);
+
+            if (status) {
+                errlogPrintf("caPutLog: dbGetField error=%ld\n", status);
+                if (plogData->value_size < MAX_STRING_SIZE) {
+                    /* the new value is going to be read as a string, too */
+                    LOGDATA *pstring = caPutLogDataAlloc(MAX_STRING_SIZE,
+                        pmessage->userid, pmessage->hostid, pv_name);
+
+                    if (pstring == NULL) {
+                        errlogPrintf("caPutLog: memory allocation failed\n");
+                        caPutLogRateReturn(paddr, pv_name, pmessage->userid,
+                            pmessage->hostid, suppressed);
+                        caPutLogDataFree(plogData);
+                        pmessage->userPvt = NULL;
+                        return;
+                    }
+                    pstring->pfield = plogData->pfield;
+                    pstring->old_log_size = plogData->old_log_size;
+                    pstring->old_size = plogData->old_size;
+                    pstring->is_array = plogData->is_array;
+                    caPutLogDataFree(plogData);
+                    plogData = pstring;
+                }
+                plogData->type = DBR_STRING;
+                strcpy(plogData->old_value->v_string, "Not Accessible");
+            }
+            else if (plogData->type == DBR_CHAR) {
+                plogData->old_value->a_bytes[num_elm] = 0;
+            }
+        }
+        plogData->policy = ppolicy;
+        plogData->suppressed_pv = suppressed[caPutLogRatePv];
+        plogData->suppressed_client = suppressed[caPutLogRateClient];
+        pmessage->userPvt = (void *)plogData;
     }
     else {                              /* after put */
         epicsTimeStamp curTime;
+        int readOk = TRUE;
 
         plogData = (LOGDATA *) pmessage->userPvt;
+        /* filtered out, or the allocation failed */
+        if (plogData == NULL)
+            return;
+        memcpy(&tmp_addr, paddr, sizeof(dbAddr));
 
-        options = DBR_TIME;
-        num_elm = caPutLogMaxArraySize(plogData->type);
-        status = dbGetField(
-            paddr, plogData->type, &plogData->new_value, &options, &num_elm, 0);
-        plogData->new_log_size = num_elm;
-        plogData->new_size = caPutLogActualArraySize(&tmp_addr);
+        if (plogData->raw) {
+            caPutLogCapture(paddr, plogData, plogData->new_value->value.a_bytes,
+                &plogData->new_log_size, &plogData->new_size,
+                &plogData->new_value->time);
+        }
+        else {
+            options = DBR_TIME;
+            num_elm = caPutLogValueCapacity(plogData);
+            plogData->new_value->time.secPastEpoch = 0;
+            plogData->new_value->time.nsec = 0;
+            status = dbGetField(
+                paddr, plogData->type, plogData->new_value, &options, &num_elm, 0);
+            plogData->new_log_size = num_elm;
+            plogData->new_size = caPutLogActualArraySize(&tmp_addr);
+
+            if (status) {
+                readOk = FALSE;
+                errlogPrintf("caPutLog: dbGetField error=%ld.\n", status);
+                if (plogData->type != DBR_STRING) {
+                    /* the old value is going to be shown as a string, too */
+                    size_t used = plogData->old_log_size * dbValueSize(plogData->type);
+
+                    if (used < (size_t)plogData->value_size)
+                        memset(plogData->old_value->a_bytes + used, 0,
+                            plogData->value_size - used);
+                    plogData->old_value->a_bytes[plogData->value_size - 1] = 0;
+                }
+                plogData->type = DBR_STRING;
+                strcpy(plogData->new_value->value.v_string, "Not Accessible");
+            }
+            else if (plogData->type == DBR_CHAR) {
+                plogData->new_value->value.a_bytes[num_elm] = 0;
+            }
+        }
         plogData->is_array = plogData->is_array || paddr->no_elements > 1 ? TRUE : FALSE;
 
-        if (status) {
-            errlogPrintf("caPutLog: dbGetField error=%ld.\n", status);
-            plogData->type = DBR_STRING;
-            strcpy(plogData->new_value.value.v_string, "Not Accessible");
+        /*
+         * The on-change mode would not log a put that left the value as it
+         * was; free it here rather than in the logger task. Such a put
+         * neither opens nor extends a burst then. One that carries counts
+         * of puts dropped by the rate limits still has to go through.
+         */
+        if (readOk && caPutLogPolicyMode(plogData, epicsAtomicGetIntT(&trapMode)) ==
+                caPutLogOnChange && !plogData->suppressed_pv && !plogData->suppressed_client) {
+            epicsAtomicIncrSizeT(&trapCompared);
+            if (caPutLogDataUnchanged(plogData)) {
+                epicsAtomicIncrSizeT(&trapUnchanged);
+                caPutLogDataFree(plogData);
+                return;
+            }
         }
+
         epicsTimeGetCurrent(&curTime); /* get current time stamp */
         /* replace, if necessary, the time stamp */
-        if (plogData->new_value.time.secPastEpoch < curTime.secPastEpoch) {
-            plogData->new_value.time.secPastEpoch = curTime.secPastEpoch;
-            plogData->new_value.time.nsec = curTime.nsec;
+        if (plogData->new_value->time.secPastEpoch < curTime.secPastEpoch) {
+            plogData->new_value->time.secPastEpoch = curTime.secPastEpoch;
+            plogData->new_value->time.nsec = curTime.nsec;
         }
         psendCallback(plogData);
     }
@@ -227,12 +490,118 @@ long caPutLogActualArraySize(dbAddr * paddr)
     return nActual;
 }
 
+/*
+ * Set up the pointers of a LOGDATA for the given value size
+ */
+static void caPutLogDataInit(LOGDATA *plogData, int sizeClass, int valueSize)
+{
+    char *pbuf = (char *)plogData + NEW_VALUE_OFFSET;
+
+    plogData->size_class = (short)sizeClass;
+    plogData->value_size = valueSize;
+    plogData->new_value = (TIME_VALUE *)pbuf;
+    pbuf += ALIGN8(TIME_SIZE) + valueSize;
+    plogData->old_value = (VALUE *)pbuf;
+    pbuf += valueSize;
+    plogData->pv_name = pbuf;
+}
+
+LOGDATA* caPutLogDataAlloc(int valueSize, const char *userid,
+    const char *hostid, const char *pv_name)
+{
+    size_t pvlen = strlen(pv_name);
+    size_t size;
+    unsigned sizeClass;
+    caPutLogIdent *pident;
+    LOGDATA *plogData;
+
+    if (pvlen > PVNAME_STRINGSZ - 1) pvlen = PVNAME_STRINGSZ - 1;
+
+    if (valueSize < MIN_VALUE_SIZE) valueSize = MIN_VALUE_SIZE;
+    if (valueSize > MAX_ARRAY_SIZE_BYTES) valueSize = MAX_ARRAY_SIZE_BYTES;
+    valueSize = (int)ALIGN8(valueSize);
+
+    size = LOGDATA_SIZE(valueSize, pvlen + 1);
+    for (sizeClass = 0; sizeClasses[sizeClass] < size; sizeClass++)
+        ;
+
+    pident = caPutLogIdentGet(userid, hostid);
+    if (pident == NULL)
+        return NULL;
+    plogData = freeListMalloc(logDataFreeList[sizeClass]);
+    if (plogData == NULL) {
+        caPutLogIdentRelease(pident);
+        return NULL;
+    }
+
+    memset(plogData, 0, sizeof(LOGDATA));
+    caPutLogDataInit(plogData, sizeClass, valueSize);
+    plogData->ident = pident;
+    plogData->userid = (char *)pident->userid;
+    plogData->hostid = (char *)pident->hostid;
+    memcpy(plogData->pv_name, pv_name, pvlen);
+    plogData->pv_name[pvlen] = 0;
+    return plogData;
+}
+
+void caPutLogDataResolve(LOGDATA *plogData)
+{
+    int i;
+
+    if (!plogData->raw)
+        return;
+    plogData->raw = FALSE;
+
+    switch (plogData->type) {
+    case DBR_CHAR:
+        plogData->old_value->a_bytes[plogData->old_log_size] = 0;
+        plogData->new_value->value.a_bytes[plogData->new_log_size] = 0;
+        break;
+    case DBR_STRING:
+        /* longer string fields are truncated like dbGetField does */
+        for (i = 0; i < plogData->old_log_size; i++)
+            plogData->old_value->a_string[i][MAX_STRING_SIZE - 1] = 0;
+        for (i = 0; i < plogData->new_log_size; i++)
+            plogData->new_value->value.a_string[i][MAX_STRING_SIZE - 1] = 0;
+        break;
+    }
+}
+
 void caPutLogDataFree(LOGDATA *plogData)
 {
-    freeListFree(logDataFreeList, plogData);
+    if (plogData->ident)
+        caPutLogIdentRelease(plogData->ident);
+    freeListFree(logDataFreeList[plogData->size_class], plogData);
+}
+
+size_t caPutLogDataSize(const LOGDATA *plogData)
+{
+    return sizeClasses[plogData->size_class];
 }
 
 LOGDATA* caPutLogDataCalloc(void)
 {
-  return freeListCalloc(logDataFreeList);
+    LOGDATA *plogData = freeListCalloc(logDataFreeList[NUM_SIZE_CLASSES - 1]);
+
+    if (plogData == NULL)
+        return NULL;
+
+    caPutLogDataInit(plogData, NUM_SIZE_CLASSES - 1, MAX_ARRAY_SIZE_BYTES);
+    plogData->userid = plogData->pv_name + PVNAME_STRINGSZ;
+    plogData->hostid = plogData->userid + MAX_USERID_SIZE;
+    return plogData;
+}
+
+LOGDATA* caPutLogDataSuppressed(const char *pv_name, const char *userid,
+    const char *hostid, const unsigned suppressed[2])
+{
+    LOGDATA *plogData = caPutLogDataAlloc(0, userid, hostid, pv_name);
+
+    if (plogData == NULL)
+        return NULL;
+    plogData->type = DBR_STRING;
+    plogData->suppressed_pv = suppressed[caPutLogRatePv];
+    plogData->suppressed_client = suppressed[caPutLogRateClient];
+    epicsTimeGetCurrent(&plogData->new_value->time);
+    return plogData;
 }
@@ -1,6 +1,7 @@
 #ifndef INCcaPutLogAsh
 #define INCcaPutLogAsh 1
 
+#include <stddef.h>
 #include <shareLib.h>
 #include <dbAddr.h>
 
@@ -12,8 +13,42 @@ extern "C" {
 
 epicsShareFunc int caPutLogAsInit(void (*sendCallback)(LOGDATA *), void (*stopCallback)());
 epicsShareFunc void caPutLogAsStop();
+/*
+ * Mode of the logger the trap sends to (caPutLogOnChange, ...). In the
+ * on-change mode, or for records whose policy sets it, the trap frees
+ * puts that left the value unchanged instead of sending them; the logger
+ * would drop them anyway. caPutLogNone until set.
+ */
+epicsShareFunc void caPutLogAsSetMode(int config);
+/* Puts freed so far because they did not change the value */
+epicsShareFunc size_t caPutLogAsUnchanged(void);
+epicsShareFunc void caPutLogAsShow(const char *name);
 epicsShareFunc void caPutLogDataFree(LOGDATA *pLogData);
+/* Largest size, zero-filled; values hold up to MAX_ARRAY_SIZE_BYTES */
 epicsShareFunc LOGDATA* caPutLogDataCalloc(void);
+/*
+ * Room for values of valueSize bytes each, PV name copied and client
+ * identity looked up (strings truncated like the former fixed-size
+ * members). Only the header is initialized.
+ */
+epicsShareFunc LOGDATA* caPutLogDataAlloc(int valueSize, const char *userid,
+    const char *hostid, const char *pv_name);
+/*
+ * No values, only counts of suppressed puts from caPutLogRateSweep() and
+ * the current time
+ */
+epicsShareFunc LOGDATA* caPutLogDataSuppressed(const char *pv_name, const char *userid,
+    const char *hostid, const unsigned suppressed[2]);
+/* Bytes taken by the element, for accounting of queued puts */
+epicsShareFunc size_t caPutLogDataSize(const LOGDATA *pLogData);
+
+/*
+ * With caPutLogRawCapture set, the trap copies field values of native DBR
+ * types unconverted; the logger task has to call caPutLogDataResolve on
+ * each LOGDATA it receives before looking at the values.
+ */
+epicsShareExtern int caPutLogRawCapture;
+epicsShareFunc void caPutLogDataResolve(LOGDATA *pLogData);
 
 epicsShareFunc int caPutLogMaxArraySize(short type);
 epicsShareFunc long caPutLogActualArraySize(dbAddr * paddr);
@@ -0,0 +1,809 @@
+/*	File:	  caPutLogBin.c
+ *
+ *	Binary put log format, encoder and reference decoder, see
+ *	caPutLogBin.h.
+ *
+ *	The encoder keeps the strings it has defined in one hash table for
+ *	all kinds, and all DEF frames so far, after the MAGIC frame, in one
+ *	buffer that is the preamble for new connections. Only that buffer
+ *	and the cached preamble message are shared with the sender threads,
+ *	under the encoder's lock. Elements are copied into an unsigned
+ *	integer of their size and written least significant byte first, so
+ *	the host's byte order does not matter.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsMutex.h>
+#include <epicsString.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <dbAccess.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogIdent.h"
+#include "caPutLogBin.h"
+
+#define isDbrNumeric(type) ((type) > DBR_STRING && (type) <= DBR_ENUM)
+
+/* Longest DBR_CHAR string, as in the JSON formatter */
+#define MAX_CHAR_STRING (MAX_STRING_SIZE > MAX_ARRAY_SIZE_BYTES \
+                        ? MAX_STRING_SIZE : MAX_ARRAY_SIZE_BYTES)
+
+#define DICT_BUCKETS 4096
+#define MAX_FRAME (16 * 1024 * 1024)    /* larger ones mean a corrupt stream */
+
+static const char magic[4] = {'C', 'P', 'L', 'B'};
+
+typedef struct {
+    unsigned char   *data;
+    size_t          len;
+    size_t          cap;
+} buffer;
+
+static unsigned char *reserve(buffer *pbuf, size_t len)
+{
+    if (pbuf->len + len > pbuf->cap) {
+        size_t cap = pbuf->cap ? pbuf->cap : 256;
+
+        while (pbuf->len + len > cap)
+            cap *= 2;
+        pbuf->data = realloc(pbuf->data, cap);
+        if (!pbuf->data)
+            cantProceed("caPutLogBin: out of memory\n");
+        pbuf->cap = cap;
+    }
+    return pbuf->data + pbuf->len;
+}
+
+static void putBytes(buffer *pbuf, const void *data, size_t len)
+{
+    if (!len)
+        return;
+    memcpy(reserve(pbuf, len), data, len);
+    pbuf->len += len;
+}
+
+static void putByte(buffer *pbuf, unsigned v)
+{
+    *reserve(pbuf, 1) = (unsigned char)v;
+    pbuf->len++;
+}
+
+static void putVarint(buffer *pbuf, epicsUInt64 v)
+{
+    unsigned char *p = reserve(pbuf, 10);
+
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    pbuf->len = p - pbuf->data;
+}
+
+static void putFixed(buffer *pbuf, epicsUInt64 v, unsigned size)
+{
+    unsigned char *p = reserve(pbuf, size);
+    unsigned i;
+
+    for (i = 0; i < size; i++, v >>= 8)
+        p[i] = (unsigned char)v;
+    pbuf->len += size;
+}
+
+static void putString(buffer *pbuf, const char *s, size_t len)
+{
+    putVarint(pbuf, len);
+    putBytes(pbuf, s, len);
+}
+
+/* A frame with the payload in pbody */
+static void putFrame(buffer *pbuf, unsigned type, const buffer *pbody)
+{
+    putVarint(pbuf, pbody->len + 1);
+    putByte(pbuf, type);
+    putBytes(pbuf, pbody->data, pbody->len);
+}
+
+static size_t boundedLength(const char *s, size_t max)
+{
+    const void *end = memchr(s, 0, max);
+
+    return end ? (size_t)((const char *)end - s) : max;
+}
+
+/* Bytes per element of the numeric types, 0 for the others */
+static unsigned elementSize(int type)
+{
+    switch (type) {
+    case DBR_UCHAR:     return sizeof(epicsUInt8);
+    case DBR_SHORT:
+    case DBR_USHORT:
+    case DBR_ENUM:      return sizeof(epicsUInt16);
+    case DBR_LONG:
+    case DBR_ULONG:     return sizeof(epicsUInt32);
+#ifdef DBR_INT64
+    case DBR_INT64:
+    case DBR_UINT64:    return sizeof(epicsUInt64);
+#endif
+    case DBR_FLOAT:     return sizeof(epicsFloat32);
+    case DBR_DOUBLE:    return sizeof(epicsFloat64);
+    }
+    return 0;
+}
+
+static int supported(int type)
+{
+    return type == DBR_STRING || type == DBR_CHAR || elementSize(type);
+}
+
+/* The element at p as an unsigned integer of its size, and back */
+static epicsUInt64 loadElement(const char *p, unsigned size)
+{
+    epicsUInt8 u8;
+    epicsUInt16 u16;
+    epicsUInt32 u32;
+    epicsUInt64 u64;
+
+    switch (size) {
+    case 1: memcpy(&u8, p, 1); return u8;
+    case 2: memcpy(&u16, p, 2); return u16;
+    case 4: memcpy(&u32, p, 4); return u32;
+    default: memcpy(&u64, p, 8); return u64;
+    }
+}
+
+static void storeElement(char *p, unsigned size, epicsUInt64 v)
+{
+    epicsUInt8 u8 = (epicsUInt8)v;
+    epicsUInt16 u16 = (epicsUInt16)v;
+    epicsUInt32 u32 = (epicsUInt32)v;
+
+    switch (size) {
+    case 1: memcpy(p, &u8, 1); break;
+    case 2: memcpy(p, &u16, 2); break;
+    case 4: memcpy(p, &u32, 4); break;
+    default: memcpy(p, &v, 8); break;
+    }
+}
+
+/*
+ * Encoder
+ */
+
+typedef struct dictEntry {
+    struct dictEntry *next;
+    unsigned        hash;
+    unsigned        kind;
+    unsigned        id;
+    size_t          len;
+    char            str[1];
+} dictEntry;
+
+struct caPutLogBinEncoder {
+    dictEntry       *table[DICT_BUCKETS];
+    unsigned        ids[caPutLogBinKinds];  /* defined so far */
+    int             started;                /* MAGIC sent */
+    epicsUInt32     seq;                    /* of the next put */
+    epicsUInt32     base;                   /* of the last SYNC */
+    buffer          shared;
+    buffer          body;
+    buffer          frame;                  /* scratch for DEF and SYNC */
+    buffer          put;
+    epicsMutexId    lock;                   /* for defs and preamble */
+    buffer          defs;                   /* MAGIC and all DEF frames */
+    caPutLogMsg     *preamble;              /* built from defs, NULL: to do */
+};
+
+static void putMagic(buffer *pbuf)
+{
+    putVarint(pbuf, sizeof(magic) + 2);
+    putByte(pbuf, caPutLogBinMagic);
+    putBytes(pbuf, magic, sizeof(magic));
+    putByte(pbuf, caPutLogBinVersion);
+}
+
+caPutLogBinEncoder *caPutLogBinEncoderCreate(void)
+{
+    caPutLogBinEncoder *penc = callocMustSucceed(1, sizeof(caPutLogBinEncoder),
+        "caPutLogBinEncoderCreate");
+
+    penc->lock = epicsMutexMustCreate();
+    putMagic(&penc->defs);
+    return penc;
+}
+
+void caPutLogBinEncoderDestroy(caPutLogBinEncoder *penc)
+{
+    unsigned i;
+
+    if (!penc)
+        return;
+    for (i = 0; i < DICT_BUCKETS; i++) {
+        dictEntry *pentry, *pnext;
+
+        for (pentry = penc->table[i]; pentry; pentry = pnext) {
+            pnext = pentry->next;
+            free(pentry);
+        }
+    }
+    caPutLogMsgRelease(penc->preamble);
+    epicsMutexDestroy(penc->lock);
+    free(penc->shared.data);
+    free(penc->body.data);
+    free(penc->frame.data);
+    free(penc->put.data);
+    free(penc->defs.data);
+    free(penc);
+}
+
+/* The id of a string, defined now if new; 0 if it has to go inline */
+static unsigned lookup(caPutLogBinEncoder *penc, unsigned kind, const char *s, size_t len)
+{
+    unsigned hash = epicsMemHash(s, len, kind);
+    dictEntry **ppentry = &penc->table[hash % DICT_BUCKETS], *pentry;
+
+    for (pentry = *ppentry; pentry; pentry = pentry->next) {
+        if (pentry->hash == hash && pentry->kind == kind && pentry->len == len
+                && memcmp(pentry->str, s, len) == 0)
+            return pentry->id;
+    }
+    if (len == 0 || penc->ids[kind] == caPutLogBinMaxIds)
+        return 0;
+
+    pentry = mallocMustSucceed(sizeof(dictEntry) + len, "caPutLogBin");
+    pentry->hash = hash;
+    pentry->kind = kind;
+    pentry->id = ++penc->ids[kind];
+    pentry->len = len;
+    memcpy(pentry->str, s, len);
+    pentry->str[len] = 0;
+    pentry->next = *ppentry;
+    *ppentry = pentry;
+
+    penc->frame.len = 0;
+    putByte(&penc->frame, kind);
+    putVarint(&penc->frame, pentry->id);
+    putBytes(&penc->frame, s, len);
+    putFrame(&penc->shared, caPutLogBinDef, &penc->frame);
+
+    epicsMutexMustLock(penc->lock);
+    putFrame(&penc->defs, caPutLogBinDef, &penc->frame);
+    caPutLogMsgRelease(penc->preamble);
+    penc->preamble = NULL;
+    epicsMutexUnlock(penc->lock);
+    return pentry->id;
+}
+
+static void putRef(caPutLogBinEncoder *penc, unsigned kind, const char *s, size_t len)
+{
+    unsigned id = lookup(penc, kind, s, len);
+
+    putVarint(&penc->body, id);
+    if (!id)
+        putString(&penc->body, s, len);
+}
+
+/* Empty the buffers for the next frames, MAGIC first on a new stream */
+static void startFrames(caPutLogBinEncoder *penc)
+{
+    penc->shared.len = 0;
+    penc->body.len = 0;
+    if (!penc->started) {
+        putMagic(&penc->shared);
+        penc->started = 1;
+    }
+}
+
+/* Time, PV name, host, user and metadata, as in PUT and SUPPRESSED */
+static void putHead(caPutLogBinEncoder *penc, const LOGDATA *pLogData,
+    const char *meta, size_t metaLen)
+{
+    const epicsTimeStamp *pts = &pLogData->new_value->time;
+    const char *host = pLogData->ident ? pLogData->ident->hostid : pLogData->hostid;
+    const char *user = pLogData->ident ? pLogData->ident->userid : pLogData->userid;
+
+    putFixed(&penc->body, ((epicsUInt64)pts->secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH)
+        * 1000000000u + pts->nsec, 8);
+    putRef(penc, caPutLogBinPvName, pLogData->pv_name, strlen(pLogData->pv_name));
+    putRef(penc, caPutLogBinHost, host, strlen(host));
+    putRef(penc, caPutLogBinUser, user, strlen(user));
+    putRef(penc, caPutLogBinMeta, meta, metaLen);
+}
+
+/* The body as a frame of the type, and both into *pout */
+static void endFrames(caPutLogBinEncoder *penc, unsigned type, caPutLogBinOut *pout)
+{
+    penc->put.len = 0;
+    putFrame(&penc->put, type, &penc->body);
+    pout->shared = (const char *)penc->shared.data;
+    pout->sharedLen = penc->shared.len;
+    pout->put = (const char *)penc->put.data;
+    pout->putLen = penc->put.len;
+}
+
+/* Element count, array size and the elements of a value */
+static void putValue(buffer *pbuf, const VALUE *pval, int type, size_t valueSize,
+    int count, int size, int isArray)
+{
+    unsigned esize = elementSize(type);
+    int i;
+
+    if (count < 0)
+        count = 0;
+    putVarint(pbuf, (unsigned)count);
+    if (isArray)
+        putVarint(pbuf, size > 0 ? (unsigned)size : 0);
+    if (type == DBR_CHAR) {
+        putString(pbuf, pval->a_bytes, boundedLength(pval->a_bytes,
+            valueSize < MAX_CHAR_STRING ? valueSize : MAX_CHAR_STRING));
+    } else if (type == DBR_STRING) {
+        for (i = 0; i < count; i++)
+            putString(pbuf, pval->a_string[i],
+                boundedLength(pval->a_string[i], MAX_STRING_SIZE));
+    } else {
+        for (i = 0; i < count; i++)
+            putFixed(pbuf, loadElement(pval->a_bytes + i * esize, esize), esize);
+    }
+}
+
+int caPutLogBinEncode(caPutLogBinEncoder *penc, const LOGDATA *pLogData,
+    const VALUE *pold_value, int burst, const VALUE *pmin, const VALUE *pmax,
+    const char *meta, size_t metaLen, caPutLogBinOut *pout)
+{
+    int isArray = pLogData->is_array != 0;
+    int minMax = burst && isDbrNumeric(pLogData->type) && !isArray;
+
+    if (!supported(pLogData->type)) {
+        errlogSevPrintf(errlogMajor, "caPutLogBin: cannot encode values of DBR type %d\n",
+            pLogData->type);
+        return -1;
+    }
+
+    startFrames(penc);
+    if (penc->seq % caPutLogBinSyncInterval == 0) {
+        penc->base = penc->seq;
+        penc->frame.len = 0;
+        putVarint(&penc->frame, penc->base);
+        putFrame(&penc->shared, caPutLogBinSync, &penc->frame);
+    }
+
+    putVarint(&penc->body, penc->seq - penc->base);
+    putHead(penc, pLogData, meta, metaLen);
+    putByte(&penc->body, (unsigned)pLogData->type);
+    putByte(&penc->body, (isArray ? caPutLogBinArray : 0) | (burst ? caPutLogBinBurst : 0));
+    if (burst)
+        putVarint(&penc->body, (unsigned)burst);
+    putValue(&penc->body, &pLogData->new_value->value, pLogData->type,
+        pLogData->value_size, pLogData->new_log_size, pLogData->new_size, isArray);
+    putValue(&penc->body, pold_value, pLogData->type, pLogData->value_size,
+        pLogData->old_log_size, pLogData->old_size, isArray);
+    if (minMax) {
+        putValue(&penc->body, pmin, pLogData->type, pLogData->value_size, 1, 0, 0);
+        putValue(&penc->body, pmax, pLogData->type, pLogData->value_size, 1, 0, 0);
+    }
+
+    endFrames(penc, caPutLogBinPut, pout);
+    penc->seq++;
+    return 0;
+}
+
+int caPutLogBinEncodeSuppressed(caPutLogBinEncoder *penc, const LOGDATA *pLogData,
+    const char *meta, size_t metaLen, caPutLogBinOut *pout)
+{
+    startFrames(penc);
+    putHead(penc, pLogData, meta, metaLen);
+    putVarint(&penc->body, pLogData->suppressed_pv);
+    putVarint(&penc->body, pLogData->suppressed_client);
+    endFrames(penc, caPutLogBinSuppressed, pout);
+    return 0;
+}
+
+caPutLogMsg *caPutLogBinPreamble(void *arg)
+{
+    caPutLogBinEncoder *penc = (caPutLogBinEncoder *)arg;
+    caPutLogMsg *pmsg;
+
+    epicsMutexMustLock(penc->lock);
+    if (!penc->preamble)
+        penc->preamble = caPutLogMsgCreate((const char *)penc->defs.data, penc->defs.len);
+    pmsg = penc->preamble;
+    caPutLogMsgAddRef(pmsg);
+    epicsMutexUnlock(penc->lock);
+    return pmsg;
+}
+
+/*
+ * Decoder
+ */
+
+typedef struct {
+    char            *str;       /* NUL terminated */
+    size_t          len;
+} dictString;
+
+struct caPutLogBinDecoder {
+    int             started;    /* MAGIC seen */
+    int             seqKnown;
+    epicsUInt32     base;
+    dictString      *dict[caPutLogBinKinds];
+    unsigned        dictSize[caPutLogBinKinds];
+    buffer          inl[caPutLogBinKinds];  /* inline and undefined strings */
+    buffer          pending;    /* an incomplete frame */
+    caPutLogBinRecord rec;
+};
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int             error;
+} reader;
+
+static unsigned getByte(reader *prd)
+{
+    if (prd->p == prd->end) {
+        prd->error = 1;
+        return 0;
+    }
+    return *prd->p++;
+}
+
+static epicsUInt64 getVarint(reader *prd)
+{
+    epicsUInt64 v = 0;
+    unsigned shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        unsigned b = getByte(prd);
+
+        v |= (epicsUInt64)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    prd->error = 1;
+    return 0;
+}
+
+static epicsUInt64 getFixed(reader *prd, unsigned size)
+{
+    epicsUInt64 v = 0;
+    unsigned i;
+
+    if ((size_t)(prd->end - prd->p) < size) {
+        prd->error = 1;
+        return 0;
+    }
+    for (i = 0; i < size; i++)
+        v |= (epicsUInt64)prd->p[i] << (8 * i);
+    prd->p += size;
+    return v;
+}
+
+/* A string of up to max bytes, NULL if there is none */
+static const char *getString(reader *prd, size_t max, size_t *plen)
+{
+    epicsUInt64 len = getVarint(prd);
+    const char *s = (const char *)prd->p;
+
+    if (prd->error || len > max || len > (epicsUInt64)(prd->end - prd->p)) {
+        prd->error = 1;
+        return NULL;
+    }
+    prd->p += len;
+    *plen = (size_t)len;
+    return s;
+}
+
+caPutLogBinDecoder *caPutLogBinDecoderCreate(void)
+{
+    return callocMustSucceed(1, sizeof(caPutLogBinDecoder), "caPutLogBinDecoderCreate");
+}
+
+void caPutLogBinDecoderDestroy(caPutLogBinDecoder *pdec)
+{
+    unsigned kind, id;
+
+    if (!pdec)
+        return;
+    for (kind = 0; kind < caPutLogBinKinds; kind++) {
+        for (id = 0; id < pdec->dictSize[kind]; id++)
+            free(pdec->dict[kind][id].str);
+        free(pdec->dict[kind]);
+        free(pdec->inl[kind].data);
+    }
+    free(pdec->pending.data);
+    free(pdec);
+}
+
+static int decodeDef(caPutLogBinDecoder *pdec, reader *prd)
+{
+    unsigned kind = getByte(prd);
+    epicsUInt64 id = getVarint(prd);
+    size_t len = prd->end - prd->p;
+    dictString *pstr;
+
+    if (prd->error || id == 0 || id > caPutLogBinMaxIds)
+        return -1;
+    if (kind >= caPutLogBinKinds)
+        return 0;
+    if (id >= pdec->dictSize[kind]) {
+        unsigned size = pdec->dictSize[kind] ? pdec->dictSize[kind] : 64;
+
+        while (size <= id)
+            size *= 2;
+        pdec->dict[kind] = realloc(pdec->dict[kind], size * sizeof(dictString));
+        if (!pdec->dict[kind])
+            cantProceed("caPutLogBin: out of memory\n");
+        memset(pdec->dict[kind] + pdec->dictSize[kind], 0,
+            (size - pdec->dictSize[kind]) * sizeof(dictString));
+        pdec->dictSize[kind] = size;
+    }
+    pstr = &pdec->dict[kind][id];
+    free(pstr->str);
+    pstr->str = mallocMustSucceed(len + 1, "caPutLogBin");
+    memcpy(pstr->str, prd->p, len);
+    pstr->str[len] = 0;
+    pstr->len = len;
+    return 0;
+}
+
+/* A string given by id or inline, NUL terminated */
+static const char *getRef(caPutLogBinDecoder *pdec, reader *prd, unsigned kind, size_t *plen)
+{
+    epicsUInt64 id = getVarint(prd);
+    buffer *pbuf = &pdec->inl[kind];
+    const char *s;
+    size_t len;
+    char undefined[24];
+
+    if (prd->error)
+        return NULL;
+    if (id && id < pdec->dictSize[kind] && pdec->dict[kind][id].str) {
+        *plen = pdec->dict[kind][id].len;
+        return pdec->dict[kind][id].str;
+    }
+    if (id) {
+        sprintf(undefined, "#%u", (unsigned)id);
+        s = undefined;
+        len = strlen(undefined);
+    } else if (!(s = getString(prd, MAX_FRAME, &len))) {
+        return NULL;
+    }
+    pbuf->len = 0;
+    putBytes(pbuf, s, len);
+    putByte(pbuf, 0);
+    *plen = len;
+    return (const char *)pbuf->data;
+}
+
+static int getValue(reader *prd, VALUE *pval, int type, int *pcount, int *psize,
+    int isArray)
+{
+    unsigned esize = elementSize(type);
+    epicsUInt64 count = getVarint(prd), size = isArray ? getVarint(prd) : 0;
+    const char *s;
+    size_t len;
+    unsigned i;
+
+    memset(pval, 0, sizeof(VALUE));
+    if (prd->error || count > MAX_ARRAY_SIZE_BYTES || size > 0x7fffffff)
+        return -1;
+    *pcount = (int)count;
+    *psize = (int)size;
+    if (type == DBR_CHAR) {
+        if (!(s = getString(prd, sizeof(pval->a_bytes), &len)))
+            return -1;
+        memcpy(pval->a_bytes, s, len);
+    } else if (type == DBR_STRING) {
+        if (count > NELEMENTS(pval->a_string))
+            return -1;
+        for (i = 0; i < count; i++) {
+            if (!(s = getString(prd, MAX_STRING_SIZE, &len)))
+                return -1;
+            memcpy(pval->a_string[i], s, len);
+        }
+    } else {
+        if (count * esize > sizeof(pval->a_bytes))
+            return -1;
+        for (i = 0; i < count; i++)
+            storeElement(pval->a_bytes + i * esize, esize, getFixed(prd, esize));
+    }
+    return prd->error ? -1 : 0;
+}
+
+/* Time, names and metadata of a PUT or SUPPRESSED frame into the record */
+static void getHead(caPutLogBinDecoder *pdec, reader *prd)
+{
+    caPutLogBinRecord *prec = &pdec->rec;
+    LOGDATA *pdata = &prec->data;
+    epicsUInt64 ns = getFixed(prd, 8), secs;
+    size_t len;
+
+    memset(pdata, 0, sizeof(LOGDATA));
+    secs = ns / 1000000000u;
+    prec->newValue.time.secPastEpoch = secs > POSIX_TIME_AT_EPICS_EPOCH
+        ? (epicsUInt32)(secs - POSIX_TIME_AT_EPICS_EPOCH) : 0;
+    prec->newValue.time.nsec = (epicsUInt32)(ns % 1000000000u);
+    pdata->new_value = &prec->newValue;
+    pdata->old_value = &prec->oldValue;
+    pdata->pv_name = (char *)getRef(pdec, prd, caPutLogBinPvName, &len);
+    pdata->hostid = (char *)getRef(pdec, prd, caPutLogBinHost, &len);
+    pdata->userid = (char *)getRef(pdec, prd, caPutLogBinUser, &len);
+    prec->meta = getRef(pdec, prd, caPutLogBinMeta, &prec->metaLen);
+}
+
+static int decodePut(caPutLogBinDecoder *pdec, reader *prd, caPutLogBinPutFunc *put,
+    void *arg)
+{
+    caPutLogBinRecord *prec = &pdec->rec;
+    LOGDATA *pdata = &prec->data;
+    epicsUInt64 delta = getVarint(prd);
+    unsigned flags;
+    int type, unused;
+
+    getHead(pdec, prd);
+    prec->suppressed = 0;
+    prec->seqKnown = pdec->seqKnown;
+    prec->seq = pdec->base + (epicsUInt32)delta;
+    type = getByte(prd);
+    flags = getByte(prd);
+    if (prd->error || !supported(type))
+        return -1;
+    pdata->type = (short)type;
+    pdata->is_array = (flags & caPutLogBinArray) != 0;
+    pdata->value_size = MAX_ARRAY_SIZE_BYTES;
+    prec->burst = flags & caPutLogBinBurst ? (int)getVarint(prd) : 0;
+    if (getValue(prd, &prec->newValue.value, type, &pdata->new_log_size,
+            &pdata->new_size, pdata->is_array)
+        || getValue(prd, &prec->oldValue, type, &pdata->old_log_size,
+            &pdata->old_size, pdata->is_array))
+        return -1;
+    if (prec->burst && isDbrNumeric(type) && !pdata->is_array) {
+        if (getValue(prd, &prec->min, type, &unused, &unused, 0)
+                || getValue(prd, &prec->max, type, &unused, &unused, 0))
+            return -1;
+    } else {
+        memset(&prec->min, 0, sizeof(VALUE));
+        memset(&prec->max, 0, sizeof(VALUE));
+    }
+    put(arg, prec);
+    return 0;
+}
+
+/* Counts of dropped puts, a record with no values and no sequence number */
+static int decodeSuppressed(caPutLogBinDecoder *pdec, reader *prd, caPutLogBinPutFunc *put,
+    void *arg)
+{
+    caPutLogBinRecord *prec = &pdec->rec;
+    LOGDATA *pdata = &prec->data;
+
+    getHead(pdec, prd);
+    pdata->type = DBR_STRING;
+    pdata->suppressed_pv = (unsigned)getVarint(prd);
+    pdata->suppressed_client = (unsigned)getVarint(prd);
+    if (prd->error)
+        return -1;
+    prec->suppressed = 1;
+    prec->seqKnown = 0;
+    prec->seq = 0;
+    prec->burst = 0;
+    memset(&prec->oldValue, 0, sizeof(VALUE));
+    memset(&prec->min, 0, sizeof(VALUE));
+    memset(&prec->max, 0, sizeof(VALUE));
+    put(arg, prec);
+    return 0;
+}
+
+/* One frame of len bytes from the type on, -1 if corrupt */
+static int decodeFrame(caPutLogBinDecoder *pdec, const unsigned char *p, size_t len,
+    caPutLogBinPutFunc *put, void *arg)
+{
+    reader rd;
+    unsigned type = *p;
+
+    rd.p = p + 1;
+    rd.end = p + len;
+    rd.error = 0;
+    if (type == caPutLogBinMagic) {
+        if (len != sizeof(magic) + 2 || memcmp(rd.p, magic, sizeof(magic))
+                || rd.p[sizeof(magic)] != caPutLogBinVersion)
+            return -1;
+        pdec->started = 1;
+        pdec->seqKnown = 0;
+        return 0;
+    }
+    if (!pdec->started)
+        return -1;
+    switch (type) {
+    case caPutLogBinDef:
+        return decodeDef(pdec, &rd);
+    case caPutLogBinSync:
+        pdec->base = (epicsUInt32)getVarint(&rd);
+        pdec->seqKnown = 1;
+        return rd.error ? -1 : 0;
+    case caPutLogBinPut:
+        return decodePut(pdec, &rd, put, arg);
+    case caPutLogBinSuppressed:
+        return decodeSuppressed(pdec, &rd, put, arg);
+    }
+    return 0;
+}
+
+/* Decode the complete frames at data; returns the bytes used, -1 if corrupt */
+static long decodeFrames(caPutLogBinDecoder *pdec, const unsigned char *data, size_t len,
+    caPutLogBinPutFunc *put, void *arg)
+{
+    size_t used = 0;
+
+    while (used < len) {
+        reader rd;
+        epicsUInt64 flen;
+
+        rd.p = data + used;
+        rd.end = data + len;
+        rd.error = 0;
+        flen = getVarint(&rd);
+        if (rd.error && rd.p == rd.end)
+            break;          /* the length is incomplete */
+        if (rd.error || flen > MAX_FRAME)
+            return -1;
+        /* not starting with MAGIC, no need to wait for the rest */
+        if (!pdec->started && flen && flen != sizeof(magic) + 2)
+            return -1;
+        if (flen > (epicsUInt64)(rd.end - rd.p))
+            break;
+        if (flen && decodeFrame(pdec, rd.p, (size_t)flen, put, arg))
+            return -1;
+        used = rd.p + flen - data;
+    }
+    return (long)used;
+}
+
+size_t caPutLogBinFramed(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t used = 0;
+
+    if (len < sizeof(magic) + 3 || p[0] != sizeof(magic) + 2 ||
+        p[1] != caPutLogBinMagic || memcmp(p + 2, magic, sizeof(magic)))
+        return 0;
+    while (used < len) {
+        reader rd;
+        epicsUInt64 flen;
+
+        rd.p = p + used;
+        rd.end = p + len;
+        rd.error = 0;
+        flen = getVarint(&rd);
+        if (rd.error || flen == 0 || flen > (epicsUInt64)(rd.end - rd.p))
+            break;
+        used = rd.p + flen - p;
+    }
+    return used;
+}
+
+int caPutLogBinDecode(caPutLogBinDecoder *pdec, const void *data, size_t len,
+    caPutLogBinPutFunc *put, void *arg)
+{
+    long used;
+
+    if (pdec->pending.len) {
+        putBytes(&pdec->pending, data, len);
+        used = decodeFrames(pdec, pdec->pending.data, pdec->pending.len, put, arg);
+        if (used < 0)
+            return -1;
+        pdec->pending.len -= used;
+        memmove(pdec->pending.data, pdec->pending.data + used, pdec->pending.len);
+        return 0;
+    }
+    used = decodeFrames(pdec, data, len, put, arg);
+    if (used < 0)
+        return -1;
+    putBytes(&pdec->pending, (const char *)data + used, len - used);
+    return 0;
+}
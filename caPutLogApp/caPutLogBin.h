@@ -0,0 +1,157 @@
+#ifndef INCcaPutLogBinh
+#define INCcaPutLogBinh 1
+
+#include <stddef.h>
+#include <epicsTypes.h>
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary put log format, an alternative to the JSON lines that is
+ * written straight from LOGDATA and read without parsing text.
+ *
+ * The stream is a sequence of frames:
+ *
+ *   length (varint)  type (1 byte)  payload (length - 1 bytes)
+ *
+ * varint is an unsigned LEB128 number (7 bits per byte, least significant
+ * first, high bit set on all but the last byte). Fixed size numbers are
+ * little endian, floating point ones in IEEE 754 format. Strings are a
+ * varint length followed by the bytes, without a NUL. A length of 0 is
+ * padding (a journal segment is NUL padded) and skipped. Frame types:
+ *
+ *   MAGIC  "CPLB", version (1 byte): starts a stream or a connection
+ *   DEF    kind (1 byte), id (varint), the string up to the end of the
+ *          frame: defines a dictionary entry. Kinds are PV names, hosts,
+ *          users and JSON metadata fragments (,"key":"value"...); ids
+ *          count from 1 per kind, a later definition of an id replaces
+ *          the earlier one.
+ *   SYNC   sequence number (varint): base for the following puts
+ *   PUT    sequence number - base (varint)
+ *          time in nanoseconds since 1970-01-01 UTC (8 bytes)
+ *          PV name, host, user, metadata: id (varint), if 0 followed by
+ *          the string (empty metadata: none)
+ *          DBR type (1 byte), flags (1 byte, see below)
+ *          burst count (varint, if flagged)
+ *          new value, old value: element count (varint), array size
+ *          (varint, arrays only) and the elements: native numbers, one
+ *          string per element for DBR_STRING, one string for DBR_CHAR
+ *          min and max (numeric scalars with a burst, one element each)
+ *   SUPPRESSED time, PV name, host, user, metadata as in PUT
+ *          puts of the PV, puts of the client the rate limits dropped
+ *          (varint each): the summary caPutLogRate.h reports; it has no
+ *          sequence number and may be sharded like a put
+ *
+ * A decoder skips frame types it does not know. The encoder sends a
+ * definition before the first put that refers to it and a SYNC frame every
+ * caPutLogBinSyncInterval puts; definitions, SYNC and MAGIC frames have to
+ * reach every server, puts may be sharded. A connection or journal segment
+ * starts with caPutLogBinPreamble(): MAGIC and all definitions so far.
+ * Sequence numbers are unknown to a decoder after MAGIC until the next
+ * SYNC frame. A definition lost with a full queue leaves its id undefined
+ * for that server; the decoder gives such names as "#<id>".
+ */
+
+#define caPutLogBinVersion      1
+#define caPutLogBinSyncInterval 128     /* puts per SYNC frame */
+#define caPutLogBinMaxIds       65535   /* per kind, later strings go inline */
+
+/* Frame types */
+#define caPutLogBinMagic        0
+#define caPutLogBinDef          1
+#define caPutLogBinSync         2
+#define caPutLogBinPut          3
+#define caPutLogBinSuppressed   4
+
+/* Dictionary kinds */
+#define caPutLogBinPvName       0
+#define caPutLogBinHost         1
+#define caPutLogBinUser         2
+#define caPutLogBinMeta         3
+#define caPutLogBinKinds        4
+
+/* PUT flags */
+#define caPutLogBinArray        1
+#define caPutLogBinBurst        2
+
+typedef struct caPutLogBinEncoder caPutLogBinEncoder;
+
+epicsShareFunc caPutLogBinEncoder *caPutLogBinEncoderCreate(void);
+epicsShareFunc void caPutLogBinEncoderDestroy(caPutLogBinEncoder *penc);
+
+/* The frames for one put; the buffers belong to the encoder and are
+   overwritten by the next call */
+typedef struct {
+    const char  *shared;        /* for all servers, before the put */
+    size_t      sharedLen;      /* 0: none */
+    const char  *put;
+    size_t      putLen;
+} caPutLogBinOut;
+
+/*
+ * Encode a put with the arguments the JSON formatter gets, meta being
+ * the serialized metadata (may be empty). Not thread safe, called from
+ * one logger thread. -1 for an unsupported value type.
+ */
+epicsShareFunc int caPutLogBinEncode(caPutLogBinEncoder *penc, const LOGDATA *pLogData,
+    const VALUE *pold_value, int burst, const VALUE *pmin, const VALUE *pmax,
+    const char *meta, size_t metaLen, caPutLogBinOut *pout);
+
+/* A SUPPRESSED frame with the counts in pLogData, else as caPutLogBinEncode() */
+epicsShareFunc int caPutLogBinEncodeSuppressed(caPutLogBinEncoder *penc,
+    const LOGDATA *pLogData, const char *meta, size_t metaLen, caPutLogBinOut *pout);
+
+/* MAGIC and all definitions so far, a caPutLogSinkPreamble for
+   caPutLogSinkSetPreamble; may be called from any thread */
+epicsShareFunc caPutLogMsg *caPutLogBinPreamble(void *penc);
+
+/*
+ * Reference decoder. caPutLogBinDecode() takes the stream in pieces of any
+ * size and calls put() for every complete PUT frame with a record that
+ * can be handed to CaPutJsonLogFormat::format() to get the JSON line the
+ * JSON logger would have written, and for every SUPPRESSED frame with one
+ * for CaPutJsonLogFormat::suppressed().
+ */
+typedef struct {
+    LOGDATA     data;           /* ident is NULL, strings point into the decoder */
+    TIME_VALUE  newValue;
+    VALUE       oldValue;
+    VALUE       min, max;
+    int         burst;
+    int         suppressed;     /* a SUPPRESSED frame, the counts are in data */
+    int         seqKnown;       /* a SYNC frame has been seen */
+    epicsUInt32 seq;
+    const char  *meta;          /* metadata fragment, "" if none */
+    size_t      metaLen;
+} caPutLogBinRecord;
+
+typedef void caPutLogBinPutFunc(void *arg, const caPutLogBinRecord *prec);
+
+typedef struct caPutLogBinDecoder caPutLogBinDecoder;
+
+epicsShareFunc caPutLogBinDecoder *caPutLogBinDecoderCreate(void);
+epicsShareFunc void caPutLogBinDecoderDestroy(caPutLogBinDecoder *pdec);
+
+/* -1 if the stream is corrupt or not of this format; the decoder then
+   has to be created anew */
+epicsShareFunc int caPutLogBinDecode(caPutLogBinDecoder *pdec, const void *data, size_t len,
+    caPutLogBinPutFunc *put, void *arg);
+
+/*
+ * Length of the whole frames data starts with, up to padding or a frame
+ * that is cut short; 0 if data does not start with a MAGIC frame. Finds
+ * the end of a journal segment, whose last values may well end in NULs.
+ */
+epicsShareFunc size_t caPutLogBinFramed(const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogBinh*/
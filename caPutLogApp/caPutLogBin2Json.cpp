@@ -0,0 +1,149 @@
+/* File:     caPutLogBin2Json.cpp
+ *
+ * Converts binary put logs (see caPutLogBin.h), as received by a log
+ * server or written to a journal file, to the JSON lines the JSON logger
+ * would have sent.
+ *
+ * Usage: caPutLogBin2Json [-t time format] [-n number format] [-s] [file...]
+ *
+ * The files, or the standard input, are decoded one after the other, each
+ * as a stream of its own. -t and -n take the names caPutJsonLogSetTimeFmt
+ * and caPutJsonLogSetNumFmt take; "date-time" is in the local time of
+ * this machine. -s puts the sequence number of each put, or "?" while it
+ * is not known, and a space in front of its line; "-" in front of the
+ * counts of puts the rate limits dropped, which have none.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "caPutLogBin.h"
+#include "caPutLogNum.h"
+#include "caPutJsonLogFormat.h"
+
+namespace {
+
+struct Converter {
+    CaPutJsonLogFormat format;
+    std::string metadata;
+    bool sequence;
+    unsigned long puts;
+    unsigned long failed;
+};
+
+void putFunc(void *arg, const caPutLogBinRecord *prec)
+{
+    Converter *pconv = static_cast<Converter *>(arg);
+
+    pconv->metadata.assign(prec->meta, prec->metaLen);
+    if (prec->suppressed) {
+        pconv->format.suppressed(&prec->data, pconv->metadata);
+    } else if (pconv->format.format(&prec->oldValue, &prec->data, prec->burst,
+            &prec->min, &prec->max, pconv->metadata)) {
+        pconv->failed++;
+        return;
+    }
+    if (pconv->sequence) {
+        if (prec->suppressed)
+            fputs("- ", stdout);
+        else if (prec->seqKnown)
+            printf("%u ", (unsigned)prec->seq);
+        else
+            fputs("? ", stdout);
+    }
+    std::string &msg = pconv->format.message();
+    msg += '\n';
+    fwrite(msg.data(), 1, msg.size(), stdout);
+    pconv->puts++;
+}
+
+int convert(FILE *fp, const char *name, Converter &conv)
+{
+    caPutLogBinDecoder *pdec = caPutLogBinDecoderCreate();
+    char buf[65536];
+    unsigned long offset = 0;
+    size_t n;
+    int status = 0;
+
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        if (caPutLogBinDecode(pdec, buf, n, putFunc, &conv)) {
+            fprintf(stderr, "caPutLogBin2Json: %s: not a binary put log,"
+                " or corrupt before byte %lu\n", name, offset + (unsigned long)n);
+            status = -1;
+            break;
+        }
+        offset += (unsigned long)n;
+    }
+    if (ferror(fp)) {
+        perror(name);
+        status = -1;
+    }
+    caPutLogBinDecoderDestroy(pdec);
+    return status;
+}
+
+int usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t date-time|iso8601|epoch-ns] [-n shortest|printf] [-s]"
+        " [file...]\n", prog);
+    return 2;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Converter conv;
+    int i, status = 0;
+
+    conv.sequence = false;
+    conv.puts = conv.failed = 0;
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            int fmt = CaPutJsonLogFormat::timeFmtFromName(argv[++i]);
+
+            if (fmt < 0)
+                return usage(argv[0]);
+            conv.format.setTimeFmt(static_cast<CaPutJsonLogFormat::timeFmt_t>(fmt));
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            int fmt = caPutLogNumFmtFromName(argv[++i]);
+
+            if (fmt < 0)
+                return usage(argv[0]);
+            conv.format.setNumFmt(static_cast<caPutLogNumFmt>(fmt));
+        } else if (strcmp(argv[i], "-s") == 0) {
+            conv.sequence = true;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    if (i == argc) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        status = convert(stdin, "standard input", conv);
+    }
+    for (; i < argc; i++) {
+        FILE *fp = fopen(argv[i], "rb");
+
+        if (!fp) {
+            perror(argv[i]);
+            status = -1;
+            continue;
+        }
+        if (convert(fp, argv[i], conv))
+            status = -1;
+        fclose(fp);
+    }
+    if (conv.failed)
+        fprintf(stderr, "caPutLogBin2Json: %lu of %lu puts could not be converted\n",
+            conv.failed, conv.puts + conv.failed);
+    return status ? 1 : 0;
+}
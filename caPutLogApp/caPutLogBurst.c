@@ -0,0 +1,485 @@
+/*	File:	  caPutLogBurst.c
+ *
+ *	Burst filter for the loggers. Pending bursts are kept in a hash
+ *	table keyed by the field address, and their ends are scheduled on
+ *	a hierarchical timer wheel (4 levels of 64 slots, 10 ms per tick),
+ *	so that any number of fields can be in a burst at the same time.
+ *
+ *	A put that extends a burst only moves the deadline of its entry;
+ *	the entry stays in its wheel slot and is rescheduled when the slot
+ *	comes due (unless the deadline moved to an earlier tick, which only
+ *	happens if the timeout is reduced).
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <dbAccess.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogAs.h"
+#include "caPutLogTask.h"
+#include "caPutLogBurst.h"
+
+#ifndef VERSION_INT
+#define VERSION_INT(V,R,M,P) (((V)<<24) | ((R)<<16) | ((M)<<8) | (P))
+#endif
+#ifndef EPICS_VERSION_INT
+#define EPICS_VERSION_INT VERSION_INT(EPICS_VERSION, EPICS_REVISION, EPICS_MODIFICATION, EPICS_PATCH_LEVEL)
+#endif
+
+#ifndef max
+#define max(x, y)       (((x) < (y)) ? (y) : (x))
+#endif
+
+#ifndef min
+#define min(x, y)       (((x) < (y)) ? (x) : (y))
+#endif
+
+#define isDbrNumeric(type) ((type) > DBR_STRING && (type) <= DBR_ENUM)
+
+#define TICKS_PER_SEC   100
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1u << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+#define MAX_DELTA       ((1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+#define INITIAL_BUCKETS 64
+
+/* signed distance between two ticks, the counter may wrap */
+#define TICK_DIFF(a, b) ((int)((unsigned)(a) - (unsigned)(b)))
+
+typedef union {
+    epicsFloat64    align;
+    char            bytes[8];
+} SCALAR;
+
+typedef struct burstEntry {
+    struct burstEntry *hnext;       /* hash chain */
+    struct burstEntry *wnext;       /* wheel slot */
+    struct burstEntry **wprev;
+    LOGDATA         *plogData;      /* last put */
+    unsigned        expires;        /* tick of the wheel slot */
+    unsigned        deadline;       /* tick at which the burst ends */
+    int             burst;
+    SCALAR          min;
+    SCALAR          max;
+    VALUE           old;            /* plogData->value_size bytes */
+} burstEntry;
+
+struct caPutLogBurst {
+    caPutLogBurstEmit emit;
+    void            *arg;
+    int             flags;
+    unsigned        tick;           /* next tick to be processed */
+    unsigned        count;
+    unsigned        nbuckets;       /* power of two */
+    burstEntry      **buckets;
+    burstEntry      *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+#if EPICS_VERSION_INT < VERSION_INT(7,0,0,0)
+    epicsTimeStamp  start;
+#endif
+};
+
+static unsigned burstNow(const caPutLogBurst *pburst)
+{
+#if EPICS_VERSION_INT >= VERSION_INT(7,0,0,0)
+    return (unsigned)(epicsMonotonicGet() / (1000000000u / TICKS_PER_SEC));
+#else
+    epicsTimeStamp now;
+    double diff;
+
+    epicsTimeGetCurrent(&now);
+    diff = epicsTimeDiffInSeconds(&now, &pburst->start);
+    return diff > 0.0 ? (unsigned)(diff * TICKS_PER_SEC) : 0;
+#endif
+}
+
+static unsigned timeoutTicks(double timeout)
+{
+    double ticks = timeout * TICKS_PER_SEC + 0.999;
+
+    if (ticks < 1.0) return 1;
+    if (ticks > MAX_DELTA) return MAX_DELTA;
+    return (unsigned)ticks;
+}
+
+static unsigned hashField(const caPutLogBurst *pburst, const void *pfield)
+{
+    size_t key = (size_t)pfield >> 3;
+
+    return ((unsigned)key * 2654435761u) & (pburst->nbuckets - 1);
+}
+
+static void wheelInsert(caPutLogBurst *pburst, burstEntry *pentry, unsigned expires)
+{
+    unsigned delta;
+    burstEntry **pslot;
+
+    if (TICK_DIFF(expires, pburst->tick) < 0)
+        expires = pburst->tick;
+    delta = expires - pburst->tick;
+    if (delta > MAX_DELTA) {
+        delta = MAX_DELTA;
+        expires = pburst->tick + MAX_DELTA;
+    }
+
+    if (delta < (1u << WHEEL_BITS))
+        pslot = &pburst->wheel[0][expires & WHEEL_MASK];
+    else if (delta < (1u << 2 * WHEEL_BITS))
+        pslot = &pburst->wheel[1][(expires >> WHEEL_BITS) & WHEEL_MASK];
+    else if (delta < (1u << 3 * WHEEL_BITS))
+        pslot = &pburst->wheel[2][(expires >> 2 * WHEEL_BITS) & WHEEL_MASK];
+    else
+        pslot = &pburst->wheel[3][(expires >> 3 * WHEEL_BITS) & WHEEL_MASK];
+
+    pentry->expires = expires;
+    pentry->wnext = *pslot;
+    pentry->wprev = pslot;
+    if (*pslot)
+        (*pslot)->wprev = &pentry->wnext;
+    *pslot = pentry;
+}
+
+static void wheelRemove(burstEntry *pentry)
+{
+    *pentry->wprev = pentry->wnext;
+    if (pentry->wnext)
+        pentry->wnext->wprev = pentry->wprev;
+}
+
+static void hashRemove(caPutLogBurst *pburst, burstEntry *pentry)
+{
+    burstEntry **pprev = &pburst->buckets[hashField(pburst, pentry->plogData->pfield)];
+
+    while (*pprev != pentry)
+        pprev = &(*pprev)->hnext;
+    *pprev = pentry->hnext;
+    pburst->count--;
+}
+
+static void hashGrow(caPutLogBurst *pburst)
+{
+    unsigned oldsize = pburst->nbuckets;
+    burstEntry **oldbuckets = pburst->buckets;
+    burstEntry **buckets = calloc(2 * oldsize, sizeof(burstEntry *));
+    unsigned i;
+
+    if (!buckets)
+        return;                 /* keep going with longer chains */
+
+    pburst->buckets = buckets;
+    pburst->nbuckets = 2 * oldsize;
+    for (i = 0; i < oldsize; i++) {
+        burstEntry *pentry = oldbuckets[i];
+
+        while (pentry) {
+            burstEntry *pnext = pentry->hnext;
+            burstEntry **phead = &buckets[hashField(pburst, pentry->plogData->pfield)];
+
+            pentry->hnext = *phead;
+            *phead = pentry;
+            pentry = pnext;
+        }
+    }
+    free(oldbuckets);
+}
+
+static void val_min(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
+{
+    switch (type) {
+    case DBR_CHAR:
+        pres->v_int8 = min(pa->v_int8, pb->v_int8);
+        return;
+    case DBR_UCHAR:
+        pres->v_uint8 = min(pa->v_uint8, pb->v_uint8);
+        return;
+    case DBR_SHORT:
+        pres->v_int16 = min(pa->v_int16, pb->v_int16);
+        return;
+    case DBR_USHORT:
+    case DBR_ENUM:
+        pres->v_uint16 = min(pa->v_uint16, pb->v_uint16);
+        return;
+    case DBR_LONG:
+        pres->v_int32 = min(pa->v_int32, pb->v_int32);
+        return;
+    case DBR_ULONG:
+        pres->v_uint32 = min(pa->v_uint32, pb->v_uint32);
+        return;
+#ifdef DBR_INT64
+    case DBR_INT64:
+        pres->v_int64 = min(pa->v_int64, pb->v_int64);
+        return;
+    case DBR_UINT64:
+        pres->v_uint64 = min(pa->v_uint64, pb->v_uint64);
+        return;
+#endif
+    case DBR_FLOAT:
+        pres->v_float = min(pa->v_float, pb->v_float);
+        return;
+    case DBR_DOUBLE:
+        pres->v_double = min(pa->v_double, pb->v_double);
+        return;
+    }
+}
+
+static void val_max(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
+{
+    switch (type) {
+    case DBR_CHAR:
+        pres->v_int8 = max(pa->v_int8, pb->v_int8);
+        return;
+    case DBR_UCHAR:
+        pres->v_uint8 = max(pa->v_uint8, pb->v_uint8);
+        return;
+    case DBR_SHORT:
+        pres->v_int16 = max(pa->v_int16, pb->v_int16);
+        return;
+    case DBR_USHORT:
+    case DBR_ENUM:
+        pres->v_uint16 = max(pa->v_uint16, pb->v_uint16);
+        return;
+    case DBR_LONG:
+        pres->v_int32 = max(pa->v_int32, pb->v_int32);
+        return;
+    case DBR_ULONG:
+        pres->v_uint32 = max(pa->v_uint32, pb->v_uint32);
+        return;
+#ifdef DBR_INT64
+    case DBR_INT64:
+        pres->v_int64 = max(pa->v_int64, pb->v_int64);
+        return;
+    case DBR_UINT64:
+        pres->v_uint64 = max(pa->v_uint64, pb->v_uint64);
+        return;
+#endif
+    case DBR_FLOAT:
+        pres->v_float = max(pa->v_float, pb->v_float);
+        return;
+    case DBR_DOUBLE:
+        pres->v_double = max(pa->v_double, pb->v_double);
+        return;
+    }
+}
+
+/* Emit a single put that is not part of a burst */
+static void emitSingle(caPutLogBurst *pburst, LOGDATA *plogData)
+{
+    pburst->emit(pburst->arg, plogData->old_value, plogData, 0,
+        &plogData->new_value->value, &plogData->new_value->value);
+    caPutLogDataFree(plogData);
+}
+
+/* Emit the burst of an entry that has been taken out of hash and wheel */
+static void emitEntry(caPutLogBurst *pburst, burstEntry *pentry)
+{
+    pburst->emit(pburst->arg, &pentry->old, pentry->plogData, pentry->burst,
+        (const VALUE *)&pentry->min, (const VALUE *)&pentry->max);
+    caPutLogDataFree(pentry->plogData);
+    free(pentry);
+}
+
+static burstEntry *entryFind(const caPutLogBurst *pburst, const void *pfield)
+{
+    burstEntry *pentry = pburst->buckets[hashField(pburst, pfield)];
+
+    while (pentry && pentry->plogData->pfield != pfield)
+        pentry = pentry->hnext;
+    return pentry;
+}
+
+caPutLogBurst *caPutLogBurstCreate(caPutLogBurstEmit emit, void *arg, int flags)
+{
+    caPutLogBurst *pburst = calloc(1, sizeof(caPutLogBurst));
+
+    if (!pburst)
+        return NULL;
+    pburst->buckets = calloc(INITIAL_BUCKETS, sizeof(burstEntry *));
+    if (!pburst->buckets) {
+        free(pburst);
+        return NULL;
+    }
+    pburst->nbuckets = INITIAL_BUCKETS;
+    pburst->emit = emit;
+    pburst->arg = arg;
+    pburst->flags = flags;
+#if EPICS_VERSION_INT < VERSION_INT(7,0,0,0)
+    epicsTimeGetCurrent(&pburst->start);
+#endif
+    pburst->tick = burstNow(pburst);
+    return pburst;
+}
+
+void caPutLogBurstDestroy(caPutLogBurst *pburst)
+{
+    if (!pburst)
+        return;
+    caPutLogBurstDiscard(pburst);
+    free(pburst->buckets);
+    free(pburst);
+}
+
+void caPutLogBurstPut(caPutLogBurst *pburst, LOGDATA *plogData,
+    double timeout, int merge)
+{
+    unsigned now = burstNow(pburst);
+    unsigned deadline = now + timeoutTicks(timeout);
+    burstEntry *pentry;
+
+    if (pburst->count == 0)
+        pburst->tick = now;
+
+    pentry = entryFind(pburst, plogData->pfield);
+
+    if (pentry && (!merge ||
+            pentry->plogData->type != plogData->type ||
+            pentry->plogData->value_size != plogData->value_size)) {
+        /* cannot extend this burst, finish it first */
+        hashRemove(pburst, pentry);
+        wheelRemove(pentry);
+        emitEntry(pburst, pentry);
+        pentry = NULL;
+    }
+
+    if (!merge ||
+        ((pburst->flags & caPutLogBurstNoMergeChar) && plogData->type == DBR_CHAR)) {
+        emitSingle(pburst, plogData);
+        return;
+    }
+
+    if (pentry) {
+        /* next put of a burst */
+        caPutLogDataFree(pentry->plogData);
+        pentry->plogData = plogData;
+        if (isDbrNumeric(plogData->type) &&
+            (!(pburst->flags & caPutLogBurstScalarOnly) || plogData->new_size == 1)) {
+            const VALUE *pnew = &plogData->new_value->value;
+
+            pentry->burst++;
+            val_min((VALUE *)&pentry->min, pnew, (VALUE *)&pentry->min, plogData->type);
+            val_max((VALUE *)&pentry->max, pnew, (VALUE *)&pentry->max, plogData->type);
+        }
+        pentry->deadline = deadline;
+        if (TICK_DIFF(deadline, pentry->expires) < 0) {
+            wheelRemove(pentry);
+            wheelInsert(pburst, pentry, deadline);
+        }
+        return;
+    }
+
+    /* first put of a burst */
+    pentry = malloc(offsetof(burstEntry, old) + plogData->value_size);
+    if (!pentry) {
+        errlogSevPrintf(errlogMinor, "caPutLog: out of memory for burst filter\n");
+        emitSingle(pburst, plogData);
+        return;
+    }
+    if (pburst->count >= pburst->nbuckets)
+        hashGrow(pburst);
+
+    pentry->plogData = plogData;
+    pentry->burst = 0;
+    pentry->deadline = deadline;
+    memcpy(&pentry->old, plogData->old_value, plogData->value_size);
+    memcpy(&pentry->min, &plogData->new_value->value, sizeof(SCALAR));
+    memcpy(&pentry->max, &plogData->new_value->value, sizeof(SCALAR));
+    {
+        burstEntry **phead = &pburst->buckets[hashField(pburst, plogData->pfield)];
+
+        pentry->hnext = *phead;
+        *phead = pentry;
+    }
+    pburst->count++;
+    wheelInsert(pburst, pentry, deadline);
+}
+
+/* Move the entries of a slot of an upper level down the wheel */
+static void wheelCascade(caPutLogBurst *pburst, int level, unsigned index)
+{
+    burstEntry *pentry = pburst->wheel[level][index];
+
+    pburst->wheel[level][index] = NULL;
+    while (pentry) {
+        burstEntry *pnext = pentry->wnext;
+
+        wheelInsert(pburst, pentry, pentry->expires);
+        pentry = pnext;
+    }
+}
+
+double caPutLogBurstProcess(caPutLogBurst *pburst, double idle)
+{
+    unsigned now = burstNow(pburst);
+    unsigned next;
+    double wait;
+    int level;
+
+    while (pburst->count && TICK_DIFF(now, pburst->tick) >= 0) {
+        unsigned tick = pburst->tick;
+        burstEntry *pentry;
+
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if (tick & ((1u << level * WHEEL_BITS) - 1))
+                break;
+            wheelCascade(pburst, level, (tick >> level * WHEEL_BITS) & WHEEL_MASK);
+        }
+
+        pentry = pburst->wheel[0][tick & WHEEL_MASK];
+        pburst->wheel[0][tick & WHEEL_MASK] = NULL;
+        pburst->tick = tick + 1;
+
+        while (pentry) {
+            burstEntry *pnext = pentry->wnext;
+
+            if (TICK_DIFF(pentry->deadline, tick) > 0) {
+                wheelInsert(pburst, pentry, pentry->deadline);
+            } else {
+                hashRemove(pburst, pentry);
+                emitEntry(pburst, pentry);
+            }
+            pentry = pnext;
+        }
+    }
+
+    if (pburst->count == 0)
+        return idle;
+
+    /* next occupied slot on the lowest level, or the next cascade */
+    for (next = pburst->tick; next & WHEEL_MASK; next++) {
+        if (pburst->wheel[0][next & WHEEL_MASK])
+            break;
+    }
+    wait = (double)TICK_DIFF(next, now) / TICKS_PER_SEC;
+    return wait < idle ? wait : idle;
+}
+
+void caPutLogBurstDiscard(caPutLogBurst *pburst)
+{
+    unsigned i;
+
+    for (i = 0; i < pburst->nbuckets; i++) {
+        burstEntry *pentry = pburst->buckets[i];
+
+        while (pentry) {
+            burstEntry *pnext = pentry->hnext;
+
+            caPutLogDataFree(pentry->plogData);
+            free(pentry);
+            pentry = pnext;
+        }
+        pburst->buckets[i] = NULL;
+    }
+    memset(pburst->wheel, 0, sizeof(pburst->wheel));
+    pburst->count = 0;
+}
+
+unsigned caPutLogBurstPending(const caPutLogBurst *pburst)
+{
+    return pburst->count;
+}
@@ -0,0 +1,62 @@
+#ifndef INCcaPutLogBursth
+#define INCcaPutLogBursth 1
+
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Burst filter shared by the loggers: puts to the same field that follow
+ * each other within the burst timeout are collapsed into one message.
+ * Every field has its own burst window, so interleaved puts to different
+ * fields are coalesced as well. Not thread safe; it is owned by the
+ * logger task.
+ */
+typedef struct caPutLogBurst caPutLogBurst;
+
+/*
+ * Called once per burst with the value before the first put, the last
+ * put, the number of puts merged into it and their min and max (valid
+ * only if burst is non-zero). The LOGDATA is freed after the call.
+ */
+typedef void (*caPutLogBurstEmit)(void *arg, const VALUE *pold,
+    const LOGDATA *pLogData, int burst, const VALUE *pmin, const VALUE *pmax);
+
+/* flags */
+#define caPutLogBurstNoMergeChar    0x1 /* DBR_CHAR puts are never merged */
+#define caPutLogBurstScalarOnly     0x2 /* only scalars count as burst */
+
+epicsShareFunc caPutLogBurst *caPutLogBurstCreate(caPutLogBurstEmit emit,
+    void *arg, int flags);
+
+/* Free the filter, pending bursts are discarded */
+epicsShareFunc void caPutLogBurstDestroy(caPutLogBurst *pburst);
+
+/*
+ * Hand a (resolved) put over to the filter. If merge is zero the put
+ * is emitted right away, otherwise it opens or extends the burst of its
+ * field, which ends timeout seconds after the last put.
+ */
+epicsShareFunc void caPutLogBurstPut(caPutLogBurst *pburst, LOGDATA *plogData,
+    double timeout, int merge);
+
+/*
+ * Emit all bursts that have ended. Returns the number of seconds until
+ * the next one may end, or idle if no burst is pending.
+ */
+epicsShareFunc double caPutLogBurstProcess(caPutLogBurst *pburst, double idle);
+
+/* Discard all pending bursts without emitting them */
+epicsShareFunc void caPutLogBurstDiscard(caPutLogBurst *pburst);
+
+epicsShareFunc unsigned caPutLogBurstPending(const caPutLogBurst *pburst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogBursth*/
@@ -25,15 +25,13 @@
 #include <dbDefs.h>
 #include <envDefs.h>
 #include <errlog.h>
-#include <logClient.h>
 #include <epicsString.h>
 #include <epicsStdio.h>
-#include <epicsMutex.h>
-#include <cantProceed.h>
 
 #define epicsExportSharedSymbols
 #include "caPutLog.h"
 #include "caPutLogClient.h"
+#include "caPutLogSink.h"
 
 #ifndef LOCAL
 #define LOCAL static
@@ -45,24 +43,26 @@
 
 LOCAL READONLY ENV_PARAM EPICS_CA_PUT_LOG_ADDR = {"EPICS_CA_PUT_LOG_ADDR", ""};
 
-LOCAL struct clientItem {
-    logClientId caPutLogClient;
-    struct clientItem *next;
-    char addr[1];
-} *caPutLogClients = NULL;
-static epicsMutexId caPutLogClientsMutex;
+/* One queue and sender thread per server, see caPutLogSink.h */
+static caPutLogSinkList *caPutLogSinks = NULL;
+
+static caPutLogSinkList *caPutLogClientSinks (void)
+{
+    if (!caPutLogSinks)
+        caPutLogSinks = caPutLogSinkListCreate("caPutLog", 0);
+    return caPutLogSinks;
+}
+
+/* How long caPutLogClientFlush waits for the queues to drain */
+#define FLUSH_TIMEOUT 5.0
 
 /*
  *  caPutLogClientFlush ()
  */
 void caPutLogClientFlush ()
 {
-    struct clientItem* c;
-    epicsMutexMustLock(caPutLogClientsMutex);
-    for (c = caPutLogClients; c; c = c->next) {
-        logClientFlush (c->caPutLogClient);
-    }
-    epicsMutexUnlock(caPutLogClientsMutex);
+    if (caPutLogSinks)
+        caPutLogSinkFlush(caPutLogSinks, FLUSH_TIMEOUT);
 }
 
 /*
@@ -70,12 +70,8 @@ void caPutLogClientFlush ()
  */
 void caPutLogClientShow (unsigned level)
 {
-    struct clientItem* c;
-    epicsMutexMustLock(caPutLogClientsMutex);
-    for (c = caPutLogClients; c; c = c->next) {
-        logClientShow (c->caPutLogClient, level);
-    }
-    epicsMutexUnlock(caPutLogClientsMutex);
+    if (caPutLogSinks)
+        caPutLogSinkShow(caPutLogSinks, level);
 }
 
 /*
@@ -83,19 +79,15 @@ void caPutLogClientShow (unsigned level)
  */
 int caPutLogClientInit (const char *addr_str)
 {
-    int status;
-    struct sockaddr_in saddr;
     unsigned short default_port = 7011;
-    struct clientItem** pclient;
     char *clientaddr;
     char *saveptr;
     char *addr_str_copy1;
     char *addr_str_copy2;
 
-    if (!caPutLogClientsMutex)
-        caPutLogClientsMutex = epicsMutexMustCreate();
+    caPutLogClientSinks();
     if (!addr_str || !addr_str[0]) {
-        if (caPutLogClients) return caPutLogSuccess;
+        if (caPutLogSinkCount(caPutLogSinks)) return caPutLogSuccess;
         addr_str = envGetConfigParamPtr(&EPICS_CA_PUT_LOG_ADDR);
     }
     if (addr_str == NULL) {
@@ -105,53 +97,46 @@ int caPutLogClientInit (const char *addr_str)
 
     addr_str_copy2 = addr_str_copy1 = epicsStrDup(addr_str);
 
-    epicsMutexMustLock(caPutLogClientsMutex);
     while(1) {
         clientaddr = strtok_r(addr_str_copy1, " \t\n\r", &saveptr);
         if (!clientaddr) break;
         addr_str_copy1 = NULL;
 
-        for (pclient = &caPutLogClients; *pclient; pclient = &(*pclient)->next) {
-            if (strcmp(clientaddr, (*pclient)->addr) == 0) {
-                fprintf (stderr, "caPutLog: address %s already configured\n", clientaddr);
-                break;
-            }
-        }
-        if (*pclient) continue;
-
-        status = aToIPAddr (clientaddr, default_port, &saddr);
-        if (status<0) {
-            fprintf (stderr, "caPutLog: bad address or host name %s\n", clientaddr);
-            continue;
-        }
-
-        *pclient = callocMustSucceed(1,sizeof(struct clientItem)+strlen(clientaddr),"caPutLog");
-        strcpy((*pclient)->addr, clientaddr);
-
-        (*pclient)->caPutLogClient = logClientCreate (saddr.sin_addr, ntohs(saddr.sin_port));
-        if (!(*pclient)->caPutLogClient) {
-            fprintf (stderr, "caPutLog: cannot create logClient %s\n", clientaddr);
-            free(*pclient);
-            *pclient = NULL;
-            continue;
-        }
-
-        (*pclient)->next = NULL;
+        caPutLogSinkAdd(caPutLogSinks, clientaddr, default_port);
     }
-    epicsMutexUnlock(caPutLogClientsMutex);
     free(addr_str_copy2);
-    return caPutLogClients ? caPutLogSuccess : caPutLogError;
+    return caPutLogSinkCount(caPutLogSinks) ? caPutLogSuccess : caPutLogError;
 }
 
 /*
  * caPutLogClientSend ()
  */
-void caPutLogClientSend (const char *message)
+void caPutLogClientSend (const char *message, size_t len, unsigned key)
 {
-    struct clientItem* c;
-    epicsMutexMustLock(caPutLogClientsMutex);
-    for (c = caPutLogClients; c; c = c->next) {
-        logClientSend (c->caPutLogClient, message);
-    }
-    epicsMutexUnlock(caPutLogClientsMutex);
+    if (caPutLogSinks)
+        caPutLogSinkSendTextKeyed(caPutLogSinks, message, len, key);
+}
+
+/*
+ * caPutLogClientSetBatch ()
+ */
+void caPutLogClientSetBatch (size_t bytes, double delay)
+{
+    caPutLogSinkSetBatch(caPutLogClientSinks(), bytes, delay);
+}
+
+/*
+ * caPutLogClientSetCopies ()
+ */
+void caPutLogClientSetCopies (unsigned copies)
+{
+    caPutLogSinkSetCopies(caPutLogClientSinks(), copies);
+}
+
+/*
+ * caPutLogClientSetSpool ()
+ */
+void caPutLogClientSetSpool (const char *dir, size_t bytes, double rate, int ack)
+{
+    caPutLogSinkSetSpool(caPutLogClientSinks(), dir, bytes, rate, ack);
 }
@@ -1,6 +1,7 @@
 #ifndef INCcaPutLogClienth
 #define INCcaPutLogClienth 1
 
+#include <stddef.h>
 #include <shareLib.h>
 
 #ifdef __cplusplus
@@ -10,7 +11,12 @@ extern "C" {
 epicsShareFunc int caPutLogClientInit (const char *addr_str);
 epicsShareFunc void caPutLogClientShow (unsigned level);
 epicsShareFunc void caPutLogClientFlush ();
-epicsShareFunc void caPutLogClientSend (const char *message);
+epicsShareFunc void caPutLogClientSend (const char *message, size_t len,
+    unsigned key);
+epicsShareFunc void caPutLogClientSetBatch (size_t bytes, double delay);
+epicsShareFunc void caPutLogClientSetCopies (unsigned copies);
+epicsShareFunc void caPutLogClientSetSpool (const char *dir, size_t bytes,
+    double rate, int ack);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,299 @@
+/*	File:	  caPutLogDeadband.c
+ *
+ *	Deadband of the on-change mode, see caPutLogDeadband.h.
+ *
+ *	The last logged values are kept in an open addressing table keyed
+ *	by the field address, like the pending bursts, and grown when half
+ *	full. Only PVs that have a deadband get an entry. An entry for a
+ *	PV that uses MDEL or ADEL also holds the address of that field,
+ *	looked up at the first put.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <errlog.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogDeadband.h"
+#include "caPutLogPolicy.h"
+
+#define MIN_SIZE    64
+
+typedef struct {
+    const void      *pfield;        /* NULL: free */
+    double          last;           /* value last logged */
+    int             delKind;        /* the field delAddr is for, 0: none */
+    int             delValid;
+    dbAddr          delAddr;        /* of MDEL or ADEL */
+} deadbandEntry;
+
+struct caPutLogDeadband {
+    deadbandEntry   *entries;
+    unsigned        mask;           /* size - 1, size a power of two */
+    unsigned        count;
+    size_t          dropped;
+};
+
+static caPutLogDeadbandSpec typeSpecs[2];
+static const char *const typeNames[] = { "float", "integer" };
+
+int caPutLogDeadbandParse(const char *text, caPutLogDeadbandSpec *pspec)
+{
+    char *end;
+    double value;
+
+    if (!text)
+        return -1;
+    if (strcmp(text, "none") == 0 || !*text) {
+        pspec->kind = caPutLogDeadbandNone;
+        pspec->value = 0.0;
+        return 0;
+    }
+    if (strcmp(text, "MDEL") == 0 || strcmp(text, "ADEL") == 0) {
+        pspec->kind = text[0] == 'M' ? caPutLogDeadbandMdel : caPutLogDeadbandAdel;
+        pspec->value = 0.0;
+        return 0;
+    }
+    value = strtod(text, &end);
+    if (end == text || value < 0.0 || !(value < HUGE_VAL))
+        return -1;
+    if (*end == '%' && !end[1]) {
+        pspec->kind = caPutLogDeadbandRelative;
+        pspec->value = value / 100.0;
+        return 0;
+    }
+    if (*end)
+        return -1;
+    pspec->kind = caPutLogDeadbandAbsolute;
+    pspec->value = value;
+    return 0;
+}
+
+int caPutLogDeadbandSet(const char *type, const char *deadband)
+{
+    caPutLogDeadbandSpec spec;
+    int i, all = type && strcmp(type, "all") == 0;
+
+    if (!all && (!type || (strcmp(type, typeNames[0]) != 0 &&
+            strcmp(type, typeNames[1]) != 0))) {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: unknown deadband type '%s' (float, integer, all)\n", type ? type : "");
+        return -1;
+    }
+    if (caPutLogDeadbandParse(deadband, &spec)) {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: invalid deadband '%s' (a number, a percentage, MDEL, ADEL or none)\n",
+            deadband ? deadband : "");
+        return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (all || strcmp(type, typeNames[i]) == 0) {
+            /* the logger tasks read it without a lock: kind last */
+            typeSpecs[i].value = spec.value;
+            typeSpecs[i].kind = spec.kind;
+        }
+    }
+    return 0;
+}
+
+caPutLogDeadband *caPutLogDeadbandCreate(void)
+{
+    caPutLogDeadband *pdeadband = calloc(1, sizeof(caPutLogDeadband));
+
+    if (!pdeadband)
+        return NULL;
+    pdeadband->entries = calloc(MIN_SIZE, sizeof(deadbandEntry));
+    if (!pdeadband->entries) {
+        free(pdeadband);
+        return NULL;
+    }
+    pdeadband->mask = MIN_SIZE - 1;
+    return pdeadband;
+}
+
+void caPutLogDeadbandDestroy(caPutLogDeadband *pdeadband)
+{
+    if (!pdeadband)
+        return;
+    free(pdeadband->entries);
+    free(pdeadband);
+}
+
+static unsigned hashField(const void *pfield)
+{
+    size_t key = (size_t)pfield >> 3;
+
+    return (unsigned)key * 2654435761u;
+}
+
+static deadbandEntry *entrySlot(deadbandEntry *entries, unsigned mask, const void *pfield)
+{
+    unsigned i = hashField(pfield) & mask;
+
+    while (entries[i].pfield && entries[i].pfield != pfield)
+        i = (i + 1) & mask;
+    return &entries[i];
+}
+
+static void tableGrow(caPutLogDeadband *pdeadband)
+{
+    unsigned size = 2 * (pdeadband->mask + 1), i;
+    deadbandEntry *entries = calloc(size, sizeof(deadbandEntry));
+
+    if (!entries)
+        return;                 /* keep going fuller */
+    for (i = 0; i <= pdeadband->mask; i++) {
+        if (pdeadband->entries[i].pfield)
+            *entrySlot(entries, size - 1, pdeadband->entries[i].pfield) =
+                pdeadband->entries[i];
+    }
+    free(pdeadband->entries);
+    pdeadband->entries = entries;
+    pdeadband->mask = size - 1;
+}
+
+/* The value of a numeric scalar, 0 for other types */
+static int toDouble(const VALUE *pval, short type, double *pres)
+{
+    switch (type) {
+    case DBR_CHAR:      *pres = pval->v_int8; return 1;
+    case DBR_UCHAR:     *pres = pval->v_uint8; return 1;
+    case DBR_SHORT:     *pres = pval->v_int16; return 1;
+    case DBR_USHORT:    *pres = pval->v_uint16; return 1;
+    case DBR_LONG:      *pres = pval->v_int32; return 1;
+    case DBR_ULONG:     *pres = pval->v_uint32; return 1;
+#ifdef DBR_INT64
+    case DBR_INT64:     *pres = (double)pval->v_int64; return 1;
+    case DBR_UINT64:    *pres = (double)pval->v_uint64; return 1;
+#endif
+    case DBR_FLOAT:     *pres = pval->v_float; return 1;
+    case DBR_DOUBLE:    *pres = pval->v_double; return 1;
+    }
+    return 0;
+}
+
+/*
+ * MDEL or ADEL of the record, -1 (log all) if it has none. The record
+ * name is the PV name up to the field.
+ */
+static double recordDeadband(deadbandEntry *pentry, const char *pv_name, int kind)
+{
+    double value;
+    long status;
+
+    if (pentry->delKind != kind) {
+        char name[PVNAME_STRINGSZ + 8];
+        size_t len = strcspn(pv_name, ".{");
+
+        if (len > PVNAME_STRINGSZ - 1)
+            len = PVNAME_STRINGSZ - 1;
+        memcpy(name, pv_name, len);
+        strcpy(name + len, kind == caPutLogDeadbandMdel ? ".MDEL" : ".ADEL");
+        pentry->delKind = kind;
+        pentry->delValid = dbNameToAddr(name, &pentry->delAddr) == 0;
+    }
+    if (!pentry->delValid)
+        return -1.0;
+    status = dbGetField(&pentry->delAddr, DBR_DOUBLE, &value, NULL, NULL, NULL);
+    return status ? -1.0 : value;
+}
+
+int caPutLogDeadbandPass(caPutLogDeadband *pdeadband, const VALUE *pold,
+    const LOGDATA *pLogData, int burst, const VALUE *pmin, const VALUE *pmax)
+{
+    const caPutLogPolicy *ppolicy = pLogData->policy;
+    caPutLogDeadbandSpec spec;
+    deadbandEntry *pentry;
+    double value, old, low, high, band;
+
+    if (ppolicy && ppolicy->deadband.kind != caPutLogDeadbandNone) {
+        spec = ppolicy->deadband;
+    } else {
+        int type = pLogData->type == DBR_FLOAT || pLogData->type == DBR_DOUBLE ?
+            caPutLogDeadbandFloat : caPutLogDeadbandInteger;
+
+        spec.kind = typeSpecs[type].kind;
+        spec.value = typeSpecs[type].value;
+    }
+    if (spec.kind == caPutLogDeadbandNone || pLogData->is_array ||
+            !toDouble(&pLogData->new_value->value, pLogData->type, &value))
+        return 1;
+
+    pentry = entrySlot(pdeadband->entries, pdeadband->mask, pLogData->pfield);
+    if (!pentry->pfield) {
+        if (!toDouble(pold, pLogData->type, &old))
+            return 1;
+        if (2 * (pdeadband->count + 1) > pdeadband->mask + 1) {
+            tableGrow(pdeadband);
+            if (pdeadband->count + 1 > pdeadband->mask)
+                return 1;       /* out of memory, leave one slot free */
+            pentry = entrySlot(pdeadband->entries, pdeadband->mask, pLogData->pfield);
+        }
+        memset(pentry, 0, sizeof(deadbandEntry));
+        pentry->pfield = pLogData->pfield;
+        pentry->last = old;
+        pdeadband->count++;
+    }
+
+    switch (spec.kind) {
+    case caPutLogDeadbandAbsolute:
+        band = spec.value;
+        break;
+    case caPutLogDeadbandRelative:
+        band = spec.value * fabs(pentry->last);
+        break;
+    default:
+        band = recordDeadband(pentry, pLogData->pv_name, spec.kind);
+    }
+
+    /* NaN compares false and is always logged */
+    if (band >= 0.0 && fabs(value - pentry->last) <= band) {
+        if (!burst || (toDouble(pmin, pLogData->type, &low) &&
+                toDouble(pmax, pLogData->type, &high) &&
+                fabs(low - pentry->last) <= band && fabs(high - pentry->last) <= band)) {
+            pdeadband->dropped++;
+            return 0;
+        }
+    }
+    pentry->last = value;
+    return 1;
+}
+
+unsigned caPutLogDeadbandCount(const caPutLogDeadband *pdeadband)
+{
+    return pdeadband->count;
+}
+
+size_t caPutLogDeadbandDropped(const caPutLogDeadband *pdeadband)
+{
+    return pdeadband->dropped;
+}
+
+static void specText(char *buf, const caPutLogDeadbandSpec *pspec)
+{
+    switch (pspec->kind) {
+    case caPutLogDeadbandAbsolute: sprintf(buf, "%g", pspec->value); break;
+    case caPutLogDeadbandRelative: sprintf(buf, "%g%%", pspec->value * 100.0); break;
+    case caPutLogDeadbandMdel: strcpy(buf, "MDEL"); break;
+    case caPutLogDeadbandAdel: strcpy(buf, "ADEL"); break;
+    default: strcpy(buf, "none");
+    }
+}
+
+void caPutLogDeadbandShow(const caPutLogDeadband *pdeadband, const char *name)
+{
+    char text[2][32];
+
+    if (!pdeadband->count && typeSpecs[0].kind == caPutLogDeadbandNone &&
+            typeSpecs[1].kind == caPutLogDeadbandNone)
+        return;
+    specText(text[0], &typeSpecs[0]);
+    specText(text[1], &typeSpecs[1]);
+    printf("%s Deadband: float %s, integer %s; %lu puts within, %u PVs tracked\n", name,
+        text[0], text[1], (unsigned long)pdeadband->dropped, pdeadband->count);
+}
@@ -0,0 +1,79 @@
+#ifndef INCcaPutLogDeadbandh
+#define INCcaPutLogDeadbandh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Deadband for the on-change mode: a put of a numeric scalar is not
+ * logged while its value stays within the deadband around the last value
+ * logged for the PV, so that slow drift is still logged once it adds up.
+ * For the first put to a PV the value before the put counts as logged. A
+ * burst is dropped only if its min and max stay within the deadband, too.
+ *
+ * The deadband of a PV comes from the record's info(caPutLogDeadband, ...)
+ * tag (see caPutLogPolicy.h), or else from the one set for its value type
+ * with caPutLogDeadbandSet(). Written as text it is one of
+ *
+ *   "0.5"      absolute: changes up to 0.5 are not logged
+ *   "2%"       relative: changes up to 2% of the last logged value
+ *   "MDEL"     the record's MDEL (monitor deadband), read at each put;
+ *   "ADEL"     or ADEL (archive deadband). A negative value logs all.
+ *   "none"     no deadband
+ *
+ * The last logged values are kept by each logger task in a table of its
+ * own; it is not thread safe.
+ */
+
+#define caPutLogDeadbandNone        0
+#define caPutLogDeadbandAbsolute    1
+#define caPutLogDeadbandRelative    2
+#define caPutLogDeadbandMdel        3
+#define caPutLogDeadbandAdel        4
+
+typedef struct caPutLogDeadbandSpec {
+    int         kind;
+    double      value;          /* absolute, or relative as a fraction */
+} caPutLogDeadbandSpec;
+
+/* Value types of caPutLogDeadbandSet() */
+#define caPutLogDeadbandFloat       0   /* DBR_FLOAT, DBR_DOUBLE */
+#define caPutLogDeadbandInteger     1   /* the integer types, not DBR_ENUM */
+
+/* -1 if the text is not a deadband */
+epicsShareFunc int caPutLogDeadbandParse(const char *text, caPutLogDeadbandSpec *pspec);
+
+/*
+ * Deadband for the PVs of a value type ("float", "integer" or "all")
+ * without one of their own; may be changed at any time
+ */
+epicsShareFunc int caPutLogDeadbandSet(const char *type, const char *deadband);
+
+typedef struct caPutLogDeadband caPutLogDeadband;
+
+epicsShareFunc caPutLogDeadband *caPutLogDeadbandCreate(void);
+epicsShareFunc void caPutLogDeadbandDestroy(caPutLogDeadband *pdeadband);
+
+/*
+ * Whether to log a put (or a burst) in the on-change mode; if so, its new
+ * value becomes the PV's last logged one. Puts of other values and PVs
+ * without a deadband always pass.
+ */
+epicsShareFunc int caPutLogDeadbandPass(caPutLogDeadband *pdeadband, const VALUE *pold,
+    const LOGDATA *pLogData, int burst, const VALUE *pmin, const VALUE *pmax);
+
+epicsShareFunc unsigned caPutLogDeadbandCount(const caPutLogDeadband *pdeadband);
+epicsShareFunc size_t caPutLogDeadbandDropped(const caPutLogDeadband *pdeadband);
+epicsShareFunc void caPutLogDeadbandShow(const caPutLogDeadband *pdeadband, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogDeadbandh*/
@@ -0,0 +1,484 @@
+/*	File:	  caPutLogFile.c
+ *
+ *	Journal file transport, see caPutLogFile.h.
+ *
+ *	A batch is appended to the mapped segment with memcpy() under the
+ *	file's lock. The sync thread msync()s everything appended since the
+ *	previous sync once per interval, so the cost of a sync is shared by
+ *	all batches of that interval. Appends wait while a sync is running;
+ *	the sink's queue takes up the slack.
+ *
+ *	Rotation syncs the segment, unmaps it, cuts the file to the used
+ *	length and renames it. rename() is atomic, so a rotated segment is
+ *	seen complete or not at all. A new segment is only ever created at
+ *	a free path: if the rename fails, the old segment stays there and
+ *	the rename is tried again before each attempt to start a new one.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(_WIN32) || defined(vxWorks) || defined(__rtems__)
+#define NO_MMAP
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogFile.h"
+#include "caPutLogBin.h"
+
+#define DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+
+int caPutLogFileSegmentSize = DEFAULT_SEGMENT_SIZE;
+epicsExportAddress(int, caPutLogFileSegmentSize);
+double caPutLogFileSyncInterval = 1.0;
+epicsExportAddress(double, caPutLogFileSyncInterval);
+int caPutLogFileRotateHours = 0;
+epicsExportAddress(int, caPutLogFileRotateHours);
+
+#ifdef NO_MMAP
+
+caPutLogFile *caPutLogFileCreate(const char *path)
+{
+    errlogSevPrintf(errlogMajor, "caPutLog: file %s: not supported on this target\n", path);
+    return NULL;
+}
+
+void caPutLogFileSetPreamble(caPutLogFile *pfile, caPutLogSinkPreamble *preamble,
+    void *arg)
+{
+}
+
+void caPutLogFileGetStats(caPutLogFile *pfile, caPutLogFileStats *pstats)
+{
+    memset(pstats, 0, sizeof(*pstats));
+}
+
+static int fileSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    return -1;
+}
+
+const caPutLogSinkTransport caPutLogFileTransport = {
+    fileSend, NULL, NULL, NULL
+};
+
+#else /* NO_MMAP */
+
+struct caPutLogFile {
+    epicsMutexId    lock;
+    int             fd;         /* -1: no active segment */
+    char            *map;
+    size_t          size;
+    size_t          used;
+    size_t          synced;
+    size_t          pageSize;
+    epicsTimeStamp  started;    /* of the active segment */
+    epicsUInt32     period;     /* seconds, 0: rotate by size only */
+    double          syncInterval;
+    int             failing;    /* last attempt failed, reported once */
+    int             fresh;      /* nothing written to the segment yet */
+    int             pending;    /* a segment at path still to be renamed */
+    epicsTimeStamp  pendingStarted;
+    caPutLogSinkPreamble *preamble;
+    void            *preambleArg;
+    int             stop;
+    epicsEventId    wakeup;
+    epicsEventId    done;
+    caPutLogFileStats stats;
+    char            path[1];
+};
+
+static void report(caPutLogFile *pfile, const char *what)
+{
+    errlogSevPrintf(errlogMinor, "caPutLog: %s %s: %s\n", what, pfile->path,
+        strerror(errno));
+}
+
+/* "path.YYYYmmdd-HHMMSS", with a suffix if that is taken */
+static void rotatedName(caPutLogFile *pfile, const epicsTimeStamp *pstarted,
+    char *name, size_t size)
+{
+    char stamp[32];
+    int n = epicsSnprintf(name, size, "%s.", pfile->path);
+    unsigned i;
+
+    epicsTimeToStrftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", pstarted);
+    epicsSnprintf(name + n, size - n, "%s", stamp);
+    for (i = 1; access(name, F_OK) == 0; i++)
+        epicsSnprintf(name + n, size - n, "%s-%u", stamp, i);
+}
+
+/*
+ * Rename the segment left at path by a rename that failed; it keeps its
+ * data until this succeeds
+ */
+static int renamePending(caPutLogFile *pfile)
+{
+    size_t len = strlen(pfile->path) + 40;
+    char *name;
+    int status;
+
+    if (!pfile->pending)
+        return 0;
+    name = mallocMustSucceed(len, "caPutLogFile");
+    rotatedName(pfile, &pfile->pendingStarted, name, len);
+    status = rename(pfile->path, name);
+    free(name);
+    if (status && errno != ENOENT) {
+        if (!pfile->failing)
+            report(pfile, "cannot rename segment");
+        pfile->failing = 1;
+        return -1;
+    }
+    pfile->pending = 0;
+    return 0;
+}
+
+/* Cut the file at path to its used length and rename it */
+static int retire(caPutLogFile *pfile, int fd, size_t used,
+    const epicsTimeStamp *pstarted)
+{
+    int status;
+
+    status = ftruncate(fd, (off_t)used) || fsync(fd);
+    if (status)
+        report(pfile, "cannot cut segment");
+    close(fd);
+    if (used == 0) {
+        remove(pfile->path);
+    } else {
+        pfile->pending = 1;
+        pfile->pendingStarted = *pstarted;
+        if (renamePending(pfile))
+            status = -1;
+    }
+    return status ? -1 : 0;
+}
+
+/* A segment left behind by an earlier run: find its end, rotate it */
+static void recover(caPutLogFile *pfile)
+{
+    struct stat st;
+    size_t used;
+    epicsTimeStamp started;
+    char *map;
+    int fd = open(pfile->path, O_RDWR);
+
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    used = (size_t)st.st_size;
+    map = mmap(NULL, used, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        report(pfile, "cannot map old segment");
+        close(fd);
+        return;
+    }
+    /* binary frames may end in NULs, text ends at the padding */
+    used = caPutLogBinFramed(map, used);
+    if (!used) {
+        used = (size_t)st.st_size;
+        while (used && !map[used - 1])
+            used--;
+    }
+    munmap(map, (size_t)st.st_size);
+    epicsTimeFromTime_t(&started, st.st_mtime);
+    if (retire(pfile, fd, used, &started) == 0 && used)
+        errlogSevPrintf(errlogInfo, "caPutLog: recovered %lu bytes from %s\n",
+            (unsigned long)used, pfile->path);
+}
+
+/* Call with the file locked */
+static void syncSegment(caPutLogFile *pfile)
+{
+    size_t start = pfile->synced & ~(pfile->pageSize - 1);
+    epicsTimeStamp t0, t1;
+
+    if (pfile->used == pfile->synced)
+        return;
+    epicsTimeGetCurrent(&t0);
+    if (msync(pfile->map + start, pfile->used - start, MS_SYNC))
+        report(pfile, "cannot sync");
+    epicsTimeGetCurrent(&t1);
+    pfile->synced = pfile->used;
+    pfile->stats.syncs++;
+    pfile->stats.lastSync = epicsTimeDiffInSeconds(&t1, &t0);
+    if (pfile->stats.lastSync > pfile->stats.maxSync)
+        pfile->stats.maxSync = pfile->stats.lastSync;
+}
+
+/*
+ * Call with the file locked. Never truncates: whatever is still at path
+ * is renamed first (or removed if empty), or else no segment is started.
+ */
+static int startSegment(caPutLogFile *pfile)
+{
+    struct stat st;
+    int fd, status;
+
+    if (renamePending(pfile))
+        return -1;
+    fd = open(pfile->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && stat(pfile->path, &st) == 0) {
+        if (st.st_size == 0) {
+            remove(pfile->path);
+        } else {
+            pfile->pending = 1;
+            epicsTimeFromTime_t(&pfile->pendingStarted, st.st_mtime);
+            if (renamePending(pfile))
+                return -1;
+        }
+        fd = open(pfile->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        if (!pfile->failing)
+            report(pfile, "cannot create");
+        pfile->failing = 1;
+        return -1;
+    }
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+    /* reserve the blocks now, not on the first write to each page */
+    status = posix_fallocate(fd, 0, (off_t)pfile->size);
+    if (status == EINVAL || status == EOPNOTSUPP)
+        status = ftruncate(fd, (off_t)pfile->size);
+    else if (status)
+        errno = status;
+#else
+    status = ftruncate(fd, (off_t)pfile->size);
+#endif
+    if (status == 0) {
+        pfile->map = mmap(NULL, pfile->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pfile->map == MAP_FAILED) {
+            pfile->map = NULL;
+            status = -1;
+        }
+    }
+    if (status) {
+        if (!pfile->failing)
+            report(pfile, "cannot allocate segment");
+        pfile->failing = 1;
+        close(fd);
+        remove(pfile->path);
+        return -1;
+    }
+    pfile->fd = fd;
+    pfile->used = pfile->synced = 0;
+    pfile->failing = 0;
+    pfile->fresh = 1;
+    epicsTimeGetCurrent(&pfile->started);
+    return 0;
+}
+
+/* Call with the file locked; rotate, or else leave it at path */
+static void endSegment(caPutLogFile *pfile, int rotate)
+{
+    syncSegment(pfile);
+    munmap(pfile->map, pfile->size);
+    pfile->map = NULL;
+    if (rotate) {
+        if (retire(pfile, pfile->fd, pfile->used, &pfile->started) == 0)
+            pfile->stats.rotations++;
+    } else {
+        if (ftruncate(pfile->fd, (off_t)pfile->used) || fsync(pfile->fd))
+            report(pfile, "cannot cut segment");
+        close(pfile->fd);
+    }
+    pfile->fd = -1;
+}
+
+static void syncThread(void *arg)
+{
+    caPutLogFile *pfile = (caPutLogFile *)arg;
+
+    while (1) {
+        epicsEventWaitWithTimeout(pfile->wakeup, pfile->syncInterval);
+        epicsMutexMustLock(pfile->lock);
+        if (pfile->stop) {
+            epicsMutexUnlock(pfile->lock);
+            break;
+        }
+        if (pfile->map)
+            syncSegment(pfile);
+        epicsMutexUnlock(pfile->lock);
+    }
+    epicsEventSignal(pfile->done);
+}
+
+caPutLogFile *caPutLogFileCreate(const char *path)
+{
+    caPutLogFile *pfile = callocMustSucceed(1, sizeof(caPutLogFile) + strlen(path),
+        "caPutLogFileCreate");
+    size_t size = caPutLogFileSegmentSize > 0 ? (size_t)caPutLogFileSegmentSize
+        : DEFAULT_SEGMENT_SIZE;
+
+    strcpy(pfile->path, path);
+    pfile->fd = -1;
+    pfile->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    pfile->size = (size + pfile->pageSize - 1) & ~(pfile->pageSize - 1);
+    pfile->period = caPutLogFileRotateHours > 0 ? 3600u * caPutLogFileRotateHours : 0;
+    pfile->syncInterval = caPutLogFileSyncInterval;
+    pfile->stats.segmentSize = pfile->size;
+    pfile->lock = epicsMutexMustCreate();
+    pfile->wakeup = epicsEventMustCreate(epicsEventEmpty);
+    pfile->done = epicsEventMustCreate(epicsEventEmpty);
+
+    recover(pfile);
+    if (startSegment(pfile)) {
+        epicsEventDestroy(pfile->done);
+        epicsEventDestroy(pfile->wakeup);
+        epicsMutexDestroy(pfile->lock);
+        free(pfile);
+        return NULL;
+    }
+    if (pfile->syncInterval > 0.0 && !epicsThreadCreate("caPutLogSync",
+            epicsThreadPriorityLow, epicsThreadGetStackSize(epicsThreadStackSmall),
+            syncThread, pfile)) {
+        errlogSevPrintf(errlogMinor, "caPutLog: no sync thread for %s, "
+            "syncing after every batch\n", path);
+        pfile->syncInterval = 0.0;
+    }
+    return pfile;
+}
+
+/* Call with the file locked: has the active segment's period passed? */
+static int expired(caPutLogFile *pfile, const epicsTimeStamp *pnow)
+{
+    return pfile->period &&
+        pnow->secPastEpoch / pfile->period != pfile->started.secPastEpoch / pfile->period;
+}
+
+/* Call with the file locked, before the first message of len bytes in
+   a segment; the preamble is left out if both do not fit */
+static void writePreamble(caPutLogFile *pfile, size_t len)
+{
+    caPutLogMsg *pre = pfile->preamble(pfile->preambleArg);
+
+    if (pre->len + len <= pfile->size - pfile->used) {
+        memcpy(pfile->map + pfile->used, pre->text, pre->len);
+        pfile->used += pre->len;
+    }
+    caPutLogMsgRelease(pre);
+}
+
+static int fileSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    caPutLogFile *pfile = (caPutLogFile *)ctx;
+    epicsTimeStamp now;
+    unsigned i, dropped = 0;
+
+    epicsTimeGetCurrent(&now);
+    epicsMutexMustLock(pfile->lock);
+    for (i = 0; i < count; i++) {
+        size_t len = pmsgs[i]->len;
+
+        if (len > pfile->size) {
+            dropped++;
+            continue;
+        }
+        if (pfile->map && (pfile->used + len > pfile->size || expired(pfile, &now)))
+            endSegment(pfile, 1);
+        if (!pfile->map && startSegment(pfile)) {
+            dropped++;
+            continue;
+        }
+        if (pfile->fresh && pfile->preamble)
+            writePreamble(pfile, len);
+        pfile->fresh = 0;
+        memcpy(pfile->map + pfile->used, pmsgs[i]->text, len);
+        pfile->used += len;
+        pfile->stats.msgsWritten++;
+        pfile->stats.bytesWritten += len;
+    }
+    pfile->stats.msgsDropped += dropped;
+    if (pfile->syncInterval == 0.0 && pfile->map)
+        syncSegment(pfile);
+    epicsMutexUnlock(pfile->lock);
+    return dropped ? -1 : 0;
+}
+
+static void fileFlush(void *ctx)
+{
+    caPutLogFile *pfile = (caPutLogFile *)ctx;
+
+    epicsMutexMustLock(pfile->lock);
+    if (pfile->map)
+        syncSegment(pfile);
+    epicsMutexUnlock(pfile->lock);
+}
+
+static void fileShow(void *ctx, unsigned level)
+{
+    caPutLogFile *pfile = (caPutLogFile *)ctx;
+    caPutLogFileStats stats;
+
+    caPutLogFileGetStats(pfile, &stats);
+    printf("    segment %lu of %lu bytes used, %u rotations, %lu syncs"
+        " (last %.3f ms, max %.3f ms)\n", (unsigned long)stats.segmentUsed,
+        (unsigned long)stats.segmentSize, stats.rotations, (unsigned long)stats.syncs,
+        stats.lastSync * 1e3, stats.maxSync * 1e3);
+    printf("    wrote %lu messages (%lu bytes), dropped %lu\n",
+        (unsigned long)stats.msgsWritten, (unsigned long)stats.bytesWritten,
+        (unsigned long)stats.msgsDropped);
+}
+
+static void fileDestroy(void *ctx)
+{
+    caPutLogFile *pfile = (caPutLogFile *)ctx;
+
+    epicsMutexMustLock(pfile->lock);
+    pfile->stop = 1;
+    epicsMutexUnlock(pfile->lock);
+    if (pfile->syncInterval > 0.0) {
+        epicsEventSignal(pfile->wakeup);
+        epicsEventMustWait(pfile->done);
+    }
+    if (pfile->map)
+        endSegment(pfile, 0);
+    epicsEventDestroy(pfile->done);
+    epicsEventDestroy(pfile->wakeup);
+    epicsMutexDestroy(pfile->lock);
+    free(pfile);
+}
+
+const caPutLogSinkTransport caPutLogFileTransport = {
+    fileSend, fileFlush, fileShow, fileDestroy
+};
+
+void caPutLogFileSetPreamble(caPutLogFile *pfile, caPutLogSinkPreamble *preamble,
+    void *arg)
+{
+    epicsMutexMustLock(pfile->lock);
+    pfile->preamble = preamble;
+    pfile->preambleArg = arg;
+    epicsMutexUnlock(pfile->lock);
+}
+
+void caPutLogFileGetStats(caPutLogFile *pfile, caPutLogFileStats *pstats)
+{
+    epicsMutexMustLock(pfile->lock);
+    *pstats = pfile->stats;
+    pstats->segmentUsed = pfile->map ? pfile->used : 0;
+    epicsMutexUnlock(pfile->lock);
+}
+
+#endif /* NO_MMAP */
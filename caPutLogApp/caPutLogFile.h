@@ -0,0 +1,73 @@
+#ifndef INCcaPutLogFileh
+#define INCcaPutLogFileh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Append-only journal file, a transport for caPutLogSink.h selected with
+ * a "file://path" address.
+ *
+ * Messages are appended to a segment of caPutLogFileSegmentSize bytes
+ * that is preallocated and mapped into memory. What was appended is
+ * synced to disk every caPutLogFileSyncInterval seconds, one sync for all
+ * batches of that interval. A segment that is full, or was started in an
+ * earlier period of caPutLogFileRotateHours hours, is cut to its used
+ * length and renamed to "path.YYYYmmdd-HHMMSS" (the time it was started),
+ * and a new segment is started at path.
+ *
+ * The active segment is NUL padded up to its full size, readers should
+ * stop at the first NUL (binary streams skip the padding, see
+ * caPutLogBin.h). A segment left behind by an IOC that did not
+ * exit cleanly is cut and renamed the same way at the next start, after
+ * its last NUL free byte, or after its last whole frame if it starts
+ * with a binary MAGIC frame. A
+ * segment that cannot be renamed stays at path untouched; until the rename
+ * succeeds no new segment is started and messages are dropped.
+ *
+ * Not available on targets without mmap() (Windows, vxWorks, RTEMS).
+ */
+
+epicsShareExtern int caPutLogFileSegmentSize;       /* bytes, default 64 MiB */
+epicsShareExtern double caPutLogFileSyncInterval;   /* seconds, default 1.0,
+                                                       0: after every batch,
+                                                       < 0: left to the system */
+epicsShareExtern int caPutLogFileRotateHours;       /* 0: by size only (default) */
+
+typedef struct caPutLogFile caPutLogFile;
+
+epicsShareExtern const caPutLogSinkTransport caPutLogFileTransport;
+
+/* Start a segment at path, NULL on errors (reported) */
+epicsShareFunc caPutLogFile *caPutLogFileCreate(const char *path);
+
+/* Write the preamble's message first in every segment (see
+   caPutLogSink.h); call before the transport is used */
+epicsShareFunc void caPutLogFileSetPreamble(caPutLogFile *pfile,
+    caPutLogSinkPreamble *preamble, void *arg);
+
+typedef struct {
+    size_t      msgsWritten;
+    size_t      bytesWritten;
+    size_t      msgsDropped;    /* larger than a segment or no segment */
+    size_t      syncs;
+    unsigned    rotations;
+    size_t      segmentUsed;    /* of the active segment */
+    size_t      segmentSize;
+    double      lastSync;       /* seconds the last sync took */
+    double      maxSync;
+} caPutLogFileStats;
+
+epicsShareFunc void caPutLogFileGetStats(caPutLogFile *pfile, caPutLogFileStats *pstats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogFileh*/
@@ -0,0 +1,809 @@
+/*	File:	  caPutLogFilter.c
+ *
+ *	PV filter of the access security trap, see caPutLogFilter.h.
+ *
+ *	Every pattern is translated into a Thompson NFA ending in a match
+ *	node for its rule. The NFAs of all rules are turned into one DFA by
+ *	subset construction over classes of bytes no pattern tells apart; a
+ *	state decides for the lowest rule whose match node it contains, so
+ *	one walk over the name finds the first rule that matches.
+ *
+ *	The decision for each field is cached in an open addressing table
+ *	keyed by the record and the field description, which stay the same
+ *	for the life of the IOC. A slot is claimed with a compare and swap and
+ *	published when complete, readers take no lock. Fields that find no
+ *	free slot walk the DFA on every put, which allocates nothing either.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <dbDefs.h>
+#include <dbBase.h>
+#include <dbCommon.h>
+#include <epicsAtomic.h>
+#include <epicsString.h>
+#include <cantProceed.h>
+#include <errlog.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogFilter.h"
+
+#define CACHE_SIZE      8192    /* fields, power of two */
+#define CACHE_PROBES    8
+#define STATE_HASH_SIZE 1024    /* chains of DFA states while compiling */
+
+typedef struct {
+    int         include;
+    char        *pattern;
+    size_t      hits;
+} filterRule;
+
+static filterRule *rules;
+static int nrules;
+static int rulesCap;
+static int haveInclude;
+static size_t defaultHits;
+static int compiled;
+
+/* The DFA; state 0 is dead, state 1 the start */
+static unsigned char byteClass[256];
+static int nclasses;
+static int nstates;
+static epicsUInt16 *trans;      /* nstates rows of nclasses */
+static int *decision;           /* rule per state, nrules for none */
+
+#define SLOT_EMPTY  0
+#define SLOT_BUSY   1
+#define SLOT_VALID  2
+
+typedef struct {
+    int         state;
+    const void  *precord;
+    const void  *pfldDes;
+    int         decision;
+} cacheSlot;
+
+static cacheSlot *cache;
+static int cached;
+
+/*
+ * Thompson NFA: character set nodes, epsilon nodes with up to two
+ * successors and match nodes. A fragment ends in an epsilon node whose
+ * successor is still to be patched.
+ */
+enum { NODE_SET, NODE_EPS, NODE_MATCH };
+
+typedef struct {
+    int         type;
+    int         out, out1;      /* -1: none */
+    int         arg;            /* set index or rule */
+} nfaNode;
+
+typedef struct {
+    unsigned char bits[32];
+} byteSet;
+
+typedef struct {
+    nfaNode     *nodes;
+    int         nnodes, nodesCap;
+    byteSet     *sets;
+    int         nsets, setsCap;
+} nfa;
+
+typedef struct {
+    int         start, end;
+} frag;
+
+typedef struct {
+    nfa         *pnfa;
+    const char  *p;
+    const char  *error;
+} parser;
+
+static int newNode(nfa *pnfa, int type, int out, int out1, int arg)
+{
+    nfaNode *pnode;
+
+    if (pnfa->nnodes == pnfa->nodesCap) {
+        pnfa->nodesCap = pnfa->nodesCap ? 2 * pnfa->nodesCap : 64;
+        pnfa->nodes = realloc(pnfa->nodes, pnfa->nodesCap * sizeof(nfaNode));
+        if (!pnfa->nodes)
+            cantProceed("caPutLogFilter: out of memory\n");
+    }
+    pnode = &pnfa->nodes[pnfa->nnodes];
+    pnode->type = type;
+    pnode->out = out;
+    pnode->out1 = out1;
+    pnode->arg = arg;
+    return pnfa->nnodes++;
+}
+
+static int newSet(nfa *pnfa)
+{
+    if (pnfa->nsets == pnfa->setsCap) {
+        pnfa->setsCap = pnfa->setsCap ? 2 * pnfa->setsCap : 16;
+        pnfa->sets = realloc(pnfa->sets, pnfa->setsCap * sizeof(byteSet));
+        if (!pnfa->sets)
+            cantProceed("caPutLogFilter: out of memory\n");
+    }
+    memset(&pnfa->sets[pnfa->nsets], 0, sizeof(byteSet));
+    return pnfa->nsets++;
+}
+
+static void nfaFree(nfa *pnfa)
+{
+    free(pnfa->nodes);
+    free(pnfa->sets);
+    memset(pnfa, 0, sizeof(nfa));
+}
+
+#define setAdd(pset, c) ((pset)->bits[(c) >> 3] |= 1u << ((c) & 7))
+#define setHas(pset, c) ((pset)->bits[(c) >> 3] & (1u << ((c) & 7)))
+
+static frag fragSet(nfa *pnfa, int set)
+{
+    frag f;
+
+    f.end = newNode(pnfa, NODE_EPS, -1, -1, 0);
+    f.start = newNode(pnfa, NODE_SET, f.end, -1, set);
+    return f;
+}
+
+static frag fragChar(nfa *pnfa, unsigned char c)
+{
+    int set = newSet(pnfa);
+
+    setAdd(&pnfa->sets[set], c);
+    return fragSet(pnfa, set);
+}
+
+static frag fragAny(nfa *pnfa)
+{
+    int set = newSet(pnfa);
+
+    memset(pnfa->sets[set].bits, 0xff, sizeof(pnfa->sets[set].bits));
+    return fragSet(pnfa, set);
+}
+
+static frag fragEmpty(nfa *pnfa)
+{
+    frag f;
+
+    f.start = f.end = newNode(pnfa, NODE_EPS, -1, -1, 0);
+    return f;
+}
+
+static frag fragConcat(nfa *pnfa, frag a, frag b)
+{
+    frag f;
+
+    pnfa->nodes[a.end].out = b.start;
+    f.start = a.start;
+    f.end = b.end;
+    return f;
+}
+
+static frag fragAlt(nfa *pnfa, frag a, frag b)
+{
+    frag f;
+
+    f.end = newNode(pnfa, NODE_EPS, -1, -1, 0);
+    pnfa->nodes[a.end].out = f.end;
+    pnfa->nodes[b.end].out = f.end;
+    f.start = newNode(pnfa, NODE_EPS, a.start, b.start, 0);
+    return f;
+}
+
+/* a*, a+ and a? */
+static frag fragRepeat(nfa *pnfa, frag a, char op)
+{
+    frag f;
+    int split;
+
+    f.end = newNode(pnfa, NODE_EPS, -1, -1, 0);
+    split = newNode(pnfa, NODE_EPS, a.start, f.end, 0);
+    pnfa->nodes[a.end].out = op == '?' ? f.end : split;
+    f.start = op == '+' ? a.start : split;
+    return f;
+}
+
+/* [...] after the opening bracket, ! or ^ negating */
+static void parseSet(parser *pp, int set)
+{
+    byteSet *pset = &pp->pnfa->sets[set];
+    const char *p = pp->p;
+    int negate = 0, first = 1;
+    unsigned lo, hi, i;
+
+    if (*p == '!' || *p == '^') {
+        negate = 1;
+        p++;
+    }
+    while (*p && (*p != ']' || first)) {
+        first = 0;
+        if (*p == '\\' && p[1])
+            p++;
+        lo = hi = (unsigned char)*p++;
+        if (*p == '-' && p[1] && p[1] != ']') {
+            p++;
+            if (*p == '\\' && p[1])
+                p++;
+            hi = (unsigned char)*p++;
+        }
+        if (lo > hi) {
+            pp->error = "reversed range in [...]";
+            return;
+        }
+        for (i = lo; i <= hi; i++)
+            setAdd(pset, i);
+    }
+    if (*p != ']') {
+        pp->error = "missing ]";
+        return;
+    }
+    pp->p = p + 1;
+    if (negate)
+        for (i = 0; i < sizeof(pset->bits); i++)
+            pset->bits[i] = (unsigned char)~pset->bits[i];
+}
+
+static frag parseGlob(parser *pp)
+{
+    nfa *pnfa = pp->pnfa;
+    frag f = fragEmpty(pnfa), a;
+    unsigned char c;
+    int set;
+
+    while (*pp->p && !pp->error) {
+        c = *pp->p++;
+        switch (c) {
+        case '*':
+            a = fragRepeat(pnfa, fragAny(pnfa), '*');
+            break;
+        case '?':
+            a = fragAny(pnfa);
+            break;
+        case '[':
+            set = newSet(pnfa);
+            parseSet(pp, set);
+            a = fragSet(pnfa, set);
+            break;
+        case '\\':
+            if (*pp->p)
+                c = *pp->p++;
+            /* fall through */
+        default:
+            a = fragChar(pnfa, c);
+        }
+        f = fragConcat(pnfa, f, a);
+    }
+    return f;
+}
+
+static frag parseAlt(parser *pp);
+
+static frag parseAtom(parser *pp)
+{
+    nfa *pnfa = pp->pnfa;
+    unsigned char c = *pp->p++;
+    frag f;
+    int set;
+
+    switch (c) {
+    case '(':
+        f = parseAlt(pp);
+        if (*pp->p == ')')
+            pp->p++;
+        else if (!pp->error)
+            pp->error = "missing )";
+        return f;
+    case '.':
+        return fragAny(pnfa);
+    case '[':
+        set = newSet(pnfa);
+        parseSet(pp, set);
+        return fragSet(pnfa, set);
+    case '*':
+    case '+':
+    case '?':
+        pp->error = "*, + or ? without an operand";
+        return fragEmpty(pnfa);
+    case '\\':
+        if (*pp->p)
+            c = *pp->p++;
+        break;
+    }
+    return fragChar(pnfa, c);
+}
+
+static frag parseRepeat(parser *pp)
+{
+    frag f = parseAtom(pp);
+
+    while (*pp->p == '*' || *pp->p == '+' || *pp->p == '?')
+        f = fragRepeat(pp->pnfa, f, *pp->p++);
+    return f;
+}
+
+static frag parseConcat(parser *pp)
+{
+    frag f = fragEmpty(pp->pnfa);
+
+    while (*pp->p && *pp->p != '|' && *pp->p != ')' && !pp->error)
+        f = fragConcat(pp->pnfa, f, parseRepeat(pp));
+    return f;
+}
+
+static frag parseAlt(parser *pp)
+{
+    frag f = parseConcat(pp);
+
+    while (*pp->p == '|' && !pp->error) {
+        pp->p++;
+        f = fragAlt(pp->pnfa, f, parseConcat(pp));
+    }
+    return f;
+}
+
+/*
+ * Add the NFA of a pattern, ending in a match node for the rule; the
+ * start node goes to *pstart. Returns an error message or NULL.
+ */
+static const char *addPattern(nfa *pnfa, const char *pattern, int rule, int *pstart)
+{
+    size_t len = strlen(pattern);
+    char *body = NULL;
+    parser ps;
+    frag f;
+
+    ps.pnfa = pnfa;
+    ps.error = NULL;
+    if (len >= 2 && pattern[0] == '/' && pattern[len - 1] == '/') {
+        /* regular expression, always matched against the whole name */
+        body = mallocMustSucceed(len, "caPutLogFilter");
+        memcpy(body, pattern + 1, len - 2);
+        len -= 2;
+        body[len] = 0;
+        if (len && body[len - 1] == '$' && (len < 2 || body[len - 2] != '\\'))
+            body[--len] = 0;
+        ps.p = body[0] == '^' ? body + 1 : body;
+        f = parseAlt(&ps);
+        if (*ps.p && !ps.error)
+            ps.error = "unbalanced )";
+        free(body);
+    } else {
+        ps.p = pattern;
+        f = parseGlob(&ps);
+        if (!strchr(pattern, '.'))
+            f = fragConcat(pnfa, fragConcat(pnfa, f, fragChar(pnfa, '.')),
+                fragRepeat(pnfa, fragAny(pnfa), '*'));
+    }
+    pnfa->nodes[f.end].out = newNode(pnfa, NODE_MATCH, -1, -1, rule);
+    *pstart = f.start;
+    return ps.error;
+}
+
+/*
+ * Split the bytes into classes that all sets of the NFA either contain
+ * or do not contain as a whole; rep[c] is a byte of class c
+ */
+static void computeClasses(const nfa *pnfa, unsigned char *rep)
+{
+    short map[256][2];
+    int i, b, n = 1;
+
+    memset(byteClass, 0, sizeof(byteClass));
+    for (i = 0; i < pnfa->nsets; i++) {
+        const byteSet *pset = &pnfa->sets[i];
+
+        memset(map, 0xff, sizeof(map));
+        n = 0;
+        for (b = 0; b < 256; b++) {
+            short *pclass = &map[byteClass[b]][setHas(pset, b) ? 1 : 0];
+
+            if (*pclass < 0)
+                *pclass = (short)n++;
+            byteClass[b] = (unsigned char)*pclass;
+        }
+    }
+    nclasses = n;
+    for (b = 255; b >= 0; b--)
+        rep[byteClass[b]] = (unsigned char)b;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+typedef struct {
+    const nfa   *pnfa;
+    int         *mark;          /* generation a node was last visited in */
+    int         gen;
+    int         *stack;
+    int         *items;         /* node lists of all states */
+    size_t      nitems, itemsCap;
+    size_t      *offset;        /* per state */
+    int         *length;
+    int         *next;          /* hash chain */
+    int         head[STATE_HASH_SIZE];
+    int         cap;            /* states allocated */
+} dfaBuilder;
+
+/* Nodes other than epsilon nodes reachable from the seeds, sorted */
+static int closure(dfaBuilder *pb, const int *seeds, int nseeds, int *out)
+{
+    int sp = 0, n = 0, i, id;
+
+    pb->gen++;
+    for (i = 0; i < nseeds; i++)
+        pb->stack[sp++] = seeds[i];
+    while (sp) {
+        const nfaNode *pnode;
+
+        id = pb->stack[--sp];
+        if (id < 0 || pb->mark[id] == pb->gen)
+            continue;
+        pb->mark[id] = pb->gen;
+        pnode = &pb->pnfa->nodes[id];
+        if (pnode->type == NODE_EPS) {
+            pb->stack[sp++] = pnode->out;
+            pb->stack[sp++] = pnode->out1;
+        } else {
+            out[n++] = id;
+        }
+    }
+    qsort(out, n, sizeof(int), compareInt);
+    return n;
+}
+
+/* The state for a list of nodes, created if new; -1 if too many */
+static int intern(dfaBuilder *pb, const int *list, int n)
+{
+    unsigned hash = epicsMemHash((const char *)list, n * sizeof(int), 0) & (STATE_HASH_SIZE - 1);
+    int s, i;
+
+    for (s = pb->head[hash]; s >= 0; s = pb->next[s])
+        if (pb->length[s] == n && memcmp(pb->items + pb->offset[s], list, n * sizeof(int)) == 0)
+            return s;
+    if (nstates == caPutLogFilterMaxStates)
+        return -1;
+
+    if (nstates == pb->cap) {
+        pb->cap = pb->cap ? 2 * pb->cap : 64;
+        pb->offset = realloc(pb->offset, pb->cap * sizeof(size_t));
+        pb->length = realloc(pb->length, pb->cap * sizeof(int));
+        pb->next = realloc(pb->next, pb->cap * sizeof(int));
+        trans = realloc(trans, pb->cap * nclasses * sizeof(epicsUInt16));
+        decision = realloc(decision, pb->cap * sizeof(int));
+        if (!pb->offset || !pb->length || !pb->next || !trans || !decision)
+            cantProceed("caPutLogFilter: out of memory\n");
+    }
+    if (pb->nitems + n > pb->itemsCap) {
+        while (pb->nitems + n > pb->itemsCap)
+            pb->itemsCap = pb->itemsCap ? 2 * pb->itemsCap : 1024;
+        pb->items = realloc(pb->items, pb->itemsCap * sizeof(int));
+        if (!pb->items)
+            cantProceed("caPutLogFilter: out of memory\n");
+    }
+
+    s = nstates++;
+    if (n)
+        memcpy(pb->items + pb->nitems, list, n * sizeof(int));
+    pb->offset[s] = pb->nitems;
+    pb->length[s] = n;
+    pb->nitems += n;
+    pb->next[s] = pb->head[hash];
+    pb->head[hash] = s;
+
+    decision[s] = nrules;
+    for (i = 0; i < n; i++) {
+        const nfaNode *pnode = &pb->pnfa->nodes[list[i]];
+
+        if (pnode->type == NODE_MATCH && pnode->arg < decision[s])
+            decision[s] = pnode->arg;
+    }
+    memset(trans + s * nclasses, 0, nclasses * sizeof(epicsUInt16));
+    return s;
+}
+
+/* Subset construction, starting from the given nodes */
+static int buildDfa(const nfa *pnfa, const int *starts, int nstarts)
+{
+    dfaBuilder b;
+    unsigned char rep[256];
+    int *seeds = mallocMustSucceed((pnfa->nnodes + nstarts) * sizeof(int), "caPutLogFilter");
+    int *list = mallocMustSucceed(pnfa->nnodes * sizeof(int), "caPutLogFilter");
+    int s, c, i, n, nseeds, status = 0;
+
+    memset(&b, 0, sizeof(b));
+    memset(b.head, 0xff, sizeof(b.head));
+    b.pnfa = pnfa;
+    b.mark = callocMustSucceed(pnfa->nnodes, sizeof(int), "caPutLogFilter");
+    b.stack = mallocMustSucceed((3 * pnfa->nnodes + nstarts + 1) * sizeof(int), "caPutLogFilter");
+
+    computeClasses(pnfa, rep);
+    nstates = 0;
+    intern(&b, NULL, 0);
+    n = closure(&b, starts, nstarts, list);
+    intern(&b, list, n);
+
+    for (s = 1; s < nstates; s++) {
+        for (c = 0; c < nclasses; c++) {
+            const int *items = b.items + b.offset[s];
+            int t;
+
+            nseeds = 0;
+            for (i = 0; i < b.length[s]; i++) {
+                const nfaNode *pnode = &pnfa->nodes[items[i]];
+
+                if (pnode->type == NODE_SET && setHas(&pnfa->sets[pnode->arg], rep[c]))
+                    seeds[nseeds++] = pnode->out;
+            }
+            n = closure(&b, seeds, nseeds, list);
+            t = intern(&b, list, n);
+            if (t < 0) {
+                status = -1;
+                goto done;
+            }
+            trans[s * nclasses + c] = (epicsUInt16)t;
+        }
+    }
+
+done:
+    free(b.mark);
+    free(b.stack);
+    free(b.items);
+    free(b.offset);
+    free(b.length);
+    free(b.next);
+    free(seeds);
+    free(list);
+    return status;
+}
+
+static int walk(int state, const char *str)
+{
+    const unsigned char *p = (const unsigned char *)str;
+
+    while (*p && state)
+        state = trans[state * nclasses + byteClass[*p++]];
+    return state;
+}
+
+static int decide(const dbAddr *paddr)
+{
+    int state = walk(1, paddr->precord->name);
+
+    if (state)
+        state = trans[state * nclasses + byteClass['.']];
+    return decision[walk(state, ((const dbFldDes *)paddr->pfldDes)->name)];
+}
+
+static int logged(int d)
+{
+    return d < nrules ? rules[d].include : !haveInclude;
+}
+
+int caPutLogFilterAdd(const char *action, const char *pattern)
+{
+    const char *error;
+    nfa scratch;
+    int include, start;
+
+    if (action && strcmp(action, "include") == 0)
+        include = 1;
+    else if (action && strcmp(action, "exclude") == 0)
+        include = 0;
+    else {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: PV filter action must be \"include\" or \"exclude\", not \"%s\"\n",
+            action ? action : "");
+        return -1;
+    }
+    if (!pattern || !*pattern) {
+        errlogSevPrintf(errlogMinor, "caPutLog: PV filter pattern missing\n");
+        return -1;
+    }
+    if (compiled) {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: PV filter rules must be given before the logger is initialized\n");
+        return -1;
+    }
+
+    memset(&scratch, 0, sizeof(scratch));
+    error = addPattern(&scratch, pattern, 0, &start);
+    nfaFree(&scratch);
+    if (error) {
+        errlogSevPrintf(errlogMinor, "caPutLog: PV filter pattern \"%s\": %s\n",
+            pattern, error);
+        return -1;
+    }
+
+    if (nrules == rulesCap) {
+        rulesCap = rulesCap ? 2 * rulesCap : 8;
+        rules = realloc(rules, rulesCap * sizeof(filterRule));
+        if (!rules)
+            cantProceed("caPutLogFilter: out of memory\n");
+    }
+    rules[nrules].include = include;
+    rules[nrules].pattern = epicsStrDup(pattern);
+    rules[nrules].hits = 0;
+    nrules++;
+    haveInclude |= include;
+    return 0;
+}
+
+int caPutLogFilterLoad(const char *file)
+{
+    char line[256];
+    int lineno = 0, status = 0;
+    FILE *fp;
+
+    if (!file || !*file) {
+        errlogSevPrintf(errlogMinor, "caPutLog: PV filter file name missing\n");
+        return -1;
+    }
+    fp = fopen(file, "r");
+    if (!fp) {
+        errlogSevPrintf(errlogMinor, "caPutLog: cannot open PV filter file %s\n", file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line, *action, *end = line + strlen(line);
+
+        lineno++;
+        while (end > line && isspace((unsigned char)end[-1]))
+            *--end = 0;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p || *p == '#')
+            continue;
+        action = p;
+        while (*p && !isspace((unsigned char)*p))
+            p++;
+        if (*p)
+            *p++ = 0;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p) {
+            errlogSevPrintf(errlogMinor, "caPutLog: %s line %d: PV filter pattern missing\n",
+                file, lineno);
+            status = -1;
+        } else if (caPutLogFilterAdd(action, p)) {
+            errlogSevPrintf(errlogMinor, "caPutLog: in %s line %d\n", file, lineno);
+            status = -1;
+        }
+    }
+    fclose(fp);
+    return status;
+}
+
+int caPutLogFilterCompile(void)
+{
+    nfa all;
+    int *starts;
+    int i;
+
+    if (compiled)
+        return 0;
+    compiled = 1;
+    if (!nrules)
+        return 0;
+
+    memset(&all, 0, sizeof(all));
+    starts = callocMustSucceed(nrules, sizeof(int), "caPutLogFilter");
+    for (i = 0; i < nrules; i++)
+        addPattern(&all, rules[i].pattern, i, &starts[i]);
+    if (buildDfa(&all, starts, nrules)) {
+        errlogSevPrintf(errlogFatal,
+            "caPutLog: PV filter needs more than %d DFA states, use fewer or simpler rules\n",
+            caPutLogFilterMaxStates);
+        free(trans);
+        free(decision);
+        trans = NULL;
+        decision = NULL;
+        nstates = 0;
+    }
+    nfaFree(&all);
+    free(starts);
+    if (!trans)
+        return -1;
+    cache = callocMustSucceed(CACHE_SIZE, sizeof(cacheSlot), "caPutLogFilter");
+    return 0;
+}
+
+int caPutLogFilterPut(const dbAddr *paddr)
+{
+    const void *precord = paddr->precord;
+    const void *pfldDes = paddr->pfldDes;
+    size_t hash;
+    int i, d = -1;
+
+    if (!trans)
+        return 1;
+
+    hash = ((size_t)precord ^ ((size_t)pfldDes << 5)) * 2654435761u;
+    hash ^= hash >> 15;
+    for (i = 0; i < CACHE_PROBES; i++) {
+        cacheSlot *pslot = &cache[(hash + i) & (CACHE_SIZE - 1)];
+        int state = epicsAtomicGetIntT(&pslot->state);
+
+        if (state == SLOT_VALID) {
+            epicsAtomicReadMemoryBarrier();
+            if (pslot->precord == precord && pslot->pfldDes == pfldDes) {
+                d = pslot->decision;
+                break;
+            }
+        } else if (state == SLOT_EMPTY &&
+                epicsAtomicCmpAndSwapIntT(&pslot->state, SLOT_EMPTY, SLOT_BUSY) == SLOT_EMPTY) {
+            d = decide(paddr);
+            pslot->precord = precord;
+            pslot->pfldDes = pfldDes;
+            pslot->decision = d;
+            epicsAtomicWriteMemoryBarrier();
+            epicsAtomicSetIntT(&pslot->state, SLOT_VALID);
+            epicsAtomicIncrIntT(&cached);
+            break;
+        }
+    }
+    if (d < 0)
+        d = decide(paddr);
+    epicsAtomicIncrSizeT(d < nrules ? &rules[d].hits : &defaultHits);
+    return logged(d);
+}
+
+int caPutLogFilterMatch(const char *name)
+{
+    if (!trans)
+        return 1;
+    return logged(decision[walk(1, name)]);
+}
+
+size_t caPutLogFilterHits(int n)
+{
+    if (n < 0)
+        return epicsAtomicGetSizeT(&defaultHits);
+    return n < nrules ? epicsAtomicGetSizeT(&rules[n].hits) : 0;
+}
+
+int caPutLogFilterCount(void)
+{
+    return nrules;
+}
+
+void caPutLogFilterShow(const char *name)
+{
+    int i;
+
+    if (!nrules)
+        return;
+    printf("%s PV filter: %d rules, %d DFA states, %d fields cached\n", name,
+        nrules, nstates, epicsAtomicGetIntT(&cached));
+    for (i = 0; i < nrules; i++)
+        printf("%s   %s %s: %lu puts\n", name, rules[i].include ? "include" : "exclude",
+            rules[i].pattern, (unsigned long)caPutLogFilterHits(i));
+    printf("%s   no rule matched (%s): %lu puts\n", name,
+        haveInclude ? "not logged" : "logged", (unsigned long)caPutLogFilterHits(-1));
+}
+
+void caPutLogFilterClear(void)
+{
+    int i;
+
+    for (i = 0; i < nrules; i++)
+        free(rules[i].pattern);
+    free(rules);
+    free(trans);
+    free(decision);
+    free(cache);
+    rules = NULL;
+    trans = NULL;
+    decision = NULL;
+    cache = NULL;
+    nrules = rulesCap = haveInclude = compiled = nstates = nclasses = cached = 0;
+    defaultHits = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef INCcaPutLogFilterh
+#define INCcaPutLogFilterh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+#include <dbAddr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PV filter: include and exclude rules that decide in the access
+ * security trap, before anything is allocated or read, whether a put is
+ * logged. A rule's pattern is matched against the whole "record.FIELD"
+ * name of the channel:
+ *
+ *   glob       * any string, ? any character, [a-z] and [!a-z] sets,
+ *              \ quotes the next character. A glob without a dot matches
+ *              all fields of the records it matches.
+ *   /regex/    an extended regular expression between slashes: | * + ?
+ *              ( ) . [ ] and \ quoting; ^ and $ are implied.
+ *
+ * The first rule that matches decides; when none does, a put is logged
+ * unless there are include rules. The rules are compiled into one DFA
+ * when the trap is installed and cannot be changed afterwards.
+ */
+
+#define caPutLogFilterMaxStates 4096    /* of the compiled DFA */
+
+/* action is "include" or "exclude"; -1 if a pattern is invalid */
+epicsShareFunc int caPutLogFilterAdd(const char *action, const char *pattern);
+/*
+ * Rules from a file, one "include pattern" or "exclude pattern" per line;
+ * empty lines and lines starting with # are skipped.
+ */
+epicsShareFunc int caPutLogFilterLoad(const char *file);
+
+/* Called by caPutLogAsInit(); -1 if the DFA gets too large */
+epicsShareFunc int caPutLogFilterCompile(void);
+
+/*
+ * Whether to log a put to the field, decided once per field and then
+ * looked up without a lock. Counts the hit of the deciding rule.
+ */
+epicsShareFunc int caPutLogFilterPut(const dbAddr *paddr);
+
+/* The decision for a name ("record.FIELD"), not cached nor counted */
+epicsShareFunc int caPutLogFilterMatch(const char *name);
+
+/* Puts decided by rule n (counting from 0), by no rule for n = -1 */
+epicsShareFunc size_t caPutLogFilterHits(int n);
+epicsShareFunc int caPutLogFilterCount(void);
+epicsShareFunc void caPutLogFilterShow(const char *name);
+
+/* Drop all rules and the DFA, for tests only */
+epicsShareFunc void caPutLogFilterClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogFilterh*/
@@ -0,0 +1,248 @@
+/*	File:	  caPutLogHistory.c
+ *
+ *	Rolling history transport, see caPutLogHistory.h.
+ *
+ *	buf[start..end) is what the text PV gets, the lines separated by
+ *	newlines; lens is a ring of the lengths of these lines, oldest at
+ *	first. buf has room for two PVs worth of text, so the live part is
+ *	moved back to the start at most once per room characters added.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
+#include <dbDefs.h>
+#include <dbFldTypes.h>
+#include <dbAccess.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogHistory.h"
+
+#define MAX_SIZE 100000
+
+double caPutLogHistoryMaxRate = 0.0;
+epicsExportAddress(double, caPutLogHistoryMaxRate);
+
+struct caPutLogHistory {
+    epicsMutexId    lock;
+    DBADDR          text;
+    DBADDR          seq;
+    int             hasSeq;
+    size_t          room;           /* characters per update */
+    char            *buf;           /* 2 * room + 1 */
+    size_t          start, end;
+    size_t          *lens;          /* of the lines, a ring */
+    unsigned        size;
+    unsigned        first;
+    unsigned        count;
+    epicsUInt32     added;          /* messages added, wraps around */
+    int             changed;        /* since the last update */
+    epicsTimeStamp  last;           /* of the last update */
+    int             failing;        /* last update failed, reported */
+    caPutLogHistoryStats stats;
+    char            name[1];
+};
+
+caPutLogHistory *caPutLogHistoryCreate(const char *textName, const char *seqName,
+    unsigned size)
+{
+    caPutLogHistory *phist = callocMustSucceed(1, sizeof(caPutLogHistory) +
+        strlen(textName), "caPutLogHistoryCreate");
+
+    strcpy(phist->name, textName);
+    if (dbNameToAddr(textName, &phist->text)) {
+        errlogSevPrintf(errlogMajor, "caPutLog: history PV %s not found\n", textName);
+        free(phist);
+        return NULL;
+    }
+    if ((phist->text.field_type != DBF_CHAR && phist->text.field_type != DBF_UCHAR)
+            || phist->text.no_elements < 2) {
+        errlogSevPrintf(errlogMajor, "caPutLog: history PV %s is not a char array\n",
+            textName);
+        free(phist);
+        return NULL;
+    }
+    if (seqName && seqName[0]) {
+        if (dbNameToAddr(seqName, &phist->seq)) {
+            errlogSevPrintf(errlogMajor, "caPutLog: history sequence PV %s not found\n",
+                seqName);
+            free(phist);
+            return NULL;
+        }
+        phist->hasSeq = 1;
+    }
+    phist->size = size < 1 ? 1 : size > MAX_SIZE ? MAX_SIZE : size;
+    phist->room = (size_t)phist->text.no_elements - 1;
+    phist->buf = mallocMustSucceed(2 * phist->room + 1, "caPutLogHistoryCreate");
+    phist->lens = callocMustSucceed(phist->size, sizeof(size_t), "caPutLogHistoryCreate");
+    phist->stats.size = phist->size;
+    phist->stats.room = phist->room;
+    phist->lock = epicsMutexMustCreate();
+    return phist;
+}
+
+static void dropOldest(caPutLogHistory *phist)
+{
+    size_t len = phist->lens[phist->first];
+
+    /* with its separator, unless it is the only line */
+    phist->start += phist->count > 1 ? len + 1 : len;
+    phist->first = (phist->first + 1) % phist->size;
+    phist->count--;
+}
+
+static void add(caPutLogHistory *phist, const caPutLogMsg *pmsg)
+{
+    size_t len = pmsg->len;
+
+    if (len && pmsg->text[len - 1] == '\n')
+        len--;
+    if (len > phist->room)
+        len = phist->room;
+    while (phist->count &&
+            (phist->count == phist->size || phist->end - phist->start + 1 + len > phist->room))
+        dropOldest(phist);
+    if (!phist->count)
+        phist->start = phist->end = 0;
+    else if (phist->end + 1 + len > 2 * phist->room) {
+        memmove(phist->buf, phist->buf + phist->start, phist->end - phist->start);
+        phist->end -= phist->start;
+        phist->start = 0;
+    }
+    if (phist->count)
+        phist->buf[phist->end++] = '\n';
+    memcpy(phist->buf + phist->end, pmsg->text, len);
+    phist->end += len;
+    phist->lens[(phist->first + phist->count) % phist->size] = len;
+    phist->count++;
+    phist->added++;
+    phist->changed = 1;
+}
+
+/* Seconds until the next update may be written */
+static double untilDue(caPutLogHistory *phist, epicsTimeStamp *pnow)
+{
+    double rate = caPutLogHistoryMaxRate;
+
+    epicsTimeGetCurrent(pnow);
+    if (rate <= 0.0 || !phist->stats.updates)
+        return 0.0;
+    return 1.0 / rate - epicsTimeDiffInSeconds(pnow, &phist->last);
+}
+
+static void publish(caPutLogHistory *phist, const epicsTimeStamp *pnow)
+{
+    epicsInt32 seq = (epicsInt32)phist->added;
+    long status;
+
+    phist->buf[phist->end] = 0;
+    status = dbPutField(&phist->text, DBR_CHAR, phist->buf + phist->start,
+        phist->end - phist->start + 1);
+    if (!status && phist->hasSeq)
+        status = dbPutField(&phist->seq, DBR_LONG, &seq, 1);
+
+    phist->last = *pnow;
+    phist->changed = 0;
+    phist->stats.updates++;
+    if (status) {
+        phist->stats.failed++;
+        if (!phist->failing)
+            errlogSevPrintf(errlogMajor,
+                "caPutLog: dbPutField to history PV %s failed, status = %ld\n",
+                phist->name, status);
+    }
+    phist->failing = status != 0;
+}
+
+static int historySend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    caPutLogHistory *phist = (caPutLogHistory *)ctx;
+    epicsTimeStamp now;
+    unsigned i;
+
+    epicsMutexMustLock(phist->lock);
+    for (i = 0; i < count; i++)
+        add(phist, pmsgs[i]);
+    if (untilDue(phist, &now) <= 0.0)
+        publish(phist, &now);
+    epicsMutexUnlock(phist->lock);
+    return 0;
+}
+
+static double historyIdle(void *ctx)
+{
+    caPutLogHistory *phist = (caPutLogHistory *)ctx;
+    epicsTimeStamp now;
+    double wait = 0.0;
+
+    epicsMutexMustLock(phist->lock);
+    if (phist->changed) {
+        wait = untilDue(phist, &now);
+        if (wait <= 0.0) {
+            publish(phist, &now);
+            wait = 0.0;
+        }
+    }
+    epicsMutexUnlock(phist->lock);
+    return wait;
+}
+
+static void historyFlush(void *ctx)
+{
+    caPutLogHistory *phist = (caPutLogHistory *)ctx;
+    epicsTimeStamp now;
+
+    epicsMutexMustLock(phist->lock);
+    if (phist->changed) {
+        epicsTimeGetCurrent(&now);
+        publish(phist, &now);
+    }
+    epicsMutexUnlock(phist->lock);
+}
+
+static void historyShow(void *ctx, unsigned level)
+{
+    caPutLogHistory *phist = (caPutLogHistory *)ctx;
+    caPutLogHistoryStats stats;
+
+    caPutLogHistoryGetStats(phist, &stats);
+    printf("    history of %u messages (up to %u), %lu of %lu characters, %lu added\n",
+        stats.msgs, stats.size, (unsigned long)stats.chars, (unsigned long)stats.room,
+        stats.seq);
+    printf("    %lu updates (%lu failed)", (unsigned long)stats.updates,
+        (unsigned long)stats.failed);
+    if (caPutLogHistoryMaxRate > 0.0)
+        printf(", up to %g/s", caPutLogHistoryMaxRate);
+    printf("\n");
+}
+
+static void historyDestroy(void *ctx)
+{
+    caPutLogHistory *phist = (caPutLogHistory *)ctx;
+
+    epicsMutexDestroy(phist->lock);
+    free(phist->lens);
+    free(phist->buf);
+    free(phist);
+}
+
+const caPutLogSinkTransport caPutLogHistoryTransport = {
+    historySend, historyFlush, historyShow, historyDestroy, historyIdle
+};
+
+void caPutLogHistoryGetStats(caPutLogHistory *phist, caPutLogHistoryStats *pstats)
+{
+    epicsMutexMustLock(phist->lock);
+    *pstats = phist->stats;
+    pstats->msgs = phist->count;
+    pstats->chars = phist->end - phist->start;
+    pstats->seq = phist->added;
+    epicsMutexUnlock(phist->lock);
+}
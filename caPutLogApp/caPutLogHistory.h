@@ -0,0 +1,62 @@
+#ifndef INCcaPutLogHistoryh
+#define INCcaPutLogHistoryh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Rolling history of the last messages, a transport for caPutLogSink.h
+ * next to the log PV (caPutLogPv.h).
+ *
+ * The last size messages are kept, oldest first and one per line, in a
+ * char array PV (a waveform of CHAR or UCHAR, or a long string "name.$"),
+ * as many as fit into it. An optional second PV gets the number of
+ * messages added so far, written after the text, so a client can fetch
+ * the history with one get and tell from the number which lines it has
+ * not seen yet.
+ *
+ * Adding a message costs its length: the lines are kept contiguous in a
+ * buffer of twice the PV's size, old ones are dropped by moving the start
+ * and the text is moved back to the beginning only when the end of the
+ * buffer is reached. The PV is written once per batch, and at most
+ * caPutLogHistoryMaxRate times per second.
+ */
+
+epicsShareExtern double caPutLogHistoryMaxRate;     /* updates per second,
+                                                       0: no limit */
+
+#define caPutLogHistoryDefaultSize 100     /* messages */
+
+typedef struct caPutLogHistory caPutLogHistory;
+
+epicsShareExtern const caPutLogSinkTransport caPutLogHistoryTransport;
+
+/* seqName may be NULL; NULL if a PV does not exist or textName is not
+   a char array (reported) */
+epicsShareFunc caPutLogHistory *caPutLogHistoryCreate(const char *textName,
+    const char *seqName, unsigned size);
+
+typedef struct {
+    unsigned    msgs;           /* in the history now */
+    unsigned    size;           /* most messages kept */
+    size_t      chars;          /* taken by them */
+    size_t      room;           /* characters of the PV, without the NUL */
+    unsigned long seq;          /* messages added so far */
+    size_t      updates;
+    size_t      failed;
+} caPutLogHistoryStats;
+
+epicsShareFunc void caPutLogHistoryGetStats(caPutLogHistory *phist,
+    caPutLogHistoryStats *pstats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogHistoryh*/
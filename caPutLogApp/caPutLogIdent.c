@@ -0,0 +1,278 @@
+/*	File:	  caPutLogIdent.c
+ *
+ *	Table of client identities (user and host name), shared by all
+ *	LOGDATA of the same client. The access security trap looks the
+ *	client up once per put instead of copying both strings, and the
+ *	loggers write the prepared fragments instead of formatting and
+ *	escaping the strings for every message.
+ *
+ *	Lookups walk the hash chains without a lock: entries are published
+ *	with atomic pointer stores, and a reference is taken with a compare
+ *	and swap that fails on an entry being reclaimed. Only insertions
+ *	and the reclaiming are done under a mutex. References are dropped
+ *	without it; an entry whose count has dropped to zero stays in the
+ *	table (the client usually comes back) until the table grows beyond
+ *	IDENT_LIMIT entries, then unreferenced entries are unlinked. Each
+ *	chain counts the lookups walking it, and an unlinked entry is only
+ *	freed once its chain has been seen without any.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsString.h>
+#include <errlog.h>
+#include <yajl_gen.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogTask.h"
+#include "caPutLogIdent.h"
+
+#define HASH_SIZE   256         /* number of hash chains, power of two */
+#define IDENT_LIMIT 1024        /* entries kept before reclaiming */
+
+#define DEAD        -1          /* refcount of an unlinked entry */
+
+typedef struct {
+    caPutLogIdent   *head;
+    int             readers;    /* lookups walking the chain */
+} identChain;
+
+static identChain identTable[HASH_SIZE];
+static caPutLogIdent *identRetired; /* unlinked, not yet freed */
+static unsigned identCount;
+static epicsMutexId identLock;
+static epicsThreadOnceId identOnce = EPICS_THREAD_ONCE_INIT;
+
+static void identInit(void *arg)
+{
+    identLock = epicsMutexMustCreate();
+}
+
+static size_t strLength(const char *str, size_t maxlen)
+{
+    size_t len = 0;
+
+    while (len < maxlen && str[len])
+        len++;
+    return len;
+}
+
+/*
+ * Quote and escape a string with yajl, so that the fragment is exactly
+ * what the JSON logger would have generated for it
+ */
+static yajl_gen jsonQuote(const char *str, size_t len,
+    const unsigned char **pbuf, size_t *plen)
+{
+    yajl_gen handle = yajl_gen_alloc(
+#ifndef EPICS_YAJL_VERSION
+        NULL,
+#endif
+        NULL);
+#ifdef EPICS_YAJL_VERSION
+    size_t
+#else
+    unsigned int
+#endif
+        buflen = 0;
+
+    if (handle == NULL)
+        return NULL;
+    if (yajl_gen_string(handle, (const unsigned char *)str, len) != yajl_gen_status_ok ||
+        yajl_gen_get_buf(handle, pbuf, &buflen) != yajl_gen_status_ok) {
+        yajl_gen_free(handle);
+        return NULL;
+    }
+    *plen = buflen;
+    return handle;
+}
+
+static char *append(char **pdst, const char *src, size_t len)
+{
+    char *start = *pdst;
+
+    memcpy(start, src, len);
+    start[len] = 0;
+    *pdst += len + 1;
+    return start;
+}
+
+static caPutLogIdent *identCreate(const char *userid, size_t userlen,
+    const char *hostid, size_t hostlen, unsigned hash)
+{
+    caPutLogIdent *pident = NULL;
+    const unsigned char *juser, *jhost;
+    size_t juserlen, jhostlen;
+    yajl_gen huser, hhost = NULL;
+    char *pstr;
+
+    huser = jsonQuote(userid, userlen, &juser, &juserlen);
+    if (huser)
+        hhost = jsonQuote(hostid, hostlen, &jhost, &jhostlen);
+    if (hhost)
+        pident = malloc(sizeof(caPutLogIdent) + 2 * (userlen + hostlen) +
+            juserlen + jhostlen + 6);
+
+    if (pident) {
+        pstr = (char *)(pident + 1);
+        pident->next = NULL;
+        pident->retired = NULL;
+        pident->hash = hash;
+        pident->refcount = 0;
+        pident->userid = append(&pstr, userid, userlen);
+        pident->hostid = append(&pstr, hostid, hostlen);
+        pident->json_user = append(&pstr, (const char *)juser, juserlen);
+        pident->json_user_len = juserlen;
+        pident->json_host = append(&pstr, (const char *)jhost, jhostlen);
+        pident->json_host_len = jhostlen;
+        pident->text = pstr;
+        memcpy(pstr, hostid, hostlen);
+        pstr[hostlen] = ' ';
+        pstr += hostlen + 1;
+        append(&pstr, userid, userlen);
+        pident->text_len = hostlen + 1 + userlen;
+    }
+    if (hhost) yajl_gen_free(hhost);
+    if (huser) yajl_gen_free(huser);
+    return pident;
+}
+
+#define chainOf(hash) (&identTable[(hash) & (HASH_SIZE - 1)])
+
+/*
+ * Free the unlinked entries whose chain no lookup is walking; lookups
+ * starting later cannot reach them any more. Called with identLock held.
+ */
+static void identFreeRetired(void)
+{
+    caPutLogIdent **pprev = &identRetired;
+
+    while (*pprev) {
+        caPutLogIdent *pident = *pprev;
+
+        /* a read-modify-write, so it is ordered after the unlinking */
+        if (epicsAtomicAddIntT(&chainOf(pident->hash)->readers, 0) == 0) {
+            *pprev = pident->retired;
+            free(pident);
+        } else {
+            pprev = &pident->retired;
+        }
+    }
+}
+
+/* Unlink all unreferenced entries; called with identLock held */
+static void identReclaim(void)
+{
+    unsigned i;
+
+    for (i = 0; i < HASH_SIZE; i++) {
+        caPutLogIdent **pprev = &identTable[i].head;
+
+        while (*pprev) {
+            caPutLogIdent *pident = *pprev;
+
+            /* a lookup may still be walking past it, so its next
+               pointer stays valid until it is freed */
+            if (epicsAtomicCmpAndSwapIntT(&pident->refcount, 0, DEAD) == 0) {
+                epicsAtomicSetPtrT((EpicsAtomicPtrT *)pprev, pident->next);
+                pident->retired = identRetired;
+                identRetired = pident;
+                identCount--;
+            } else {
+                pprev = &pident->next;
+            }
+        }
+    }
+    identFreeRetired();
+}
+
+/* Take a reference unless the entry is being reclaimed */
+static int identRef(caPutLogIdent *pident)
+{
+    int count = epicsAtomicGetIntT(&pident->refcount);
+
+    while (count != DEAD) {
+        int prev = epicsAtomicCmpAndSwapIntT(&pident->refcount, count, count + 1);
+
+        if (prev == count)
+            return 1;
+        count = prev;
+    }
+    return 0;
+}
+
+static caPutLogIdent *identFind(identChain *pchain, unsigned hash,
+    const char *userid, size_t userlen, const char *hostid, size_t hostlen)
+{
+    caPutLogIdent *pident;
+
+    for (pident = epicsAtomicGetPtrT((EpicsAtomicPtrT *)&pchain->head); pident;
+         pident = epicsAtomicGetPtrT((EpicsAtomicPtrT *)&pident->next)) {
+        if (pident->hash == hash &&
+            strncmp(pident->userid, userid, userlen) == 0 && !pident->userid[userlen] &&
+            strncmp(pident->hostid, hostid, hostlen) == 0 && !pident->hostid[hostlen] &&
+            identRef(pident))
+            return pident;
+    }
+    return NULL;
+}
+
+caPutLogIdent *caPutLogIdentGet(const char *userid, const char *hostid)
+{
+    size_t userlen = strLength(userid, MAX_USERID_SIZE - 1);
+    size_t hostlen = strLength(hostid, MAX_HOSTID_SIZE - 1);
+    unsigned hash = epicsMemHash(hostid, hostlen, epicsMemHash(userid, userlen, 0));
+    identChain *pchain = chainOf(hash);
+    caPutLogIdent *pident;
+
+    epicsAtomicIncrIntT(&pchain->readers);
+    pident = identFind(pchain, hash, userid, userlen, hostid, hostlen);
+    epicsAtomicDecrIntT(&pchain->readers);
+    if (pident)
+        return pident;
+
+    epicsThreadOnce(&identOnce, identInit, NULL);
+    epicsMutexMustLock(identLock);
+
+    /* another thread may have inserted it meanwhile */
+    pident = identFind(pchain, hash, userid, userlen, hostid, hostlen);
+    if (pident) {
+        epicsMutexUnlock(identLock);
+        return pident;
+    }
+
+    if (identCount >= IDENT_LIMIT)
+        identReclaim();
+
+    pident = identCreate(userid, userlen, hostid, hostlen, hash);
+    if (pident) {
+        pident->refcount = 1;
+        pident->next = pchain->head;
+        epicsAtomicSetPtrT((EpicsAtomicPtrT *)&pchain->head, pident);
+        identCount++;
+    } else {
+        errlogSevPrintf(errlogMajor, "caPutLog: out of memory for client identity\n");
+    }
+    epicsMutexUnlock(identLock);
+    return pident;
+}
+
+void caPutLogIdentRelease(caPutLogIdent *pident)
+{
+    epicsAtomicDecrIntT(&pident->refcount);
+}
+
+unsigned caPutLogIdentCount(void)
+{
+    unsigned count;
+
+    epicsThreadOnce(&identOnce, identInit, NULL);
+    epicsMutexMustLock(identLock);
+    count = identCount;
+    epicsMutexUnlock(identLock);
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef INCcaPutLogIdenth
+#define INCcaPutLogIdenth 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Interned client identity: one shared, reference counted entry per
+ * (userid, hostid) pair, holding the strings in the forms the loggers
+ * write them. Entries are immutable once created.
+ */
+typedef struct caPutLogIdent {
+    struct caPutLogIdent *next;     /* hash chain, private */
+    struct caPutLogIdent *retired;  /* unlinked, waiting to be freed, private */
+    unsigned        hash;           /* private */
+    int             refcount;       /* private */
+    const char      *userid;
+    const char      *hostid;
+    const char      *json_user;     /* quoted and escaped like yajl_gen_string */
+    const char      *json_host;
+    const char      *text;          /* "hostid userid" */
+    size_t          json_user_len;
+    size_t          json_host_len;
+    size_t          text_len;
+} caPutLogIdent;
+
+/*
+ * Look up (or create) the entry for a client and take a reference to it.
+ * The strings are truncated to MAX_USERID_SIZE-1 resp. MAX_HOSTID_SIZE-1
+ * characters. Returns NULL if memory is exhausted.
+ */
+epicsShareFunc caPutLogIdent *caPutLogIdentGet(const char *userid, const char *hostid);
+
+/* Drop a reference; unreferenced entries are reclaimed later */
+epicsShareFunc void caPutLogIdentRelease(caPutLogIdent *pident);
+
+epicsShareFunc unsigned caPutLogIdentCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogIdenth*/
@@ -0,0 +1,520 @@
+/*	File:	  caPutLogNum.c
+ *
+ *	Number to text conversion for the loggers.
+ *
+ *	Floating point values are converted with Grisu2 (F. Loitsch, "Printing
+ *	Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010):
+ *	the value and its rounding boundaries are scaled by a cached power of
+ *	ten so that the digits can be generated with 64-bit integer arithmetic.
+ *	The result always reads back as the same value and is the shortest
+ *	such digit string in almost all cases.
+ */
+
+#include <string.h>
+
+#include <epicsMath.h>
+#include <dbFldTypes.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogNum.h"
+
+static const char *numFmtNames[] = {"printf", "shortest"};
+
+int caPutLogNumFmtFromName(const char *name)
+{
+    int i;
+
+    for (i = 0; name && i < (int)(sizeof(numFmtNames) / sizeof(numFmtNames[0])); i++) {
+        if (strcmp(name, numFmtNames[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *caPutLogNumFmtName(int fmt)
+{
+    if (fmt < 0 || fmt >= (int)(sizeof(numFmtNames) / sizeof(numFmtNames[0])))
+        return "unknown";
+    return numFmtNames[fmt];
+}
+
+/*
+ * Integers: digits are produced from the end of a scratch buffer, with
+ * 32-bit divisions where the value allows it
+ */
+
+#define DIGITS_MAX 20
+
+static int copyDigits(char *buf, const char *p, const char *end)
+{
+    int len = (int)(end - p);
+
+    memcpy(buf, p, len);
+    buf[len] = 0;
+    return len;
+}
+
+static char *digits32(char *end, epicsUInt32 v)
+{
+    do {
+        *--end = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    return end;
+}
+
+static char *digits64(char *end, epicsUInt64 v)
+{
+    while (v > 0xffffffffu) {
+        *--end = (char)('0' + (int)(v % 10));
+        v /= 10;
+    }
+    return digits32(end, (epicsUInt32)v);
+}
+
+int caPutLogFormatUInt32(char *buf, epicsUInt32 value)
+{
+    char tmp[DIGITS_MAX];
+    char *end = tmp + sizeof(tmp);
+
+    return copyDigits(buf, digits32(end, value), end);
+}
+
+int caPutLogFormatInt32(char *buf, epicsInt32 value)
+{
+    if (value < 0) {
+        *buf = '-';
+        return 1 + caPutLogFormatUInt32(buf + 1, 0u - (epicsUInt32)value);
+    }
+    return caPutLogFormatUInt32(buf, (epicsUInt32)value);
+}
+
+int caPutLogFormatUInt64(char *buf, epicsUInt64 value)
+{
+    char tmp[DIGITS_MAX];
+    char *end = tmp + sizeof(tmp);
+
+    return copyDigits(buf, digits64(end, value), end);
+}
+
+int caPutLogFormatInt64(char *buf, epicsInt64 value)
+{
+    if (value < 0) {
+        *buf = '-';
+        return 1 + caPutLogFormatUInt64(buf + 1, (epicsUInt64)0 - (epicsUInt64)value);
+    }
+    return caPutLogFormatUInt64(buf, (epicsUInt64)value);
+}
+
+/*
+ * Grisu2
+ */
+
+#define U64(hi, lo) (((epicsUInt64)(hi) << 32) | (epicsUInt64)(lo))
+
+/* Floating point number f * 2^e with a 64-bit significand */
+typedef struct {
+    epicsUInt64 f;
+    int e;
+} diyFp;
+
+/* Target range of the binary exponent after scaling */
+#define ALPHA (-60)
+#define GAMMA (-32)
+
+/* Normalized powers of ten 10^k for k = -300, -292, ..., 324 */
+#define CACHED_MIN_DEC_EXP (-300)
+#define CACHED_DEC_STEP 8
+
+static const struct {
+    epicsUInt64 f;
+    int e;
+    int k;
+} cachedPowers[] = {
+    { U64(0xAB70FE17, 0xC79AC6CA), -1060, -300 },
+    { U64(0xFF77B1FC, 0xBEBCDC4F), -1034, -292 },
+    { U64(0xBE5691EF, 0x416BD60C), -1007, -284 },
+    { U64(0x8DD01FAD, 0x907FFC3C),  -980, -276 },
+    { U64(0xD3515C28, 0x31559A83),  -954, -268 },
+    { U64(0x9D71AC8F, 0xADA6C9B5),  -927, -260 },
+    { U64(0xEA9C2277, 0x23EE8BCB),  -901, -252 },
+    { U64(0xAECC4991, 0x4078536D),  -874, -244 },
+    { U64(0x823C1279, 0x5DB6CE57),  -847, -236 },
+    { U64(0xC2109436, 0x4DFB5637),  -821, -228 },
+    { U64(0x9096EA6F, 0x3848984F),  -794, -220 },
+    { U64(0xD77485CB, 0x25823AC7),  -768, -212 },
+    { U64(0xA086CFCD, 0x97BF97F4),  -741, -204 },
+    { U64(0xEF340A98, 0x172AACE5),  -715, -196 },
+    { U64(0xB23867FB, 0x2A35B28E),  -688, -188 },
+    { U64(0x84C8D4DF, 0xD2C63F3B),  -661, -180 },
+    { U64(0xC5DD4427, 0x1AD3CDBA),  -635, -172 },
+    { U64(0x936B9FCE, 0xBB25C996),  -608, -164 },
+    { U64(0xDBAC6C24, 0x7D62A584),  -582, -156 },
+    { U64(0xA3AB6658, 0x0D5FDAF6),  -555, -148 },
+    { U64(0xF3E2F893, 0xDEC3F126),  -529, -140 },
+    { U64(0xB5B5ADA8, 0xAAFF80B8),  -502, -132 },
+    { U64(0x87625F05, 0x6C7C4A8B),  -475, -124 },
+    { U64(0xC9BCFF60, 0x34C13053),  -449, -116 },
+    { U64(0x964E858C, 0x91BA2655),  -422, -108 },
+    { U64(0xDFF97724, 0x70297EBD),  -396, -100 },
+    { U64(0xA6DFBD9F, 0xB8E5B88F),  -369,  -92 },
+    { U64(0xF8A95FCF, 0x88747D94),  -343,  -84 },
+    { U64(0xB9447093, 0x8FA89BCF),  -316,  -76 },
+    { U64(0x8A08F0F8, 0xBF0F156B),  -289,  -68 },
+    { U64(0xCDB02555, 0x653131B6),  -263,  -60 },
+    { U64(0x993FE2C6, 0xD07B7FAC),  -236,  -52 },
+    { U64(0xE45C10C4, 0x2A2B3B06),  -210,  -44 },
+    { U64(0xAA242499, 0x697392D3),  -183,  -36 },
+    { U64(0xFD87B5F2, 0x8300CA0E),  -157,  -28 },
+    { U64(0xBCE50864, 0x92111AEB),  -130,  -20 },
+    { U64(0x8CBCCC09, 0x6F5088CC),  -103,  -12 },
+    { U64(0xD1B71758, 0xE219652C),   -77,   -4 },
+    { U64(0x9C400000, 0x00000000),   -50,    4 },
+    { U64(0xE8D4A510, 0x00000000),   -24,   12 },
+    { U64(0xAD78EBC5, 0xAC620000),     3,   20 },
+    { U64(0x813F3978, 0xF8940984),    30,   28 },
+    { U64(0xC097CE7B, 0xC90715B3),    56,   36 },
+    { U64(0x8F7E32CE, 0x7BEA5C70),    83,   44 },
+    { U64(0xD5D238A4, 0xABE98068),   109,   52 },
+    { U64(0x9F4F2726, 0x179A2245),   136,   60 },
+    { U64(0xED63A231, 0xD4C4FB27),   162,   68 },
+    { U64(0xB0DE6538, 0x8CC8ADA8),   189,   76 },
+    { U64(0x83C7088E, 0x1AAB65DB),   216,   84 },
+    { U64(0xC45D1DF9, 0x42711D9A),   242,   92 },
+    { U64(0x924D692C, 0xA61BE758),   269,  100 },
+    { U64(0xDA01EE64, 0x1A708DEA),   295,  108 },
+    { U64(0xA26DA399, 0x9AEF774A),   322,  116 },
+    { U64(0xF209787B, 0xB47D6B85),   348,  124 },
+    { U64(0xB454E4A1, 0x79DD1877),   375,  132 },
+    { U64(0x865B8692, 0x5B9BC5C2),   402,  140 },
+    { U64(0xC83553C5, 0xC8965D3D),   428,  148 },
+    { U64(0x952AB45C, 0xFA97A0B3),   455,  156 },
+    { U64(0xDE469FBD, 0x99A05FE3),   481,  164 },
+    { U64(0xA59BC234, 0xDB398C25),   508,  172 },
+    { U64(0xF6C69A72, 0xA3989F5C),   534,  180 },
+    { U64(0xB7DCBF53, 0x54E9BECE),   561,  188 },
+    { U64(0x88FCF317, 0xF22241E2),   588,  196 },
+    { U64(0xCC20CE9B, 0xD35C78A5),   614,  204 },
+    { U64(0x98165AF3, 0x7B2153DF),   641,  212 },
+    { U64(0xE2A0B5DC, 0x971F303A),   667,  220 },
+    { U64(0xA8D9D153, 0x5CE3B396),   694,  228 },
+    { U64(0xFB9B7CD9, 0xA4A7443C),   720,  236 },
+    { U64(0xBB764C4C, 0xA7A44410),   747,  244 },
+    { U64(0x8BAB8EEF, 0xB6409C1A),   774,  252 },
+    { U64(0xD01FEF10, 0xA657842C),   800,  260 },
+    { U64(0x9B10A4E5, 0xE9913129),   827,  268 },
+    { U64(0xE7109BFB, 0xA19C0C9D),   853,  276 },
+    { U64(0xAC2820D9, 0x623BF429),   880,  284 },
+    { U64(0x80444B5E, 0x7AA7CF85),   907,  292 },
+    { U64(0xBF21E440, 0x03ACDD2D),   933,  300 },
+    { U64(0x8E679C2F, 0x5E44FF8F),   960,  308 },
+    { U64(0xD433179D, 0x9C8CB841),   986,  316 },
+    { U64(0x9E19DB92, 0xB4E31BA9),  1013,  324 }
+};
+
+static diyFp diySub(diyFp x, diyFp y)
+{
+    diyFp r;
+
+    r.f = x.f - y.f;
+    r.e = x.e;
+    return r;
+}
+
+/* Product, upper 64 bits of the 128-bit result rounded */
+static diyFp diyMul(diyFp x, diyFp y)
+{
+    epicsUInt64 M32 = 0xffffffffu;
+    epicsUInt64 a = x.f >> 32, b = x.f & M32;
+    epicsUInt64 c = y.f >> 32, d = y.f & M32;
+    epicsUInt64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    epicsUInt64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    diyFp r;
+
+    tmp += (epicsUInt64)1 << 31;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static diyFp diyNormalize(diyFp x)
+{
+    while (!(x.f >> 63)) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/*
+ * Value v = f * 2^e of a binary floating point number with the given
+ * precision and exponent bias, and its boundaries m-, m+ (half way to the
+ * neighbouring values) normalized to the same exponent
+ */
+static void boundaries(epicsUInt64 fraction, int biasedExp, int precision, int bias,
+    diyFp *pminus, diyFp *pv, diyFp *pplus)
+{
+    epicsUInt64 hidden = (epicsUInt64)1 << (precision - 1);
+    diyFp v, mplus, mminus;
+
+    if (biasedExp == 0) {
+        v.f = fraction;
+        v.e = 1 - bias;
+    } else {
+        v.f = fraction + hidden;
+        v.e = biasedExp - bias;
+    }
+    mplus.f = 2 * v.f + 1;
+    mplus.e = v.e - 1;
+    if (fraction == 0 && biasedExp > 1) {
+        /* the lower neighbour is closer (power of two) */
+        mminus.f = 4 * v.f - 1;
+        mminus.e = v.e - 2;
+    } else {
+        mminus.f = 2 * v.f - 1;
+        mminus.e = v.e - 1;
+    }
+    mplus = diyNormalize(mplus);
+    mminus.f <<= mminus.e - mplus.e;
+    mminus.e = mplus.e;
+    *pminus = mminus;
+    *pv = diyNormalize(v);
+    *pplus = mplus;
+}
+
+/* Round the last digit towards w while staying inside the boundaries */
+static void roundWeed(char *buf, int len, epicsUInt64 dist, epicsUInt64 delta,
+    epicsUInt64 rest, epicsUInt64 tenK)
+{
+    while (rest < dist && delta - rest >= tenK &&
+           (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+        buf[len - 1]--;
+        rest += tenK;
+    }
+}
+
+/* Number of decimal digits of n and the largest power of ten <= n */
+static int largestPow10(epicsUInt32 n, epicsUInt32 *ppow10)
+{
+    static const epicsUInt32 pow10[] = {1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000, 1000000000};
+    int k = 9;
+
+    while (k > 0 && n < pow10[k])
+        k--;
+    *ppow10 = pow10[k];
+    return k + 1;
+}
+
+/*
+ * Generate the digits of the value between mminus and mplus closest to w
+ * (all scaled to an exponent in [ALPHA, GAMMA]); returns the number of
+ * digits, the value is buf * 10^*pexp
+ */
+static int digitGen(char *buf, int *pexp, diyFp mminus, diyFp w, diyFp mplus)
+{
+    epicsUInt64 delta = diySub(mplus, mminus).f;
+    epicsUInt64 dist = diySub(mplus, w).f;
+    int shift = -mplus.e;
+    epicsUInt64 one = (epicsUInt64)1 << shift;
+    epicsUInt32 p1 = (epicsUInt32)(mplus.f >> shift);
+    epicsUInt64 p2 = mplus.f & (one - 1);
+    epicsUInt32 pow10;
+    int n = largestPow10(p1, &pow10);
+    int len = 0, m = 0;
+
+    /* integral part */
+    while (n > 0) {
+        epicsUInt64 rest;
+
+        buf[len++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+        rest = ((epicsUInt64)p1 << shift) + p2;
+        if (rest <= delta) {
+            *pexp += n;
+            roundWeed(buf, len, dist, delta, rest, (epicsUInt64)pow10 << shift);
+            return len;
+        }
+        pow10 /= 10;
+    }
+
+    /* fractional part */
+    for (;;) {
+        p2 *= 10;
+        buf[len++] = (char)('0' + (int)(p2 >> shift));
+        p2 &= one - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta)
+            break;
+    }
+    *pexp -= m;
+    roundWeed(buf, len, dist, delta, p2, one);
+    return len;
+}
+
+static int grisu2(char *buf, int *pexp, diyFp mminus, diyFp v, diyFp mplus)
+{
+    /* k such that ALPHA <= e(c_k) + e(mplus) + 64 <= GAMMA */
+    int f = ALPHA - mplus.e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    int index = (-CACHED_MIN_DEC_EXP + k + (CACHED_DEC_STEP - 1)) / CACHED_DEC_STEP;
+    diyFp c, w, wminus, wplus;
+
+    c.f = cachedPowers[index].f;
+    c.e = cachedPowers[index].e;
+    w = diyMul(v, c);
+    wminus = diyMul(mminus, c);
+    wplus = diyMul(mplus, c);
+
+    /* the products may be off by one unit, stay on the safe side */
+    wminus.f++;
+    wplus.f--;
+
+    *pexp = -cachedPowers[index].k;
+    return digitGen(buf, pexp, wminus, w, wplus);
+}
+
+/*
+ * Lay out the digits d1..dn * 10^exp like "%g" would (with enough
+ * precision), switching to exponent notation for decimal exponents
+ * below -4 or from maxExp on
+ */
+static int layout(char *buf, const char *digits, int n, int exp, int maxExp, int marker)
+{
+    int x = n + exp - 1;       /* decimal exponent of the first digit */
+    char *p = buf;
+
+    if (x < -4 || x >= maxExp) {
+        *p++ = digits[0];
+        if (n > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, n - 1);
+            p += n - 1;
+        }
+        *p++ = 'e';
+        if (x < 0) {
+            *p++ = '-';
+            x = -x;
+        } else {
+            *p++ = '+';
+        }
+        if (x < 10)
+            *p++ = '0';
+        p += caPutLogFormatUInt32(p, (epicsUInt32)x);
+    } else if (x < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -x - 1);
+        p += -x - 1;
+        memcpy(p, digits, n);
+        p += n;
+    } else if (x >= n - 1) {
+        memcpy(p, digits, n);
+        p += n;
+        memset(p, '0', x - n + 1);
+        p += x - n + 1;
+        if (marker) {
+            *p++ = '.';
+            *p++ = '0';
+        }
+    } else {
+        memcpy(p, digits, x + 1);
+        p += x + 1;
+        *p++ = '.';
+        memcpy(p, digits + x + 1, n - x - 1);
+        p += n - x - 1;
+    }
+    *p = 0;
+    return (int)(p - buf);
+}
+
+/* NaN, infinity and zero, which Grisu2 doesn't handle */
+static int special(char *buf, double value, int negative, int marker)
+{
+    const char *s;
+
+    if (isnan(value))
+        s = "nan";
+    else if (isinf(value))
+        s = negative ? "-inf" : "inf";
+    else if (marker)
+        s = negative ? "-0.0" : "0.0";
+    else
+        s = negative ? "-0" : "0";
+    strcpy(buf, s);
+    return (int)strlen(s);
+}
+
+int caPutLogFormatDouble(char *buf, epicsFloat64 value, int marker)
+{
+    char digits[20];
+    epicsUInt64 bits;
+    int negative, biasedExp, n, exp;
+    diyFp mminus, v, mplus;
+
+    memcpy(&bits, &value, sizeof(bits));
+    negative = (int)(bits >> 63);
+    biasedExp = (int)((bits >> 52) & 0x7ff);
+    if (biasedExp == 0x7ff || (bits << 1) == 0)
+        return special(buf, value, negative, marker);
+
+    boundaries(bits & ((U64(0, 1) << 52) - 1), biasedExp, 53, 1075,
+        &mminus, &v, &mplus);
+    n = grisu2(digits, &exp, mminus, v, mplus);
+    if (negative)
+        *buf = '-';
+    return negative + layout(buf + negative, digits, n, exp, 17, marker);
+}
+
+int caPutLogFormatFloat(char *buf, epicsFloat32 value, int marker)
+{
+    char digits[20];
+    epicsUInt32 bits;
+    int negative, biasedExp, n, exp;
+    diyFp mminus, v, mplus;
+
+    memcpy(&bits, &value, sizeof(bits));
+    negative = (int)(bits >> 31);
+    biasedExp = (int)((bits >> 23) & 0xff);
+    if (biasedExp == 0xff || (bits << 1) == 0)
+        return special(buf, value, negative, marker);
+
+    boundaries(bits & ((1u << 23) - 1), biasedExp, 24, 150,
+        &mminus, &v, &mplus);
+    n = grisu2(digits, &exp, mminus, v, mplus);
+    if (negative)
+        *buf = '-';
+    return negative + layout(buf + negative, digits, n, exp, 8, marker);
+}
+
+int caPutLogFormatValue(char *buf, const void *pval, short type, int index, int marker)
+{
+    switch (type) {
+    case DBR_UCHAR:
+        return caPutLogFormatUInt32(buf, ((const epicsUInt8 *)pval)[index]);
+    case DBR_SHORT:
+        return caPutLogFormatInt32(buf, ((const epicsInt16 *)pval)[index]);
+    case DBR_USHORT:
+    case DBR_ENUM:
+        return caPutLogFormatUInt32(buf, ((const epicsUInt16 *)pval)[index]);
+    case DBR_LONG:
+        return caPutLogFormatInt32(buf, ((const epicsInt32 *)pval)[index]);
+    case DBR_ULONG:
+        return caPutLogFormatUInt32(buf, ((const epicsUInt32 *)pval)[index]);
+#ifdef DBR_INT64
+    case DBR_INT64:
+        return caPutLogFormatInt64(buf, ((const epicsInt64 *)pval)[index]);
+    case DBR_UINT64:
+        return caPutLogFormatUInt64(buf, ((const epicsUInt64 *)pval)[index]);
+#endif
+    case DBR_FLOAT:
+        return caPutLogFormatFloat(buf, ((const epicsFloat32 *)pval)[index], marker);
+    case DBR_DOUBLE:
+        return caPutLogFormatDouble(buf, ((const epicsFloat64 *)pval)[index], marker);
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef INCcaPutLogNumh
+#define INCcaPutLogNumh 1
+
+#include <epicsTypes.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Conversion of field values to text for both loggers. Floating point
+ * values are written either with the printf formats used so far, or
+ * with the shortest digit string that reads back as the same value
+ * (Grisu2), converted without going through printf.
+ */
+typedef enum {
+    caPutLogNumPrintf,      /* "%g" (text), "%.8g" / "%.17g" (JSON) */
+    caPutLogNumShortest     /* shortest round trip */
+} caPutLogNumFmt;
+
+/* Room for any number written by the functions below, including the NUL */
+#define caPutLogNumBufSize 32
+
+/* Format names as used by the shell commands; -1 if unknown */
+epicsShareFunc int caPutLogNumFmtFromName(const char *name);
+epicsShareFunc const char *caPutLogNumFmtName(int fmt);
+
+/*
+ * Decimal integers, same output as printf "%d" / "%u" / "%lld" / "%llu".
+ * The result is NUL terminated, the length is returned.
+ */
+epicsShareFunc int caPutLogFormatInt32(char *buf, epicsInt32 value);
+epicsShareFunc int caPutLogFormatUInt32(char *buf, epicsUInt32 value);
+epicsShareFunc int caPutLogFormatInt64(char *buf, epicsInt64 value);
+epicsShareFunc int caPutLogFormatUInt64(char *buf, epicsUInt64 value);
+
+/*
+ * Shortest digit string that converts back to the same double or float.
+ * Numbers below 1e-4 or from 1e17 (double) or 1e8 (float) on are written
+ * in exponent notation like printf's "%g" does. If marker is set, ".0" is
+ * appended to results that would look like an integer. NaN and infinity
+ * come out as "nan", "inf" and "-inf". Returns the length.
+ */
+epicsShareFunc int caPutLogFormatDouble(char *buf, epicsFloat64 value, int marker);
+epicsShareFunc int caPutLogFormatFloat(char *buf, epicsFloat32 value, int marker);
+
+/*
+ * Element index of a numeric DBR_xxx value or array, integers as above and
+ * DBR_FLOAT / DBR_DOUBLE with the shortest conversion. DBR_CHAR, which the
+ * loggers treat differently, and the other types give -1.
+ */
+epicsShareFunc int caPutLogFormatValue(char *buf, const void *pval, short type,
+    int index, int marker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogNumh*/
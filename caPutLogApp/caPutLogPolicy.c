@@ -0,0 +1,190 @@
+/*	File:	  caPutLogPolicy.c
+ *
+ *	Per record logging policy from info tags, see caPutLogPolicy.h.
+ *
+ *	The records with tags are collected once into an open addressing
+ *	table keyed by the record address, at most half full, so the trap
+ *	finds a record's policy (or that it has none) in a probe or two.
+ *	Records without tags cost nothing; without any tags the lookup
+ *	returns right away.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dbDefs.h>
+#include <dbBase.h>
+#include <dbCommon.h>
+#include <dbStaticLib.h>
+#include <dbAccess.h>
+#include <cantProceed.h>
+#include <errlog.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLog.h"
+#include "caPutLogPolicy.h"
+
+typedef struct {
+    const struct dbCommon *precord;
+    caPutLogPolicy  policy;
+} policyEntry;
+
+static policyEntry *table;
+static unsigned tableMask;
+static unsigned count;
+static int scanned;
+
+static unsigned hashRecord(const struct dbCommon *precord)
+{
+    size_t key = (size_t)precord >> 3;
+
+    return (unsigned)key * 2654435761u;
+}
+
+static void insert(policyEntry *ptable, unsigned mask, const policyEntry *pentry)
+{
+    unsigned i = hashRecord(pentry->precord) & mask;
+
+    while (ptable[i].precord)
+        i = (i + 1) & mask;
+    ptable[i] = *pentry;
+}
+
+static const char *tag(DBENTRY *pdbentry, const char *name)
+{
+    return dbFindInfo(pdbentry, name) == 0 ? dbGetInfoString(pdbentry) : NULL;
+}
+
+/* Fill in the policy from the tags; 0 if the record has none */
+static int parseTags(DBENTRY *pdbentry, caPutLogPolicy *ppolicy)
+{
+    const char *name = dbGetRecordName(pdbentry);
+    const char *log = tag(pdbentry, "caPutLog");
+    const char *mode = tag(pdbentry, "caPutLogMode");
+    const char *burst = tag(pdbentry, "caPutLogBurst");
+    const char *deadband = tag(pdbentry, "caPutLogDeadband");
+
+    ppolicy->log = 1;
+    ppolicy->mode = -1;
+    ppolicy->burstTimeout = 0.0;
+    ppolicy->deadband.kind = caPutLogDeadbandNone;
+    ppolicy->deadband.value = 0.0;
+
+    if (log) {
+        if (strcmp(log, "off") == 0)
+            ppolicy->log = 0;
+        else if (strcmp(log, "on") != 0)
+            errlogSevPrintf(errlogMinor,
+                "caPutLog: %s: info(caPutLog, \"%s\") is neither \"on\" nor \"off\"\n",
+                name, log);
+    }
+    if (mode) {
+        if (strcmp(mode, "on-change") == 0 || strcmp(mode, "0") == 0)
+            ppolicy->mode = caPutLogOnChange;
+        else if (strcmp(mode, "all") == 0 || strcmp(mode, "1") == 0)
+            ppolicy->mode = caPutLogAll;
+        else if (strcmp(mode, "no-filter") == 0 || strcmp(mode, "2") == 0)
+            ppolicy->mode = caPutLogAllNoFilter;
+        else
+            errlogSevPrintf(errlogMinor,
+                "caPutLog: %s: info(caPutLogMode, \"%s\") is not one of"
+                " \"on-change\", \"all\", \"no-filter\"\n", name, mode);
+    }
+    if (burst) {
+        char *end;
+        double timeout = strtod(burst, &end);
+
+        if (end != burst && !*end && timeout > 0.0)
+            ppolicy->burstTimeout = timeout;
+        else
+            errlogSevPrintf(errlogMinor,
+                "caPutLog: %s: info(caPutLogBurst, \"%s\") is not a positive number"
+                " of seconds\n", name, burst);
+    }
+    if (deadband && caPutLogDeadbandParse(deadband, &ppolicy->deadband)) {
+        ppolicy->deadband.kind = caPutLogDeadbandNone;
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: %s: info(caPutLogDeadband, \"%s\") is not a number, a percentage,"
+            " MDEL or ADEL\n", name, deadband);
+    }
+    return !ppolicy->log || ppolicy->mode >= 0 || ppolicy->burstTimeout > 0.0 ||
+        ppolicy->deadband.kind != caPutLogDeadbandNone;
+}
+
+int caPutLogPolicyScan(void)
+{
+    DBENTRY dbentry;
+    policyEntry *found = NULL, entry;
+    unsigned nfound = 0, cap = 0, size, i;
+    long status;
+
+    if (scanned || !pdbbase)
+        return 0;
+    scanned = 1;
+
+    dbInitEntry(pdbbase, &dbentry);
+    for (status = dbFirstRecordType(&dbentry); !status; status = dbNextRecordType(&dbentry)) {
+        for (status = dbFirstRecord(&dbentry); !status; status = dbNextRecord(&dbentry)) {
+            if (dbIsAlias(&dbentry) || !parseTags(&dbentry, &entry.policy))
+                continue;
+            entry.precord = dbentry.precnode->precord;
+            if (nfound == cap) {
+                cap = cap ? 2 * cap : 64;
+                found = realloc(found, cap * sizeof(policyEntry));
+                if (!found)
+                    cantProceed("caPutLogPolicy: out of memory\n");
+            }
+            found[nfound++] = entry;
+        }
+    }
+    dbFinishEntry(&dbentry);
+
+    if (nfound) {
+        for (size = 4; size < 2 * nfound; size *= 2)
+            ;
+        table = callocMustSucceed(size, sizeof(policyEntry), "caPutLogPolicy");
+        tableMask = size - 1;
+        for (i = 0; i < nfound; i++)
+            insert(table, tableMask, &found[i]);
+        count = nfound;
+    }
+    free(found);
+    return 0;
+}
+
+const caPutLogPolicy *caPutLogPolicyGet(const struct dbCommon *precord)
+{
+    unsigned i;
+
+    if (!table)
+        return NULL;
+    for (i = hashRecord(precord) & tableMask; table[i].precord; i = (i + 1) & tableMask)
+        if (table[i].precord == precord)
+            return &table[i].policy;
+    return NULL;
+}
+
+unsigned caPutLogPolicyCount(void)
+{
+    return count;
+}
+
+void caPutLogPolicyShow(const char *name)
+{
+    unsigned i, off = 0, modes = 0, bursts = 0, deadbands = 0;
+
+    if (!count)
+        return;
+    for (i = 0; i <= tableMask; i++) {
+        if (!table[i].precord)
+            continue;
+        off += !table[i].policy.log;
+        modes += table[i].policy.mode >= 0;
+        bursts += table[i].policy.burstTimeout > 0.0;
+        deadbands += table[i].policy.deadband.kind != caPutLogDeadbandNone;
+    }
+    printf("%s Record policies: %u records, %u not logged, %u with their own mode,"
+        " %u with their own burst timeout, %u with their own deadband\n",
+        name, count, off, modes, bursts, deadbands);
+}
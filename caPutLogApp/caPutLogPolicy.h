@@ -0,0 +1,57 @@
+#ifndef INCcaPutLogPolicyh
+#define INCcaPutLogPolicyh 1
+
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+#include "caPutLogDeadband.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct dbCommon;
+
+/*
+ * Logging policy of a record, from info tags in the database:
+ *
+ *   info(caPutLog, "off")          puts to the record are not logged
+ *   info(caPutLogMode, "all")      mode for the record: "on-change",
+ *                                  "all" or "no-filter" (or 0, 1, 2 as
+ *                                  for caPutLogInit)
+ *   info(caPutLogBurst, "0.5")     burst timeout for the record, seconds
+ *   info(caPutLogDeadband, "2%")   deadband of the on-change mode for the
+ *                                  record's fields, see caPutLogDeadband.h
+ *
+ * The tags are read once when the trap is installed (after iocInit) into
+ * a table that is not changed afterwards and looked up without a lock.
+ * The trap hangs the policy on each LOGDATA for the loggers.
+ */
+typedef struct caPutLogPolicy {
+    int         log;            /* 0: not logged */
+    int         mode;           /* -1: the logger's */
+    double      burstTimeout;   /* 0: the logger's */
+    caPutLogDeadbandSpec deadband;  /* kind none: the type's */
+} caPutLogPolicy;
+
+/* Read the tags of all records; called by caPutLogAsInit() */
+epicsShareFunc int caPutLogPolicyScan(void);
+
+/* The policy of a record, NULL if it has no tags */
+epicsShareFunc const caPutLogPolicy *caPutLogPolicyGet(const struct dbCommon *precord);
+
+epicsShareFunc unsigned caPutLogPolicyCount(void);
+epicsShareFunc void caPutLogPolicyShow(const char *name);
+
+/* Mode and burst timeout of a put, given the logger's */
+#define caPutLogPolicyMode(plogData, config) \
+    ((plogData)->policy && (plogData)->policy->mode >= 0 ? (plogData)->policy->mode : (config))
+#define caPutLogPolicyBurst(plogData, timeout) \
+    ((plogData)->policy && (plogData)->policy->burstTimeout > 0.0 ? \
+        (plogData)->policy->burstTimeout : (timeout))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogPolicyh*/
@@ -0,0 +1,225 @@
+/*	File:	  caPutLogPv.c
+ *
+ *	Log PV transport, see caPutLogPv.h.
+ *
+ *	What is pending for the next update is kept joined, as it is going
+ *	to be written. A message that does not fit pushes out whole lines
+ *	at the front, all in one move. The sink's thread calls send() for
+ *	each batch and idle() when the queue runs empty, idle() returning
+ *	the time until an update held back by the rate limit is due.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <dbDefs.h>
+#include <dbFldTypes.h>
+#include <dbAccess.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogPv.h"
+
+int caPutLogPvPack = 0;
+epicsExportAddress(int, caPutLogPvPack);
+double caPutLogPvMaxRate = 0.0;
+epicsExportAddress(double, caPutLogPvMaxRate);
+
+struct caPutLogPv {
+    epicsMutexId    lock;
+    DBADDR          addr;
+    int             chars;          /* a char array, else a string field */
+    size_t          room;           /* characters per update */
+    char            *buf;           /* pending for the next update */
+    size_t          len;
+    unsigned        msgs;           /* in buf, 0: nothing pending */
+    epicsTimeStamp  last;           /* of the last update */
+    int             failing;        /* last update failed, reported */
+    caPutLogPvStats stats;
+    char            name[1];
+};
+
+caPutLogPv *caPutLogPvCreate(const char *name)
+{
+    caPutLogPv *ppv = callocMustSucceed(1, sizeof(caPutLogPv) + strlen(name),
+        "caPutLogPvCreate");
+
+    strcpy(ppv->name, name);
+    if (dbNameToAddr(name, &ppv->addr)) {
+        errlogSevPrintf(errlogMajor,
+            "caPutLog: log PV %s not found, logging to PV disabled\n", name);
+        free(ppv);
+        return NULL;
+    }
+    ppv->chars = (ppv->addr.field_type == DBF_CHAR || ppv->addr.field_type == DBF_UCHAR)
+        && ppv->addr.no_elements > 1;
+    ppv->room = ppv->chars ? (size_t)ppv->addr.no_elements - 1 : MAX_STRING_SIZE - 1;
+    ppv->buf = mallocMustSucceed(ppv->room + 1, "caPutLogPvCreate");
+    ppv->stats.chars = ppv->room;
+    ppv->lock = epicsMutexMustCreate();
+    return ppv;
+}
+
+/* Add a message to what is pending, the newest win */
+static void hold(caPutLogPv *ppv, const caPutLogMsg *pmsg)
+{
+    size_t len = pmsg->len;
+
+    if (len && pmsg->text[len - 1] == '\n')
+        len--;
+    if (len > ppv->room)
+        len = ppv->room;
+    if (ppv->msgs && (!caPutLogPvPack || !ppv->chars || ppv->len + 1 + len > ppv->room)) {
+        size_t need = ppv->len + 1 + len - ppv->room, cut = 0;
+        unsigned dropped = 0;
+
+        if (!caPutLogPvPack || !ppv->chars)
+            need = ppv->len + 1;
+        while (cut < need) {
+            const char *eol = memchr(ppv->buf + cut, '\n', ppv->len - cut);
+
+            if (!eol)
+                break;
+            cut = eol - ppv->buf + 1;
+            dropped++;
+        }
+        if (cut < need || dropped >= ppv->msgs) {
+            cut = ppv->len;
+            dropped = ppv->msgs;
+        }
+        memmove(ppv->buf, ppv->buf + cut, ppv->len - cut);
+        ppv->len -= cut;
+        ppv->msgs -= dropped;
+        ppv->stats.superseded += dropped;
+    }
+    if (ppv->msgs)
+        ppv->buf[ppv->len++] = '\n';
+    memcpy(ppv->buf + ppv->len, pmsg->text, len);
+    ppv->len += len;
+    ppv->msgs++;
+}
+
+/* Seconds until the next update may be written */
+static double untilDue(caPutLogPv *ppv, epicsTimeStamp *pnow)
+{
+    double rate = caPutLogPvMaxRate;
+
+    epicsTimeGetCurrent(pnow);
+    if (rate <= 0.0 || !ppv->stats.updates)
+        return 0.0;
+    return 1.0 / rate - epicsTimeDiffInSeconds(pnow, &ppv->last);
+}
+
+static void publish(caPutLogPv *ppv, const epicsTimeStamp *pnow)
+{
+    long status;
+
+    ppv->buf[ppv->len] = 0;
+    if (ppv->chars)
+        status = dbPutField(&ppv->addr, DBR_CHAR, ppv->buf, ppv->len + 1);
+    else
+        status = dbPutField(&ppv->addr, DBR_STRING, ppv->buf, 1);
+
+    ppv->last = *pnow;
+    ppv->stats.updates++;
+    if (status) {
+        ppv->stats.failed++;
+        if (!ppv->failing)
+            errlogSevPrintf(errlogMajor,
+                "caPutLog: dbPutField to log PV %s failed, status = %ld\n", ppv->name, status);
+    } else {
+        ppv->stats.published += ppv->msgs;
+    }
+    ppv->failing = status != 0;
+    ppv->len = 0;
+    ppv->msgs = 0;
+}
+
+static int pvSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    caPutLogPv *ppv = (caPutLogPv *)ctx;
+    epicsTimeStamp now;
+    unsigned i;
+
+    epicsMutexMustLock(ppv->lock);
+    for (i = 0; i < count; i++)
+        hold(ppv, pmsgs[i]);
+    if (untilDue(ppv, &now) <= 0.0)
+        publish(ppv, &now);
+    epicsMutexUnlock(ppv->lock);
+    return 0;
+}
+
+static double pvIdle(void *ctx)
+{
+    caPutLogPv *ppv = (caPutLogPv *)ctx;
+    epicsTimeStamp now;
+    double wait = 0.0;
+
+    epicsMutexMustLock(ppv->lock);
+    if (ppv->msgs) {
+        wait = untilDue(ppv, &now);
+        if (wait <= 0.0) {
+            publish(ppv, &now);
+            wait = 0.0;
+        }
+    }
+    epicsMutexUnlock(ppv->lock);
+    return wait;
+}
+
+/* Write what is held back, regardless of the rate */
+static void pvFlush(void *ctx)
+{
+    caPutLogPv *ppv = (caPutLogPv *)ctx;
+    epicsTimeStamp now;
+
+    epicsMutexMustLock(ppv->lock);
+    if (ppv->msgs) {
+        epicsTimeGetCurrent(&now);
+        publish(ppv, &now);
+    }
+    epicsMutexUnlock(ppv->lock);
+}
+
+static void pvShow(void *ctx, unsigned level)
+{
+    caPutLogPv *ppv = (caPutLogPv *)ctx;
+    caPutLogPvStats stats;
+
+    caPutLogPvGetStats(ppv, &stats);
+    printf("    %s field of %lu characters, %s, ", ppv->chars ? "char array" : "string",
+        (unsigned long)stats.chars, caPutLogPvPack && ppv->chars ? "packed" : "latest message");
+    if (caPutLogPvMaxRate > 0.0)
+        printf("up to %g updates/s\n", caPutLogPvMaxRate);
+    else
+        printf("no rate limit\n");
+    printf("    %lu updates (%lu failed) with %lu messages, %lu superseded\n",
+        (unsigned long)stats.updates, (unsigned long)stats.failed,
+        (unsigned long)stats.published, (unsigned long)stats.superseded);
+}
+
+static void pvDestroy(void *ctx)
+{
+    caPutLogPv *ppv = (caPutLogPv *)ctx;
+
+    epicsMutexDestroy(ppv->lock);
+    free(ppv->buf);
+    free(ppv);
+}
+
+const caPutLogSinkTransport caPutLogPvTransport = {
+    pvSend, pvFlush, pvShow, pvDestroy, pvIdle
+};
+
+void caPutLogPvGetStats(caPutLogPv *ppv, caPutLogPvStats *pstats)
+{
+    epicsMutexMustLock(ppv->lock);
+    *pstats = ppv->stats;
+    epicsMutexUnlock(ppv->lock);
+}
@@ -0,0 +1,54 @@
+#ifndef INCcaPutLogPvh
+#define INCcaPutLogPvh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Publishing to the log PV (EPICS_AS_PUT_LOG_PV, EPICS_AS_PUT_JSON_LOG_PV),
+ * a transport for caPutLogSink.h, so the loggers only queue the message
+ * and the dbPutField happens in the sink's own thread.
+ *
+ * The PV is written at most caPutLogPvMaxRate times per second. Messages
+ * arriving in between, or several arriving at once because the thread
+ * fell behind, are held back and only the latest are written: with
+ * caPutLogPvPack set and a char array field (a waveform of CHAR or
+ * UCHAR, or a long string "name.$") as many of the newest messages as
+ * fit, one per line, else only the newest message. The others are
+ * counted as superseded. Messages are expected to be single lines, a
+ * trailing newline is removed.
+ *
+ * A string field gets the first 39 characters of the message.
+ */
+
+epicsShareExtern int caPutLogPvPack;            /* several messages per update */
+epicsShareExtern double caPutLogPvMaxRate;      /* updates per second, 0: no limit */
+
+typedef struct caPutLogPv caPutLogPv;
+
+epicsShareExtern const caPutLogSinkTransport caPutLogPvTransport;
+
+/* For the PV name, NULL if it does not exist (reported) */
+epicsShareFunc caPutLogPv *caPutLogPvCreate(const char *name);
+
+typedef struct {
+    size_t      updates;        /* dbPutField calls */
+    size_t      failed;         /* of them */
+    size_t      published;      /* messages written in the updates */
+    size_t      superseded;     /* messages replaced by newer ones */
+    size_t      chars;          /* per update, without the NUL */
+} caPutLogPvStats;
+
+epicsShareFunc void caPutLogPvGetStats(caPutLogPv *ppv, caPutLogPvStats *pstats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogPvh*/
@@ -0,0 +1,535 @@
+/*	File:	  caPutLogQueue.c
+ *
+ *	Lock-free hand-off of LOGDATA pointers from the access security
+ *	trap (many CA server threads) to the logger task (one thread).
+ *
+ *	The queue is a ring of cells, each carrying a sequence number
+ *	(D. Vyukov's bounded queue). A producer claims a cell with a single
+ *	compare-and-swap on the enqueue position and publishes it by
+ *	advancing the cell's sequence number; the consumer owns the dequeue
+ *	position alone. No mutex is taken on the put path, the consumer's
+ *	event is only signalled while the consumer is actually asleep.
+ *
+ *	caPutLogQueueSend adds soft limits (messages and bytes) on top of
+ *	the ring and applies the overflow policy. Puts to be coalesced are
+ *	held in a small table keyed by field (under a mutex, this is the
+ *	overflow path only); while it holds anything all new puts go there,
+ *	so the receiver, which takes them after the ring, sees every field's
+ *	puts in order.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <cantProceed.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogAs.h"
+#include "caPutLogQueue.h"
+
+/* Keep the producer and consumer positions on separate cache lines */
+#define CACHE_LINE_SIZE 64
+
+struct cell {
+    size_t          sequence;
+    LOGDATA         *data;
+    size_t          bytes;      /* accounted size, 0 if sent unlimited */
+};
+
+struct caPutLogQueue {
+    size_t          enqueuePos;
+    char            pad1[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t          dequeuePos;
+    char            pad2[CACHE_LINE_SIZE - sizeof(size_t)];
+    int             waiting;    /* consumer is (about to be) asleep */
+    epicsEventId    wakeup;
+    size_t          mask;
+    struct cell     *cells;
+
+    /* limits of caPutLogQueueSend */
+    unsigned        maxMsgs;
+    size_t          maxBytes;
+    int             policy;
+    double          blockTimeout;
+    size_t          pendingBytes;
+    int             blockedWaiters;
+    epicsEventId    space;
+
+    /* puts held back to be coalesced, see above */
+    epicsMutexId    overflowLock;
+    int             overflowCount;
+    LOGDATA         **overflow;
+    unsigned        *overflowIndex; /* by field: position in overflow + 1 */
+
+    /* statistics */
+    size_t          highWater;
+    size_t          droppedNewest;
+    size_t          droppedOldest;
+    size_t          droppedBlocked;
+    size_t          coalesced;
+    size_t          blocked;
+};
+
+static const char * const policyNames[] = {
+    "drop-newest", "drop-oldest", "coalesce", "block"
+};
+
+caPutLogQueue *caPutLogQueueCreate(unsigned capacity)
+{
+    caPutLogQueue *q;
+    size_t size = 2, i;
+
+    while (size < capacity)
+        size <<= 1;
+
+    q = callocMustSucceed(1, sizeof(caPutLogQueue), "caPutLogQueueCreate");
+    q->cells = callocMustSucceed(size, sizeof(struct cell), "caPutLogQueueCreate");
+    q->mask = size - 1;
+    for (i = 0; i < size; i++) {
+        q->cells[i].sequence = i;
+    }
+    q->maxMsgs = (unsigned)size;
+    q->policy = caPutLogDropNewest;
+    q->wakeup = epicsEventCreate(epicsEventEmpty);
+    q->space = epicsEventCreate(epicsEventEmpty);
+    q->overflowLock = epicsMutexCreate();
+    if (!q->wakeup || !q->space || !q->overflowLock) {
+        caPutLogQueueDestroy(q);
+        return NULL;
+    }
+    return q;
+}
+
+void caPutLogQueueDestroy(caPutLogQueue *q)
+{
+    if (!q) return;
+    if (q->wakeup) epicsEventDestroy(q->wakeup);
+    if (q->space) epicsEventDestroy(q->space);
+    if (q->overflowLock) epicsMutexDestroy(q->overflowLock);
+    free(q->overflow);
+    free(q->overflowIndex);
+    free(q->cells);
+    free(q);
+}
+
+static void wakeConsumer(caPutLogQueue *q)
+{
+    if (epicsAtomicGetIntT(&q->waiting) &&
+        epicsAtomicCmpAndSwapIntT(&q->waiting, 1, 0) == 1) {
+        epicsEventSignal(q->wakeup);
+    }
+}
+
+static int enqueue(caPutLogQueue *q, LOGDATA *plogData, size_t bytes)
+{
+    struct cell *c;
+    size_t pos = epicsAtomicGetSizeT(&q->enqueuePos);
+
+    for (;;) {
+        size_t seq;
+
+        c = &q->cells[pos & q->mask];
+        seq = epicsAtomicGetSizeT(&c->sequence);
+        if (seq == pos) {
+            /* cell is free in this lap, try to claim it */
+            size_t prev = epicsAtomicCmpAndSwapSizeT(&q->enqueuePos, pos, pos + 1);
+            if (prev == pos) break;
+            pos = prev;
+        }
+        else if ((ptrdiff_t)(seq - pos) < 0) {
+            /* cell still holds an entry from the previous lap */
+            return -1;
+        }
+        else {
+            /* another producer claimed it first */
+            pos = epicsAtomicGetSizeT(&q->enqueuePos);
+        }
+    }
+
+    c->data = plogData;
+    c->bytes = bytes;
+    if (bytes)
+        epicsAtomicAddSizeT(&q->pendingBytes, bytes);
+    /* publish; the swap is a full barrier, which orders it against
+       the read of the consumer's waiting flag below */
+    epicsAtomicCmpAndSwapSizeT(&c->sequence, pos, pos + 1);
+
+    wakeConsumer(q);
+    return 0;
+}
+
+int caPutLogQueueTrySend(caPutLogQueue *q, LOGDATA *plogData)
+{
+    return enqueue(q, plogData, 0);
+}
+
+static unsigned drain(caPutLogQueue *q, LOGDATA **pbuf, unsigned max, size_t *pbytes)
+{
+    unsigned n = 0;
+    size_t pos = q->dequeuePos;
+
+    while (n < max) {
+        struct cell *c = &q->cells[pos & q->mask];
+
+        if (epicsAtomicGetSizeT(&c->sequence) != pos + 1)
+            break;              /* empty, or producer not done yet */
+        epicsAtomicReadMemoryBarrier();
+        pbuf[n++] = c->data;
+        *pbytes += c->bytes;
+        /* hand the cell back to the producers for the next lap */
+        epicsAtomicCmpAndSwapSizeT(&c->sequence, pos + 1, pos + q->mask + 1);
+        pos++;
+    }
+    epicsAtomicSetSizeT(&q->dequeuePos, pos);
+    return n;
+}
+
+/* Find the overflow entry of a field, or the free index slot for it */
+static unsigned *overflowFind(caPutLogQueue *q, const void *pfield)
+{
+    size_t imask = 2 * q->mask + 1;
+    size_t h = ((size_t)pfield >> 3) * 2654435761u;
+
+    for (;; h++) {
+        unsigned *pslot = &q->overflowIndex[h & imask];
+
+        if (!*pslot || q->overflow[*pslot - 1]->pfield == pfield)
+            return pslot;
+    }
+}
+
+/* Take up to max puts out of the overflow table */
+static unsigned takeOverflow(caPutLogQueue *q, LOGDATA **pbuf, unsigned max,
+    size_t *pbytes)
+{
+    unsigned n, i, left;
+
+    epicsMutexMustLock(q->overflowLock);
+    n = (unsigned)q->overflowCount;
+    if (n > max) n = max;
+    left = (unsigned)q->overflowCount - n;
+    for (i = 0; i < n; i++) {
+        pbuf[i] = q->overflow[i];
+        *pbytes += caPutLogDataSize(pbuf[i]);
+    }
+    memmove(q->overflow, q->overflow + n, left * sizeof(LOGDATA *));
+    memset(q->overflowIndex, 0, 2 * (q->mask + 1) * sizeof(unsigned));
+    for (i = 0; i < left; i++)
+        *overflowFind(q, q->overflow[i]->pfield) = i + 1;
+    epicsAtomicSetIntT(&q->overflowCount, (int)left);
+    epicsMutexUnlock(q->overflowLock);
+    return n;
+}
+
+/* caPutLogDropOldest: drop the head of the batch while over the limits */
+static unsigned dropOldest(caPutLogQueue *q, LOGDATA **pbuf, unsigned n,
+    size_t batchBytes)
+{
+    unsigned total = caPutLogQueuePending(q) + n;
+    size_t bytes = epicsAtomicGetSizeT(&q->pendingBytes) + batchBytes;
+    unsigned drop = 0;
+
+    while (drop < n &&
+           (total > q->maxMsgs || (q->maxBytes && bytes > q->maxBytes))) {
+        size_t size = caPutLogDataSize(pbuf[drop]);
+
+        caPutLogDataFree(pbuf[drop++]);
+        total--;
+        bytes = bytes > size ? bytes - size : 0;
+    }
+    if (drop) {
+        memmove(pbuf, pbuf + drop, (n - drop) * sizeof(LOGDATA *));
+        epicsAtomicAddSizeT(&q->droppedOldest, drop);
+    }
+    return n - drop;
+}
+
+static unsigned take(caPutLogQueue *q, LOGDATA **pbuf, unsigned max)
+{
+    unsigned n;
+
+    do {
+        size_t bytes = 0;
+
+        n = drain(q, pbuf, max, &bytes);
+        if (n < max && epicsAtomicGetIntT(&q->overflowCount))
+            n += takeOverflow(q, pbuf + n, max - n, &bytes);
+        if (!n)
+            break;
+        if (bytes)
+            epicsAtomicSubSizeT(&q->pendingBytes, bytes);
+        if (epicsAtomicGetIntT(&q->policy) == caPutLogDropOldest)
+            n = dropOldest(q, pbuf, n, bytes);
+        if (epicsAtomicGetIntT(&q->blockedWaiters))
+            epicsEventSignal(q->space);
+    } while (!n);           /* the whole batch was dropped, look again */
+    return n;
+}
+
+unsigned caPutLogQueueReceive(caPutLogQueue *q, LOGDATA **pbuf,
+    unsigned max, double timeout)
+{
+    unsigned n = take(q, pbuf, max);
+
+    if (n || timeout == 0.0)
+        return n;
+
+    /* announce that we are going to sleep, then look again so that a
+       producer publishing in between is not missed */
+    epicsAtomicCmpAndSwapIntT(&q->waiting, 0, 1);
+    n = take(q, pbuf, max);
+    if (!n) {
+        if (timeout < 0.0)
+            epicsEventWait(q->wakeup);
+        else
+            epicsEventWaitWithTimeout(q->wakeup, timeout);
+        n = take(q, pbuf, max);
+    }
+    epicsAtomicSetIntT(&q->waiting, 0);
+    return n;
+}
+
+unsigned caPutLogQueueCapacity(const caPutLogQueue *q)
+{
+    return (unsigned)(q->mask + 1);
+}
+
+unsigned caPutLogQueuePending(const caPutLogQueue *q)
+{
+    size_t tail = epicsAtomicGetSizeT(&q->dequeuePos);
+    size_t head = epicsAtomicGetSizeT(&q->enqueuePos);
+
+    return (unsigned)(head - tail);
+}
+
+static void updateHighWater(caPutLogQueue *q)
+{
+    size_t n = caPutLogQueuePending(q) + epicsAtomicGetIntT(&q->overflowCount);
+    size_t high = epicsAtomicGetSizeT(&q->highWater);
+
+    while (n > high) {
+        size_t prev = epicsAtomicCmpAndSwapSizeT(&q->highWater, high, n);
+        if (prev == high) break;
+        high = prev;
+    }
+}
+
+static int overLimit(caPutLogQueue *q, size_t bytes)
+{
+    unsigned pending = caPutLogQueuePending(q) +
+        (unsigned)epicsAtomicGetIntT(&q->overflowCount);
+
+    if (pending >= q->maxMsgs)
+        return 1;
+    return q->maxBytes &&
+        epicsAtomicGetSizeT(&q->pendingBytes) + bytes > q->maxBytes;
+}
+
+/*
+ * Merge a put into a held back put to the same field: the older put
+ * keeps its old value and takes over the new one, and adds up the counts
+ * of puts the rate limits dropped before each
+ */
+static int mergePut(LOGDATA *pdst, const LOGDATA *psrc)
+{
+    if (pdst->type != psrc->type || pdst->value_size != psrc->value_size ||
+        pdst->raw != psrc->raw)
+        return 0;
+    if (pdst->ident != psrc->ident || (!pdst->ident &&
+        (strcmp(pdst->userid, psrc->userid) || strcmp(pdst->hostid, psrc->hostid))))
+        return 0;
+
+    memcpy(pdst->new_value, psrc->new_value,
+        offsetof(TIME_VALUE, value) + psrc->value_size);
+    pdst->new_size = psrc->new_size;
+    pdst->new_log_size = psrc->new_log_size;
+    pdst->is_array = pdst->is_array || psrc->is_array;
+    pdst->suppressed_pv += psrc->suppressed_pv;
+    pdst->suppressed_client += psrc->suppressed_client;
+    return 1;
+}
+
+static int coalesce(caPutLogQueue *q, LOGDATA *plogData, size_t bytes)
+{
+    unsigned *pslot;
+
+    epicsMutexMustLock(q->overflowLock);
+    if (!q->overflowCount && !overLimit(q, bytes)) {
+        /* the receiver has caught up in the meantime */
+        epicsMutexUnlock(q->overflowLock);
+        if (enqueue(q, plogData, bytes) == 0) {
+            updateHighWater(q);
+            return 0;
+        }
+        epicsMutexMustLock(q->overflowLock);
+    }
+
+    pslot = overflowFind(q, plogData->pfield);
+    if (*pslot && mergePut(q->overflow[*pslot - 1], plogData)) {
+        epicsMutexUnlock(q->overflowLock);
+        caPutLogDataFree(plogData);
+        epicsAtomicIncrSizeT(&q->coalesced);
+        return 0;
+    }
+    if ((size_t)q->overflowCount > q->mask) {
+        epicsMutexUnlock(q->overflowLock);
+        caPutLogDataFree(plogData);
+        epicsAtomicIncrSizeT(&q->droppedNewest);
+        return -1;
+    }
+    q->overflow[q->overflowCount] = plogData;
+    epicsAtomicAddSizeT(&q->pendingBytes, bytes);
+    epicsAtomicSetIntT(&q->overflowCount, q->overflowCount + 1);
+    *pslot = (unsigned)q->overflowCount;
+    epicsMutexUnlock(q->overflowLock);
+
+    updateHighWater(q);
+    wakeConsumer(q);
+    return 0;
+}
+
+/* Wait up to the block timeout until the put fits; returns 0 on timeout */
+static int waitForRoom(caPutLogQueue *q, size_t bytes)
+{
+    epicsTimeStamp start, now;
+    double left = q->blockTimeout;
+    int ok = 1;
+
+    epicsAtomicIncrSizeT(&q->blocked);
+    epicsAtomicIncrIntT(&q->blockedWaiters);
+    epicsTimeGetCurrent(&start);
+    while (overLimit(q, bytes)) {
+        if (left <= 0.0) {
+            ok = 0;
+            break;
+        }
+        epicsEventWaitWithTimeout(q->space, left);
+        epicsTimeGetCurrent(&now);
+        left = q->blockTimeout - epicsTimeDiffInSeconds(&now, &start);
+    }
+    /* pass the wakeup on to the next waiting thread */
+    if (epicsAtomicDecrIntT(&q->blockedWaiters) > 0)
+        epicsEventSignal(q->space);
+    return ok;
+}
+
+int caPutLogQueueSend(caPutLogQueue *q, LOGDATA *plogData)
+{
+    size_t bytes = caPutLogDataSize(plogData);
+    int policy = epicsAtomicGetIntT(&q->policy);
+
+    if (policy == caPutLogCoalesce &&
+        (epicsAtomicGetIntT(&q->overflowCount) || overLimit(q, bytes)))
+        return coalesce(q, plogData, bytes);
+
+    if (policy != caPutLogDropOldest && overLimit(q, bytes)) {
+        if (policy != caPutLogBlock) {
+            caPutLogDataFree(plogData);
+            epicsAtomicIncrSizeT(&q->droppedNewest);
+            return -1;
+        }
+        if (!waitForRoom(q, bytes)) {
+            caPutLogDataFree(plogData);
+            epicsAtomicIncrSizeT(&q->droppedBlocked);
+            return -1;
+        }
+    }
+
+    if (enqueue(q, plogData, bytes)) {
+        /* no room in the ring at all */
+        caPutLogDataFree(plogData);
+        epicsAtomicIncrSizeT(&q->droppedNewest);
+        return -1;
+    }
+    updateHighWater(q);
+    return 0;
+}
+
+void caPutLogQueueSetLimits(caPutLogQueue *q, unsigned maxMsgs,
+    size_t maxBytes, caPutLogOverflowPolicy policy, double blockTimeout)
+{
+    unsigned capacity = caPutLogQueueCapacity(q);
+
+    if (policy == caPutLogCoalesce && !q->overflow) {
+        LOGDATA **overflow = calloc(capacity, sizeof(LOGDATA *));
+        unsigned *index = calloc(2 * (size_t)capacity, sizeof(unsigned));
+
+        if (overflow && index) {
+            q->overflowIndex = index;
+            q->overflow = overflow;
+        } else {
+            free(overflow);
+            free(index);
+            errlogSevPrintf(errlogMajor,
+                "caPutLog: out of memory, not coalescing queued puts\n");
+            policy = caPutLogDropNewest;
+        }
+    }
+    q->maxMsgs = (maxMsgs && maxMsgs < capacity) ? maxMsgs : capacity;
+    q->maxBytes = maxBytes;
+    q->blockTimeout = blockTimeout > 0.0 ? blockTimeout : 0.0;
+    /* publishes the overflow table as well */
+    epicsAtomicSetIntT(&q->policy, policy);
+    if (epicsAtomicGetIntT(&q->blockedWaiters))
+        epicsEventSignal(q->space);
+}
+
+void caPutLogQueueGetStats(const caPutLogQueue *q, caPutLogQueueStats *pstats)
+{
+    pstats->pending = caPutLogQueuePending(q) +
+        (unsigned)epicsAtomicGetIntT(&q->overflowCount);
+    pstats->pendingBytes = epicsAtomicGetSizeT(&q->pendingBytes);
+    pstats->highWater = (unsigned)epicsAtomicGetSizeT(&q->highWater);
+    pstats->droppedNewest = epicsAtomicGetSizeT(&q->droppedNewest);
+    pstats->droppedOldest = epicsAtomicGetSizeT(&q->droppedOldest);
+    pstats->droppedBlocked = epicsAtomicGetSizeT(&q->droppedBlocked);
+    pstats->coalesced = epicsAtomicGetSizeT(&q->coalesced);
+    pstats->blocked = epicsAtomicGetSizeT(&q->blocked);
+}
+
+void caPutLogQueueShow(const caPutLogQueue *q, const char *name)
+{
+    caPutLogQueueStats stats;
+
+    caPutLogQueueGetStats(q, &stats);
+    printf("%s queue: %u of %u messages", name, stats.pending, q->maxMsgs);
+    if (q->maxBytes)
+        printf(", %lu of %lu bytes", (unsigned long)stats.pendingBytes,
+            (unsigned long)q->maxBytes);
+    else
+        printf(", %lu bytes", (unsigned long)stats.pendingBytes);
+    printf(" (high water %u, capacity %u)\n", stats.highWater, caPutLogQueueCapacity(q));
+    printf("%s overflow policy: %s", name, caPutLogQueuePolicyName(q->policy));
+    if (q->policy == caPutLogBlock)
+        printf(", timeout %g s", q->blockTimeout);
+    printf("\n%s dropped: %lu newest, %lu oldest, %lu after blocking;"
+        " coalesced: %lu, blocked: %lu\n", name,
+        (unsigned long)stats.droppedNewest, (unsigned long)stats.droppedOldest,
+        (unsigned long)stats.droppedBlocked, (unsigned long)stats.coalesced,
+        (unsigned long)stats.blocked);
+}
+
+int caPutLogQueuePolicyFromName(const char *name)
+{
+    int i;
+
+    for (i = 0; name && i < (int)(sizeof(policyNames) / sizeof(policyNames[0])); i++) {
+        if (strcmp(name, policyNames[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *caPutLogQueuePolicyName(int policy)
+{
+    if (policy < 0 || policy >= (int)(sizeof(policyNames) / sizeof(policyNames[0])))
+        return "invalid";
+    return policyNames[policy];
+}
@@ -0,0 +1,90 @@
+#ifndef INCcaPutLogQueueh
+#define INCcaPutLogQueueh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#include "caPutLogTask.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded lock-free multi-producer/single-consumer queue of LOGDATA
+ * pointers. Any number of threads (the CA server threads running the
+ * access security trap) may call caPutLogQueueTrySend() concurrently,
+ * exactly one thread (the logger task) may call caPutLogQueueReceive().
+ */
+typedef struct caPutLogQueue caPutLogQueue;
+
+/* The capacity is rounded up to the next power of two */
+epicsShareFunc caPutLogQueue *caPutLogQueueCreate(unsigned capacity);
+epicsShareFunc void caPutLogQueueDestroy(caPutLogQueue *q);
+
+/* Returns 0 on success, -1 if the queue is full */
+epicsShareFunc int caPutLogQueueTrySend(caPutLogQueue *q, LOGDATA *plogData);
+
+/*
+ * Move up to max entries into pbuf, waiting up to timeout seconds for the
+ * first one to arrive (a negative timeout waits forever). Returns the
+ * number of entries received, 0 on timeout.
+ */
+epicsShareFunc unsigned caPutLogQueueReceive(caPutLogQueue *q,
+    LOGDATA **pbuf, unsigned max, double timeout);
+
+epicsShareFunc unsigned caPutLogQueueCapacity(const caPutLogQueue *q);
+epicsShareFunc unsigned caPutLogQueuePending(const caPutLogQueue *q);
+
+/*
+ * What caPutLogQueueSend does with a put that does not fit the limits
+ */
+typedef enum {
+    caPutLogDropNewest,     /* drop the put */
+    caPutLogDropOldest,     /* queue it, the receiver drops the oldest puts */
+    caPutLogCoalesce,       /* merge it into a queued put to the same field */
+    caPutLogBlock           /* wait up to a timeout for room, then drop it */
+} caPutLogOverflowPolicy;
+
+typedef struct {
+    unsigned        pending;        /* puts queued */
+    size_t          pendingBytes;   /* and their size */
+    unsigned        highWater;      /* most puts queued at once */
+    size_t          droppedNewest;  /* puts dropped on arrival */
+    size_t          droppedOldest;  /* queued puts dropped for newer ones */
+    size_t          droppedBlocked; /* puts dropped after waiting for room */
+    size_t          coalesced;      /* puts merged into a queued put */
+    size_t          blocked;        /* puts that had to wait for room */
+} caPutLogQueueStats;
+
+/*
+ * Limit the puts queued by caPutLogQueueSend to maxMsgs entries (0 or
+ * more than the capacity: the capacity) and maxBytes bytes of LOGDATA
+ * (0: no limit). The limits can be changed at any time.
+ */
+epicsShareFunc void caPutLogQueueSetLimits(caPutLogQueue *q, unsigned maxMsgs,
+    size_t maxBytes, caPutLogOverflowPolicy policy, double blockTimeout);
+
+/*
+ * Queue a put subject to the limits. The queue takes ownership: returns
+ * 0 if the put was queued or merged, -1 if it has been dropped (and
+ * freed). Puts dropped by the receiver (caPutLogDropOldest) only show up
+ * in the statistics. caPutLogQueueTrySend bypasses the limits.
+ */
+epicsShareFunc int caPutLogQueueSend(caPutLogQueue *q, LOGDATA *plogData);
+
+epicsShareFunc void caPutLogQueueGetStats(const caPutLogQueue *q,
+    caPutLogQueueStats *pstats);
+
+/* Print limits and statistics, lines prefixed with name */
+epicsShareFunc void caPutLogQueueShow(const caPutLogQueue *q, const char *name);
+
+/* Policy names as used by the shell commands; -1 if unknown */
+epicsShareFunc int caPutLogQueuePolicyFromName(const char *name);
+epicsShareFunc const char *caPutLogQueuePolicyName(int policy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogQueueh*/
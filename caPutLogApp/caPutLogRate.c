@@ -0,0 +1,476 @@
+/*	File:	  caPutLogRate.c
+ *
+ *	Token bucket rate limits of the trap, see caPutLogRate.h.
+ *
+ *	The buckets of both kinds share caPutLogRateShards hash tables. The
+ *	low bits of a key's hash select the table and its mutex, the next
+ *	ones the chain in it. A put locks the table of its PV and then the
+ *	one of its client, never both at the same time. Without limits it
+ *	does not look at the tables at all.
+ *
+ *	The sweep for counts no put has taken over only walks the tables
+ *	while some bucket holds one, at most once per SWEEP_INTERVAL. It
+ *	unlocks the table around each report, which is safe as long as the
+ *	buckets are not freed; only caPutLogRateClear() frees them, and not
+ *	while the trap is registered.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <cantProceed.h>
+#include <errlog.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogTask.h"
+#include "caPutLogRate.h"
+
+#ifndef VERSION_INT
+#define VERSION_INT(V,R,M,P) (((V)<<24) | ((R)<<16) | ((M)<<8) | (P))
+#endif
+#ifndef EPICS_VERSION_INT
+#define EPICS_VERSION_INT VERSION_INT(EPICS_VERSION, EPICS_REVISION, EPICS_MODIFICATION, EPICS_PATCH_LEVEL)
+#endif
+
+#define SHARD_BITS  6               /* 1 << SHARD_BITS == caPutLogRateShards */
+#define CHAINS      256             /* per shard */
+#define SWEEP_INTERVAL 1.0          /* seconds between sweeps */
+
+typedef struct rateBucket {
+    struct rateBucket *next;
+    unsigned        hash;
+    const void      *pfield;        /* of a PV's bucket, NULL for a client's */
+    double          tokens;
+    double          last;           /* time of the last refill */
+    unsigned        suppressed;     /* puts dropped since the last one logged */
+    char            name[1];        /* PV name of a PV's bucket,
+                                       "user\0host" of a client's */
+} rateBucket;
+
+typedef struct {
+    epicsMutexId    lock;
+    rateBucket      *chains[CHAINS];
+} rateShard;
+
+typedef struct {
+    volatile double rate;           /* tokens per second, 0: no limit */
+    volatile double burst;          /* capacity of a bucket */
+} rateLimit;
+
+static const char *const scopeNames[] = { "pv", "client" };
+
+static rateLimit limits[2];
+static int limited;                 /* a limit is set */
+static rateShard *shards;
+static epicsThreadOnceId onceId = EPICS_THREAD_ONCE_INIT;
+static int nbuckets[2];
+static int npending;                /* buckets with a count to report */
+static double sweptAt;              /* time of the last sweep */
+static size_t suppressedTotal;
+static int trapRegistered;          /* CA threads may be in caPutLogRatePut */
+#if EPICS_VERSION_INT < VERSION_INT(7,0,0,0)
+static epicsTimeStamp start;
+#endif
+
+static void rateInit(void *arg)
+{
+    unsigned i;
+
+    shards = callocMustSucceed(caPutLogRateShards, sizeof(rateShard), "caPutLogRate");
+    for (i = 0; i < caPutLogRateShards; i++)
+        shards[i].lock = epicsMutexMustCreate();
+#if EPICS_VERSION_INT < VERSION_INT(7,0,0,0)
+    epicsTimeGetCurrent(&start);
+#endif
+}
+
+static double rateNow(void)
+{
+#if EPICS_VERSION_INT >= VERSION_INT(7,0,0,0)
+    return epicsMonotonicGet() * 1e-9;
+#else
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &start);
+#endif
+}
+
+static unsigned hashField(const void *pfield)
+{
+    size_t key = (size_t)pfield >> 3;
+
+    return (unsigned)key * 2654435761u;
+}
+
+/* FNV-1a over "user\0host" */
+static unsigned hashClient(const char *userid, const char *hostid)
+{
+    unsigned hash = 2166136261u;
+
+    while (*userid)
+        hash = (hash ^ (unsigned char)*userid++) * 16777619u;
+    hash *= 16777619u;
+    while (*hostid)
+        hash = (hash ^ (unsigned char)*hostid++) * 16777619u;
+    return hash;
+}
+
+int caPutLogRateSet(const char *scope, double rate, double burst)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (scope && strcmp(scope, scopeNames[i]) == 0)
+            break;
+    }
+    if (i == 2) {
+        errlogSevPrintf(errlogMinor, "caPutLog: unknown rate limit '%s' (pv, client)\n",
+            scope ? scope : "");
+        return -1;
+    }
+    epicsThreadOnce(&onceId, rateInit, NULL);
+
+    if (rate > 0.0) {
+        if (burst <= 0.0)
+            burst = rate;
+        limits[i].burst = burst < 1.0 ? 1.0 : burst;
+        limits[i].rate = rate;
+    } else {
+        limits[i].rate = 0.0;
+    }
+    epicsAtomicSetIntT(&limited, limits[0].rate > 0.0 || limits[1].rate > 0.0);
+    return 0;
+}
+
+/*
+ * Find or create the bucket, with the shard locked; NULL (and unlocked)
+ * if there are too many buckets already
+ */
+static rateBucket *lockBucket(int scope, unsigned hash, const void *pfield,
+    const char *pvname, const char *userid, const char *hostid, double now)
+{
+    rateShard *pshard = &shards[hash & (caPutLogRateShards - 1)];
+    rateBucket **pchain = &pshard->chains[(hash >> SHARD_BITS) & (CHAINS - 1)];
+    rateBucket *pbucket;
+    size_t namelen, userlen = 0, hostlen = 0;
+
+    epicsMutexMustLock(pshard->lock);
+    for (pbucket = *pchain; pbucket; pbucket = pbucket->next) {
+        if (pbucket->hash != hash)
+            continue;
+        if (scope == caPutLogRatePv ? pbucket->pfield == pfield :
+                !pbucket->pfield && strcmp(pbucket->name, userid) == 0 &&
+                strcmp(pbucket->name + strlen(userid) + 1, hostid) == 0)
+            return pbucket;
+    }
+
+    if (epicsAtomicGetIntT(&nbuckets[0]) + epicsAtomicGetIntT(&nbuckets[1]) >=
+            caPutLogRateMaxBuckets) {
+        epicsMutexUnlock(pshard->lock);
+        return NULL;
+    }
+    if (pfield) {
+        namelen = strlen(pvname);
+        if (namelen > PVNAME_STRINGSZ - 1)
+            namelen = PVNAME_STRINGSZ - 1;
+    } else {
+        userlen = strlen(userid);
+        hostlen = strlen(hostid);
+        namelen = userlen + hostlen + 1;
+    }
+    pbucket = malloc(sizeof(rateBucket) + namelen);
+    if (!pbucket) {
+        epicsMutexUnlock(pshard->lock);
+        return NULL;
+    }
+    pbucket->hash = hash;
+    pbucket->pfield = pfield;
+    pbucket->tokens = limits[scope].burst;
+    pbucket->last = now;
+    pbucket->suppressed = 0;
+    if (pfield) {
+        memcpy(pbucket->name, pvname, namelen);
+        pbucket->name[namelen] = 0;
+    } else {
+        memcpy(pbucket->name, userid, userlen + 1);
+        memcpy(pbucket->name + userlen + 1, hostid, hostlen + 1);
+    }
+    pbucket->next = *pchain;
+    *pchain = pbucket;
+    epicsAtomicIncrIntT(&nbuckets[scope]);
+    return pbucket;
+}
+
+static void unlockBucket(const rateBucket *pbucket)
+{
+    epicsMutexUnlock(shards[pbucket->hash & (caPutLogRateShards - 1)].lock);
+}
+
+/* Lock a bucket found earlier; buckets are never freed */
+static void relockBucket(const rateBucket *pbucket)
+{
+    epicsMutexMustLock(shards[pbucket->hash & (caPutLogRateShards - 1)].lock);
+}
+
+/* Add to the bucket's count of suppressed puts; with its shard locked */
+static void addSuppressed(rateBucket *pbucket, unsigned count)
+{
+    if (!count)
+        return;
+    if (!pbucket->suppressed)
+        epicsAtomicIncrIntT(&npending);
+    pbucket->suppressed += count;
+}
+
+/* Take over the bucket's count; with its shard locked */
+static unsigned takeSuppressed(rateBucket *pbucket)
+{
+    unsigned count = pbucket->suppressed;
+
+    if (count) {
+        pbucket->suppressed = 0;
+        epicsAtomicDecrIntT(&npending);
+    }
+    return count;
+}
+
+/* Refill the bucket for the time passed */
+static void refill(rateBucket *pbucket, const rateLimit *plimit, double now)
+{
+    if (now > pbucket->last) {
+        pbucket->tokens += (now - pbucket->last) * plimit->rate;
+        pbucket->last = now;
+    }
+    if (pbucket->tokens > plimit->burst)
+        pbucket->tokens = plimit->burst;
+}
+
+/*
+ * Refill the bucket and take a token; counts the put as suppressed if
+ * there is none
+ */
+static int takeToken(rateBucket *pbucket, const rateLimit *plimit, double now)
+{
+    refill(pbucket, plimit, now);
+    if (pbucket->tokens < 1.0) {
+        addSuppressed(pbucket, 1);
+        epicsAtomicIncrSizeT(&suppressedTotal);
+        return 0;
+    }
+    pbucket->tokens -= 1.0;
+    return 1;
+}
+
+int caPutLogRatePut(const dbAddr *paddr, const char *pvname, const char *userid,
+    const char *hostid, unsigned suppressed[2])
+{
+    rateBucket *pvBucket = NULL, *pbucket;
+    int pvPending = 0;
+    double now;
+
+    suppressed[caPutLogRatePv] = suppressed[caPutLogRateClient] = 0;
+    if (!epicsAtomicGetIntT(&limited))
+        return 1;
+    now = rateNow();
+
+    if (limits[caPutLogRatePv].rate > 0.0) {
+        pvBucket = lockBucket(caPutLogRatePv, hashField(paddr->pfield), paddr->pfield,
+            pvname, NULL, NULL, now);
+        if (pvBucket) {
+            if (!takeToken(pvBucket, &limits[caPutLogRatePv], now)) {
+                unlockBucket(pvBucket);
+                return 0;
+            }
+            /* taken over only once the client's bucket lets the put pass */
+            pvPending = pvBucket->suppressed != 0;
+            unlockBucket(pvBucket);
+        }
+    }
+
+    if (limits[caPutLogRateClient].rate > 0.0) {
+        pbucket = lockBucket(caPutLogRateClient, hashClient(userid, hostid), NULL,
+            NULL, userid, hostid, now);
+        if (pbucket) {
+            if (!takeToken(pbucket, &limits[caPutLogRateClient], now)) {
+                unlockBucket(pbucket);
+                if (pvBucket) {
+                    /* the put is not logged, so it does not use up the PV's token */
+                    relockBucket(pvBucket);
+                    pvBucket->tokens += 1.0;
+                    if (pvBucket->tokens > limits[caPutLogRatePv].burst)
+                        pvBucket->tokens = limits[caPutLogRatePv].burst;
+                    unlockBucket(pvBucket);
+                }
+                return 0;
+            }
+            suppressed[caPutLogRateClient] = takeSuppressed(pbucket);
+            unlockBucket(pbucket);
+        }
+    }
+
+    if (pvPending) {
+        relockBucket(pvBucket);
+        suppressed[caPutLogRatePv] = takeSuppressed(pvBucket);
+        unlockBucket(pvBucket);
+    }
+    return 1;
+}
+
+void caPutLogRateReturn(const dbAddr *paddr, const char *pvname, const char *userid,
+    const char *hostid, const unsigned suppressed[2])
+{
+    rateBucket *pbucket;
+    double now;
+
+    if (!suppressed[caPutLogRatePv] && !suppressed[caPutLogRateClient])
+        return;
+    now = rateNow();
+    if (suppressed[caPutLogRatePv]) {
+        pbucket = lockBucket(caPutLogRatePv, hashField(paddr->pfield), paddr->pfield,
+            pvname, NULL, NULL, now);
+        if (pbucket) {
+            addSuppressed(pbucket, suppressed[caPutLogRatePv]);
+            unlockBucket(pbucket);
+        }
+    }
+    if (suppressed[caPutLogRateClient]) {
+        pbucket = lockBucket(caPutLogRateClient, hashClient(userid, hostid), NULL,
+            NULL, userid, hostid, now);
+        if (pbucket) {
+            addSuppressed(pbucket, suppressed[caPutLogRateClient]);
+            unlockBucket(pbucket);
+        }
+    }
+}
+
+/* Copy at most size - 1 characters */
+static void copyName(char *dst, const char *src, size_t size)
+{
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = 0;
+}
+
+double caPutLogRateSweep(caPutLogRateReport *report, void *arg, double idle)
+{
+    char pvname[PVNAME_STRINGSZ], userid[MAX_USERID_SIZE], hostid[MAX_HOSTID_SIZE];
+    double now;
+    unsigned i, j;
+
+    if (!epicsAtomicGetIntT(&npending))
+        return idle;
+    now = rateNow();
+    if (now < sweptAt + SWEEP_INTERVAL)
+        return sweptAt + SWEEP_INTERVAL - now < idle ? sweptAt + SWEEP_INTERVAL - now : idle;
+    sweptAt = now;
+
+    for (i = 0; i < caPutLogRateShards; i++) {
+        rateShard *pshard = &shards[i];
+
+        epicsMutexMustLock(pshard->lock);
+        for (j = 0; j < CHAINS; j++) {
+            rateBucket *pbucket;
+
+            for (pbucket = pshard->chains[j]; pbucket; pbucket = pbucket->next) {
+                int scope = pbucket->pfield ? caPutLogRatePv : caPutLogRateClient;
+                const rateLimit *plimit = &limits[scope];
+                unsigned counts[2];
+
+                if (!pbucket->suppressed)
+                    continue;
+                /* the limit has not cleared yet if a put would be dropped */
+                refill(pbucket, plimit, now);
+                if (plimit->rate > 0.0 && pbucket->tokens < 1.0)
+                    continue;
+
+                counts[caPutLogRatePv] = counts[caPutLogRateClient] = 0;
+                counts[scope] = takeSuppressed(pbucket);
+                pvname[0] = userid[0] = hostid[0] = 0;
+                if (scope == caPutLogRatePv) {
+                    copyName(pvname, pbucket->name, sizeof(pvname));
+                } else {
+                    copyName(userid, pbucket->name, sizeof(userid));
+                    copyName(hostid, pbucket->name + strlen(pbucket->name) + 1,
+                        sizeof(hostid));
+                }
+                epicsMutexUnlock(pshard->lock);
+                /* buckets are never freed, so pbucket stays good */
+                if (!report(arg, pvname, userid, hostid, counts)) {
+                    epicsMutexMustLock(pshard->lock);
+                    addSuppressed(pbucket, counts[scope]);
+                    continue;
+                }
+                epicsMutexMustLock(pshard->lock);
+            }
+        }
+        epicsMutexUnlock(pshard->lock);
+    }
+    return epicsAtomicGetIntT(&npending) && SWEEP_INTERVAL < idle ? SWEEP_INTERVAL : idle;
+}
+
+size_t caPutLogRateSuppressed(void)
+{
+    return epicsAtomicGetSizeT(&suppressedTotal);
+}
+
+void caPutLogRateShow(const char *name)
+{
+    char text[2][64];
+    int i;
+
+    if (!epicsAtomicGetIntT(&limited) && !caPutLogRateSuppressed())
+        return;
+    for (i = 0; i < 2; i++) {
+        if (limits[i].rate > 0.0)
+            sprintf(text[i], "%g/s (burst %g)", limits[i].rate, limits[i].burst);
+        else
+            strcpy(text[i], "none");
+    }
+    printf("%s Rate limits: pv %s, client %s\n", name, text[0], text[1]);
+    printf("%s Rate limits: %lu puts suppressed, %d PV and %d client buckets\n", name,
+        (unsigned long)caPutLogRateSuppressed(), epicsAtomicGetIntT(&nbuckets[0]),
+        epicsAtomicGetIntT(&nbuckets[1]));
+}
+
+void caPutLogRateTrap(int registered)
+{
+    epicsAtomicSetIntT(&trapRegistered, registered != 0);
+}
+
+int caPutLogRateClear(void)
+{
+    unsigned i, j;
+
+    if (epicsAtomicGetIntT(&trapRegistered)) {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: rate limit buckets cannot be cleared while the trap is registered\n");
+        return -1;
+    }
+    epicsThreadOnce(&onceId, rateInit, NULL);
+    epicsAtomicSetIntT(&limited, 0);
+    limits[0].rate = limits[1].rate = 0.0;
+    for (i = 0; i < caPutLogRateShards; i++) {
+        epicsMutexMustLock(shards[i].lock);
+        for (j = 0; j < CHAINS; j++) {
+            while (shards[i].chains[j]) {
+                rateBucket *pbucket = shards[i].chains[j];
+
+                shards[i].chains[j] = pbucket->next;
+                free(pbucket);
+            }
+        }
+        epicsMutexUnlock(shards[i].lock);
+    }
+    epicsAtomicSetIntT(&nbuckets[0], 0);
+    epicsAtomicSetIntT(&nbuckets[1], 0);
+    epicsAtomicSetIntT(&npending, 0);
+    sweptAt = 0.0;
+    epicsAtomicSetSizeT(&suppressedTotal, 0);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef INCcaPutLogRateh
+#define INCcaPutLogRateh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+#include <dbAddr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Rate limits: a token bucket for each PV (record field) and one for each
+ * client (user and host), checked in the access security trap before
+ * anything is allocated or read. A bucket holds up to burst tokens and
+ * gains rate tokens per second; a put takes one from the PV's bucket and
+ * one from the client's. A put that finds a bucket empty is not logged,
+ * only counted in that bucket (a put the client's bucket drops gives the
+ * PV's token back). The next put logged through the bucket takes over the
+ * count, and the loggers write a summary line for it. A count no put has
+ * taken over by the time the bucket has refilled is reported by
+ * caPutLogRateSweep() instead.
+ *
+ * The buckets are spread over caPutLogRateShards hash tables, each with a
+ * mutex of its own, so that CA server threads putting to different PVs
+ * or from different clients rarely wait for each other. Buckets are never
+ * removed; beyond caPutLogRateMaxBuckets puts are not limited.
+ */
+
+#define caPutLogRateShards      64
+#define caPutLogRateMaxBuckets  100000
+
+/* Which bucket a limit applies to */
+#define caPutLogRatePv          0
+#define caPutLogRateClient      1
+
+/*
+ * Set the limit of scope "pv" or "client" to rate puts per second with
+ * bursts of up to burst puts (burst <= 0: one second's worth); rate <= 0
+ * lifts it. May be changed at any time. -1 for an unknown scope.
+ */
+epicsShareFunc int caPutLogRateSet(const char *scope, double rate, double burst);
+
+/*
+ * Whether to log a put to the field (PV pvname) from the client. If so,
+ * suppressed[] receives the numbers of puts the PV's and the client's
+ * bucket dropped since the previous put logged through them (usually 0).
+ */
+epicsShareFunc int caPutLogRatePut(const dbAddr *paddr, const char *pvname,
+    const char *userid, const char *hostid, unsigned suppressed[2]);
+
+/*
+ * Give the counts caPutLogRatePut() handed over back to the buckets, for
+ * a put that cannot be logged after all
+ */
+epicsShareFunc void caPutLogRateReturn(const dbAddr *paddr, const char *pvname,
+    const char *userid, const char *hostid, const unsigned suppressed[2]);
+
+/*
+ * Gets a count of suppressed puts that no put has taken over: the PV
+ * name for a PV's bucket, user and host for a client's (the others
+ * empty), and the count in suppressed[] of that scope, the other 0.
+ * Returns 0 if it could not log the count, which then stays pending.
+ */
+typedef int caPutLogRateReport(void *arg, const char *pvname, const char *userid,
+    const char *hostid, const unsigned suppressed[2]);
+
+/*
+ * Report the counts of buckets that have refilled (or whose limit was
+ * lifted) since they dropped a put. Called by the logger task before it
+ * waits for puts, from one thread only; returns idle, or the seconds
+ * until the next sweep if that is sooner and a count is still pending.
+ */
+epicsShareFunc double caPutLogRateSweep(caPutLogRateReport *report, void *arg,
+    double idle);
+
+/* Puts dropped so far, by both limits */
+epicsShareFunc size_t caPutLogRateSuppressed(void);
+epicsShareFunc void caPutLogRateShow(const char *name);
+
+/* The trap has been (1) or is no longer (0) registered, from caPutLogAs.c */
+epicsShareFunc void caPutLogRateTrap(int registered);
+
+/*
+ * Lift the limits and drop all buckets, for tests only. -1 while the trap
+ * is registered, as CA threads may be holding a bucket then.
+ */
+epicsShareFunc int caPutLogRateClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogRateh*/
@@ -16,15 +16,17 @@
 static const iocshArg caPutLogInitArg0 = {"address", iocshArgString};
 static const iocshArg caPutLogInitArg1 = {"config", iocshArgInt};
 static const iocshArg caPutLogInitArg2 = {"burst timeout", iocshArgDouble};
+static const iocshArg caPutLogInitArg3 = {"copies", iocshArgInt};
 static const iocshArg *const caPutLogInitArgs[] = {
     &caPutLogInitArg0,
     &caPutLogInitArg1,
-    &caPutLogInitArg2
+    &caPutLogInitArg2,
+    &caPutLogInitArg3
 };
-static const iocshFuncDef caPutLogInitDef = {"caPutLogInit", 3, caPutLogInitArgs};
+static const iocshFuncDef caPutLogInitDef = {"caPutLogInit", 4, caPutLogInitArgs};
 static void caPutLogInitCall(const iocshArgBuf *args)
 {
-    caPutLogInit(args[0].sval, args[1].ival, args[2].dval);
+    caPutLogInitCopies(args[0].sval, args[1].ival, args[2].dval, args[3].ival);
 }
 
 static const iocshArg caPutLogReconfArg0 = {"config", iocshArgInt};
@@ -91,6 +93,122 @@ static void caPutLogSetBurstTimeoutCall(const iocshArgBuf *args)
     caPutLogSetBurstTimeout(args[0].dval);
 }
 
+static const iocshArg caPutLogSetQueueArg0 = {"messages", iocshArgInt};
+static const iocshArg caPutLogSetQueueArg1 = {"bytes", iocshArgInt};
+static const iocshArg caPutLogSetQueueArg2 = {"policy", iocshArgString};
+static const iocshArg caPutLogSetQueueArg3 = {"block timeout", iocshArgDouble};
+static const iocshArg *const caPutLogSetQueueArgs[] = {
+    &caPutLogSetQueueArg0,
+    &caPutLogSetQueueArg1,
+    &caPutLogSetQueueArg2,
+    &caPutLogSetQueueArg3
+};
+static const iocshFuncDef caPutLogSetQueueDef = {"caPutLogSetQueue", 4, caPutLogSetQueueArgs};
+static void caPutLogSetQueueCall(const iocshArgBuf *args)
+{
+    caPutLogSetQueue(args[0].ival, args[1].ival, args[2].sval, args[3].dval);
+}
+
+static const iocshArg caPutLogSetNumFmtArg0 = {"format", iocshArgString};
+static const iocshArg *const caPutLogSetNumFmtArgs[] = {
+    &caPutLogSetNumFmtArg0
+};
+static const iocshFuncDef caPutLogSetNumFmtDef = {"caPutLogSetNumFmt", 1, caPutLogSetNumFmtArgs};
+static void caPutLogSetNumFmtCall(const iocshArgBuf *args)
+{
+    caPutLogSetNumFmt(args[0].sval);
+}
+
+static const iocshArg caPutLogSetBatchArg0 = {"bytes", iocshArgInt};
+static const iocshArg caPutLogSetBatchArg1 = {"delay ms", iocshArgDouble};
+static const iocshArg *const caPutLogSetBatchArgs[] = {
+    &caPutLogSetBatchArg0,
+    &caPutLogSetBatchArg1
+};
+static const iocshFuncDef caPutLogSetBatchDef = {"caPutLogSetBatch", 2, caPutLogSetBatchArgs};
+static void caPutLogSetBatchCall(const iocshArgBuf *args)
+{
+    caPutLogSetBatch(args[0].ival, args[1].dval);
+}
+
+static const iocshArg caPutLogSetSpoolArg0 = {"directory", iocshArgString};
+static const iocshArg caPutLogSetSpoolArg1 = {"bytes", iocshArgInt};
+static const iocshArg caPutLogSetSpoolArg2 = {"replay rate", iocshArgDouble};
+static const iocshArg caPutLogSetSpoolArg3 = {"ack", iocshArgInt};
+static const iocshArg *const caPutLogSetSpoolArgs[] = {
+    &caPutLogSetSpoolArg0,
+    &caPutLogSetSpoolArg1,
+    &caPutLogSetSpoolArg2,
+    &caPutLogSetSpoolArg3
+};
+static const iocshFuncDef caPutLogSetSpoolDef = {"caPutLogSetSpool", 4, caPutLogSetSpoolArgs};
+static void caPutLogSetSpoolCall(const iocshArgBuf *args)
+{
+    caPutLogSetSpool(args[0].sval, args[1].ival, args[2].dval, args[3].ival);
+}
+
+static const iocshArg caPutLogSetHistoryArg0 = {"text PV", iocshArgString};
+static const iocshArg caPutLogSetHistoryArg1 = {"sequence PV", iocshArgString};
+static const iocshArg caPutLogSetHistoryArg2 = {"messages", iocshArgInt};
+static const iocshArg *const caPutLogSetHistoryArgs[] = {
+    &caPutLogSetHistoryArg0,
+    &caPutLogSetHistoryArg1,
+    &caPutLogSetHistoryArg2
+};
+static const iocshFuncDef caPutLogSetHistoryDef = {"caPutLogSetHistory", 3, caPutLogSetHistoryArgs};
+static void caPutLogSetHistoryCall(const iocshArgBuf *args)
+{
+    caPutLogSetHistory(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static const iocshArg caPutLogAddFilterArg0 = {"include|exclude", iocshArgString};
+static const iocshArg caPutLogAddFilterArg1 = {"pattern", iocshArgString};
+static const iocshArg *const caPutLogAddFilterArgs[] = {
+    &caPutLogAddFilterArg0,
+    &caPutLogAddFilterArg1
+};
+static const iocshFuncDef caPutLogAddFilterDef = {"caPutLogAddFilter", 2, caPutLogAddFilterArgs};
+static void caPutLogAddFilterCall(const iocshArgBuf *args)
+{
+    caPutLogAddFilter(args[0].sval, args[1].sval);
+}
+
+static const iocshArg caPutLogLoadFilterArg0 = {"file", iocshArgString};
+static const iocshArg *const caPutLogLoadFilterArgs[] = {
+    &caPutLogLoadFilterArg0
+};
+static const iocshFuncDef caPutLogLoadFilterDef = {"caPutLogLoadFilter", 1, caPutLogLoadFilterArgs};
+static void caPutLogLoadFilterCall(const iocshArgBuf *args)
+{
+    caPutLogLoadFilter(args[0].sval);
+}
+
+static const iocshArg caPutLogSetRateLimitArg0 = {"pv|client", iocshArgString};
+static const iocshArg caPutLogSetRateLimitArg1 = {"puts per second", iocshArgDouble};
+static const iocshArg caPutLogSetRateLimitArg2 = {"burst", iocshArgDouble};
+static const iocshArg *const caPutLogSetRateLimitArgs[] = {
+    &caPutLogSetRateLimitArg0,
+    &caPutLogSetRateLimitArg1,
+    &caPutLogSetRateLimitArg2
+};
+static const iocshFuncDef caPutLogSetRateLimitDef = {"caPutLogSetRateLimit", 3, caPutLogSetRateLimitArgs};
+static void caPutLogSetRateLimitCall(const iocshArgBuf *args)
+{
+    caPutLogSetRateLimit(args[0].sval, args[1].dval, args[2].dval);
+}
+
+static const iocshArg caPutLogSetDeadbandArg0 = {"float|integer|all", iocshArgString};
+static const iocshArg caPutLogSetDeadbandArg1 = {"deadband", iocshArgString};
+static const iocshArg *const caPutLogSetDeadbandArgs[] = {
+    &caPutLogSetDeadbandArg0,
+    &caPutLogSetDeadbandArg1
+};
+static const iocshFuncDef caPutLogSetDeadbandDef = {"caPutLogSetDeadband", 2, caPutLogSetDeadbandArgs};
+static void caPutLogSetDeadbandCall(const iocshArgBuf *args)
+{
+    caPutLogSetDeadband(args[0].sval, args[1].sval);
+}
+
 static void caPutLogRegister(void)
 {
     extern int caPutLogRegisterDone;
@@ -103,6 +221,15 @@ static void caPutLogRegister(void)
         iocshRegister(&caPutLogSetTimeFmtDef,caPutLogSetTimeFmtCall);
         iocshRegister(&caPutJsonLogInitDef,caPutJsonLogInitCall);
         iocshRegister(&caPutLogSetBurstTimeoutDef,caPutLogSetBurstTimeoutCall);
+        iocshRegister(&caPutLogSetQueueDef,caPutLogSetQueueCall);
+        iocshRegister(&caPutLogSetNumFmtDef,caPutLogSetNumFmtCall);
+        iocshRegister(&caPutLogSetBatchDef,caPutLogSetBatchCall);
+        iocshRegister(&caPutLogSetSpoolDef,caPutLogSetSpoolCall);
+        iocshRegister(&caPutLogSetHistoryDef,caPutLogSetHistoryCall);
+        iocshRegister(&caPutLogAddFilterDef,caPutLogAddFilterCall);
+        iocshRegister(&caPutLogLoadFilterDef,caPutLogLoadFilterCall);
+        iocshRegister(&caPutLogSetRateLimitDef,caPutLogSetRateLimitCall);
+        iocshRegister(&caPutLogSetDeadbandDef,caPutLogSetDeadbandCall);
         caPutLogRegisterDone = 1;
         break;
 
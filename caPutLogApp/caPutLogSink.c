@@ -0,0 +1,684 @@
+/*	File:	  caPutLogSink.c
+ *
+ *	Per-sink queues and sender threads, see caPutLogSink.h.
+ *
+ *	Each sink owns a ring of message pointers under its own mutex. The
+ *	logger task only takes that mutex to add a reference and store the
+ *	pointer; the sink's thread takes the oldest entry, releases the
+ *	mutex and calls the transport, so a transport that blocks only
+ *	stalls its own queue. When the queue is full the new message is
+ *	dropped for this sink and counted.
+ *
+ *	The thread takes whatever is queued, up to the batch size, in one
+ *	go, so under load the transport sees few large writes instead of
+ *	one per message. With a batch delay it waits for more messages as
+ *	long as the oldest one has not reached the deadline; the logger
+ *	wakes it early when the queued bytes reach the batch size.
+ *
+ *	Keyed messages with copies set go to a window of the list, starting
+ *	at key modulo the number of sinks; sinks that are down are skipped
+ *	and the window extends over the next ones.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <osiSock.h>
+#include <logClient.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <epicsString.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogSink.h"
+#include "caPutLogTcp.h"
+#include "caPutLogFile.h"
+
+#define DEFAULT_QUEUE_SIZE 1000
+
+/* Messages queued per sink */
+int caPutLogSinkQueueSize = DEFAULT_QUEUE_SIZE;
+epicsExportAddress(int, caPutLogSinkQueueSize);
+
+/* Use base's logClient for the servers */
+int caPutLogUseLogClient = 0;
+epicsExportAddress(int, caPutLogUseLogClient);
+
+struct entry {
+    caPutLogMsg     *pmsg;
+    epicsTimeStamp  queued;
+};
+
+typedef struct sink {
+    struct sink     *next;
+    const caPutLogSinkTransport *ptransport;
+    void            *ctx;
+    epicsMutexId    lock;
+    epicsEventId    wakeup;     /* messages queued or stop requested */
+    epicsEventId    idle;       /* the queue ran empty */
+    epicsEventId    done;       /* the thread has exited */
+    int             stop;
+    unsigned        busy;       /* entries the thread is sending */
+    int             chosen;     /* for the keyed message being queued */
+    unsigned        capacity;
+    unsigned        head;       /* oldest entry */
+    unsigned        count;
+    size_t          bytes;      /* queued */
+    size_t          batchBytes;
+    double          batchDelay;
+    struct entry    *entries;
+    caPutLogSinkStats stats;
+    char            address[1];
+} sink;
+
+struct caPutLogSinkList {
+    epicsMutexId    lock;
+    sink            *first;
+    unsigned        count;
+    unsigned        queueSize;
+    unsigned        copies;     /* of keyed messages, 0: all sinks */
+    size_t          batchBytes;
+    double          batchDelay;
+    char            *spoolDir;
+    size_t          spoolCapacity;
+    double          spoolRate;
+    int             spoolAck;
+    caPutLogSinkPreamble *preamble;
+    void            *preambleArg;
+    char            name[1];
+};
+
+caPutLogMsg *caPutLogMsgCreate(const char *text, size_t len)
+{
+    caPutLogMsg *pmsg = mallocMustSucceed(sizeof(caPutLogMsg) + len, "caPutLogMsgCreate");
+
+    pmsg->refs = 1;
+    pmsg->len = len;
+    memcpy(pmsg->text, text, len);
+    pmsg->text[len] = 0;
+    return pmsg;
+}
+
+void caPutLogMsgAddRef(caPutLogMsg *pmsg)
+{
+    epicsAtomicIncrIntT(&pmsg->refs);
+}
+
+void caPutLogMsgRelease(caPutLogMsg *pmsg)
+{
+    if (pmsg && epicsAtomicDecrIntT(&pmsg->refs) == 0)
+        free(pmsg);
+}
+
+/* Call with the sink locked: wait for more messages before sending? */
+static double holdBack(sink *psink)
+{
+    epicsTimeStamp now;
+
+    if (psink->batchDelay <= 0.0 || psink->bytes >= psink->batchBytes
+            || psink->count >= caPutLogSinkMaxBatch)
+        return 0.0;
+    epicsTimeGetCurrent(&now);
+    return psink->batchDelay -
+        epicsTimeDiffInSeconds(&now, &psink->entries[psink->head].queued);
+}
+
+static void sinkThread(void *arg)
+{
+    sink *psink = (sink *)arg;
+    caPutLogMsg *batch[caPutLogSinkMaxBatch];
+
+    epicsMutexMustLock(psink->lock);
+    while (!psink->stop) {
+        epicsTimeStamp oldest, now;
+        unsigned n = 0, i;
+        size_t bytes = 0;
+        double wait, lag;
+        int status;
+
+        if (psink->count == 0) {
+            epicsMutexUnlock(psink->lock);
+            wait = psink->ptransport->idle ? psink->ptransport->idle(psink->ctx) : 0.0;
+            if (wait > 0.0)
+                epicsEventWaitWithTimeout(psink->wakeup, wait);
+            else
+                epicsEventMustWait(psink->wakeup);
+            epicsMutexMustLock(psink->lock);
+            continue;
+        }
+        wait = holdBack(psink);
+        if (wait > 0.0) {
+            epicsMutexUnlock(psink->lock);
+            epicsEventWaitWithTimeout(psink->wakeup, wait);
+            epicsMutexMustLock(psink->lock);
+            continue;
+        }
+
+        oldest = psink->entries[psink->head].queued;
+        do {
+            caPutLogMsg *pmsg = psink->entries[psink->head].pmsg;
+
+            batch[n++] = pmsg;
+            bytes += pmsg->len;
+            psink->head = (psink->head + 1) % psink->capacity;
+            psink->count--;
+        } while (psink->count && n < caPutLogSinkMaxBatch &&
+            bytes + psink->entries[psink->head].pmsg->len <= psink->batchBytes);
+        psink->bytes -= bytes;
+        psink->busy = n;
+        epicsMutexUnlock(psink->lock);
+
+        status = psink->ptransport->send(psink->ctx, batch, n);
+        for (i = 0; i < n; i++)
+            caPutLogMsgRelease(batch[i]);
+        epicsTimeGetCurrent(&now);
+        lag = epicsTimeDiffInSeconds(&now, &oldest);
+
+        epicsMutexMustLock(psink->lock);
+        psink->busy = 0;
+        psink->stats.sent += n;
+        psink->stats.batches++;
+        if (status)
+            psink->stats.failed += n;
+        psink->stats.lastLag = lag;
+        if (lag > psink->stats.maxLag)
+            psink->stats.maxLag = lag;
+        if (psink->count == 0)
+            epicsEventSignal(psink->idle);
+    }
+    epicsMutexUnlock(psink->lock);
+    epicsEventSignal(psink->done);
+}
+
+static void sinkDestroy(sink *psink)
+{
+    epicsMutexMustLock(psink->lock);
+    psink->stop = 1;
+    epicsMutexUnlock(psink->lock);
+    epicsEventSignal(psink->wakeup);
+    epicsEventMustWait(psink->done);
+
+    while (psink->count) {
+        caPutLogMsgRelease(psink->entries[psink->head].pmsg);
+        psink->head = (psink->head + 1) % psink->capacity;
+        psink->count--;
+    }
+    if (psink->ptransport->destroy)
+        psink->ptransport->destroy(psink->ctx);
+    epicsEventDestroy(psink->done);
+    epicsEventDestroy(psink->idle);
+    epicsEventDestroy(psink->wakeup);
+    epicsMutexDestroy(psink->lock);
+    free(psink->entries);
+    free(psink);
+}
+
+caPutLogSinkList *caPutLogSinkListCreate(const char *name, unsigned queueSize)
+{
+    caPutLogSinkList *plist = callocMustSucceed(1, sizeof(caPutLogSinkList) + strlen(name),
+        "caPutLogSinkListCreate");
+
+    strcpy(plist->name, name);
+    plist->lock = epicsMutexMustCreate();
+    plist->queueSize = queueSize;
+    plist->batchBytes = caPutLogSinkDefaultBatchBytes;
+    return plist;
+}
+
+void caPutLogSinkListDestroy(caPutLogSinkList *plist)
+{
+    sink *psink, *pnext;
+
+    if (!plist)
+        return;
+    for (psink = plist->first; psink; psink = pnext) {
+        pnext = psink->next;
+        sinkDestroy(psink);
+    }
+    epicsMutexDestroy(plist->lock);
+    free(plist->spoolDir);
+    free(plist);
+}
+
+/* Call with the list locked */
+static sink **findSink(caPutLogSinkList *plist, const char *address)
+{
+    sink **ppsink;
+
+    for (ppsink = &plist->first; *ppsink; ppsink = &(*ppsink)->next) {
+        if (strcmp(address, (*ppsink)->address) == 0)
+            break;
+    }
+    return ppsink;
+}
+
+int caPutLogSinkAddTransport(caPutLogSinkList *plist, const char *address,
+    const caPutLogSinkTransport *ptransport, void *ctx)
+{
+    sink **ppsink, *psink;
+    unsigned capacity = plist->queueSize;
+    char threadName[32];
+
+    if (!capacity)
+        capacity = caPutLogSinkQueueSize > 0 ? caPutLogSinkQueueSize : DEFAULT_QUEUE_SIZE;
+
+    epicsMutexMustLock(plist->lock);
+    ppsink = findSink(plist, address);
+    if (*ppsink) {
+        epicsMutexUnlock(plist->lock);
+        errlogSevPrintf(errlogMinor, "%s: address %s already configured\n", plist->name, address);
+        return 0;
+    }
+
+    psink = callocMustSucceed(1, sizeof(sink) + strlen(address), "caPutLogSinkAdd");
+    strcpy(psink->address, address);
+    psink->ptransport = ptransport;
+    psink->ctx = ctx;
+    psink->lock = epicsMutexMustCreate();
+    psink->wakeup = epicsEventMustCreate(epicsEventEmpty);
+    psink->idle = epicsEventMustCreate(epicsEventEmpty);
+    psink->done = epicsEventMustCreate(epicsEventEmpty);
+    psink->capacity = capacity;
+    psink->batchBytes = plist->batchBytes;
+    psink->batchDelay = plist->batchDelay;
+    psink->stats.capacity = capacity;
+    psink->entries = callocMustSucceed(capacity, sizeof(struct entry), "caPutLogSinkAdd");
+
+    epicsSnprintf(threadName, sizeof(threadName), "%s-%u", plist->name, plist->count + 1);
+    if (!epicsThreadCreate(threadName, epicsThreadPriorityLow,
+            epicsThreadGetStackSize(epicsThreadStackSmall), sinkThread, psink)) {
+        epicsMutexUnlock(plist->lock);
+        errlogSevPrintf(errlogMajor, "%s: thread creation for %s failed\n", plist->name, address);
+        epicsEventSignal(psink->done);
+        sinkDestroy(psink);
+        return -1;
+    }
+    *ppsink = psink;
+    plist->count++;
+    epicsMutexUnlock(plist->lock);
+    return 0;
+}
+
+/* The batch goes out in one write */
+static int logClientSinkSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+        logClientSend((logClientId)ctx, pmsgs[i]->text);
+    logClientFlush((logClientId)ctx);
+    return 0;
+}
+
+static void logClientSinkFlush(void *ctx)
+{
+    logClientFlush((logClientId)ctx);
+}
+
+static void logClientSinkShow(void *ctx, unsigned level)
+{
+    logClientShow((logClientId)ctx, level);
+}
+
+/* logClients are never destroyed, base does that at exit */
+static const caPutLogSinkTransport logClientTransport = {
+    logClientSinkSend, logClientSinkFlush, logClientSinkShow, NULL
+};
+
+/* The spool file is named after the list and the address */
+static void addSpool(caPutLogSinkList *plist, caPutLogTcp *ptcp, const char *address)
+{
+    size_t len = strlen(plist->spoolDir) + strlen(plist->name) + strlen(address) + 9;
+    char *path = mallocMustSucceed(len, "caPutLogSinkAdd");
+    char *p;
+
+    epicsSnprintf(path, len, "%s/%s-", plist->spoolDir, plist->name);
+    for (p = path + strlen(path); *address; address++)
+        *p++ = strchr(":/\\", *address) ? '_' : *address;
+    strcpy(p, ".spool");
+    caPutLogTcpSetSpool(ptcp, path, plist->spoolCapacity, plist->spoolRate,
+        plist->spoolAck);
+    free(path);
+}
+
+int caPutLogSinkAdd(caPutLogSinkList *plist, const char *address,
+    unsigned short defaultPort)
+{
+    struct sockaddr_in saddr;
+    const char *host = address;
+    logClientId id;
+    caPutLogFile *pfile;
+    int configured, native = !caPutLogUseLogClient, zlib = 0;
+
+    epicsMutexMustLock(plist->lock);
+    configured = *findSink(plist, address) != NULL;
+    epicsMutexUnlock(plist->lock);
+    if (configured) {
+        errlogSevPrintf(errlogMinor, "%s: address %s already configured\n", plist->name, address);
+        return 0;
+    }
+
+    if (strncmp(address, "file://", 7) == 0) {
+        pfile = caPutLogFileCreate(address + 7);
+        if (!pfile)
+            return -1;
+        if (plist->preamble)
+            caPutLogFileSetPreamble(pfile, plist->preamble, plist->preambleArg);
+        return caPutLogSinkAddTransport(plist, address, &caPutLogFileTransport, pfile);
+    }
+    /* logClient cannot write a preamble */
+    if (plist->preamble)
+        native = 1;
+    if (strncmp(address, "tcp://", 6) == 0) {
+        host = address + 6;
+        native = 1;
+    } else if (strncmp(address, "zlib://", 7) == 0) {
+        host = address + 7;
+        native = zlib = 1;
+    }
+    if (aToIPAddr(host, defaultPort, &saddr) < 0) {
+        errlogSevPrintf(errlogMajor, "%s: bad address or host name %s\n", plist->name, address);
+        return -1;
+    }
+    if (native) {
+        caPutLogTcp *ptcp = caPutLogTcpCreate(&saddr, address);
+
+        if (zlib && caPutLogTcpSetCompression(ptcp, caPutLogTcpZlibLevel)) {
+            caPutLogTcpTransport.destroy(ptcp);
+            return -1;
+        }
+        if (plist->spoolDir)
+            addSpool(plist, ptcp, address);
+        if (plist->preamble)
+            caPutLogTcpSetPreamble(ptcp, plist->preamble, plist->preambleArg);
+        return caPutLogSinkAddTransport(plist, address, &caPutLogTcpTransport, ptcp);
+    }
+    if (plist->spoolDir)
+        errlogSevPrintf(errlogMinor, "%s: no spool for %s with logClient\n",
+            plist->name, address);
+
+    id = logClientCreate(saddr.sin_addr, ntohs(saddr.sin_port));
+    if (!id) {
+        errlogSevPrintf(errlogMajor, "%s: cannot create logClient %s\n", plist->name, address);
+        return -1;
+    }
+    return caPutLogSinkAddTransport(plist, address, &logClientTransport, id);
+}
+
+void caPutLogSinkSetBatch(caPutLogSinkList *plist, size_t maxBytes, double delay)
+{
+    sink *psink;
+
+    if (delay < 0.0)
+        delay = 0.0;
+    epicsMutexMustLock(plist->lock);
+    plist->batchBytes = maxBytes;
+    plist->batchDelay = delay;
+    for (psink = plist->first; psink; psink = psink->next) {
+        epicsMutexMustLock(psink->lock);
+        psink->batchBytes = maxBytes;
+        psink->batchDelay = delay;
+        epicsMutexUnlock(psink->lock);
+        epicsEventSignal(psink->wakeup);
+    }
+    epicsMutexUnlock(plist->lock);
+}
+
+void caPutLogSinkSetSpool(caPutLogSinkList *plist, const char *dir,
+    size_t capacity, double rate, int ack)
+{
+    epicsMutexMustLock(plist->lock);
+    free(plist->spoolDir);
+    plist->spoolDir = dir && dir[0] ? epicsStrDup(dir) : NULL;
+    plist->spoolCapacity = capacity;
+    plist->spoolRate = rate > 0.0 ? rate : 0.0;
+    plist->spoolAck = ack;
+    epicsMutexUnlock(plist->lock);
+}
+
+void caPutLogSinkSetPreamble(caPutLogSinkList *plist, caPutLogSinkPreamble *preamble,
+    void *arg)
+{
+    epicsMutexMustLock(plist->lock);
+    plist->preamble = preamble;
+    plist->preambleArg = arg;
+    epicsMutexUnlock(plist->lock);
+}
+
+unsigned caPutLogSinkCount(caPutLogSinkList *plist)
+{
+    unsigned count;
+
+    epicsMutexMustLock(plist->lock);
+    count = plist->count;
+    epicsMutexUnlock(plist->lock);
+    return count;
+}
+
+static void enqueue(sink *psink, caPutLogMsg *pmsg, const epicsTimeStamp *pnow,
+    int failover)
+{
+    int wake = 0;
+
+    epicsMutexMustLock(psink->lock);
+    if (failover)
+        psink->stats.failover++;
+    if (psink->count == psink->capacity) {
+        psink->stats.dropped++;
+    } else {
+        struct entry *pentry =
+            &psink->entries[(psink->head + psink->count) % psink->capacity];
+
+        caPutLogMsgAddRef(pmsg);
+        pentry->pmsg = pmsg;
+        pentry->queued = *pnow;
+        /* wake the thread when it waits for the first message or
+           for a batch to fill up */
+        wake = psink->count++ == 0
+            || (psink->bytes < psink->batchBytes
+                && psink->bytes + pmsg->len >= psink->batchBytes)
+            || psink->count == caPutLogSinkMaxBatch;
+        psink->bytes += pmsg->len;
+        if (psink->count > psink->stats.highWater)
+            psink->stats.highWater = psink->count;
+    }
+    epicsMutexUnlock(psink->lock);
+    if (wake)
+        epicsEventSignal(psink->wakeup);
+}
+
+void caPutLogSinkSend(caPutLogSinkList *plist, caPutLogMsg *pmsg)
+{
+    epicsTimeStamp now;
+    sink *psink;
+
+    epicsTimeGetCurrent(&now);
+    epicsMutexMustLock(plist->lock);
+    for (psink = plist->first; psink; psink = psink->next)
+        enqueue(psink, pmsg, &now, 0);
+    epicsMutexUnlock(plist->lock);
+}
+
+void caPutLogSinkSetCopies(caPutLogSinkList *plist, unsigned copies)
+{
+    epicsMutexMustLock(plist->lock);
+    plist->copies = copies;
+    epicsMutexUnlock(plist->lock);
+}
+
+unsigned caPutLogSinkKey(const char *pvName)
+{
+    const char *dot = strchr(pvName, '.');
+
+    return epicsMemHash(pvName, dot ? (size_t)(dot - pvName) : strlen(pvName), 0);
+}
+
+static int healthy(sink *psink)
+{
+    return !psink->ptransport->healthy || psink->ptransport->healthy(psink->ctx);
+}
+
+void caPutLogSinkSendKeyed(caPutLogSinkList *plist, caPutLogMsg *pmsg, unsigned key)
+{
+    epicsTimeStamp now;
+    sink *pstart, *psink;
+    unsigned copies, queued = 0, pos;
+
+    epicsMutexMustLock(plist->lock);
+    copies = plist->copies;
+    if (!copies || copies >= plist->count) {
+        epicsMutexUnlock(plist->lock);
+        caPutLogSinkSend(plist, pmsg);
+        return;
+    }
+    epicsTimeGetCurrent(&now);
+    for (pstart = plist->first, pos = key % plist->count; pos; pos--)
+        pstart = pstart->next;
+
+    /* the healthy sinks from the one the key picked on */
+    for (psink = pstart, pos = 0; pos < plist->count; pos++) {
+        psink->chosen = queued < copies && healthy(psink);
+        if (psink->chosen) {
+            enqueue(psink, pmsg, &now, pos >= copies);
+            queued++;
+        }
+        psink = psink->next ? psink->next : plist->first;
+    }
+    /* not enough of them: the others after all, the transport may spool */
+    for (psink = pstart, pos = 0; queued < copies && pos < plist->count; pos++) {
+        if (!psink->chosen) {
+            enqueue(psink, pmsg, &now, 0);
+            queued++;
+        }
+        psink = psink->next ? psink->next : plist->first;
+    }
+    epicsMutexUnlock(plist->lock);
+}
+
+void caPutLogSinkSendText(caPutLogSinkList *plist, const char *text, size_t len)
+{
+    caPutLogMsg *pmsg;
+
+    if (!plist->first)
+        return;
+    pmsg = caPutLogMsgCreate(text, len);
+    caPutLogSinkSend(plist, pmsg);
+    caPutLogMsgRelease(pmsg);
+}
+
+void caPutLogSinkSendTextKeyed(caPutLogSinkList *plist, const char *text, size_t len,
+    unsigned key)
+{
+    caPutLogMsg *pmsg;
+
+    if (!plist->first)
+        return;
+    pmsg = caPutLogMsgCreate(text, len);
+    caPutLogSinkSendKeyed(plist, pmsg, key);
+    caPutLogMsgRelease(pmsg);
+}
+
+/*
+ * The sink after psink, the first one for NULL. Sinks are only appended
+ * and never removed while the list is alive, so the list need not stay
+ * locked in between.
+ */
+static sink *nextSink(caPutLogSinkList *plist, sink *psink)
+{
+    sink *pnext;
+
+    epicsMutexMustLock(plist->lock);
+    pnext = psink ? psink->next : plist->first;
+    epicsMutexUnlock(plist->lock);
+    return pnext;
+}
+
+/* Waits without the list lock, so that the logger can go on sending */
+unsigned caPutLogSinkFlush(caPutLogSinkList *plist, double timeout)
+{
+    epicsTimeStamp start, now;
+    unsigned left = 0;
+    sink *psink;
+
+    epicsTimeGetCurrent(&start);
+    for (psink = nextSink(plist, NULL); psink; psink = nextSink(plist, psink)) {
+        while (1) {
+            unsigned pending;
+            double remaining;
+
+            epicsMutexMustLock(psink->lock);
+            pending = psink->count + psink->busy;
+            epicsMutexUnlock(psink->lock);
+            epicsTimeGetCurrent(&now);
+            remaining = timeout - epicsTimeDiffInSeconds(&now, &start);
+            if (!pending || remaining <= 0.0) {
+                left += pending;
+                break;
+            }
+            epicsEventWaitWithTimeout(psink->idle, remaining < 0.1 ? remaining : 0.1);
+        }
+        if (psink->ptransport->flush)
+            psink->ptransport->flush(psink->ctx);
+    }
+    return left;
+}
+
+int caPutLogSinkGetStats(caPutLogSinkList *plist, unsigned index,
+    caPutLogSinkStats *pstats)
+{
+    sink *psink;
+
+    epicsMutexMustLock(plist->lock);
+    for (psink = plist->first; psink && index; psink = psink->next)
+        index--;
+    if (psink) {
+        epicsMutexMustLock(psink->lock);
+        *pstats = psink->stats;
+        pstats->backlog = psink->count;
+        epicsMutexUnlock(psink->lock);
+    }
+    epicsMutexUnlock(plist->lock);
+    return psink ? 0 : -1;
+}
+
+void caPutLogSinkShow(caPutLogSinkList *plist, unsigned level)
+{
+    sink *psink;
+
+    epicsMutexMustLock(plist->lock);
+    if (plist->first)
+        printf("%s batches: up to %lu bytes, delay %g ms\n", plist->name,
+            (unsigned long)plist->batchBytes, plist->batchDelay * 1e3);
+    if (plist->copies && plist->copies < plist->count)
+        printf("%s sharded: each message to %u of %u servers\n", plist->name,
+            plist->copies, plist->count);
+    for (psink = plist->first; psink; psink = psink->next) {
+        caPutLogSinkStats stats;
+
+        epicsMutexMustLock(psink->lock);
+        stats = psink->stats;
+        stats.backlog = psink->count;
+        epicsMutexUnlock(psink->lock);
+
+        printf("%s server %s: backlog %u of %u (high water %u), sent %lu in %lu batches,"
+            " dropped %lu, failed %lu, lag %.3f ms (max %.3f ms)\n", plist->name,
+            psink->address, stats.backlog, stats.capacity, stats.highWater,
+            (unsigned long)stats.sent, (unsigned long)stats.batches,
+            (unsigned long)stats.dropped, (unsigned long)stats.failed,
+            stats.lastLag * 1e3, stats.maxLag * 1e3);
+        if (stats.failover)
+            printf("    took over %lu messages for servers that were down\n",
+                (unsigned long)stats.failover);
+        if (psink->ptransport->show)
+            psink->ptransport->show(psink->ctx, level);
+    }
+    epicsMutexUnlock(plist->lock);
+}
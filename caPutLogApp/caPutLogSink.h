@@ -0,0 +1,173 @@
+#ifndef INCcaPutLogSinkh
+#define INCcaPutLogSinkh 1
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Delivery of formatted messages to the log servers.
+ *
+ * A message is copied once into a reference counted buffer which is
+ * handed to every sink of a list. Each sink has its own bounded queue
+ * and sender thread, so a slow or reconnecting server neither delays
+ * the other servers nor the logger task. A message that does not fit
+ * into a sink's queue is dropped for that sink only.
+ */
+typedef struct caPutLogMsg {
+    int     refs;
+    size_t  len;            /* without the terminating NUL */
+    char    text[1];
+} caPutLogMsg;
+
+/* A new message with one reference held by the caller */
+epicsShareFunc caPutLogMsg *caPutLogMsgCreate(const char *text, size_t len);
+epicsShareFunc void caPutLogMsgAddRef(caPutLogMsg *pmsg);
+epicsShareFunc void caPutLogMsgRelease(caPutLogMsg *pmsg);
+
+/*
+ * What a sink's sender thread calls. send() gets a batch of messages,
+ * oldest first, may block as long as it needs to and returns 0, or -1
+ * if not all of them could be delivered. idle() is called when the queue
+ * is empty and returns the seconds after which to call it again unless
+ * messages arrive, 0 for not at all. healthy() is called by the senders
+ * of keyed messages (see caPutLogSinkSetCopies) and returns 0 while the
+ * server is known to be down. All but send() are optional.
+ */
+typedef struct caPutLogSinkTransport {
+    int (*send)(void *ctx, caPutLogMsg * const *pmsgs, unsigned count);
+    void (*flush)(void *ctx);
+    void (*show)(void *ctx, unsigned level);
+    void (*destroy)(void *ctx);
+    double (*idle)(void *ctx);
+    int (*healthy)(void *ctx);
+} caPutLogSinkTransport;
+
+typedef struct caPutLogSinkList caPutLogSinkList;
+
+/* Messages queued per sink for lists created with queueSize 0 */
+epicsShareExtern int caPutLogSinkQueueSize;
+
+/* Connect to the servers with base's logClient instead of caPutLogTcp.h */
+epicsShareExtern int caPutLogUseLogClient;
+
+/* Name prefixes messages and thread names, queueSize 0: see above */
+epicsShareFunc caPutLogSinkList *caPutLogSinkListCreate(const char *name,
+    unsigned queueSize);
+epicsShareFunc void caPutLogSinkListDestroy(caPutLogSinkList *plist);
+
+/*
+ * Add a sink for the server at "[tcp://]host[:port]", or for the journal
+ * file at "file://path". Returns 0 if added or already configured, -1 on
+ * errors (reported).
+ */
+epicsShareFunc int caPutLogSinkAdd(caPutLogSinkList *plist, const char *address,
+    unsigned short defaultPort);
+
+/* Add a sink with another transport, address is only a label */
+epicsShareFunc int caPutLogSinkAddTransport(caPutLogSinkList *plist,
+    const char *address, const caPutLogSinkTransport *ptransport, void *ctx);
+
+epicsShareFunc unsigned caPutLogSinkCount(caPutLogSinkList *plist);
+
+/*
+ * Batching: a sink's thread hands what is queued to the transport in
+ * batches of up to maxBytes bytes (0: every message on its own, a larger
+ * message always goes alone). With a delay (seconds) a batch smaller
+ * than that is held back until its oldest message has waited that long.
+ * Applies to present and future sinks of the list.
+ */
+#define caPutLogSinkMaxBatch 64     /* messages per batch */
+#define caPutLogSinkDefaultBatchBytes 16384
+
+epicsShareFunc void caPutLogSinkSetBatch(caPutLogSinkList *plist,
+    size_t maxBytes, double delay);
+
+/*
+ * Spool for the servers added from now on (see caPutLogTcp.h): the file
+ * "<list name>-<address>.spool" in dir with capacity bytes, replayed at
+ * up to rate messages per second (0: no limit), with acknowledgements
+ * from the servers if ack is set. A NULL or empty dir turns it off.
+ */
+epicsShareFunc void caPutLogSinkSetSpool(caPutLogSinkList *plist, const char *dir,
+    size_t capacity, double rate, int ack);
+
+/*
+ * Sharding: with copies > 0 a keyed message goes to only that many of
+ * the sinks instead of all of them. The key picks the first one, the
+ * following ones in the order the sinks were added take the other
+ * copies. A sink whose transport reports it unhealthy is skipped in
+ * favour of the next healthy one; if there are not enough of those,
+ * unhealthy ones are used after all. 0 (the default) or copies not less
+ * than the number of sinks sends every message to every sink.
+ */
+epicsShareFunc void caPutLogSinkSetCopies(caPutLogSinkList *plist, unsigned copies);
+
+/*
+ * A preamble returns a message, with a reference for the caller, that is
+ * written at the start of every connection and journal segment, before
+ * what is queued. It is called from the senders' threads.
+ */
+typedef caPutLogMsg *caPutLogSinkPreamble(void *arg);
+
+/* Preamble for the servers added from now on, which are then connected
+   without logClient; NULL for none */
+epicsShareFunc void caPutLogSinkSetPreamble(caPutLogSinkList *plist,
+    caPutLogSinkPreamble *preamble, void *arg);
+
+/* The key of the messages for a PV: a hash of its record name, so that
+   the puts to one record stay in order on the same servers */
+epicsShareFunc unsigned caPutLogSinkKey(const char *pvName);
+
+/* Queue a message for all sinks; the caller keeps its reference */
+epicsShareFunc void caPutLogSinkSend(caPutLogSinkList *plist, caPutLogMsg *pmsg);
+
+/* Queue a message for the sinks chosen by key, see caPutLogSinkSetCopies */
+epicsShareFunc void caPutLogSinkSendKeyed(caPutLogSinkList *plist, caPutLogMsg *pmsg,
+    unsigned key);
+
+/* Copy text into a new message and queue it for all sinks */
+epicsShareFunc void caPutLogSinkSendText(caPutLogSinkList *plist,
+    const char *text, size_t len);
+
+/* Copy text into a new message and queue it for the sinks chosen by key */
+epicsShareFunc void caPutLogSinkSendTextKeyed(caPutLogSinkList *plist,
+    const char *text, size_t len, unsigned key);
+
+/*
+ * Wait up to timeout seconds for the sinks to send what they have
+ * queued, then flush the transports. Returns the messages still queued.
+ * Messages may be sent to the list meanwhile.
+ */
+epicsShareFunc unsigned caPutLogSinkFlush(caPutLogSinkList *plist, double timeout);
+
+typedef struct {
+    size_t      sent;           /* messages handed to the transport */
+    size_t      batches;        /* in that many calls */
+    size_t      dropped;        /* messages that found the queue full */
+    size_t      failed;         /* messages the transport did not deliver */
+    size_t      failover;       /* keyed messages taken over for a sink that
+                                   was down */
+    unsigned    backlog;        /* messages queued now */
+    unsigned    highWater;      /* most messages queued at once */
+    unsigned    capacity;
+    double      lastLag;        /* seconds from queueing to sent, of the
+                                   oldest message in the last batch */
+    double      maxLag;
+} caPutLogSinkStats;
+
+/* Statistics of the index'th sink, -1 if there is none */
+epicsShareFunc int caPutLogSinkGetStats(caPutLogSinkList *plist, unsigned index,
+    caPutLogSinkStats *pstats);
+
+/* Print the counters of all sinks and the transports' reports */
+epicsShareFunc void caPutLogSinkShow(caPutLogSinkList *plist, unsigned level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogSinkh*/
@@ -0,0 +1,255 @@
+/*	File:	  caPutLogSpool.c
+ *
+ *	Disk spool, see caPutLogSpool.h.
+ *
+ *	The file starts with a header line "caPutLogSpool 1 <capacity>
+ *	<head> <used> <msgs>", padded to HEADER_SIZE bytes, followed by the
+ *	data area of capacity bytes. head is the offset of the oldest
+ *	record, used the bytes taken from there on, wrapping around the end
+ *	of the data area. A record is a 12 byte little endian header
+ *	(length, seconds and nanoseconds of the time stamp) and the message.
+ *	Plain stdio is used, so this works on all targets.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
+#include <epicsStdio.h>
+#include <errlog.h>
+#include <cantProceed.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogSpool.h"
+
+#define HEADER_SIZE 80
+#define RECORD_SIZE 12
+#define MAX_CAPACITY 0x7fff0000ul
+
+struct caPutLogSpool {
+    epicsMutexId    lock;
+    FILE            *fp;
+    size_t          capacity;
+    size_t          head;
+    size_t          used;
+    unsigned        msgs;
+    size_t          dropped;
+    char            path[1];
+};
+
+static void report(caPutLogSpool *psp, const char *what)
+{
+    errlogSevPrintf(errlogMinor, "caPutLog: %s spool %s: %s\n", what, psp->path,
+        strerror(errno));
+}
+
+static int writeHeader(caPutLogSpool *psp)
+{
+    char header[HEADER_SIZE];
+    int n = epicsSnprintf(header, sizeof(header), "caPutLogSpool 1 %lu %lu %lu %u",
+        (unsigned long)psp->capacity, (unsigned long)psp->head,
+        (unsigned long)psp->used, psp->msgs);
+
+    memset(header + n, ' ', HEADER_SIZE - 1 - n);
+    header[HEADER_SIZE - 1] = '\n';
+    if (fseek(psp->fp, 0, SEEK_SET) || fwrite(header, 1, HEADER_SIZE, psp->fp) != HEADER_SIZE
+            || fflush(psp->fp)) {
+        report(psp, "cannot write");
+        return -1;
+    }
+    return 0;
+}
+
+static int readHeader(caPutLogSpool *psp)
+{
+    char header[HEADER_SIZE + 1];
+    unsigned long capacity, head, used;
+    unsigned msgs;
+
+    if (fread(header, 1, HEADER_SIZE, psp->fp) != HEADER_SIZE)
+        return -1;
+    header[HEADER_SIZE] = 0;
+    if (sscanf(header, "caPutLogSpool 1 %lu %lu %lu %u", &capacity, &head, &used, &msgs) != 4
+            || capacity == 0 || capacity > MAX_CAPACITY || head >= capacity || used > capacity)
+        return -1;
+    psp->capacity = capacity;
+    psp->head = head;
+    psp->used = used;
+    psp->msgs = msgs;
+    return 0;
+}
+
+/* Read or write len bytes at pos of the data area, wrapping around */
+static int ringIO(caPutLogSpool *psp, size_t pos, char *buf, size_t len, int write)
+{
+    while (len) {
+        size_t n = psp->capacity - pos;
+
+        if (n > len)
+            n = len;
+        if (fseek(psp->fp, (long)(HEADER_SIZE + pos), SEEK_SET) ||
+                (write ? fwrite(buf, 1, n, psp->fp) : fread(buf, 1, n, psp->fp)) != n)
+            return -1;
+        buf += n;
+        len -= n;
+        pos = 0;
+    }
+    return 0;
+}
+
+static void putU32(char *p, epicsUInt32 v)
+{
+    p[0] = (char)v;
+    p[1] = (char)(v >> 8);
+    p[2] = (char)(v >> 16);
+    p[3] = (char)(v >> 24);
+}
+
+static epicsUInt32 getU32(const char *p)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    return u[0] | (u[1] << 8) | ((epicsUInt32)u[2] << 16) | ((epicsUInt32)u[3] << 24);
+}
+
+caPutLogSpool *caPutLogSpoolOpen(const char *path, size_t capacity)
+{
+    caPutLogSpool *psp = callocMustSucceed(1, sizeof(caPutLogSpool) + strlen(path),
+        "caPutLogSpoolOpen");
+
+    strcpy(psp->path, path);
+    psp->fp = fopen(path, "r+b");
+    if (psp->fp && readHeader(psp) == 0) {
+        if (psp->msgs)
+            errlogSevPrintf(errlogInfo, "caPutLog: %u messages in spool %s\n",
+                psp->msgs, path);
+    } else {
+        if (psp->fp)
+            fclose(psp->fp);
+        psp->fp = fopen(path, "w+b");
+        psp->capacity = capacity > MAX_CAPACITY ? MAX_CAPACITY : capacity;
+        if (!psp->fp || psp->capacity < RECORD_SIZE + 1 || writeHeader(psp)) {
+            if (psp->capacity < RECORD_SIZE + 1)
+                errno = EINVAL;
+            report(psp, "cannot create");
+            if (psp->fp)
+                fclose(psp->fp);
+            free(psp);
+            return NULL;
+        }
+    }
+    psp->lock = epicsMutexMustCreate();
+    return psp;
+}
+
+void caPutLogSpoolClose(caPutLogSpool *psp)
+{
+    if (!psp)
+        return;
+    fclose(psp->fp);
+    epicsMutexDestroy(psp->lock);
+    free(psp);
+}
+
+int caPutLogSpoolPut(caPutLogSpool *psp, const caPutLogMsg *pmsg)
+{
+    char record[RECORD_SIZE];
+    epicsTimeStamp now;
+    size_t pos;
+    int status = -1;
+
+    epicsTimeGetCurrent(&now);
+    putU32(record, (epicsUInt32)pmsg->len);
+    putU32(record + 4, now.secPastEpoch);
+    putU32(record + 8, now.nsec);
+
+    epicsMutexMustLock(psp->lock);
+    pos = (psp->head + psp->used) % psp->capacity;
+    if (psp->used + RECORD_SIZE + pmsg->len > psp->capacity) {
+        psp->dropped++;
+    } else if (ringIO(psp, pos, record, RECORD_SIZE, 1) ||
+            ringIO(psp, (pos + RECORD_SIZE) % psp->capacity, (char *)pmsg->text,
+                pmsg->len, 1)) {
+        report(psp, "cannot write");
+        psp->dropped++;
+    } else {
+        psp->used += RECORD_SIZE + pmsg->len;
+        psp->msgs++;
+        status = writeHeader(psp);
+    }
+    epicsMutexUnlock(psp->lock);
+    return status;
+}
+
+caPutLogMsg *caPutLogSpoolGet(caPutLogSpool *psp, size_t *poffset,
+    epicsTimeStamp *pspooled)
+{
+    char record[RECORD_SIZE];
+    caPutLogMsg *pmsg = NULL;
+    size_t pos, len;
+
+    epicsMutexMustLock(psp->lock);
+    pos = (psp->head + *poffset) % psp->capacity;
+    if (*poffset + RECORD_SIZE <= psp->used && ringIO(psp, pos, record, RECORD_SIZE, 0) == 0) {
+        len = getU32(record);
+        if (*poffset + RECORD_SIZE + len <= psp->used) {
+            pmsg = mallocMustSucceed(sizeof(caPutLogMsg) + len, "caPutLogSpoolGet");
+            pmsg->refs = 1;
+            pmsg->len = len;
+            pmsg->text[len] = 0;
+            if (ringIO(psp, (pos + RECORD_SIZE) % psp->capacity, pmsg->text, len, 0)) {
+                report(psp, "cannot read");
+                free(pmsg);
+                pmsg = NULL;
+            } else {
+                *poffset += RECORD_SIZE + len;
+                if (pspooled) {
+                    pspooled->secPastEpoch = getU32(record + 4);
+                    pspooled->nsec = getU32(record + 8);
+                }
+            }
+        }
+    }
+    epicsMutexUnlock(psp->lock);
+    return pmsg;
+}
+
+size_t caPutLogSpoolConsume(caPutLogSpool *psp, unsigned count)
+{
+    char record[RECORD_SIZE];
+    size_t bytes = 0;
+
+    epicsMutexMustLock(psp->lock);
+    while (count-- && psp->msgs &&
+            ringIO(psp, psp->head, record, RECORD_SIZE, 0) == 0) {
+        size_t len = RECORD_SIZE + getU32(record);
+
+        if (len > psp->used)
+            len = psp->used;
+        psp->head = (psp->head + len) % psp->capacity;
+        psp->used -= len;
+        psp->msgs--;
+        bytes += len;
+    }
+    if (psp->msgs == 0) {
+        /* start over at the beginning, also after a damaged record */
+        psp->head = psp->used = 0;
+    }
+    if (bytes)
+        writeHeader(psp);
+    epicsMutexUnlock(psp->lock);
+    return bytes;
+}
+
+void caPutLogSpoolGetStats(caPutLogSpool *psp, caPutLogSpoolStats *pstats)
+{
+    epicsMutexMustLock(psp->lock);
+    pstats->msgs = psp->msgs;
+    pstats->bytes = psp->used;
+    pstats->capacity = psp->capacity;
+    pstats->dropped = psp->dropped;
+    epicsMutexUnlock(psp->lock);
+}
@@ -0,0 +1,58 @@
+#ifndef INCcaPutLogSpoolh
+#define INCcaPutLogSpoolh 1
+
+#include <stddef.h>
+#include <epicsTime.h>
+#include <shareLib.h>
+
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded store-and-forward spool on disk, used by caPutLogTcp.h for the
+ * messages a server could not take.
+ *
+ * One file holds a ring of records: each is the message length and the
+ * time it was spooled, followed by the message. The ring's state is kept
+ * in a text header at the start of the file which is rewritten after
+ * every change, so the spool survives a restart of the IOC. A message
+ * that does not fit is dropped and counted; the oldest records are kept.
+ * All calls are thread safe.
+ */
+typedef struct caPutLogSpool caPutLogSpool;
+
+/* Open or create the spool at path, capacity is ignored for an existing
+   one; NULL on errors (reported) */
+epicsShareFunc caPutLogSpool *caPutLogSpoolOpen(const char *path, size_t capacity);
+epicsShareFunc void caPutLogSpoolClose(caPutLogSpool *psp);
+
+/* Append a message, -1 if it did not fit */
+epicsShareFunc int caPutLogSpoolPut(caPutLogSpool *psp, const caPutLogMsg *pmsg);
+
+/*
+ * Read the record at *poffset bytes after the oldest one into a new
+ * message and advance *poffset to the next record. NULL at the end.
+ */
+epicsShareFunc caPutLogMsg *caPutLogSpoolGet(caPutLogSpool *psp, size_t *poffset,
+    epicsTimeStamp *pspooled);
+
+/* Remove the count oldest records, returns the bytes they took */
+epicsShareFunc size_t caPutLogSpoolConsume(caPutLogSpool *psp, unsigned count);
+
+typedef struct {
+    unsigned    msgs;           /* records spooled now */
+    size_t      bytes;          /* taken by them */
+    size_t      capacity;
+    size_t      dropped;        /* messages that did not fit */
+} caPutLogSpoolStats;
+
+epicsShareFunc void caPutLogSpoolGetStats(caPutLogSpool *psp, caPutLogSpoolStats *pstats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogSpoolh*/
@@ -44,7 +44,6 @@
 #include <epicsStdio.h>
 #include <string.h>
 
-#include <epicsMessageQueue.h>
 #include <epicsThread.h>
 
 #include <epicsString.h>
@@ -60,8 +59,20 @@
 #include <epicsExport.h>
 #include "caPutLog.h"
 #include "caPutLogAs.h"
+#include "caPutLogBurst.h"
 #include "caPutLogClient.h"
+#include "caPutLogDeadband.h"
+#include "caPutLogFilter.h"
+#include "caPutLogHistory.h"
+#include "caPutLogIdent.h"
+#include "caPutLogNum.h"
+#include "caPutLogPolicy.h"
+#include "caPutLogPv.h"
+#include "caPutLogQueue.h"
+#include "caPutLogRate.h"
+#include "caPutLogSink.h"
 #include "caPutLogTask.h"
+#include "caPutLogTime.h"
 
 #ifdef NO
 #undef NO
@@ -73,14 +84,6 @@
 #endif
 #define YES 1
 
-#ifndef max
-#define max(x, y)       (((x) < (y)) ? (y) : (x))
-#endif
-
-#ifndef min
-#define min(x, y)       (((x) < (y)) ? (x) : (y))
-#endif
-
 #define MAX_BUF_SIZE    256     /* Length of log string */
 
 #ifndef DEFAULT_TIME_FMT
@@ -90,23 +93,26 @@
 #define STR(x) STR2(x)
 #define DEFAULT_TIME_FMT_STR STR(DEFAULT_TIME_FMT)
 
-static const char *timeFormat = DEFAULT_TIME_FMT_STR;
+static EpicsAtomicPtrT newTimeFormat;   /* handed over by caPutLogSetTimeFmt */
+static char *timeFormat;                /* taken over by caPutLogTask, NULL: default */
+static caPutLogTimeCache timeCache;     /* timeFormat compiled, for caPutLogTask */
 
 static void caPutLogTask(void *arg);
 static void log_msg(const VALUE *pold_value, const LOGDATA *pLogData,
     int burst, const VALUE *pmin, const VALUE *pmax, int config);
+static void log_suppressed(const LOGDATA *pLogData);
+static int  report_suppressed(void *arg, const char *pv_name, const char *userid,
+    const char *hostid, const unsigned suppressed[2]);
 static int  val_to_string(char *pbuf, size_t buflen, const VALUE *pval, short type);
-static void val_min(VALUE *pres, const VALUE *pa, const VALUE *pb, short type);
-static void val_max(VALUE *pres, const VALUE *pa, const VALUE *pb, short type);
 static int  val_equal(const VALUE *pa, const VALUE *pb, short type);
-static void val_assign(VALUE *dst, const VALUE *src, short type);
 static void val_dump(LOGDATA *pdata);
 
-static DBADDR caPutLogPV;               /* Structure to keep address of Log PV */
-static DBADDR *pcaPutLogPV;             /* Pointer to PV address structure,
-                                           also used as a flag whether this
-                                           PV is defined or not */
-static epicsMessageQueueId caPutLogQ;   /* Mailbox for caPutLogTask */
+static caPutLogSinkList *caPutLogPVSinks;   /* Publishers of the Log PV and
+                                               the history, NULL if neither
+                                               is defined */
+static int logPVDefined, historyDefined;
+static caPutLogQueue *caPutLogQ;        /* Mailbox for caPutLogTask */
+static caPutLogDeadband *deadband;      /* Last logged values, of caPutLogTask */
 
 static volatile int caPutLogConfig;
 static volatile double burstTimeout;
@@ -116,11 +122,35 @@ epicsExportAddress(int, caPutLogDebug);
 
 int caPutLogTotalCount = 0;
 
-#define MAX_MSGS 1000                   /* The length of queue (in messages) */
-#define MSG_SIZE sizeof(LOGDATA*)       /* We store only pointers */
+int caPutLogMsgQueueSize = 1000;        /* The length of queue (in messages) */
+epicsExportAddress(int, caPutLogMsgQueueSize);
+
+/* Limits of the queue, see caPutLogSetQueue */
+static unsigned queueMaxMsgs;
+static size_t queueMaxBytes;
+static caPutLogOverflowPolicy queuePolicy = caPutLogDropNewest;
+static double queueTimeout;
+
+/* Conversion of numbers, see caPutLogSetNumFmt */
+static caPutLogNumFmt numFmt = caPutLogNumPrintf;
+
+#define DEFAULT_MSGS 1000
+#define MAX_BATCH 32                    /* Messages taken from the queue at once */
 
 #define isDbrNumeric(type) ((type) > DBR_STRING && (type) <= DBR_ENUM)
 
+static unsigned queueSize(void)
+{
+    return caPutLogMsgQueueSize > 0 ? caPutLogMsgQueueSize : DEFAULT_MSGS;
+}
+
+static caPutLogSinkList *pvSinks(void)
+{
+    if (!caPutLogPVSinks)
+        caPutLogPVSinks = caPutLogSinkListCreate("caPutLogPV", 0);
+    return caPutLogPVSinks;
+}
+
 /* Start Rng Log Task */
 int caPutLogTaskStart(int config, double timeout)
 {
@@ -133,34 +163,43 @@ int caPutLogTaskStart(int config, double timeout)
     }
 
     if (!caPutLogQ) {
-        caPutLogQ = epicsMessageQueueCreate(MAX_MSGS, MSG_SIZE);
+        /* twice the size, as room for raising the limit at run time and
+           for puts queued beyond it with caPutLogDropOldest */
+        caPutLogQ = caPutLogQueueCreate(2 * queueSize());
+        if (!caPutLogQ) {
+            errlogSevPrintf(errlogFatal, "caPutLog: message queue creation failed\n");
+            return caPutLogError;
+        }
+        caPutLogQueueSetLimits(caPutLogQ, queueMaxMsgs ? queueMaxMsgs : queueSize(),
+            queueMaxBytes, queuePolicy, queueTimeout);
     }
-    if (!caPutLogQ) {
-        errlogSevPrintf(errlogFatal, "caPutLog: message queue creation failed\n");
-        return caPutLogError;
+    if (!deadband) {
+        deadband = caPutLogDeadbandCreate();
+        if (!deadband) {
+            errlogSevPrintf(errlogFatal, "caPutLog: deadband table creation failed\n");
+            return caPutLogError;
+        }
     }
 
     caPutLogPVEnv = getenv("EPICS_AS_PUT_LOG_PV"); /* Search for variable */
 
     if (!caPutLogPVEnv || !caPutLogPVEnv[0]) {
-        pcaPutLogPV = NULL;     /* If no -- clear pointer */
         if (caPutLogDebug)
             errlogSevPrintf(errlogMinor,
                 "caPutLog: EPICS_AS_PUT_LOG_PV variable not defined. CA Put Logging to PV is disabled\n");
     }
-    else {
-        long getpv_st;
-
-        pcaPutLogPV = &caPutLogPV;
-        getpv_st = dbNameToAddr(caPutLogPVEnv/* fullPVname */, pcaPutLogPV);
-        if (getpv_st) {
-            pcaPutLogPV = NULL; /* If not OK -- clear pointer */
-            errlogSevPrintf(errlogMajor,
-                "caPutLog: PV for CA Put Logging not found, logging to PV disabled\n");
+    else if (!logPVDefined) {
+        /* written by a sender thread of its own, see caPutLogPv.h */
+        caPutLogPv *ppv = caPutLogPvCreate(caPutLogPVEnv);
+
+        if (ppv) {
+            caPutLogSinkAddTransport(pvSinks(), caPutLogPVEnv, &caPutLogPvTransport, ppv);
+            logPVDefined = 1;
         }
     }
 
     caPutLogConfig = config;
+    caPutLogAsSetMode(config);
     burstTimeout = (timeout > 0.0) ? timeout : DEFAULT_BURST_TIMEOUT;
 
     if (epicsThreadGetId("caPutLog")) {
@@ -190,11 +229,24 @@ void caPutLogTaskShow(void)
     }
     printf("caPutLog mode: %d = %s\n", caPutLogConfig, state);
     printf("caPutLog Total Count: %d\n", epicsAtomicGetIntT(&caPutLogTotalCount));
+    printf("caPutLog Client identities: %u\n", caPutLogIdentCount());
+    printf("caPutLog Number format: %s\n", caPutLogNumFmtName(numFmt));
+    caPutLogFilterShow("caPutLog");
+    caPutLogPolicyShow("caPutLog");
+    caPutLogRateShow("caPutLog");
+    caPutLogAsShow("caPutLog");
+    if (deadband)
+        caPutLogDeadbandShow(deadband, "caPutLog");
+    if (caPutLogQ)
+        caPutLogQueueShow(caPutLogQ, "caPutLog");
+    if (caPutLogPVSinks)
+        caPutLogSinkShow(caPutLogPVSinks, 0);
 }
 
 void caPutLogTaskStop(void)
 {
     caPutLogConfig = caPutLogNone;
+    caPutLogAsSetMode(caPutLogNone);
     printf("waiting for caPutLogTask to terminate\n");
     while (epicsThreadGetId("caPutLog")) {
         epicsThreadSleep(1);
@@ -204,24 +256,115 @@ void caPutLogTaskStop(void)
 void caPutLogTaskSend(LOGDATA *plogData)
 {
     static int overflow = 0;
-    if (caPutLogQ) {
-        if (!epicsMessageQueueTrySend(caPutLogQ, &plogData, MSG_SIZE))
-        {
-            overflow = 0;
-            return;
-        }
-        if (!overflow) {
-            errlogSevPrintf(errlogMinor, "caPutLog: message queue overflow\n");
-            overflow = 1;
-        }
+    if (!caPutLogQ) {
+        caPutLogDataFree(plogData);
+        return;
+    }
+    if (!caPutLogQueueSend(caPutLogQ, plogData)) {
+        overflow = 0;
+        return;
+    }
+    if (!overflow) {
+        errlogSevPrintf(errlogMinor, "caPutLog: message queue overflow\n");
+        overflow = 1;
     }
-    caPutLogDataFree(plogData);
 }
 
 void caPutLogSetTimeFmt (const char *format)
 {
-    if (format)
+    char *fmt, *prev;
+
+    if (!format)
+        return;
+    /* hand the copy over to the logger; a copy it has not taken yet is
+       replaced and freed here, the logger frees the ones it took */
+    fmt = epicsStrDup(format);
+    prev = epicsAtomicGetPtrT(&newTimeFormat);
+    for (;;) {
+        char *seen = epicsAtomicCmpAndSwapPtrT(&newTimeFormat, prev, fmt);
+
+        if (seen == prev)
+            break;
+        prev = seen;
+    }
+    free(prev);
+}
+
+/*
+ * updateTimeFormat(): take over and compile the time format last set
+ * with caPutLogSetTimeFmt(), if any
+ */
+static void updateTimeFormat(void)
+{
+    char *format = epicsAtomicGetPtrT(&newTimeFormat);
+
+    if (format && epicsAtomicCmpAndSwapPtrT(&newTimeFormat, format, NULL) == format) {
+        caPutLogTimeCompile(&timeCache, format, NO);
+        free(timeFormat);
         timeFormat = format;
+    }
+    if (!timeCache.source)
+        caPutLogTimeCompile(&timeCache, DEFAULT_TIME_FMT_STR, NO);
+}
+
+int caPutLogSetQueue(int messages, int bytes, const char *policy, double timeout)
+{
+    int pol = caPutLogDropNewest;
+
+    if (policy && policy[0]) {
+        pol = caPutLogQueuePolicyFromName(policy);
+        if (pol < 0) {
+            errlogSevPrintf(errlogMinor,
+                "caPutLog: unknown queue policy '%s' (drop-newest, drop-oldest, coalesce, block)\n",
+                policy);
+            return caPutLogError;
+        }
+    }
+    queueMaxMsgs = messages > 0 ? messages : 0;
+    queueMaxBytes = bytes > 0 ? bytes : 0;
+    queuePolicy = (caPutLogOverflowPolicy)pol;
+    queueTimeout = timeout;
+
+    if (caPutLogQ) {
+        caPutLogQueueSetLimits(caPutLogQ, queueMaxMsgs ? queueMaxMsgs : queueSize(),
+            queueMaxBytes, queuePolicy, queueTimeout);
+    }
+    return caPutLogSuccess;
+}
+
+int caPutLogSetHistory(const char *textPV, const char *seqPV, int size)
+{
+    caPutLogHistory *phist;
+
+    if (!textPV || !textPV[0]) {
+        errlogSevPrintf(errlogMinor, "caPutLog: no history PV given\n");
+        return caPutLogError;
+    }
+    if (historyDefined) {
+        errlogSevPrintf(errlogMinor, "caPutLog: history already configured\n");
+        return caPutLogError;
+    }
+    phist = caPutLogHistoryCreate(textPV, seqPV,
+        size > 0 ? (unsigned)size : caPutLogHistoryDefaultSize);
+    if (!phist)
+        return caPutLogError;
+    caPutLogSinkAddTransport(pvSinks(), textPV, &caPutLogHistoryTransport, phist);
+    historyDefined = 1;
+    return caPutLogSuccess;
+}
+
+int caPutLogSetNumFmt(const char *format)
+{
+    int fmt = caPutLogNumFmtFromName(format);
+
+    if (fmt < 0) {
+        errlogSevPrintf(errlogMinor,
+            "caPutLog: unknown number format '%s' (printf, shortest)\n",
+            format ? format : "");
+        return caPutLogError;
+    }
+    numFmt = (caPutLogNumFmt)fmt;
+    return caPutLogSuccess;
 }
 
 void caPutLogSetBurstTimeout(double timeout)
@@ -234,110 +377,60 @@ void caPutLogSetBurstTimeout(double timeout)
     }
 }
 
+static void emit_msg(void *arg, const VALUE *pold_value, const LOGDATA *pLogData,
+    int burst, const VALUE *pmin, const VALUE *pmax)
+{
+    log_msg(pold_value, pLogData, burst, pmin, pmax,
+        caPutLogPolicyMode(pLogData, caPutLogConfig));
+}
+
 static void caPutLogTask(void *arg)
 {
-    int sent = FALSE;
-    int burst = 0;
     int config;
-    int msg_size;
-    LOGDATA *pcurrent, *pnext;
-    VALUE old_value, max_value, min_value;
-    VALUE *pold=&old_value, *pmax=&max_value, *pmin=&min_value;
-
-    /* Receive 1st message */
-    while (caPutLogConfig != caPutLogNone) {
-        msg_size = epicsMessageQueueReceiveWithTimeout(caPutLogQ, &pcurrent, MSG_SIZE, 5.0);
-        if (msg_size != -1) break;
-    }
-    if (caPutLogConfig == caPutLogNone) return;
-
-    if (caPutLogDebug) {
-        printf("caPutLog: received a message\n");
-        val_dump(pcurrent);
+    unsigned nmsg, imsg;
+    LOGDATA *batch[MAX_BATCH];
+    caPutLogBurst *pburst;
+    double wait;
+
+    pburst = caPutLogBurstCreate(emit_msg, NULL, 0);
+    if (!pburst) {
+        errlogSevPrintf(errlogFatal, "caPutLog: burst filter creation failed\n");
+        return;
     }
 
-    /* Store the initial old_value */
-    val_assign(pold, &pcurrent->old_value, pcurrent->type);
-
-    /* Set the initial min & max values; NOP if type==DBR_STRING */
-    val_assign(pmax, &pcurrent->new_value.value, pcurrent->type);
-    val_assign(pmin, &pcurrent->new_value.value, pcurrent->type);
-
     while (caPutLogConfig != caPutLogNone) {                 /* Main Server Loop */
 
-        /* Receive next message */
-        msg_size = epicsMessageQueueReceiveWithTimeout(caPutLogQ, &pnext, MSG_SIZE, burstTimeout);
+        /* Log the bursts that have ended and the counts of suppressed puts
+           no put took over, wait for puts until the next one is due */
+        wait = caPutLogBurstProcess(pburst, burstTimeout);
+        wait = caPutLogRateSweep(report_suppressed, NULL, wait);
+        nmsg = caPutLogQueueReceive(caPutLogQ, batch, MAX_BATCH, wait);
         config = caPutLogConfig;
 
-        if (msg_size == -1) {   /* timeout */
-            if (!sent) {
-                log_msg(pold, pcurrent, burst, pmin, pmax, config);
-                val_assign(pold, &pcurrent->new_value.value, pcurrent->type);
-                sent = TRUE;
-                burst = 0;
-            }
-        }
-        else if (msg_size != MSG_SIZE) {
-            errlogSevPrintf(errlogMinor, "caPutLog: discarding incomplete log data message\n");
-        }
-        else if ((pnext->pfield == pcurrent->pfield) && (config != caPutLogAllNoFilter)) {
-            if (caPutLogDebug) {
-                printf("caPutLog: received a message, same pv\n");
-                val_dump(pnext);
-            }
-
-            /* current and next are same pv */
-            caPutLogDataFree(pcurrent);
-            pcurrent = pnext;
-
-            epicsAtomicIncrIntT(&caPutLogTotalCount);
-
-            if (sent) {
-                /* Set new initial max & min values */
-                val_assign(pmax, &pcurrent->new_value.value, pcurrent->type);
-                val_assign(pmin, &pcurrent->new_value.value, pcurrent->type);
+        for (imsg = 0; imsg < nmsg; imsg++) {
+            LOGDATA *pnext = batch[imsg];
 
-                sent = FALSE;
-                burst = 0;   /* First message after logging */
-            }
-            else {              /* Next put of multiple puts */
-                if (isDbrNumeric(pcurrent->type)) {
-                    burst++;
-                    val_max(pmax, &pcurrent->new_value.value, pmax, pcurrent->type);
-                    val_min(pmin, &pcurrent->new_value.value, pmin, pcurrent->type);
-                }
-            }
-        }
-        else {
+            caPutLogDataResolve(pnext);
             if (caPutLogDebug) {
-                printf("caPutLog: received a message, different pv\n");
+                printf("caPutLog: received a message\n");
                 val_dump(pnext);
             }
-            /* current and next are different pvs */
-
-            if (!sent) {
-                log_msg(pold, pcurrent, burst, pmin, pmax, config);
-                sent = TRUE;
-            }
-
-            caPutLogDataFree(pcurrent);
-            pcurrent = pnext;
-
-            /* Set new old_value */
-            val_assign(pold, &pcurrent->old_value, pcurrent->type);
+            epicsAtomicIncrIntT(&caPutLogTotalCount);
 
-            /* Set new max & min values */
-            val_assign(pmax, &pcurrent->new_value.value, pcurrent->type);
-            val_assign(pmin, &pcurrent->new_value.value, pcurrent->type);
+            /* the first put through a rate limit reports what it dropped */
+            if (pnext->suppressed_pv || pnext->suppressed_client)
+                log_suppressed(pnext);
 
-            sent = FALSE;
-            burst = FALSE;
+            /* puts to the same pv are merged unless every put is logged */
+            caPutLogBurstPut(pburst, pnext, caPutLogPolicyBurst(pnext, burstTimeout),
+                caPutLogPolicyMode(pnext, config) != caPutLogAllNoFilter);
         }
     }
+    caPutLogBurstDestroy(pburst);
     errlogSevPrintf(errlogInfo, "caPutLog: log task exiting\n");
 }
 
-static void do_log(char *msg, size_t len, int truncated)
+static void do_log(char *msg, size_t len, unsigned key, int truncated)
 {
     if (truncated) {
         errlogSevPrintf(errlogMinor, "caPutLog: message truncated\n");
@@ -347,22 +440,13 @@ static void do_log(char *msg, size_t len, int truncated)
     assert(len < MAX_BUF_SIZE-1);
     strcpy(msg+len, "\n");
 
-    /* send msg to log client */
-    caPutLogClientSend(msg);
-
-    /* log to PV if enabled */
-    if (pcaPutLogPV) {
-        long status;
+    /* queue msg for the log servers */
+    caPutLogClientSend(msg, len+1, key);
 
-        /* remove terminating newline for pv log */
-        msg[len] = 0;
-        status = dbPutField(pcaPutLogPV, DBR_CHAR, msg, len+1);
-
-        if (status) {
-            errlogSevPrintf(errlogMajor,
-                "caPutLog: dbPutField to Log PV failed, status = %ld\n", status);
-        }
-    }
+    /* queue msg for the log PV and history if enabled, the newline is
+       removed there */
+    if (caPutLogPVSinks)
+        caPutLogSinkSendText(caPutLogPVSinks, msg, len+1);
 }
 
 static void log_msg(const VALUE *pold_value, const LOGDATA *pLogData,
@@ -372,129 +456,102 @@ static void log_msg(const VALUE *pold_value, const LOGDATA *pLogData,
     char * const msg = buffer;
     /* reserve one extra byte for terminating newline: */
     const size_t space = MAX_BUF_SIZE-1;
+    const unsigned key = caPutLogSinkKey(pLogData->pv_name);
     size_t len;
 
     /* for single puts check optionally equalness of old and new values */
     if (!burst && !config) {
-        if (val_equal(&pLogData->old_value, &pLogData->new_value.value, pLogData->type))
+        if (val_equal(pLogData->old_value, &pLogData->new_value->value, pLogData->type))
             return;                     /* don't log if values are equal */
     }
+    /* nor numbers that stay within their deadband of the last one logged */
+    if (!config && !caPutLogDeadbandPass(deadband, pold_value, pLogData, burst, pmin, pmax))
+        return;
 
     /* first comes the time */
-    len = epicsTimeToStrftime(msg, space, timeFormat,
-        &pLogData->new_value.time);
+    updateTimeFormat();
+    len = caPutLogTimeFormat(&timeCache, msg, space,
+        &pLogData->new_value->time);
     /* this should always succeed */
     assert(len);
 
     /* host, user, pv_name */
-    len += epicsSnprintf(msg+len, space-len,
-        " %s %s %s new=", pLogData->hostid, pLogData->userid, pLogData->pv_name);
-    if (len >= space) { do_log(msg, space-1, YES); return; }
+    if (pLogData->ident) {
+        len += epicsSnprintf(msg+len, space-len,
+            " %s %s new=", pLogData->ident->text, pLogData->pv_name);
+    } else {
+        len += epicsSnprintf(msg+len, space-len,
+            " %s %s %s new=", pLogData->hostid, pLogData->userid, pLogData->pv_name);
+    }
+    if (len >= space) { do_log(msg, space-1, key, YES); return; }
 
     /* new value */
     len += val_to_string(msg+len, space-len,
-        &pLogData->new_value.value, pLogData->type);
-    if (len >= space) { do_log(msg, space-1, YES); return; }
+        &pLogData->new_value->value, pLogData->type);
+    if (len >= space) { do_log(msg, space-1, key, YES); return; }
 
     len += epicsSnprintf(msg+len, space-len, " old=");
-    if (len >= space) { do_log(msg, space-1, YES); return; }
+    if (len >= space) { do_log(msg, space-1, key, YES); return; }
 
     /* old value */
     len += val_to_string(msg+len, space-len, pold_value, pLogData->type);
-    if (len >= space) { do_log(msg, space-1, YES); return; }
+    if (len >= space) { do_log(msg, space-1, key, YES); return; }
 
     if (burst && isDbrNumeric(pLogData->type)) {
         /* min value */
         len += epicsSnprintf(msg+len, space-len, " min=");
-        if (len >= space) { do_log(msg, space-1, YES); return; }
+        if (len >= space) { do_log(msg, space-1, key, YES); return; }
         len += val_to_string(msg+len, space-len, pmin, pLogData->type);
-        if (len >= space) { do_log(msg, space-1, YES); return; }
+        if (len >= space) { do_log(msg, space-1, key, YES); return; }
 
         /* max value */
         len += epicsSnprintf(msg+len, space-len, " max=");
-        if (len >= space) { do_log(msg, space-1, YES); return; }
+        if (len >= space) { do_log(msg, space-1, key, YES); return; }
         len += val_to_string(msg+len, space-len, pmax, pLogData->type);
-        if (len >= space) { do_log(msg, space-1, YES); return; }
+        if (len >= space) { do_log(msg, space-1, key, YES); return; }
     }
-    do_log(msg, len, NO);
+    do_log(msg, len, key, NO);
 }
 
-static void val_min(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
+/*
+ * log_suppressed(): summary line for the puts the rate limits dropped
+ * before this one, to the PV and from its client
+ */
+static void log_suppressed(const LOGDATA *pLogData)
 {
-    switch (type) {
-    case DBR_CHAR:
-        pres->v_int8 = min(pa->v_int8, pb->v_int8);
-        return;
-    case DBR_UCHAR:
-        pres->v_uint8 = min(pa->v_uint8, pb->v_uint8);
-        return;
-    case DBR_SHORT:
-        pres->v_int16 = min(pa->v_int16, pb->v_int16);
-        return;
-    case DBR_USHORT:
-    case DBR_ENUM:
-        pres->v_uint16 = min(pa->v_uint16, pb->v_uint16);
-        return;
-    case DBR_LONG:
-        pres->v_int32 = min(pa->v_int32, pb->v_int32);
-        return;
-    case DBR_ULONG:
-        pres->v_uint32 = min(pa->v_uint32, pb->v_uint32);
-        return;
-#ifdef DBR_INT64
-    case DBR_INT64:
-        pres->v_int64 = min(pa->v_int64, pb->v_int64);
-        return;
-    case DBR_UINT64:
-        pres->v_uint64 = min(pa->v_uint64, pb->v_uint64);
-        return;
-#endif
-    case DBR_FLOAT:
-        pres->v_float = min(pa->v_float, pb->v_float);
-        return;
-    case DBR_DOUBLE:
-        pres->v_double = min(pa->v_double, pb->v_double);
-        return;
-    }
+    char msg[MAX_BUF_SIZE];
+    const size_t space = MAX_BUF_SIZE-1;
+    const unsigned key = caPutLogSinkKey(pLogData->pv_name);
+    size_t len;
+
+    updateTimeFormat();
+    len = caPutLogTimeFormat(&timeCache, msg, space,
+        &pLogData->new_value->time);
+    assert(len);
+
+    len += epicsSnprintf(msg+len, space-len, " %s %s %s suppressed pv=%u client=%u",
+        pLogData->hostid, pLogData->userid, pLogData->pv_name,
+        pLogData->suppressed_pv, pLogData->suppressed_client);
+    if (len >= space) { do_log(msg, space-1, key, YES); return; }
+    do_log(msg, len, key, NO);
 }
 
-static void val_max(VALUE *pres, const VALUE *pa, const VALUE *pb, short type)
+/*
+ * report_suppressed(): summary line for a count of suppressed puts that
+ * no put took over, from caPutLogRateSweep(); "-" stands for the PV or
+ * the client it does not know
+ */
+static int report_suppressed(void *arg, const char *pv_name, const char *userid,
+    const char *hostid, const unsigned suppressed[2])
 {
-    switch (type) {
-    case DBR_CHAR:
-        pres->v_int8 = max(pa->v_int8, pb->v_int8);
-        return;
-    case DBR_UCHAR:
-        pres->v_uint8 = max(pa->v_uint8, pb->v_uint8);
-        return;
-    case DBR_SHORT:
-        pres->v_int16 = max(pa->v_int16, pb->v_int16);
-        return;
-    case DBR_USHORT:
-    case DBR_ENUM:
-        pres->v_uint16 = max(pa->v_uint16, pb->v_uint16);
-        return;
-    case DBR_LONG:
-        pres->v_int32 = max(pa->v_int32, pb->v_int32);
-        return;
-    case DBR_ULONG:
-        pres->v_uint32 = max(pa->v_uint32, pb->v_uint32);
-        return;
-#ifdef DBR_INT64
-    case DBR_INT64:
-        pres->v_int64 = max(pa->v_int64, pb->v_int64);
-        return;
-    case DBR_UINT64:
-        pres->v_uint64 = max(pa->v_uint64, pb->v_uint64);
-        return;
-#endif
-    case DBR_FLOAT:
-        pres->v_float = max(pa->v_float, pb->v_float);
-        return;
-    case DBR_DOUBLE:
-        pres->v_double = max(pa->v_double, pb->v_double);
-        return;
-    }
+    LOGDATA *pLogData = caPutLogDataSuppressed(pv_name[0] ? pv_name : "-",
+        userid[0] ? userid : "-", hostid[0] ? hostid : "-", suppressed);
+
+    if (!pLogData)
+        return 0;
+    log_suppressed(pLogData);
+    caPutLogDataFree(pLogData);
+    return 1;
 }
 
 /*
@@ -534,47 +591,24 @@ static int val_equal(const VALUE *pa, const VALUE *pb, short type)
 }
 
 /*
- * val_assign(): assign src VALUE to dst VALUE
+ * num_to_string(): convert a numeric VALUE without printf, returns the
+ * length that would have been written like epicsSnprintf()
  */
-static void val_assign(VALUE *dst, const VALUE *src, short type)
+static int num_to_string(char *pbuf, size_t buflen, const VALUE *pval, short type)
 {
-    switch (type) {
-    case DBR_CHAR:
-        dst->v_int8 = src->v_int8;
-        break;
-    case DBR_UCHAR:
-        dst->v_uint8 = src->v_uint8;
-        break;
-    case DBR_SHORT:
-        dst->v_int16 = src->v_int16;
-        break;
-    case DBR_USHORT:
-    case DBR_ENUM:
-        dst->v_uint16 = src->v_uint16;
-        break;
-    case DBR_LONG:
-        dst->v_int32 = src->v_int32;
-        break;
-    case DBR_ULONG:
-        dst->v_uint32 = src->v_uint32;
-        break;
-#ifdef DBR_INT64
-    case DBR_INT64:
-        dst->v_int64 = src->v_int64;
-        break;
-    case DBR_UINT64:
-        dst->v_uint64 = src->v_uint64;
-        break;
-#endif
-    case DBR_FLOAT:
-        dst->v_float = src->v_float;
-        break;
-    case DBR_DOUBLE:
-        dst->v_double = src->v_double;
-        break;
-    default:
-        epicsSnprintf(dst->v_string, MAX_STRING_SIZE, "%s", src->v_string);
+    char tmp[caPutLogNumBufSize];
+    int len;
+
+    /* DBR_CHAR is a number here, see below */
+    len = caPutLogFormatValue(tmp, pval, type == DBR_CHAR ? DBR_UCHAR : type, 0, NO);
+    if (len < 0)
+        return 0;
+    if (buflen) {
+        size_t n = (size_t)len < buflen ? (size_t)len : buflen-1;
+        memcpy(pbuf, tmp, n);
+        pbuf[n] = 0;
     }
+    return len;
 }
 
 /*
@@ -582,6 +616,9 @@ static void val_assign(VALUE *dst, const VALUE *src, short type)
  */
 static int val_to_string(char *pbuf, size_t buflen, const VALUE *pval, short type)
 {
+    if (numFmt == caPutLogNumShortest && isDbrNumeric(type))
+        return num_to_string(pbuf, buflen, pval, type);
+
     switch (type) {
     case DBR_CHAR:
        /* CHAR and UCHAR are typically used as SHORTSHORT,
@@ -632,9 +669,9 @@ static void val_dump(LOGDATA *pdata)
         strcpy(oldbuf,"(conv fail)");
         strcpy(newbuf,"(conv fail)");
         strcpy(timebuf,"(strftime fail)");
-        val_to_string(oldbuf,sizeof(oldbuf),&pdata->old_value,pdata->type);
-        val_to_string(newbuf,sizeof(newbuf),&pdata->new_value.value,pdata->type);
-        epicsTimeToStrftime(timebuf,sizeof(timebuf),"%Y-%m-%dT%H:%M:%S",&pdata->new_value.time);
+        val_to_string(oldbuf,sizeof(oldbuf),pdata->old_value,pdata->type);
+        val_to_string(newbuf,sizeof(newbuf),&pdata->new_value->value,pdata->type);
+        epicsTimeToStrftime(timebuf,sizeof(timebuf),"%Y-%m-%dT%H:%M:%S",&pdata->new_value->time);
         printf("userid = %s\n", pdata->userid);
         printf("hostid = %s\n", pdata->hostid);
         printf("pv_name = %s\n", pdata->pv_name);
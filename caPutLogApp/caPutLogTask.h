@@ -46,21 +46,40 @@ typedef union {
 } VALUE;
 
 typedef struct {
-    char            userid[MAX_USERID_SIZE];
-    char            hostid[MAX_HOSTID_SIZE];
-    char            pv_name[PVNAME_STRINGSZ];
+    TS_STAMP        time;
+    VALUE           value;
+} TIME_VALUE;
+
+struct caPutLogIdent;
+struct caPutLogPolicy;
+
+/*
+ * LOGDATA is allocated with only as much room for the two values as the
+ * field needs (value_size bytes each, see caPutLogDataAlloc), followed by
+ * the PV name. User and host name belong to the shared client identity
+ * (ident), or, if ident is NULL, follow the PV name. The fields the
+ * logger task looks at for every put come first.
+ */
+typedef struct {
     void            *pfield;
     short           type;
-    VALUE           old_value;
-    struct {
-        TS_STAMP    time;
-        VALUE       value;
-    }               new_value;
+    short           size_class;     /* private to the allocator */
+    int             value_size;     /* bytes available in each value */
     int is_array;
     int old_size;
     int old_log_size;
     int new_size;
     int new_log_size;
+    int raw;                        /* see caPutLogDataResolve */
+    const struct caPutLogPolicy *policy;    /* of the record, NULL: none */
+    unsigned suppressed_pv;         /* puts dropped by the rate limits */
+    unsigned suppressed_client;     /*   before this one, see caPutLogRate.h */
+    VALUE           *old_value;
+    TIME_VALUE      *new_value;
+    char            *userid;
+    char            *hostid;
+    char            *pv_name;
+    struct caPutLogIdent *ident;
 } LOGDATA;
 
 epicsShareFunc int caPutLogTaskStart(int config, double timeout);
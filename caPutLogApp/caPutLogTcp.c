@@ -0,0 +1,707 @@
+/*	File:	  caPutLogTcp.c
+ *
+ *	TCP transport for the log servers, see caPutLogTcp.h.
+ *
+ *	The socket stays non-blocking. writev() is called with the whole
+ *	batch; when the send buffer is full the thread waits in select()
+ *	for the socket to become writable, up to SEND_TIMEOUT, then gives
+ *	up on the connection. The servers never send anything, so a socket
+ *	that becomes readable has been closed or reset by the peer; this is
+ *	checked before each batch so it is not written into a dead
+ *	connection.
+ *
+ *	With a spool, messages that could not be written are appended to it,
+ *	and so is every later batch as long as it is not empty, to keep the
+ *	order. pump() sends from the spool and removes what was written;
+ *	with acknowledgements, everything goes through the spool and only
+ *	what the server has acknowledged is removed, the rest is sent again
+ *	after a reconnect. The sink's idle() callback keeps pump() going
+ *	when no new messages arrive, and without a spool it keeps trying to
+ *	reconnect to a server that is down, which gets no messages while
+ *	the list is sharded and healthy() says so.
+ *
+ *	A preamble is written by writeBatch() ahead of the first batch on
+ *	a new connection, through writeBatch() itself, so it is compressed
+ *	like the rest and the batch is not sent if it did not get through.
+ *
+ *	A compressed connection is one deflate stream, started anew with
+ *	each connect. Every batch is deflated into zbuf and ends with a sync
+ *	flush, so the server can inflate everything sent so far; the batch
+ *	counts as sent only if all of it was written.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#include <osiSock.h>
+#include <epicsSignal.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define epicsExportSharedSymbols
+#include "caPutLogTcp.h"
+#include "caPutLogSpool.h"
+
+#define CONNECT_TIMEOUT 2.0
+#define SEND_TIMEOUT 5.0
+#define MIN_BACKOFF 0.5
+#define MAX_BACKOFF 30.0
+#define POLL_INTERVAL 0.05
+
+int caPutLogTcpNoDelay = 1;
+epicsExportAddress(int, caPutLogTcpNoDelay);
+int caPutLogTcpSndBuf = 0;
+epicsExportAddress(int, caPutLogTcpSndBuf);
+int caPutLogTcpZlibLevel = 6;
+epicsExportAddress(int, caPutLogTcpZlibLevel);
+
+struct caPutLogTcp {
+    struct sockaddr_in addr;
+    SOCKET          sock;
+    epicsTimeStamp  nextAttempt;
+    int             failing;    /* last attempt failed, reported once */
+    caPutLogSpool   *spool;
+    double          rate;       /* spooled messages per second, 0: no limit */
+    int             ack;
+    int             replaying;  /* sending what was spooled before connecting */
+    double          tokens;     /* messages that may be sent at rate */
+    epicsTimeStamp  lastPump;
+    size_t          sendOffset; /* spooled bytes sent, not acknowledged */
+    unsigned        inFlight;   /* messages in them */
+    unsigned        acked;      /* messages acknowledged on this connection */
+    size_t          ackLen;
+    char            ackBuf[64];
+    caPutLogSinkPreamble *preamble;
+    void            *preambleArg;
+    int             preamblePending;    /* connected, preamble not written */
+#ifdef HAVE_ZLIB
+    z_stream        *pz;        /* NULL: not compressed */
+    int             level;
+    Bytef           *zbuf;
+    size_t          zcap;
+#endif
+    epicsMutexId    statsLock;
+    caPutLogTcpStats stats;
+    char            name[1];
+};
+
+caPutLogTcp *caPutLogTcpCreate(const struct sockaddr_in *paddr, const char *name)
+{
+    caPutLogTcp *ptcp = callocMustSucceed(1, sizeof(caPutLogTcp) + strlen(name),
+        "caPutLogTcpCreate");
+
+    epicsSignalInstallSigPipeIgnore();
+    ptcp->addr = *paddr;
+    ptcp->sock = INVALID_SOCKET;
+    strcpy(ptcp->name, name);
+    ptcp->statsLock = epicsMutexMustCreate();
+    return ptcp;
+}
+
+/* Wait for the socket to become writable (or readable), 1 if it did */
+static int waitFor(SOCKET sock, int writable, double timeout)
+{
+    fd_set fds;
+    struct timeval tv;
+    int status;
+
+    do {
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        tv.tv_sec = (long)timeout;
+        tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+        status = select((int)sock + 1, writable ? NULL : &fds,
+            writable ? &fds : NULL, NULL, &tv);
+    } while (status < 0 && SOCKERRNO == SOCK_EINTR);
+    return status > 0;
+}
+
+static void report(caPutLogTcp *ptcp, const char *what)
+{
+    char error[64];
+
+    epicsSocketConvertErrnoToString(error, sizeof(error));
+    errlogSevPrintf(errlogMinor, "caPutLog: %s %s: %s\n", what, ptcp->name, error);
+}
+
+static void disconnect(caPutLogTcp *ptcp)
+{
+    /* the next batch tries to reconnect right away */
+    epicsSocketDestroy(ptcp->sock);
+    ptcp->sock = INVALID_SOCKET;
+    /* what was not acknowledged goes again */
+    ptcp->sendOffset = 0;
+    ptcp->inFlight = 0;
+    ptcp->ackLen = 0;
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.connected = 0;
+    ptcp->stats.disconnects++;
+    epicsMutexUnlock(ptcp->statsLock);
+}
+
+static int tryConnect(caPutLogTcp *ptcp)
+{
+    SOCKET sock;
+    osiSockIoctl_t yes = 1;
+    int status, error = 0;
+    osiSocklen_t len = sizeof(error);
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    if (epicsTimeDiffInSeconds(&ptcp->nextAttempt, &now) > 0.0)
+        return -1;
+
+    sock = epicsSocketCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET) {
+        report(ptcp, "cannot create a socket for");
+        goto fail;
+    }
+    if (caPutLogTcpNoDelay)
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&yes, sizeof(yes));
+    if (caPutLogTcpSndBuf > 0)
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *)&caPutLogTcpSndBuf,
+            sizeof(caPutLogTcpSndBuf));
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&yes, sizeof(yes));
+    socket_ioctl(sock, FIONBIO, &yes);
+
+    status = connect(sock, (struct sockaddr *)&ptcp->addr, sizeof(ptcp->addr));
+    if (status < 0 && (SOCKERRNO == SOCK_EINPROGRESS || SOCKERRNO == SOCK_EWOULDBLOCK)) {
+        if (!waitFor(sock, 1, CONNECT_TIMEOUT)) {
+            if (!ptcp->failing)
+                errlogSevPrintf(errlogMinor, "caPutLog: cannot connect to %s: timeout\n",
+                    ptcp->name);
+            epicsSocketDestroy(sock);
+            goto fail;
+        }
+        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&error, &len) == 0 && error) {
+            if (!ptcp->failing)
+                errlogSevPrintf(errlogMinor, "caPutLog: cannot connect to %s: %s\n",
+                    ptcp->name, strerror(error));
+            epicsSocketDestroy(sock);
+            goto fail;
+        }
+        status = 0;
+    }
+    if (status < 0) {
+        if (!ptcp->failing)
+            report(ptcp, "cannot connect to");
+        epicsSocketDestroy(sock);
+        goto fail;
+    }
+
+    ptcp->sock = sock;
+    ptcp->failing = 0;
+    ptcp->acked = 0;
+    ptcp->replaying = ptcp->spool != NULL;
+    ptcp->preamblePending = ptcp->preamble != NULL;
+    ptcp->tokens = 0.0;
+    ptcp->lastPump = now;
+#ifdef HAVE_ZLIB
+    if (ptcp->pz)
+        deflateReset(ptcp->pz);
+#endif
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.connected = 1;
+    ptcp->stats.connects++;
+    ptcp->stats.backoff = 0.0;
+    epicsMutexUnlock(ptcp->statsLock);
+    errlogSevPrintf(errlogInfo, "caPutLog: connected to %s\n", ptcp->name);
+    return 0;
+
+fail:
+    ptcp->failing = 1;
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.backoff = ptcp->stats.backoff < MIN_BACKOFF ? MIN_BACKOFF
+        : ptcp->stats.backoff * 2 > MAX_BACKOFF ? MAX_BACKOFF : ptcp->stats.backoff * 2;
+    epicsTimeAddSeconds(&now, ptcp->stats.backoff);
+    epicsMutexUnlock(ptcp->statsLock);
+    ptcp->nextAttempt = now;
+    return -1;
+}
+
+/* Anything to read means the server has closed or reset the connection */
+static int peerClosed(caPutLogTcp *ptcp)
+{
+    char buf[256];
+    int n;
+
+    if (!waitFor(ptcp->sock, 0, 0.0))
+        return 0;
+    n = recv(ptcp->sock, buf, sizeof(buf), 0);
+    return n == 0 || (n < 0 && SOCKERRNO != SOCK_EWOULDBLOCK && SOCKERRNO != SOCK_EINTR);
+}
+
+#ifdef _WIN32
+/* No writev, the buffers go one by one */
+static int writeBuffers(SOCKET sock, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t skip)
+{
+    unsigned i;
+
+    for (i = 0; i < count && skip >= pmsgs[i]->len; i++)
+        skip -= pmsgs[i]->len;
+    return i < count ? send(sock, pmsgs[i]->text + skip, (int)(pmsgs[i]->len - skip), 0) : 0;
+}
+#else
+static int writeBuffers(SOCKET sock, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t skip)
+{
+    struct iovec iov[caPutLogSinkMaxBatch];
+    unsigned i, n = 0;
+
+    for (i = 0; i < count && n < caPutLogSinkMaxBatch; i++) {
+        if (skip >= pmsgs[i]->len) {
+            skip -= pmsgs[i]->len;
+            continue;
+        }
+        iov[n].iov_base = pmsgs[i]->text + skip;
+        iov[n].iov_len = pmsgs[i]->len - skip;
+        skip = 0;
+        n++;
+    }
+    return n ? (int)writev(sock, iov, n) : 0;
+}
+#endif
+
+/*
+ * Read the acknowledgements, lines "ACK <n>" with n the messages received
+ * on this connection, and remove those messages from the spool. Returns
+ * -1 if the server has closed the connection.
+ */
+static int readAcks(caPutLogTcp *ptcp)
+{
+    while (waitFor(ptcp->sock, 0, 0.0)) {
+        char *line = ptcp->ackBuf, *end;
+        int n = recv(ptcp->sock, ptcp->ackBuf + ptcp->ackLen,
+            (int)(sizeof(ptcp->ackBuf) - 1 - ptcp->ackLen), 0);
+
+        if (n == 0 || (n < 0 && SOCKERRNO != SOCK_EWOULDBLOCK && SOCKERRNO != SOCK_EINTR))
+            return -1;
+        if (n < 0)
+            break;
+        ptcp->ackLen += n;
+        ptcp->ackBuf[ptcp->ackLen] = 0;
+        while ((end = strchr(line, '\n')) != NULL) {
+            unsigned long count;
+
+            if (sscanf(line, "ACK %lu", &count) == 1 && count > ptcp->acked
+                    && count - ptcp->acked <= ptcp->inFlight) {
+                unsigned k = (unsigned)(count - ptcp->acked);
+
+                ptcp->sendOffset -= caPutLogSpoolConsume(ptcp->spool, k);
+                ptcp->inFlight -= k;
+                ptcp->acked = (unsigned)count;
+            }
+            line = end + 1;
+        }
+        ptcp->ackLen -= line - ptcp->ackBuf;
+        memmove(ptcp->ackBuf, line, ptcp->ackLen);
+        if (ptcp->ackLen == sizeof(ptcp->ackBuf) - 1)
+            ptcp->ackLen = 0;       /* not an acknowledgement */
+    }
+    return 0;
+}
+
+static void checkConnection(caPutLogTcp *ptcp)
+{
+    if (ptcp->sock == INVALID_SOCKET)
+        return;
+    if (ptcp->spool && ptcp->ack ? readAcks(ptcp) < 0 : peerClosed(ptcp)) {
+        errlogSevPrintf(errlogMinor, "caPutLog: connection to %s closed\n", ptcp->name);
+        disconnect(ptcp);
+    }
+}
+
+#ifdef HAVE_ZLIB
+/* Deflate a batch into zbuf, ending with a sync flush; returns the length */
+static size_t deflateBatch(caPutLogTcp *ptcp, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    z_stream *pz = ptcp->pz;
+    size_t len = 0;
+    unsigned i;
+
+    for (i = 0; i < count; i++) {
+        int flush = i + 1 < count ? Z_NO_FLUSH : Z_SYNC_FLUSH, status;
+
+        pz->next_in = (Bytef *)pmsgs[i]->text;
+        pz->avail_in = (uInt)pmsgs[i]->len;
+        do {
+            if (len == ptcp->zcap) {
+                ptcp->zcap *= 2;
+                ptcp->zbuf = realloc(ptcp->zbuf, ptcp->zcap);
+                if (!ptcp->zbuf)
+                    cantProceed("caPutLogTcp: out of memory\n");
+            }
+            pz->next_out = ptcp->zbuf + len;
+            pz->avail_out = (uInt)(ptcp->zcap - len);
+            status = deflate(pz, flush);
+            len = ptcp->zcap - pz->avail_out;
+        } while (status == Z_OK && (pz->avail_in || pz->avail_out == 0));
+    }
+    return len;
+}
+#endif
+
+/* Send some of the batch, skipping what was written already */
+static int writeSome(caPutLogTcp *ptcp, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t skip, size_t len)
+{
+#ifdef HAVE_ZLIB
+    if (ptcp->pz)
+        return send(ptcp->sock, (char *)ptcp->zbuf + skip, (int)(len - skip), 0);
+#endif
+    return writeBuffers(ptcp->sock, pmsgs, count, skip);
+}
+
+/* Write a batch of total bytes; returns the bytes written, the connection
+   is closed if that is not all of them. A compressed batch is written
+   completely or not at all. */
+static size_t writeBatch(caPutLogTcp *ptcp, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t total)
+{
+    size_t sent = 0, len = total;
+
+    if (ptcp->preamblePending) {
+        caPutLogMsg *pre = ptcp->preamble(ptcp->preambleArg);
+        size_t preLen = pre->len;
+
+        ptcp->preamblePending = 0;
+        sent = writeBatch(ptcp, &pre, 1, preLen);
+        caPutLogMsgRelease(pre);
+        if (sent < preLen)
+            return 0;
+        sent = 0;
+    }
+#ifdef HAVE_ZLIB
+    if (ptcp->pz)
+        len = deflateBatch(ptcp, pmsgs, count);
+#endif
+    while (sent < len) {
+        int n = writeSome(ptcp, pmsgs, count, sent, len);
+
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && SOCKERRNO == SOCK_EINTR) {
+            continue;
+        } else if (n < 0 && (SOCKERRNO == SOCK_EWOULDBLOCK || SOCKERRNO == SOCK_EAGAIN)
+                && waitFor(ptcp->sock, 1, SEND_TIMEOUT)) {
+            continue;
+        } else {
+            report(ptcp, "connection lost to");
+            disconnect(ptcp);
+            break;
+        }
+    }
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.wireBytes += sent;
+    epicsMutexUnlock(ptcp->statsLock);
+#ifdef HAVE_ZLIB
+    if (ptcp->pz)
+        return sent == len ? total : 0;
+#endif
+    return sent;
+}
+
+/* Messages of a batch written completely */
+static unsigned complete(caPutLogMsg * const *pmsgs, unsigned count, size_t sent)
+{
+    unsigned i;
+
+    for (i = 0; i < count && sent >= pmsgs[i]->len; i++)
+        sent -= pmsgs[i]->len;
+    return i;
+}
+
+/* Send a batch if connected; returns the messages written completely */
+static unsigned directSend(caPutLogTcp *ptcp, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t total, size_t *psent)
+{
+    unsigned done;
+
+    *psent = 0;
+    checkConnection(ptcp);
+    if (ptcp->sock == INVALID_SOCKET && tryConnect(ptcp))
+        return 0;
+    *psent = writeBatch(ptcp, pmsgs, count, total);
+    done = complete(pmsgs, count, *psent);
+
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.msgsSent += done;
+    ptcp->stats.bytesSent += *psent;
+    epicsMutexUnlock(ptcp->statsLock);
+    return done;
+}
+
+/* Send what is spooled, as far as the connection and the rate allow */
+static void pump(caPutLogTcp *ptcp)
+{
+    caPutLogMsg *batch[caPutLogSinkMaxBatch];
+    caPutLogSpoolStats spool;
+    epicsTimeStamp now, spooled;
+    int limited;
+
+    checkConnection(ptcp);
+    caPutLogSpoolGetStats(ptcp->spool, &spool);
+    if (ptcp->sendOffset >= spool.bytes) {
+        ptcp->replaying = 0;
+        epicsMutexMustLock(ptcp->statsLock);
+        ptcp->stats.replayLag = 0.0;
+        epicsMutexUnlock(ptcp->statsLock);
+        return;
+    }
+    if (ptcp->sock == INVALID_SOCKET && tryConnect(ptcp))
+        return;
+
+    epicsTimeGetCurrent(&now);
+    limited = ptcp->rate > 0.0 && (ptcp->replaying || !ptcp->ack);
+    if (limited) {
+        /* up to one second's worth at once, but at least one message */
+        double cap = ptcp->rate > 1.0 ? ptcp->rate : 1.0;
+
+        ptcp->tokens += ptcp->rate * epicsTimeDiffInSeconds(&now, &ptcp->lastPump);
+        if (ptcp->tokens > cap)
+            ptcp->tokens = cap;
+    }
+    ptcp->lastPump = now;
+
+    while (ptcp->sock != INVALID_SOCKET && (!limited || ptcp->tokens >= 1.0)) {
+        size_t offset = ptcp->sendOffset, total = 0, sent;
+        unsigned n = 0, done, max = caPutLogSinkMaxBatch, i;
+
+        if (limited && ptcp->tokens < max)
+            max = (unsigned)ptcp->tokens;
+        while (n < max &&
+                (batch[n] = caPutLogSpoolGet(ptcp->spool, &offset, n ? NULL : &spooled)))
+            total += batch[n++]->len;
+        if (n == 0) {
+            ptcp->replaying = 0;
+            break;
+        }
+
+        sent = writeBatch(ptcp, batch, n, total);
+        done = complete(batch, n, sent);
+        if (!ptcp->ack) {
+            caPutLogSpoolConsume(ptcp->spool, done);
+        } else if (done == n) {
+            ptcp->sendOffset = offset;
+            ptcp->inFlight += n;
+        }
+        if (limited)
+            ptcp->tokens -= n;
+        for (i = 0; i < n; i++)
+            caPutLogMsgRelease(batch[i]);
+
+        epicsMutexMustLock(ptcp->statsLock);
+        ptcp->stats.msgsSent += done;
+        ptcp->stats.bytesSent += sent;
+        ptcp->stats.replayed += done;
+        ptcp->stats.replayLag = epicsTimeDiffInSeconds(&now, &spooled);
+        epicsMutexUnlock(ptcp->statsLock);
+        if (done < n)
+            break;
+    }
+}
+
+/* Spool what cannot go out directly, then send from the spool */
+static int spoolSend(caPutLogTcp *ptcp, caPutLogMsg * const *pmsgs, unsigned count,
+    size_t total)
+{
+    caPutLogSpoolStats spool;
+    size_t sent, dropped = 0;
+    unsigned i = 0, msgsDropped = 0;
+
+    caPutLogSpoolGetStats(ptcp->spool, &spool);
+    if (!ptcp->ack && spool.msgs == 0)
+        i = directSend(ptcp, pmsgs, count, total, &sent);
+    for (; i < count; i++) {
+        if (caPutLogSpoolPut(ptcp->spool, pmsgs[i])) {
+            msgsDropped++;
+            dropped += pmsgs[i]->len;
+        }
+    }
+    if (msgsDropped) {
+        epicsMutexMustLock(ptcp->statsLock);
+        ptcp->stats.msgsDropped += msgsDropped;
+        ptcp->stats.bytesDropped += dropped;
+        epicsMutexUnlock(ptcp->statsLock);
+    }
+    pump(ptcp);
+    return msgsDropped ? -1 : 0;
+}
+
+static int tcpSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    caPutLogTcp *ptcp = (caPutLogTcp *)ctx;
+    size_t total = 0, sent;
+    unsigned i, done;
+
+    for (i = 0; i < count; i++)
+        total += pmsgs[i]->len;
+    if (ptcp->spool)
+        return spoolSend(ptcp, pmsgs, count, total);
+
+    done = directSend(ptcp, pmsgs, count, total, &sent);
+    epicsMutexMustLock(ptcp->statsLock);
+    ptcp->stats.msgsDropped += count - done;
+    ptcp->stats.bytesDropped += total - sent;
+    epicsMutexUnlock(ptcp->statsLock);
+    return done == count ? 0 : -1;
+}
+
+/* Keep sending from the spool, or reconnecting, while no new messages arrive */
+static double tcpIdle(void *ctx)
+{
+    caPutLogTcp *ptcp = (caPutLogTcp *)ctx;
+    caPutLogSpoolStats spool;
+    epicsTimeStamp now;
+    double wait;
+
+    if (!ptcp->spool) {
+        if (ptcp->sock != INVALID_SOCKET || !ptcp->failing || tryConnect(ptcp) == 0)
+            return 0.0;
+    } else {
+        pump(ptcp);
+        caPutLogSpoolGetStats(ptcp->spool, &spool);
+        if (spool.msgs == 0)
+            return 0.0;
+        if (ptcp->sock != INVALID_SOCKET)
+            return POLL_INTERVAL;
+    }
+    epicsTimeGetCurrent(&now);
+    wait = epicsTimeDiffInSeconds(&ptcp->nextAttempt, &now);
+    return wait > POLL_INTERVAL ? wait : POLL_INTERVAL;
+}
+
+static void tcpShow(void *ctx, unsigned level)
+{
+    caPutLogTcp *ptcp = (caPutLogTcp *)ctx;
+    caPutLogTcpStats stats;
+
+    caPutLogTcpGetStats(ptcp, &stats);
+    printf("    %s, %u connects, %u disconnects", stats.connected ? "connected" :
+        "not connected", stats.connects, stats.disconnects);
+    if (!stats.connected && stats.backoff > 0.0)
+        printf(", retry every %g s", stats.backoff);
+    printf("\n    sent %lu messages (%lu bytes), dropped %lu (%lu bytes)\n",
+        (unsigned long)stats.msgsSent, (unsigned long)stats.bytesSent,
+        (unsigned long)stats.msgsDropped, (unsigned long)stats.bytesDropped);
+#ifdef HAVE_ZLIB
+    if (ptcp->pz)
+        printf("    zlib level %d, %lu bytes on the wire (%.1f%%)\n", ptcp->level,
+            (unsigned long)stats.wireBytes,
+            stats.bytesSent ? 100.0 * stats.wireBytes / stats.bytesSent : 0.0);
+#endif
+    if (ptcp->spool)
+        printf("    spool%s: %u messages (%lu of %lu bytes), dropped %lu,"
+            " replayed %lu, replay lag %.3f s\n", ptcp->ack ? " (acknowledged)" : "",
+            stats.spoolMsgs, (unsigned long)stats.spoolBytes,
+            (unsigned long)stats.spoolCapacity, (unsigned long)stats.spoolDropped,
+            (unsigned long)stats.replayed, stats.replayLag);
+}
+
+static void tcpDestroy(void *ctx)
+{
+    caPutLogTcp *ptcp = (caPutLogTcp *)ctx;
+
+    if (ptcp->sock != INVALID_SOCKET)
+        epicsSocketDestroy(ptcp->sock);
+    caPutLogSpoolClose(ptcp->spool);
+#ifdef HAVE_ZLIB
+    if (ptcp->pz) {
+        deflateEnd(ptcp->pz);
+        free(ptcp->pz);
+        free(ptcp->zbuf);
+    }
+#endif
+    epicsMutexDestroy(ptcp->statsLock);
+    free(ptcp);
+}
+
+/* Down only after a connect failed, a server not tried yet is up */
+static int tcpHealthy(void *ctx)
+{
+    caPutLogTcp *ptcp = (caPutLogTcp *)ctx;
+    int up;
+
+    epicsMutexMustLock(ptcp->statsLock);
+    up = ptcp->stats.connected || ptcp->stats.backoff == 0.0;
+    epicsMutexUnlock(ptcp->statsLock);
+    return up;
+}
+
+const caPutLogSinkTransport caPutLogTcpTransport = {
+    tcpSend, NULL, tcpShow, tcpDestroy, tcpIdle, tcpHealthy
+};
+
+int caPutLogTcpSetSpool(caPutLogTcp *ptcp, const char *path, size_t capacity,
+    double rate, int ack)
+{
+    caPutLogSpool *spool = caPutLogSpoolOpen(path, capacity);
+
+    if (!spool)
+        return -1;
+    ptcp->spool = spool;
+    ptcp->rate = rate > 0.0 ? rate : 0.0;
+    ptcp->ack = ack;
+    epicsTimeGetCurrent(&ptcp->lastPump);
+    return 0;
+}
+
+void caPutLogTcpSetPreamble(caPutLogTcp *ptcp, caPutLogSinkPreamble *preamble, void *arg)
+{
+    ptcp->preamble = preamble;
+    ptcp->preambleArg = arg;
+}
+
+int caPutLogTcpSetCompression(caPutLogTcp *ptcp, int level)
+{
+#ifdef HAVE_ZLIB
+    z_stream *pz = callocMustSucceed(1, sizeof(z_stream), "caPutLogTcpSetCompression");
+
+    if (level < 0 || level > 9)
+        level = Z_DEFAULT_COMPRESSION;
+    if (deflateInit(pz, level) != Z_OK) {
+        errlogSevPrintf(errlogMajor, "caPutLog: cannot compress for %s: %s\n",
+            ptcp->name, pz->msg ? pz->msg : "deflateInit failed");
+        free(pz);
+        return -1;
+    }
+    ptcp->pz = pz;
+    ptcp->level = level;
+    ptcp->zcap = 16384;
+    ptcp->zbuf = mallocMustSucceed(ptcp->zcap, "caPutLogTcpSetCompression");
+    return 0;
+#else
+    errlogSevPrintf(errlogMajor,
+        "caPutLog: cannot compress for %s, built without zlib (USE_ZLIB)\n", ptcp->name);
+    return -1;
+#endif
+}
+
+void caPutLogTcpGetStats(caPutLogTcp *ptcp, caPutLogTcpStats *pstats)
+{
+    epicsMutexMustLock(ptcp->statsLock);
+    *pstats = ptcp->stats;
+    epicsMutexUnlock(ptcp->statsLock);
+    if (ptcp->spool) {
+        caPutLogSpoolStats spool;
+
+        caPutLogSpoolGetStats(ptcp->spool, &spool);
+        pstats->spoolMsgs = spool.msgs;
+        pstats->spoolBytes = spool.bytes;
+        pstats->spoolCapacity = spool.capacity;
+        pstats->spoolDropped = spool.dropped;
+    }
+}
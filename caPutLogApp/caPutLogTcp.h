@@ -0,0 +1,91 @@
+#ifndef INCcaPutLogTcph
+#define INCcaPutLogTcph 1
+
+#include <stddef.h>
+#include <osiSock.h>
+#include <shareLib.h>
+
+#include "caPutLogSink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * TCP connection to a log server, a transport for caPutLogSink.h used
+ * instead of base's logClient.
+ *
+ * Everything runs in the sink's sender thread: the connection is opened
+ * with a non-blocking connect when there is something to send, a batch
+ * goes out with one writev(). After a failed attempt or a lost connection
+ * the next attempt is delayed, starting at 0.5 s and doubling up to 30 s;
+ * batches arriving in between are dropped and counted, unless there is a
+ * spool.
+ *
+ * With compression the connection carries one zlib stream (RFC 1950),
+ * flushed after each batch (Z_SYNC_FLUSH) and started anew after each
+ * reconnect; the server inflates it to the same lines. This needs the
+ * module to be built with USE_ZLIB = YES.
+ */
+
+/* Socket options applied to new connections */
+epicsShareExtern int caPutLogTcpNoDelay;   /* TCP_NODELAY, default on */
+epicsShareExtern int caPutLogTcpSndBuf;    /* SO_SNDBUF in bytes, 0: system default */
+epicsShareExtern int caPutLogTcpZlibLevel; /* for zlib:// addresses, 0-9, default 6 */
+
+typedef struct caPutLogTcp caPutLogTcp;
+
+epicsShareExtern const caPutLogSinkTransport caPutLogTcpTransport;
+
+/* The transport's context for a server, name is used in messages */
+epicsShareFunc caPutLogTcp *caPutLogTcpCreate(const struct sockaddr_in *paddr,
+    const char *name);
+
+/*
+ * Keep what cannot be sent in the spool at path (see caPutLogSpool.h)
+ * and replay it in order at up to rate messages per second (0: no
+ * limit) once the server is back. Without ack a message counts as
+ * delivered when written to the socket. With ack every message goes
+ * through the spool and is only removed when the server acknowledges
+ * it with a line "ACK <n>\n", n being the number of messages received
+ * on that connection; after a reconnect sending resumes with the first
+ * message not acknowledged. Call before the transport is used; -1 if
+ * the spool cannot be opened (reported).
+ */
+epicsShareFunc int caPutLogTcpSetSpool(caPutLogTcp *ptcp, const char *path,
+    size_t capacity, double rate, int ack);
+
+/* Compress at level (0-9, else zlib's default) from the next connect on;
+   call before the transport is used. -1 if built without zlib (reported). */
+epicsShareFunc int caPutLogTcpSetCompression(caPutLogTcp *ptcp, int level);
+
+/* Write the preamble's message first on every connection (see
+   caPutLogSink.h); call before the transport is used */
+epicsShareFunc void caPutLogTcpSetPreamble(caPutLogTcp *ptcp,
+    caPutLogSinkPreamble *preamble, void *arg);
+
+typedef struct {
+    int         connected;
+    unsigned    connects;       /* connections established */
+    unsigned    disconnects;    /* connections lost */
+    size_t      msgsSent;
+    size_t      bytesSent;
+    size_t      msgsDropped;    /* not or only partly written */
+    size_t      bytesDropped;   /* not written */
+    size_t      wireBytes;      /* written to the socket, compressed or not */
+    double      backoff;        /* current delay between attempts */
+    unsigned    spoolMsgs;      /* messages spooled now */
+    size_t      spoolBytes;
+    size_t      spoolCapacity;
+    size_t      spoolDropped;   /* messages that found the spool full */
+    size_t      replayed;       /* messages sent from the spool */
+    double      replayLag;      /* seconds the last one replayed was spooled */
+} caPutLogTcpStats;
+
+epicsShareFunc void caPutLogTcpGetStats(caPutLogTcp *ptcp, caPutLogTcpStats *pstats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogTcph*/
@@ -0,0 +1,144 @@
+/*	File:	  caPutLogTime.c
+ *
+ *	Time stamp formatting with a per-second cache,
+ *	see caPutLogTime.h.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <epicsTime.h>
+
+#define epicsExportSharedSymbols
+#include "caPutLogTime.h"
+
+#define DEFAULT_FRAC_DIGITS 6
+#define MAX_FRAC_DIGITS 9
+
+static const epicsUInt32 fracDivisor[MAX_FRAC_DIGITS + 1] = {
+    1000000000, 100000000, 10000000, 1000000, 100000,
+    10000, 1000, 100, 10, 1
+};
+
+int caPutLogTimeCompile(caPutLogTimeCache *pcache, const char *format, int utc)
+{
+    char *seg = pcache->segments;
+    char *end = pcache->segments + sizeof(pcache->segments) - 1;
+    const char *p = format;
+
+    pcache->source = format;
+    pcache->utc = utc;
+    pcache->fallback = 0;
+    pcache->nfrac = 0;
+    pcache->cached = 0;
+
+    while (*p) {
+        if (p[0] == '%' && p[1] == '%') {
+            if (end - seg < 2)
+                goto fallback;
+            *seg++ = *p++;
+            *seg++ = *p++;
+            continue;
+        }
+        if (p[0] == '%') {
+            /* fractional seconds, "%f" or "%<n>f" as in epicsTimeToStrftime */
+            const char *q = p + 1;
+            int digits = 0;
+
+            for (; *q >= '0' && *q <= '9'; q++) {
+                if (digits <= MAX_FRAC_DIGITS)
+                    digits = digits * 10 + (*q - '0');
+            }
+            if (*q == 'f') {
+                if (q == p + 1)
+                    digits = DEFAULT_FRAC_DIGITS;
+                if (digits < 1)
+                    digits = 1;
+                if (digits > MAX_FRAC_DIGITS)
+                    digits = MAX_FRAC_DIGITS;
+                if (pcache->nfrac == caPutLogTimeMaxFrac || seg == end)
+                    goto fallback;
+                *seg++ = 0;
+                pcache->fracDigits[pcache->nfrac++] = (unsigned char)digits;
+                p = q + 1;
+                continue;
+            }
+        }
+        if (seg == end)
+            goto fallback;
+        *seg++ = *p++;
+    }
+    *seg = 0;
+    return 0;
+
+fallback:
+    pcache->fallback = 1;
+    return -1;
+}
+
+/* Render the segments for the second of *pts, leaving room for the fractions */
+static int render(caPutLogTimeCache *pcache, const epicsTimeStamp *pts)
+{
+    epicsTimeStamp second = *pts;
+    unsigned long nsec;
+    const char *seg = pcache->segments;
+    size_t len = 0;
+    struct tm tm;
+    int i;
+
+    pcache->cached = 0;
+    second.nsec = 0;
+    if ((pcache->utc ? epicsTimeToGMTM(&tm, &nsec, &second)
+                     : epicsTimeToTM(&tm, &nsec, &second)) != epicsTimeOK)
+        return -1;
+
+    for (i = 0; ; i++) {
+        if (*seg) {
+            size_t n = strftime(pcache->text + len, sizeof(pcache->text) - len, seg, &tm);
+            if (n == 0)
+                return -1;
+            len += n;
+        }
+        seg += strlen(seg) + 1;
+        if (i == pcache->nfrac)
+            break;
+        if (len + pcache->fracDigits[i] >= sizeof(pcache->text))
+            return -1;
+        pcache->fracOffset[i] = len;
+        len += pcache->fracDigits[i];
+    }
+    pcache->len = len;
+    pcache->sec = pts->secPastEpoch;
+    pcache->cached = 1;
+    return 0;
+}
+
+size_t caPutLogTimeFormat(caPutLogTimeCache *pcache, char *buf, size_t size,
+    const epicsTimeStamp *pts)
+{
+    epicsUInt32 nsec = pts->nsec < 1000000000u ? pts->nsec : 999999999u;
+    int i;
+
+    if (pcache->fallback)
+        return epicsTimeToStrftime(buf, size, pcache->source, pts);
+    if (!pcache->cached || pcache->sec != pts->secPastEpoch) {
+        if (render(pcache, pts))
+            return epicsTimeToStrftime(buf, size, pcache->source, pts);
+    }
+    if (pcache->len >= size)
+        return 0;
+
+    memcpy(buf, pcache->text, pcache->len);
+    buf[pcache->len] = 0;
+    for (i = 0; i < pcache->nfrac; i++) {
+        int digits = pcache->fracDigits[i];
+        epicsUInt32 frac = nsec / fracDivisor[digits];
+        char *p = buf + pcache->fracOffset[i] + digits;
+
+        while (digits--) {
+            *--p = (char)('0' + frac % 10);
+            frac /= 10;
+        }
+    }
+    return pcache->len;
+}
@@ -0,0 +1,60 @@
+#ifndef INCcaPutLogTimeh
+#define INCcaPutLogTimeh 1
+
+#include <epicsTime.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Time stamp formatting with a per-second cache.
+ *
+ * A format in the style of epicsTimeToStrftime() is compiled once into
+ * strftime() segments and fractional second fields ("%f", "%0<n>f").
+ * The segments are rendered once per second; messages within the same
+ * second only copy that text and fill in the fractional digits.
+ *
+ * A cache belongs to one thread. It falls back to epicsTimeToStrftime()
+ * for formats or results that don't fit into it.
+ */
+
+#define caPutLogTimeMaxLen 128      /* longest format and result */
+#define caPutLogTimeMaxFrac 4       /* fractional second fields */
+
+typedef struct caPutLogTimeCache {
+    const char *source;             /* format this was compiled from */
+    int utc;                        /* render in UTC instead of local time */
+    int fallback;                   /* format not compiled */
+    int nfrac;
+    unsigned char fracDigits[caPutLogTimeMaxFrac];
+    char segments[caPutLogTimeMaxLen]; /* nfrac+1 strftime formats, NUL separated */
+
+    int cached;                     /* text holds the second below */
+    epicsUInt32 sec;
+    size_t len;
+    size_t fracOffset[caPutLogTimeMaxFrac];
+    char text[caPutLogTimeMaxLen];
+} caPutLogTimeCache;
+
+/*
+ * Compile format (which must stay valid while the cache is used) for
+ * local time or UTC. Returns 0, or -1 if the cache will fall back to
+ * epicsTimeToStrftime() (always local time) for this format.
+ */
+epicsShareFunc int caPutLogTimeCompile(caPutLogTimeCache *pcache,
+    const char *format, int utc);
+
+/*
+ * Format a time stamp into buf like epicsTimeToStrftime() does.
+ * Returns the length of the result, 0 if it doesn't fit.
+ */
+epicsShareFunc size_t caPutLogTimeFormat(caPutLogTimeCache *pcache,
+    char *buf, size_t size, const epicsTimeStamp *pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*INCcaPutLogTimeh*/
@@ -0,0 +1,140 @@
+/* File:     caPutJsonLogFormatBench.cpp
+ *
+ * Formatting benchmark: JSON messages built with the yajl generator
+ * (CaPutJsonLogTask::buildJsonMsgYajl) versus the direct writer
+ * (CaPutJsonLogFormat), for a few typical puts. The yajl generator uses
+ * printf for numbers, the writer is timed with both number formats.
+ *
+ * Usage: caPutJsonLogFormatBench [messages]
+ *
+ * For each put the mean time per message and the speed-up of the writer
+ * with the shortest number format are reported.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <epicsTime.h>
+
+#include "caPutJsonLogTask.h"
+#include "caPutJsonLogFormat.h"
+#include "caPutLogNum.h"
+
+#define DEFAULT_MESSAGES 200000
+
+struct BenchPut {
+    const char *name;
+    LOGDATA data;
+    TIME_VALUE new_value;
+    VALUE old_value;
+    VALUE min, max;
+    int burst;
+};
+
+static void setup(BenchPut &put, const char *name, short type, int nelm, int elemSize)
+{
+    memset(&put, 0, sizeof(put));
+    put.name = name;
+    put.data.type = type;
+    put.data.value_size = nelm * elemSize;
+    put.data.is_array = nelm > 1;
+    put.data.old_size = put.data.old_log_size = nelm;
+    put.data.new_size = put.data.new_log_size = nelm;
+    put.data.old_value = &put.old_value;
+    put.data.new_value = &put.new_value;
+    put.data.userid = const_cast<char *>("operator");
+    put.data.hostid = const_cast<char *>("console.example.org");
+    put.data.pv_name = const_cast<char *>("BENCH:SECTOR1:MAGNET:CURRENT");
+    epicsTimeGetCurrent(&put.new_value.time);
+}
+
+static double run(CaPutJsonLogTask *logger, CaPutJsonLogFormat &writer,
+    BenchPut &put, int n, bool yajl, size_t *plen)
+{
+    std::string metadata = CaPutJsonLogFormat::serializeMetadata(logger->getMetadata());
+    std::string msg;
+    epicsTimeStamp start, end;
+
+    epicsTimeGetCurrent(&start);
+    for (int i = 0; i < n; i++) {
+        if (yajl) {
+            logger->buildJsonMsgYajl(msg, &put.old_value, &put.data, put.burst,
+                &put.min, &put.max);
+            *plen = msg.length();
+        } else {
+            writer.format(&put.old_value, &put.data, put.burst, &put.min, &put.max,
+                metadata);
+            *plen = writer.message().length();
+        }
+    }
+    epicsTimeGetCurrent(&end);
+    return epicsTimeDiffInSeconds(&end, &start) / n * 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : DEFAULT_MESSAGES;
+    CaPutJsonLogTask *logger = CaPutJsonLogTask::getInstance();
+    CaPutJsonLogFormat writer;
+    static BenchPut puts[5];
+    int i;
+
+    if (n <= 0 || !logger) {
+        fprintf(stderr, "usage: %s [messages]\n", argv[0]);
+        return 1;
+    }
+
+    setup(puts[0], "double scalar", DBR_DOUBLE, 1, sizeof(epicsFloat64));
+    puts[0].old_value.v_double = 12.5;
+    puts[0].new_value.value.v_double = 13.0625;
+
+    setup(puts[1], "double burst", DBR_DOUBLE, 1, sizeof(epicsFloat64));
+    puts[1].old_value.v_double = 0.1;
+    puts[1].new_value.value.v_double = 0.7;
+    puts[1].min.v_double = 0.2;
+    puts[1].max.v_double = 0.9;
+    puts[1].burst = 12;
+
+    setup(puts[2], "double[50]", DBR_DOUBLE, 50, sizeof(epicsFloat64));
+    for (i = 0; i < 50; i++) {
+        puts[2].old_value.a_double[i] = i / 3.0;
+        puts[2].new_value.value.a_double[i] = i * 1.5;
+    }
+
+    setup(puts[3], "long[100]", DBR_LONG, 100, sizeof(epicsInt32));
+    for (i = 0; i < 100; i++) {
+        puts[3].old_value.a_int32[i] = i * 1000;
+        puts[3].new_value.value.a_int32[i] = -i * 7919;
+    }
+
+    setup(puts[4], "string", DBR_STRING, 1, MAX_STRING_SIZE);
+    strcpy(puts[4].old_value.a_string[0], "Closed");
+    strcpy(puts[4].new_value.value.a_string[0], "Open \"manual\"");
+
+    logger->addMetadata("facility", "bench");
+
+    logger->setNumFmt("printf");
+
+    printf("%d messages per run\n", n);
+    printf("%-16s %8s %12s %12s %12s %8s\n", "put", "bytes", "yajl ns",
+        "printf ns", "shortest ns", "ratio");
+    for (i = 0; i < 5; i++) {
+        size_t len = 0;
+        double tYajl, tPrintf, tShortest;
+
+        /* warm up both paths (buffers, caches) */
+        run(logger, writer, puts[i], n / 10 + 1, true, &len);
+        run(logger, writer, puts[i], n / 10 + 1, false, &len);
+
+        tYajl = run(logger, writer, puts[i], n, true, &len);
+        writer.setNumFmt(caPutLogNumPrintf);
+        tPrintf = run(logger, writer, puts[i], n, false, &len);
+        writer.setNumFmt(caPutLogNumShortest);
+        tShortest = run(logger, writer, puts[i], n, false, &len);
+        printf("%-16s %8lu %12.1f %12.1f %12.1f %8.2f\n", puts[i].name, (unsigned long)len,
+            tYajl, tPrintf, tShortest, tShortest > 0.0 ? tYajl / tShortest : 0.0);
+    }
+    return 0;
+}
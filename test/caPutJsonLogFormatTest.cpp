@@ -0,0 +1,307 @@
+/* File:     caPutJsonLogFormatTest.cpp
+ *
+ * Unit tests for the direct JSON writer: for every value type, arrays,
+ * special values, bursts and strings that need escaping its output must
+ * be the same, byte for byte, as what the yajl generator produces, with
+ * either number format.
+ */
+
+#include <cstring>
+#include <string>
+
+#include <epicsAtomic.h>
+#include <epicsMath.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogIdent.h"
+#include "caPutLogNum.h"
+#include "caPutJsonLogTask.h"
+#include "caPutJsonLogFormat.h"
+
+static CaPutJsonLogTask *logger;
+static CaPutJsonLogFormat writer;
+
+// LOGDATA with room for the largest values
+struct TestPut {
+    LOGDATA data;
+    TIME_VALUE new_value;
+    VALUE old_value;
+    VALUE min, max;
+    char pv_name[PVNAME_STRINGSZ];
+
+    TestPut(short type, int nelm, int elemSize) {
+        memset(this, 0, sizeof(*this));
+        data.type = type;
+        data.value_size = nelm * elemSize;
+        data.is_array = nelm > 1;
+        data.old_size = data.old_log_size = nelm;
+        data.new_size = data.new_log_size = nelm;
+        data.old_value = &old_value;
+        data.new_value = &new_value;
+        data.userid = const_cast<char *>("user");
+        data.hostid = const_cast<char *>("host");
+        data.pv_name = pv_name;
+        strcpy(pv_name, "test:pv");
+        new_value.time.secPastEpoch = 1000000000;
+        new_value.time.nsec = 123456789;
+    }
+};
+
+static void compare(const char *what, TestPut &put, int burst = 0)
+{
+    std::string expected;
+    bool ok;
+
+    ok = logger->buildJsonMsgYajl(expected, &put.old_value, &put.data, burst,
+        &put.min, &put.max) == caPutJsonLogSuccess &&
+        writer.format(&put.old_value, &put.data, burst, &put.min, &put.max,
+            CaPutJsonLogFormat::serializeMetadata(logger->getMetadata())) == 0 &&
+        writer.message() == expected;
+    testOk(ok, "%s", what);
+    if (!ok) {
+        testDiag("yajl:   %s", expected.c_str());
+        testDiag("writer: %s", writer.message().c_str());
+    }
+}
+
+static void setNumFmt(caPutLogNumFmt fmt)
+{
+    testDiag("Number format %s", caPutLogNumFmtName(fmt));
+    logger->setNumFmt(caPutLogNumFmtName(fmt));
+    writer.setNumFmt(fmt);
+}
+
+static void testShortest()
+{
+    TestPut put(DBR_DOUBLE, 1, sizeof(epicsFloat64));
+    put.old_value.v_double = 2.0;
+    put.new_value.value.v_double = 0.1;
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    testOk(writer.message().find("\"new\":0.1,\"old\":2.0}") != std::string::npos,
+        "shortest digits and integer marker");
+}
+
+static void testScalars()
+{
+    testDiag("Scalars");
+    {
+        TestPut put(DBR_DOUBLE, 1, sizeof(epicsFloat64));
+        put.old_value.v_double = 1.0;
+        put.new_value.value.v_double = -0.1;
+        compare("DBR_DOUBLE", put);
+        put.min.v_double = -3e-300;
+        put.max.v_double = 12345678901234567890.0;
+        compare("DBR_DOUBLE burst with min and max", put, 3);
+        put.old_value.v_double = epicsNAN;
+        put.new_value.value.v_double = -epicsINF;
+        compare("DBR_DOUBLE Nan and -Infinity", put);
+    }
+    {
+        TestPut put(DBR_FLOAT, 1, sizeof(epicsFloat32));
+        put.old_value.v_float = 3.0f;
+        put.new_value.value.v_float = epicsINF;
+        compare("DBR_FLOAT", put);
+    }
+    {
+        TestPut put(DBR_SHORT, 1, sizeof(epicsInt16));
+        put.old_value.v_int16 = -32768;
+        put.new_value.value.v_int16 = 32767;
+        put.min.v_int16 = -32768;
+        put.max.v_int16 = 0;
+        compare("DBR_SHORT burst", put, 2);
+    }
+    {
+        TestPut put(DBR_ENUM, 1, sizeof(epicsUInt16));
+        put.old_value.v_uint16 = 0;
+        put.new_value.value.v_uint16 = 65535;
+        compare("DBR_ENUM", put);
+    }
+    {
+        TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+        put.old_value.v_int32 = -2147483647 - 1;
+        put.new_value.value.v_int32 = 2147483647;
+        compare("DBR_LONG", put);
+    }
+    {
+        TestPut put(DBR_ULONG, 1, sizeof(epicsUInt32));
+        put.old_value.v_uint32 = 4294967295u;
+        put.new_value.value.v_uint32 = 10;
+        compare("DBR_ULONG", put);
+    }
+#ifdef DBR_INT64
+    {
+        TestPut put(DBR_INT64, 1, sizeof(epicsInt64));
+        put.old_value.v_int64 = -9223372036854775807LL - 1;
+        put.new_value.value.v_int64 = 9223372036854775807LL;
+        compare("DBR_INT64", put);
+    }
+    {
+        TestPut put(DBR_UINT64, 1, sizeof(epicsUInt64));
+        put.old_value.v_uint64 = 18446744073709551615ULL;
+        put.new_value.value.v_uint64 = 0;
+        compare("DBR_UINT64", put);
+    }
+#endif
+}
+
+static void testArrays()
+{
+    testDiag("Arrays");
+    {
+        TestPut put(DBR_DOUBLE, 5, sizeof(epicsFloat64));
+        for (int i = 0; i < 5; i++) {
+            put.old_value.a_double[i] = i * 0.5;
+            put.new_value.value.a_double[i] = i * 1e10;
+        }
+        put.new_value.value.a_double[1] = epicsNAN;
+        put.data.new_size = 7;
+        compare("DBR_DOUBLE array with special values", put);
+    }
+    {
+        TestPut put(DBR_UCHAR, 4, sizeof(epicsUInt8));
+        for (int i = 0; i < 4; i++)
+            put.new_value.value.a_uint8[i] = static_cast<epicsUInt8>(i * 85);
+        compare("DBR_UCHAR array", put);
+    }
+    {
+        TestPut put(DBR_LONG, 3, sizeof(epicsInt32));
+        put.data.old_log_size = 0;
+        put.data.old_size = 0;
+        compare("empty old array", put);
+    }
+    {
+        TestPut put(DBR_STRING, 3, MAX_STRING_SIZE);
+        strcpy(put.old_value.a_string[0], "plain");
+        strcpy(put.old_value.a_string[1], "a/b \"quoted\" back\\slash");
+        strcpy(put.old_value.a_string[2], "tab\tnl\ncr\rff\fbs\b\x01\x1f");
+        strcpy(put.new_value.value.a_string[0], "\xc3\xa4\xc3\xb6\xc3\xbc");
+        memset(put.new_value.value.a_string[1], 'x', MAX_STRING_SIZE - 1);
+        compare("DBR_STRING array with escapes", put);
+    }
+}
+
+static void testStrings()
+{
+    testDiag("Strings and metadata");
+    {
+        TestPut put(DBR_STRING, 1, MAX_STRING_SIZE);
+        strcpy(put.new_value.value.a_string[0], "\"");
+        compare("DBR_STRING scalar", put);
+    }
+    {
+        TestPut put(DBR_CHAR, MAX_ARRAY_SIZE_BYTES, 1);
+        memset(put.new_value.value.a_bytes, 'y', MAX_ARRAY_SIZE_BYTES - 1);
+        strcpy(put.old_value.a_bytes, "long \"string\"\n");
+        put.data.new_size = MAX_ARRAY_SIZE_BYTES + 100;
+        compare("DBR_CHAR long string", put);
+    }
+    {
+        TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+        strcpy(put.pv_name, "odd\\name");
+        put.data.userid = const_cast<char *>("us\"er");
+        put.data.hostid = const_cast<char *>("ho\x02st");
+        logger->addMetadata("facility", "x/y");
+        logger->addMetadata("esc\"key", "tab\t");
+        compare("escaped names and metadata", put);
+
+        put.data.ident = caPutLogIdentGet(put.data.userid, put.data.hostid);
+        compare("client from the identity table", put);
+        caPutLogIdentRelease(put.data.ident);
+        logger->removeAllMetadata();
+        compare("metadata removed", put);
+    }
+}
+
+// Changes the metadata while the main thread builds messages
+static int changerDone;
+
+static void metadataChanger(void *)
+{
+    for (int i = 0; i < 2000; i++) {
+        logger->addMetadata("facility", i & 1 ? "odd" : "even");
+        if (i % 100 == 99)
+            logger->removeAllMetadata();
+    }
+    epics::atomic::set(changerDone, 1);
+}
+
+static void testMetadataChanges()
+{
+    TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+    std::string msg;
+    int bad = 0, n = 0;
+
+    testDiag("Metadata changed while messages are built");
+    epicsThreadMustCreate("metadataChanger", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), metadataChanger, NULL);
+    do {
+        logger->buildJsonMsgYajl(msg, &put.old_value, &put.data, 0, &put.min, &put.max);
+        n++;
+        if (msg.find("\"user\":\"user\",\"pv\"") == std::string::npos &&
+            msg.find("\"user\":\"user\",\"facility\":\"odd\",\"pv\"") == std::string::npos &&
+            msg.find("\"user\":\"user\",\"facility\":\"even\",\"pv\"") == std::string::npos)
+            bad++;
+    } while (!epics::atomic::get(changerDone) || n < 1000);
+    testOk(bad == 0, "%d messages, %d with unexpected metadata", n, bad);
+    logger->removeAllMetadata();
+}
+
+static bool startsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static void testTimeFmt()
+{
+    TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+
+    testDiag("Time formats");
+    writer.setTimeFmt(CaPutJsonLogFormat::timeIso8601);
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    testOk(startsWith(writer.message(),
+        "{\"timestamp\":\"2021-09-09T01:46:40.123456Z\",\"host\":"),
+        "%s", CaPutJsonLogFormat::timeFmtName(CaPutJsonLogFormat::timeIso8601));
+    writer.setTimeFmt(CaPutJsonLogFormat::timeEpochNs);
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    testOk(startsWith(writer.message(),
+        "{\"timestamp-ns\":1631152000123456789,\"host\":"),
+        "%s", CaPutJsonLogFormat::timeFmtName(CaPutJsonLogFormat::timeEpochNs));
+    writer.setTimeFmt(CaPutJsonLogFormat::timeDateTime);
+}
+
+static void testSuppressed()
+{
+    TestPut put(DBR_DOUBLE, 1, sizeof(epicsFloat64));
+
+    testDiag("Summary of rate limited puts");
+    put.data.suppressed_pv = 12;
+    writer.setTimeFmt(CaPutJsonLogFormat::timeEpochNs);
+    writer.suppressed(&put.data, std::string());
+    testOk(writer.message() == "{\"timestamp-ns\":1631152000123456789,\"host\":\"host\","
+        "\"user\":\"user\",\"pv\":\"test:pv\",\"suppressed-pv\":12,\"suppressed-client\":0}",
+        "%s", writer.message().c_str());
+    writer.setTimeFmt(CaPutJsonLogFormat::timeDateTime);
+}
+
+MAIN(caPutJsonLogFormatTest)
+{
+    testPlan(38);
+    logger = CaPutJsonLogTask::getInstance();
+    if (!logger)
+        testAbort("no logger instance");
+    setNumFmt(caPutLogNumPrintf);
+    testScalars();
+    testArrays();
+    setNumFmt(caPutLogNumShortest);
+    testScalars();
+    testArrays();
+    testStrings();
+    testShortest();
+    testTimeFmt();
+    testSuppressed();
+    testMetadataChanges();
+    return testDone();
+}
@@ -0,0 +1,204 @@
+/* File:     caPutLogAsTest.c
+ *
+ * Unit tests for the access security trap: values captured in raw mode
+ * (caPutLogRawCapture) must come out of caPutLogDataResolve() exactly as
+ * dbGetField would have converted them, and in the on-change mode puts
+ * that leave the value unchanged are freed in the trap.
+ */
+
+#include <string.h>
+
+#include <dbAccess.h>
+#include <dbChannel.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <asTrapWrite.h>
+#include <errlog.h>
+#include <epicsMath.h>
+#include <testMain.h>
+
+#include "caPutLog.h"
+#include "caPutLogAs.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static LOGDATA *captured;
+
+static void captureCallback(LOGDATA *plogData)
+{
+    captured = plogData;
+}
+
+/*
+ * Run the trap around a put of pnew, after setting the field to pold;
+ * returns the LOGDATA (resolved) and whether it was captured raw
+ */
+static LOGDATA *trapPut(dbChannel *pch, short dbrType, const void *pold,
+    const void *pnew, long n, int raw, int *pwasRaw)
+{
+    void *pvt;
+
+    caPutLogRawCapture = raw;
+    dbPutField(&pch->addr, dbrType, pold, n);
+    captured = NULL;
+    pvt = asTrapWriteBeforeWithData("user", "host", pch, dbrType, n, (void *)pnew);
+    dbPutField(&pch->addr, dbrType, pnew, n);
+    asTrapWriteAfterWrite(pvt);
+    caPutLogRawCapture = 0;
+
+    if (!captured) return NULL;
+    *pwasRaw = captured->raw;
+    caPutLogDataResolve(captured);
+    return captured;
+}
+
+static int sameValue(short type, const VALUE *pa, const VALUE *pb, int n)
+{
+    int i;
+
+    switch (type) {
+    case DBR_CHAR:
+        return strcmp(pa->a_bytes, pb->a_bytes) == 0;
+    case DBR_STRING:
+        for (i = 0; i < n; i++) {
+            if (strncmp(pa->a_string[i], pb->a_string[i], MAX_STRING_SIZE) != 0)
+                return 0;
+        }
+        return 1;
+    default:
+        return memcmp(pa, pb, n * dbValueSize(type)) == 0;
+    }
+}
+
+static void testField(const char *name, short dbrType,
+    const void *pold, const void *pnew, long n, int native)
+{
+    dbChannel *pch = dbChannelCreate(name);
+    LOGDATA *pconv, *praw;
+    int wasRaw = 0, same;
+
+    if (!pch || dbChannelOpen(pch))
+        testAbort("can't open channel %s", name);
+
+    pconv = trapPut(pch, dbrType, pold, pnew, n, 0, &wasRaw);
+    praw = trapPut(pch, dbrType, pold, pnew, n, 1, &wasRaw);
+    if (!pconv || !praw)
+        testAbort("no LOGDATA for %s", name);
+
+    testOk(wasRaw == native, "%s: %s", name,
+        native ? "captured raw" : "falls back to dbGetField");
+
+    same = pconv->type == praw->type &&
+        pconv->is_array == praw->is_array &&
+        pconv->old_size == praw->old_size &&
+        pconv->old_log_size == praw->old_log_size &&
+        pconv->new_size == praw->new_size &&
+        pconv->new_log_size == praw->new_log_size &&
+        sameValue(pconv->type, pconv->old_value, praw->old_value, pconv->old_log_size) &&
+        sameValue(pconv->type, &pconv->new_value->value, &praw->new_value->value,
+            pconv->new_log_size);
+    testOk(same, "%s: raw capture matches dbGetField", name);
+
+    caPutLogDataFree(pconv);
+    caPutLogDataFree(praw);
+    dbChannelDelete(pch);
+}
+
+/* Whether the trap sends on a put of nnew elements after nold of pold */
+static int sent(const char *name, short dbrType, const void *pold, long nold,
+    const void *pnew, long nnew, int raw)
+{
+    dbChannel *pch = dbChannelCreate(name);
+    void *pvt;
+
+    if (!pch || dbChannelOpen(pch))
+        testAbort("can't open channel %s", name);
+    caPutLogRawCapture = raw;
+    dbPutField(&pch->addr, dbrType, pold, nold);
+    captured = NULL;
+    pvt = asTrapWriteBeforeWithData("user", "host", pch, dbrType, nnew, (void *)pnew);
+    dbPutField(&pch->addr, dbrType, pnew, nnew);
+    asTrapWriteAfterWrite(pvt);
+    caPutLogRawCapture = 0;
+    dbChannelDelete(pch);
+
+    if (!captured)
+        return 0;
+    caPutLogDataFree(captured);
+    return 1;
+}
+
+static void testUnchanged(void)
+{
+    epicsFloat64 d0 = 1.5, d1 = -2.25, nan = epicsNAN;
+    epicsFloat64 a0[3] = {1.0, 2.0, 3.0};
+    epicsFloat64 a1[3] = {1.0, 2.0, 4.0};
+    char s0[2][MAX_STRING_SIZE] = {"one", "two"};
+
+    testDiag("Unchanged puts in the on-change mode");
+    caPutLogAsSetMode(caPutLogAll);
+    testOk(sent("ao_DBF_FLOAT", DBR_DOUBLE, &d0, 1, &d0, 1, 0), "mode all: sent");
+    caPutLogAsSetMode(caPutLogOnChange);
+    testOk(!sent("ao_DBF_FLOAT", DBR_DOUBLE, &d0, 1, &d0, 1, 0), "scalar: freed");
+    testOk(sent("ao_DBF_FLOAT", DBR_DOUBLE, &d0, 1, &d1, 1, 0), "scalar changed: sent");
+    testOk(!sent("ao_DBF_FLOAT", DBR_DOUBLE, &d0, 1, &d0, 1, 1), "raw scalar: freed");
+    testOk(sent("ao_DBF_FLOAT", DBR_DOUBLE, &nan, 1, &nan, 1, 0), "NaN: sent");
+    testOk(!sent("waveform_DBF_DOUBLE", DBR_DOUBLE, a0, 3, a0, 3, 0), "array: freed");
+    testOk(sent("waveform_DBF_DOUBLE", DBR_DOUBLE, a0, 3, a1, 3, 0), "last element changed: sent");
+    testOk(sent("waveform_DBF_DOUBLE", DBR_DOUBLE, a0, 3, a0, 2, 0), "array shorter: sent");
+    testOk(!sent("waveform_DBF_STRING", DBR_STRING, s0, 2, s0, 2, 0), "strings: freed");
+    testOk(caPutLogAsUnchanged() == 4, "%lu puts freed",
+        (unsigned long)caPutLogAsUnchanged());
+    caPutLogAsShow("caPutLogAsTest");
+    caPutLogAsSetMode(caPutLogNone);
+}
+
+MAIN(caPutLogAsTest)
+{
+    epicsFloat64 d0 = 1.5, d1 = -2.25;
+    epicsInt32 l0 = 7, l1 = 123456;
+    epicsEnum16 e0 = 1, e1 = 3;
+    epicsFloat64 a0[3] = {1.0, 2.0, 3.0};
+    epicsFloat64 a1[5] = {0.5, 1.5, 2.5, 3.5, 4.5};
+    char s0[3][MAX_STRING_SIZE] = {"one", "two", "three"};
+    char s1[2][MAX_STRING_SIZE] = {"four", "five"};
+    char c0[16] = "hello";
+    char c1[16] = "hello, world";
+    char desc0[MAX_STRING_SIZE] = "short";
+    char desc1[MAX_STRING_SIZE];
+    char pini0[MAX_STRING_SIZE] = "NO";
+    char pini1[MAX_STRING_SIZE] = "YES";
+
+    memset(desc1, 'x', sizeof(desc1) - 1);
+    desc1[sizeof(desc1) - 1] = 0;
+
+    testPlan(28);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    if (caPutLogAsInit(captureCallback, NULL))
+        testAbort("caPutLogAsInit failed");
+
+    testField("ao_DBF_FLOAT", DBR_DOUBLE, &d0, &d1, 1, 1);
+    testField("longout_DBF_LONG", DBR_LONG, &l0, &l1, 1, 1);
+    testField("mbbo_DBF_ENUM", DBR_ENUM, &e0, &e1, 1, 1);
+    testField("waveform_DBF_DOUBLE", DBR_DOUBLE, a0, a1, 3, 1);
+    testField("waveform_DBF_STRING", DBR_STRING, s0, s1, 2, 1);
+    testField("lso_DBF_CHAR", DBR_CHAR, c0, c1, sizeof(c1), 1);
+    testField("stringout_DBF_LINK", DBR_STRING, s0[0], s1[0], 1, 1);
+    testField("stringout_DBF_LINK.DESC", DBR_STRING, desc0, desc1, 1, 1);
+    testField("longout_DBF_MENU.PINI", DBR_STRING, pini0, pini1, 1, 0);
+    testUnchanged();
+
+    caPutLogAsStop();
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
@@ -0,0 +1,400 @@
+/* File:     caPutLogBinTest.cpp
+ *
+ * Unit tests for the binary put log format: every put encoded and decoded
+ * again must give the same JSON line as the original, for all value types,
+ * arrays, bursts, strings and metadata. Also the dictionary, sequence
+ * numbers, the counts of suppressed puts, the preamble of a new
+ * connection, streams fed in pieces and streams that are not binary put
+ * logs.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <epicsMath.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogIdent.h"
+#include "caPutLogBin.h"
+#include "caPutJsonLogFormat.h"
+
+// LOGDATA with room for the largest values
+struct TestPut {
+    LOGDATA data;
+    TIME_VALUE new_value;
+    VALUE old_value;
+    VALUE min, max;
+    char pv_name[PVNAME_STRINGSZ];
+
+    TestPut(short type, int nelm, int elemSize) {
+        memset(this, 0, sizeof(*this));
+        data.type = type;
+        data.value_size = nelm * elemSize;
+        data.is_array = nelm > 1;
+        data.old_size = data.old_log_size = nelm;
+        data.new_size = data.new_log_size = nelm;
+        data.old_value = &old_value;
+        data.new_value = &new_value;
+        data.userid = const_cast<char *>("user");
+        data.hostid = const_cast<char *>("host");
+        data.pv_name = pv_name;
+        strcpy(pv_name, "test:pv");
+        new_value.time.secPastEpoch = 1000000000;
+        new_value.time.nsec = 123456789;
+    }
+};
+
+static caPutLogBinEncoder *enc;
+static caPutLogBinDecoder *dec;
+static CaPutJsonLogFormat writer, reader;
+
+// What the decoder delivered last
+static std::string decoded;
+static int decodedPuts;
+static int lastSeqKnown;
+static epicsUInt32 lastSeq;
+
+static void collect(void *, const caPutLogBinRecord *prec)
+{
+    if (prec->suppressed)
+        reader.suppressed(&prec->data, std::string(prec->meta, prec->metaLen));
+    else
+        reader.format(&prec->oldValue, &prec->data, prec->burst, &prec->min, &prec->max,
+            std::string(prec->meta, prec->metaLen));
+    decoded = reader.message();
+    lastSeqKnown = prec->seqKnown;
+    lastSeq = prec->seq;
+    decodedPuts++;
+}
+
+static bool encode(TestPut &put, int burst, const std::string &meta, caPutLogBinOut &out)
+{
+    return caPutLogBinEncode(enc, &put.data, &put.old_value, burst, &put.min, &put.max,
+        meta.data(), meta.size(), &out) == 0;
+}
+
+static void roundTrip(const char *what, TestPut &put, int burst = 0,
+    const std::string &meta = std::string())
+{
+    caPutLogBinOut out;
+    int before = decodedPuts;
+    bool ok;
+
+    writer.format(&put.old_value, &put.data, burst, &put.min, &put.max, meta);
+    ok = encode(put, burst, meta, out) &&
+        caPutLogBinDecode(dec, out.shared, out.sharedLen, collect, NULL) == 0 &&
+        caPutLogBinDecode(dec, out.put, out.putLen, collect, NULL) == 0 &&
+        decodedPuts == before + 1 && decoded == writer.message();
+    testOk(ok, "%s (%lu + %lu bytes)", what, (unsigned long)out.sharedLen,
+        (unsigned long)out.putLen);
+    if (!ok) {
+        testDiag("original: %s", writer.message().c_str());
+        testDiag("decoded:  %s", decoded.c_str());
+    }
+}
+
+static void testScalars()
+{
+    testDiag("Scalars");
+    {
+        TestPut put(DBR_DOUBLE, 1, sizeof(epicsFloat64));
+        put.old_value.v_double = 1.0;
+        put.new_value.value.v_double = -0.1;
+        roundTrip("DBR_DOUBLE", put);
+        put.min.v_double = -3e-300;
+        put.max.v_double = 12345678901234567890.0;
+        roundTrip("DBR_DOUBLE burst with min and max", put, 3);
+        put.old_value.v_double = epicsNAN;
+        put.new_value.value.v_double = -epicsINF;
+        roundTrip("DBR_DOUBLE Nan and -Infinity", put);
+    }
+    {
+        TestPut put(DBR_FLOAT, 1, sizeof(epicsFloat32));
+        put.old_value.v_float = 3.0f;
+        put.new_value.value.v_float = 0.1f;
+        roundTrip("DBR_FLOAT", put);
+    }
+    {
+        TestPut put(DBR_SHORT, 1, sizeof(epicsInt16));
+        put.old_value.v_int16 = -32768;
+        put.new_value.value.v_int16 = 32767;
+        put.min.v_int16 = -32768;
+        put.max.v_int16 = 0;
+        roundTrip("DBR_SHORT burst", put, 2);
+    }
+    {
+        TestPut put(DBR_ENUM, 1, sizeof(epicsUInt16));
+        put.new_value.value.v_uint16 = 65535;
+        roundTrip("DBR_ENUM", put);
+    }
+    {
+        TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+        put.old_value.v_int32 = -2147483647 - 1;
+        put.new_value.value.v_int32 = 2147483647;
+        roundTrip("DBR_LONG", put);
+    }
+    {
+        TestPut put(DBR_ULONG, 1, sizeof(epicsUInt32));
+        put.old_value.v_uint32 = 4294967295u;
+        roundTrip("DBR_ULONG", put);
+    }
+#ifdef DBR_INT64
+    {
+        TestPut put(DBR_INT64, 1, sizeof(epicsInt64));
+        put.old_value.v_int64 = -9223372036854775807LL - 1;
+        put.new_value.value.v_int64 = 9223372036854775807LL;
+        roundTrip("DBR_INT64", put);
+    }
+    {
+        TestPut put(DBR_UINT64, 1, sizeof(epicsUInt64));
+        put.old_value.v_uint64 = 18446744073709551615ULL;
+        roundTrip("DBR_UINT64", put);
+    }
+#endif
+}
+
+static void testArrays()
+{
+    testDiag("Arrays");
+    {
+        TestPut put(DBR_DOUBLE, 5, sizeof(epicsFloat64));
+        for (int i = 0; i < 5; i++) {
+            put.old_value.a_double[i] = i * 0.5;
+            put.new_value.value.a_double[i] = i * 1e10;
+        }
+        put.new_value.value.a_double[1] = epicsNAN;
+        put.data.new_size = 7;
+        roundTrip("DBR_DOUBLE array with special values", put);
+    }
+    {
+        TestPut put(DBR_UCHAR, 4, sizeof(epicsUInt8));
+        for (int i = 0; i < 4; i++)
+            put.new_value.value.a_uint8[i] = static_cast<epicsUInt8>(i * 85);
+        roundTrip("DBR_UCHAR array", put);
+    }
+    {
+        TestPut put(DBR_LONG, 3, sizeof(epicsInt32));
+        put.data.old_log_size = 0;
+        put.data.old_size = 0;
+        roundTrip("empty old array", put);
+    }
+    {
+        TestPut put(DBR_STRING, 3, MAX_STRING_SIZE);
+        strcpy(put.old_value.a_string[0], "plain");
+        strcpy(put.old_value.a_string[1], "a/b \"quoted\" back\\slash");
+        strcpy(put.new_value.value.a_string[0], "\xc3\xa4\xc3\xb6\xc3\xbc");
+        memset(put.new_value.value.a_string[1], 'x', MAX_STRING_SIZE);
+        roundTrip("DBR_STRING array, one without NUL", put);
+    }
+}
+
+static void testStrings()
+{
+    testDiag("Strings and metadata");
+    {
+        TestPut put(DBR_STRING, 1, MAX_STRING_SIZE);
+        strcpy(put.new_value.value.a_string[0], "\"");
+        roundTrip("DBR_STRING scalar", put);
+    }
+    {
+        TestPut put(DBR_CHAR, MAX_ARRAY_SIZE_BYTES, 1);
+        memset(put.new_value.value.a_bytes, 'y', MAX_ARRAY_SIZE_BYTES);
+        strcpy(put.old_value.a_bytes, "long \"string\"\n");
+        put.data.new_size = MAX_ARRAY_SIZE_BYTES + 100;
+        roundTrip("DBR_CHAR long string", put);
+    }
+    {
+        TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+        CaPutJsonLogFormat::metadata_t metadata;
+
+        strcpy(put.pv_name, "odd\\name");
+        put.data.userid = const_cast<char *>("us\"er");
+        put.data.hostid = const_cast<char *>("ho\x02st");
+        metadata["facility"] = "x/y";
+        metadata["esc\"key"] = "tab\t";
+        roundTrip("escaped names and metadata", put, 0,
+            CaPutJsonLogFormat::serializeMetadata(metadata));
+
+        put.data.ident = caPutLogIdentGet(put.data.userid, put.data.hostid);
+        put.data.userid = const_cast<char *>("not");
+        put.data.hostid = const_cast<char *>("used");
+        roundTrip("client from the identity table", put);
+        caPutLogIdentRelease(put.data.ident);
+    }
+}
+
+static bool contains(const char *data, size_t len, const char *s)
+{
+    return std::string(data, len).find(s) != std::string::npos;
+}
+
+static void testDictionary()
+{
+    TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+    caPutLogBinOut out;
+    size_t first;
+    char name[32];
+    int i;
+
+    testDiag("Dictionary");
+    strcpy(put.pv_name, "dict:pv");
+    put.data.hostid = const_cast<char *>("dict-host");
+    encode(put, 0, std::string(), out);
+    first = out.putLen;
+    caPutLogBinDecode(dec, out.shared, out.sharedLen, collect, NULL);
+    caPutLogBinDecode(dec, out.put, out.putLen, collect, NULL);
+    encode(put, 0, std::string(), out);
+    testOk(!contains(out.shared, out.sharedLen, "dict") && !contains(out.put, out.putLen, "dict"),
+        "names defined only once");
+    testOk(out.putLen == first && out.putLen < 30, "put of %lu bytes by reference",
+        (unsigned long)out.putLen);
+
+    // Past the last id names go inline
+    for (i = 0; i < caPutLogBinMaxIds; i++) {
+        sprintf(name, "fill:%d", i);
+        strcpy(put.pv_name, name);
+        encode(put, 0, std::string(), out);
+        caPutLogBinDecode(dec, out.shared, out.sharedLen, collect, NULL);
+        caPutLogBinDecode(dec, out.put, out.putLen, collect, NULL);
+    }
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    testOk(!contains(out.shared, out.sharedLen, name) && contains(out.put, out.putLen, name) &&
+        decoded == writer.message(), "name after %d definitions inline", caPutLogBinMaxIds);
+}
+
+static void testSequence()
+{
+    TestPut put(DBR_LONG, 1, sizeof(epicsInt32));
+    caPutLogBinEncoder *penc = caPutLogBinEncoderCreate();
+    caPutLogBinDecoder *pdec = caPutLogBinDecoderCreate(), *plate;
+    caPutLogBinOut out;
+    caPutLogMsg *pre;
+    int i, wrong = 0;
+
+    testDiag("Sequence numbers and preamble");
+    for (i = 0; i < 300; i++) {
+        caPutLogBinEncode(penc, &put.data, &put.old_value, 0, NULL, NULL, "", 0, &out);
+        caPutLogBinDecode(pdec, out.shared, out.sharedLen, collect, NULL);
+        caPutLogBinDecode(pdec, out.put, out.putLen, collect, NULL);
+        if (!lastSeqKnown || lastSeq != (epicsUInt32)i)
+            wrong++;
+    }
+    testOk(wrong == 0, "300 puts numbered in order, %d wrong", wrong);
+
+    // A new connection gets the preamble, then the next put
+    plate = caPutLogBinDecoderCreate();
+    pre = caPutLogBinPreamble(penc);
+    strcpy(put.pv_name, "late:pv");
+    caPutLogBinEncode(penc, &put.data, &put.old_value, 0, NULL, NULL, "", 0, &out);
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    decoded.clear();
+    caPutLogBinDecode(plate, pre->text, pre->len, collect, NULL);
+    caPutLogBinDecode(plate, out.put, out.putLen, collect, NULL);
+    caPutLogMsgRelease(pre);
+    testOk(decoded.find("\"pv\":\"#") != std::string::npos,
+        "name defined after the preamble was taken: %s", decoded.c_str());
+    pre = caPutLogBinPreamble(penc);
+    caPutLogBinDecode(plate, pre->text, pre->len, collect, NULL);
+    caPutLogBinDecode(plate, out.put, out.putLen, collect, NULL);
+    caPutLogMsgRelease(pre);
+    testOk(decoded == writer.message() && !lastSeqKnown,
+        "decoded after a later preamble, sequence number not known yet");
+
+    caPutLogBinDecoderDestroy(plate);
+    caPutLogBinDecoderDestroy(pdec);
+    caPutLogBinEncoderDestroy(penc);
+}
+
+static void testSuppressed()
+{
+    TestPut put(DBR_STRING, 1, MAX_STRING_SIZE);
+    const std::string meta(",\"beamline\":\"x\"");
+    caPutLogBinOut out;
+    epicsUInt32 seq;
+    int before;
+    bool ok;
+
+    testDiag("Counts of suppressed puts");
+    strcpy(put.pv_name, "rate:pv");
+    roundTrip("put before it", put);
+    seq = lastSeq;
+    put.data.suppressed_pv = 300;
+    put.data.suppressed_client = 7;
+    writer.suppressed(&put.data, meta);
+    before = decodedPuts;
+    ok = caPutLogBinEncodeSuppressed(enc, &put.data, meta.data(), meta.size(), &out) == 0 &&
+        caPutLogBinDecode(dec, out.shared, out.sharedLen, collect, NULL) == 0 &&
+        caPutLogBinDecode(dec, out.put, out.putLen, collect, NULL) == 0 &&
+        decodedPuts == before + 1 && decoded == writer.message();
+    testOk(ok, "SUPPRESSED frame (%lu + %lu bytes)", (unsigned long)out.sharedLen,
+        (unsigned long)out.putLen);
+    if (!ok) {
+        testDiag("original: %s", writer.message().c_str());
+        testDiag("decoded:  %s", decoded.c_str());
+    }
+
+    // Not a put: the next one keeps its number
+    put.data.suppressed_pv = put.data.suppressed_client = 0;
+    roundTrip("put after it", put);
+    testOk(lastSeqKnown && lastSeq == seq + 1, "sequence numbers %u and %u",
+        (unsigned)seq, (unsigned)lastSeq);
+}
+
+static void testStreams()
+{
+    TestPut put(DBR_DOUBLE, 5, sizeof(epicsFloat64));
+    caPutLogBinEncoder *penc = caPutLogBinEncoderCreate();
+    caPutLogBinDecoder *pdec = caPutLogBinDecoderCreate();
+    caPutLogBinOut out;
+    std::string stream;
+    const char *json = "{\"date\":\"2026-10-17\",\"pv\":\"x\"}\n";
+    int i, status = 0;
+
+    testDiag("Streams");
+    for (i = 0; i < 5; i++) {
+        put.new_value.value.a_double[i] = i * 3.25;
+        caPutLogBinEncode(penc, &put.data, &put.old_value, 0, NULL, NULL, "", 0, &out);
+        stream.append(out.shared, out.sharedLen);
+        stream.append(out.put, out.putLen);
+        stream.append(i, '\0');
+    }
+    writer.format(&put.old_value, &put.data, 0, &put.min, &put.max, std::string());
+    decodedPuts = 0;
+    for (i = 0; i < (int)stream.size() && status == 0; i++)
+        status = caPutLogBinDecode(pdec, stream.data() + i, 1, collect, NULL);
+    testOk(status == 0 && decodedPuts == 5 && decoded == writer.message(),
+        "%lu bytes with padding fed one at a time, %d puts",
+        (unsigned long)stream.size(), decodedPuts);
+    caPutLogBinDecoderDestroy(pdec);
+
+    pdec = caPutLogBinDecoderCreate();
+    testOk(caPutLogBinDecode(pdec, json, strlen(json), collect, NULL) == -1,
+        "JSON lines rejected");
+    caPutLogBinDecoderDestroy(pdec);
+    caPutLogBinEncoderDestroy(penc);
+}
+
+MAIN(caPutLogBinTest)
+{
+    testPlan(40);
+    enc = caPutLogBinEncoderCreate();
+    dec = caPutLogBinDecoderCreate();
+    writer.setTimeFmt(CaPutJsonLogFormat::timeEpochNs);
+    reader.setTimeFmt(CaPutJsonLogFormat::timeEpochNs);
+    testScalars();
+    testArrays();
+    testStrings();
+    writer.setTimeFmt(CaPutJsonLogFormat::timeDateTime);
+    reader.setTimeFmt(CaPutJsonLogFormat::timeDateTime);
+    testScalars();
+    testDictionary();
+    testSequence();
+    testSuppressed();
+    testStreams();
+    caPutLogBinDecoderDestroy(dec);
+    caPutLogBinEncoderDestroy(enc);
+    return testDone();
+}
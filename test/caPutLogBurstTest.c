@@ -0,0 +1,201 @@
+/* File:     caPutLogBurstTest.c
+ *
+ * Unit tests for the burst filter: puts to the same field are merged
+ * into one message per burst, independently of puts to other fields
+ * in between.
+ */
+
+#include <string.h>
+
+#include <epicsThread.h>
+#include <dbAccess.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLogAs.h"
+#include "caPutLogBurst.h"
+
+#define NFIELDS 1000
+#define TIMEOUT 0.1
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static epicsFloat64 fields[NFIELDS];
+
+typedef struct {
+    void *pfield;
+    double old_value, new_value, min, max;
+    int burst;
+} MSG;
+
+static MSG msgs[NFIELDS];
+static int nmsgs;
+
+static void emit(void *arg, const VALUE *pold, const LOGDATA *pLogData,
+    int burst, const VALUE *pmin, const VALUE *pmax)
+{
+    MSG *pmsg = &msgs[nmsgs < NFIELDS ? nmsgs++ : NFIELDS - 1];
+
+    pmsg->pfield = pLogData->pfield;
+    pmsg->old_value = pLogData->type == DBR_DOUBLE ? pold->v_double : 0.0;
+    pmsg->new_value = pLogData->type == DBR_DOUBLE ? pLogData->new_value->value.v_double : 0.0;
+    pmsg->burst = burst;
+    pmsg->min = burst ? pmin->v_double : 0.0;
+    pmsg->max = burst ? pmax->v_double : 0.0;
+}
+
+static LOGDATA *put(int field, short type, int nelm, double old_value, double new_value)
+{
+    LOGDATA *plogData = caPutLogDataAlloc(nelm * (int)sizeof(epicsFloat64),
+        "user", "host", "test:pv");
+
+    if (!plogData)
+        testAbort("caPutLogDataAlloc failed");
+    plogData->pfield = &fields[field];
+    plogData->type = type;
+    plogData->is_array = nelm > 1;
+    plogData->old_size = plogData->old_log_size = nelm;
+    plogData->new_size = plogData->new_log_size = nelm;
+    plogData->old_value->v_double = old_value;
+    plogData->new_value->value.v_double = new_value;
+    return plogData;
+}
+
+/* Run the filter until no burst is pending */
+static void drain(caPutLogBurst *pburst)
+{
+    int i;
+
+    for (i = 0; i < 100 && caPutLogBurstPending(pburst); i++)
+        epicsThreadSleep(caPutLogBurstProcess(pburst, TIMEOUT));
+}
+
+static MSG *findMsg(int field)
+{
+    int i;
+
+    for (i = 0; i < nmsgs; i++) {
+        if (msgs[i].pfield == &fields[field])
+            return &msgs[i];
+    }
+    return NULL;
+}
+
+static void testInterleaved(void)
+{
+    caPutLogBurst *pburst = caPutLogBurstCreate(emit, NULL, 0);
+    MSG *pa, *pb;
+
+    testDiag("Interleaved puts to two fields");
+    nmsgs = 0;
+    caPutLogBurstPut(pburst, put(0, DBR_DOUBLE, 1, 1.0, 2.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(1, DBR_DOUBLE, 1, 10.0, 11.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(0, DBR_DOUBLE, 1, 2.0, 5.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(1, DBR_DOUBLE, 1, 11.0, 9.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(0, DBR_DOUBLE, 1, 5.0, 3.0), TIMEOUT, 1);
+    caPutLogBurstProcess(pburst, TIMEOUT);
+    testOk(nmsgs == 0 && caPutLogBurstPending(pburst) == 2,
+        "two bursts pending, nothing logged yet (%d)", nmsgs);
+
+    drain(pburst);
+    pa = findMsg(0);
+    pb = findMsg(1);
+    testOk(nmsgs == 2 && pa && pb, "one message per field (%d)", nmsgs);
+    testOk(pa && pa->old_value == 1.0 && pa->new_value == 3.0 && pa->burst == 2 &&
+        pa->min == 2.0 && pa->max == 5.0, "first field: old, new, min, max of the burst");
+    testOk(pb && pb->old_value == 10.0 && pb->new_value == 9.0 && pb->burst == 1 &&
+        pb->min == 9.0 && pb->max == 11.0, "second field: old, new, min, max of the burst");
+    caPutLogBurstDestroy(pburst);
+}
+
+static void testNoMerge(void)
+{
+    caPutLogBurst *pburst = caPutLogBurstCreate(emit, NULL,
+        caPutLogBurstNoMergeChar | caPutLogBurstScalarOnly);
+
+    testDiag("Puts that are not merged");
+    nmsgs = 0;
+    caPutLogBurstPut(pburst, put(0, DBR_DOUBLE, 1, 1.0, 2.0), TIMEOUT, 0);
+    caPutLogBurstPut(pburst, put(0, DBR_DOUBLE, 1, 2.0, 3.0), TIMEOUT, 0);
+    testOk(nmsgs == 2 && caPutLogBurstPending(pburst) == 0,
+        "without merging every put is logged at once");
+
+    nmsgs = 0;
+    caPutLogBurstPut(pburst, put(1, DBR_CHAR, 1, 0.0, 0.0), TIMEOUT, 1);
+    testOk(nmsgs == 1 && caPutLogBurstPending(pburst) == 0,
+        "DBR_CHAR put is not merged");
+
+    nmsgs = 0;
+    caPutLogBurstPut(pburst, put(2, DBR_DOUBLE, 1, 1.0, 2.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(2, DBR_STRING, 1, 0.0, 0.0), TIMEOUT, 1);
+    testOk(nmsgs == 1 && caPutLogBurstPending(pburst) == 1,
+        "change of type ends the burst");
+
+    nmsgs = 0;
+    caPutLogBurstPut(pburst, put(3, DBR_DOUBLE, 3, 1.0, 2.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(3, DBR_DOUBLE, 3, 2.0, 4.0), TIMEOUT, 1);
+    caPutLogBurstDiscard(pburst);
+    testOk(nmsgs == 0 && caPutLogBurstPending(pburst) == 0,
+        "discarded bursts are not logged");
+
+    caPutLogBurstPut(pburst, put(3, DBR_DOUBLE, 3, 1.0, 2.0), TIMEOUT, 1);
+    caPutLogBurstPut(pburst, put(3, DBR_DOUBLE, 3, 2.0, 4.0), TIMEOUT, 1);
+    drain(pburst);
+    testOk(nmsgs == 1 && msgs[0].burst == 0 && msgs[0].old_value == 1.0 &&
+        msgs[0].new_value == 4.0, "array puts are merged but not counted as burst");
+    caPutLogBurstDestroy(pburst);
+}
+
+static void testMany(void)
+{
+    caPutLogBurst *pburst = caPutLogBurstCreate(emit, NULL, 0);
+    int i, j, ok = 1;
+
+    testDiag("Ramping %d fields at the same time", NFIELDS);
+    nmsgs = 0;
+    for (j = 0; j < 10; j++) {
+        for (i = 0; i < NFIELDS; i++)
+            caPutLogBurstPut(pburst, put(i, DBR_DOUBLE, 1, j, j + 1), TIMEOUT, 1);
+    }
+    testOk(caPutLogBurstPending(pburst) == NFIELDS, "%u bursts pending",
+        caPutLogBurstPending(pburst));
+
+    drain(pburst);
+    for (i = 0; i < nmsgs; i++) {
+        if (msgs[i].burst != 9 || msgs[i].old_value != 0.0 || msgs[i].new_value != 10.0 ||
+            msgs[i].min != 1.0 || msgs[i].max != 10.0)
+            ok = 0;
+    }
+    testOk(nmsgs == NFIELDS, "one message per field (%d)", nmsgs);
+    testOk(ok, "every message covers the whole ramp");
+    caPutLogBurstDestroy(pburst);
+}
+
+MAIN(caPutLogBurstTest)
+{
+    testPlan(12);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    /* sets up the LOGDATA free lists */
+    if (caPutLogAsInit(NULL, NULL))
+        testAbort("caPutLogAsInit failed");
+
+    testInterleaved();
+    testNoMerge();
+    testMany();
+
+    caPutLogAsStop();
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
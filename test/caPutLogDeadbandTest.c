@@ -0,0 +1,157 @@
+/* File:     caPutLogDeadbandTest.c
+ *
+ * Unit tests for the deadband of the on-change mode: absolute and
+ * relative deadbands from info tags, drift that adds up, bursts, the
+ * record's MDEL and ADEL, and the deadbands set per value type.
+ */
+
+#include <string.h>
+
+#include <dbAccess.h>
+#include <dbChannel.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLogAs.h"
+#include "caPutLogDeadband.h"
+#include "caPutLogPolicy.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static caPutLogDeadband *pdeadband;
+
+static void freeCallback(LOGDATA *plogData)
+{
+    caPutLogDataFree(plogData);
+}
+
+/* Whether a put (or a burst if min < max) from old to new is logged */
+static int logged(const char *name, double old_value, double new_value,
+    double min, double max)
+{
+    dbChannel *pch = dbChannelCreate(name);
+    LOGDATA *plogData;
+    VALUE vmin, vmax;
+    int result, isLong;
+
+    if (!pch || dbChannelOpen(pch))
+        testAbort("can't open channel %s", name);
+    plogData = caPutLogDataAlloc(sizeof(epicsFloat64), "user", "host", name);
+    if (!plogData)
+        testAbort("caPutLogDataAlloc failed");
+    isLong = pch->addr.field_type == DBF_LONG;
+    plogData->type = isLong ? DBR_LONG : DBR_DOUBLE;
+    plogData->pfield = pch->addr.pfield;
+    plogData->policy = caPutLogPolicyGet(pch->addr.precord);
+    plogData->old_size = plogData->old_log_size = 1;
+    plogData->new_size = plogData->new_log_size = 1;
+    if (isLong) {
+        plogData->old_value->v_int32 = (epicsInt32)old_value;
+        plogData->new_value->value.v_int32 = (epicsInt32)new_value;
+        vmin.v_int32 = (epicsInt32)min;
+        vmax.v_int32 = (epicsInt32)max;
+    } else {
+        plogData->old_value->v_double = old_value;
+        plogData->new_value->value.v_double = new_value;
+        vmin.v_double = min;
+        vmax.v_double = max;
+    }
+    result = caPutLogDeadbandPass(pdeadband, plogData->old_value, plogData,
+        min < max ? 2 : 0, &vmin, &vmax);
+    caPutLogDataFree(plogData);
+    dbChannelDelete(pch);
+    return result;
+}
+
+#define put(name, old_value, new_value) logged(name, old_value, new_value, 0.0, 0.0)
+
+static void testTags(void)
+{
+    testDiag("Deadbands from info tags, drift adds up");
+    testOk(put("deadband:plain", 0.0, 0.001), "no deadband");
+    testOk(!put("deadband:abs", 10.0, 10.3), "10.3 within 0.5 of 10");
+    testOk(!put("deadband:abs", 10.3, 10.45), "10.45 within 0.5 of 10");
+    testOk(put("deadband:abs", 10.45, 10.55), "10.55 logged");
+    testOk(!put("deadband:abs", 10.55, 10.9), "10.9 within 0.5 of 10.55");
+    testOk(put("deadband:abs", 10.9, 11.1), "11.1 logged");
+    testOk(!put("deadband:rel", 100.0, 109.0), "109 within 10%% of 100");
+    testOk(put("deadband:rel", 109.0, 111.0), "111 logged");
+    testOk(!put("deadband:rel", 111.0, 121.0), "121 within 10%% of 111");
+    testOk(put("deadband:rel", 121.0, 123.0), "123 logged");
+    testOk(put("deadband:bad", 0.0, 0.001), "invalid tag ignored");
+
+    testDiag("Bursts");
+    testOk(logged("deadband:abs", 11.1, 11.2, 10.0, 11.3), "burst with min out of the deadband");
+    testOk(!logged("deadband:abs", 11.2, 11.3, 11.2, 11.6), "burst within the deadband");
+}
+
+static void testRecordFields(void)
+{
+    double mdel = -1.0;
+    dbAddr addr;
+
+    testDiag("MDEL and ADEL");
+    testOk(!put("deadband:mdel", 0.0, 1.5), "1.5 within MDEL 2");
+    testOk(put("deadband:mdel", 1.5, 2.5), "2.5 logged");
+    if (dbNameToAddr("deadband:mdel.MDEL", &addr))
+        testAbort("no deadband:mdel.MDEL");
+    dbPutField(&addr, DBR_DOUBLE, &mdel, 1);
+    testOk(put("deadband:mdel", 2.5, 2.6), "MDEL -1 logs all");
+    testOk(put("deadband:adel", 0.0, 0.001), "ADEL -1 logs all");
+}
+
+static void testTypes(void)
+{
+    testDiag("Deadbands per value type");
+    testOk1(caPutLogDeadbandSet("float", "1") == 0);
+    testOk(!put("deadband:plain", 0.0, 0.5), "float within 1");
+    testOk(put("deadband:long", 0, 3), "integer not affected");
+    testOk1(caPutLogDeadbandSet("integer", "5") == 0);
+    testOk(!put("deadband:long", 3, 7), "integer within 5");
+    testOk(!put("deadband:abs", 11.2, 11.5), "tag takes precedence");
+    testOk(put("deadband:abs", 11.5, 11.8), "tag takes precedence");
+    testOk1(caPutLogDeadbandSet("all", "none") == 0);
+    testOk(put("deadband:plain", 0.5, 0.6), "float without deadband");
+    testOk(put("deadband:long", 7, 8), "integer without deadband");
+
+    eltc(0);
+    testOk1(caPutLogDeadbandSet("string", "1") == -1);
+    testOk1(caPutLogDeadbandSet("float", "1 %") == -1);
+    testOk1(caPutLogDeadbandSet("float", "-1") == -1);
+    eltc(1);
+    testOk(caPutLogDeadbandDropped(pdeadband) == 10, "%lu puts dropped",
+        (unsigned long)caPutLogDeadbandDropped(pdeadband));
+    caPutLogDeadbandShow(pdeadband, "caPutLogDeadbandTest");
+}
+
+MAIN(caPutLogDeadbandTest)
+{
+    testPlan(32);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutLogDeadbandTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    testIocInitOk();
+
+    /* reads the info tags, sets up the LOGDATA free lists */
+    if (caPutLogAsInit(freeCallback, NULL))
+        testAbort("caPutLogAsInit failed");
+    eltc(1);
+    testOk(caPutLogPolicyCount() == 4, "4 records with a deadband, the invalid tag ignored");
+    pdeadband = caPutLogDeadbandCreate();
+
+    testTags();
+    testRecordFields();
+    testTypes();
+
+    caPutLogDeadbandDestroy(pdeadband);
+    caPutLogAsStop();
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
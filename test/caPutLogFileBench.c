@@ -0,0 +1,128 @@
+/* File:     caPutLogFileBench.c
+ *
+ * Journal file benchmark: messages go through a sink list into a file
+ * sink, for several sync intervals, in each of the given directories
+ * (e.g. one on tmpfs and one on ext4).
+ *
+ * Usage: caPutLogFileBench directory... [-n messages] [-s message size]
+ *
+ * For each setting the messages and megabytes per second until the last
+ * message is written and synced, the number of syncs, the longest sync
+ * and the number of rotations (segments of 16 MiB) are reported. The
+ * files are removed after each run.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogFile.h"
+
+#if defined(_WIN32) || defined(vxWorks) || defined(__rtems__)
+
+int main(int argc, char *argv[])
+{
+    fprintf(stderr, "no file sinks on this target\n");
+    return 1;
+}
+
+#else
+
+#include <dirent.h>
+
+#define NAME "caPutLogFileBench.log"
+
+#define SEGMENT_SIZE (16 * 1024 * 1024)
+
+static const double intervals[] = {-1.0, 1.0, 0.01, 0.0};
+
+static void cleanup(const char *dir)
+{
+    DIR *pdir = opendir(dir);
+    struct dirent *pentry;
+    char path[512];
+
+    while (pdir && (pentry = readdir(pdir)) != NULL) {
+        if (strncmp(pentry->d_name, NAME, strlen(NAME)) != 0)
+            continue;
+        sprintf(path, "%.200s/%.200s", dir, pentry->d_name);
+        remove(path);
+    }
+    if (pdir)
+        closedir(pdir);
+}
+
+static void run(const char *dir, double interval, int nmsgs, char *text, size_t size)
+{
+    caPutLogSinkList *plist;
+    caPutLogFile *pfile;
+    caPutLogFileStats stats;
+    caPutLogSinkStats sinkStats;
+    epicsTimeStamp start, end;
+    char path[256];
+    double seconds;
+    int i;
+
+    sprintf(path, "%.200s/" NAME, dir);
+    caPutLogFileSyncInterval = interval;
+    plist = caPutLogSinkListCreate("bench", nmsgs);
+    pfile = caPutLogFileCreate(path);
+    if (!pfile)
+        exit(1);
+    caPutLogSinkAddTransport(plist, path, &caPutLogFileTransport, pfile);
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < nmsgs; i++)
+        caPutLogSinkSendText(plist, text, size);
+    caPutLogSinkFlush(plist, 600.0);
+    epicsTimeGetCurrent(&end);
+    seconds = epicsTimeDiffInSeconds(&end, &start);
+
+    caPutLogFileGetStats(pfile, &stats);
+    caPutLogSinkGetStats(plist, 0, &sinkStats);
+    printf("%-24.24s %8g | %10.0f %8.1f | %8lu %9.3f %9u | %7lu\n", dir, interval,
+        stats.msgsWritten / seconds, stats.bytesWritten / seconds / 1e6,
+        (unsigned long)stats.syncs, stats.maxSync * 1e3, stats.rotations,
+        (unsigned long)(sinkStats.dropped + stats.msgsDropped));
+    caPutLogSinkListDestroy(plist);
+    cleanup(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    int nmsgs = 1000000, ndirs = 0, i;
+    size_t size = 200, j;
+    const char **dirs = calloc(argc, sizeof(char *));
+    char *text;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            nmsgs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            size = (size_t)atoi(argv[++i]);
+        else
+            dirs[ndirs++] = argv[i];
+    }
+    if (!ndirs || nmsgs < 1 || size < 2) {
+        fprintf(stderr, "usage: %s directory... [-n messages] [-s message size]\n", argv[0]);
+        return 1;
+    }
+    text = malloc(size);
+    memset(text, 'x', size - 1);
+    text[size - 1] = '\n';
+    caPutLogFileSegmentSize = SEGMENT_SIZE;
+
+    printf("%d messages of %u bytes\n\n", nmsgs, (unsigned)size);
+    printf("%-24s %8s | %10s %8s | %8s %9s %9s | %7s\n", "directory", "sync [s]",
+        "msgs/s", "MB/s", "syncs", "max [ms]", "rotations", "dropped");
+    for (i = 0; i < ndirs; i++) {
+        for (j = 0; j < sizeof(intervals) / sizeof(intervals[0]); j++)
+            run(dirs[i], intervals[j], nmsgs, text, size);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,351 @@
+/* File:     caPutLogFileTest.c
+ *
+ * Unit tests for the journal file transport: messages are appended to the
+ * preallocated segment, a full segment is cut and renamed, a message that
+ * does not fit into a segment is dropped, a segment left behind is
+ * recovered at the next start (a binary one after its last whole frame,
+ * even if that ends in NULs), and a segment that cannot be renamed is
+ * never overwritten.
+ *
+ * Works in the current directory, on files named caPutLogFileTest.log*
+ * and in the directory caPutLogFileTest.d.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errlog.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogFile.h"
+#include "caPutLogBin.h"
+
+#if defined(_WIN32) || defined(vxWorks) || defined(__rtems__)
+
+MAIN(caPutLogFileTest)
+{
+    testPlan(1);
+    testSkip(1, "no file sinks on this target");
+    return testDone();
+}
+
+#else
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define PATH "caPutLogFileTest.log"
+#define RO_DIR "caPutLogFileTest.d"
+#define RO_NAME "journal.log"
+#define RO_PATH RO_DIR "/" RO_NAME
+
+static long fileSize(const char *name)
+{
+    struct stat st;
+
+    return stat(name, &st) ? -1 : (long)st.st_size;
+}
+
+/* Count the rotated segments, remove them if asked to; size: of the last */
+static int rotated(int removeThem, long *size)
+{
+    DIR *dir = opendir(".");
+    struct dirent *pentry;
+    int n = 0;
+
+    if (!dir)
+        testAbort("cannot read the current directory");
+    while ((pentry = readdir(dir)) != NULL) {
+        if (strncmp(pentry->d_name, PATH ".", sizeof(PATH)) != 0)
+            continue;
+        n++;
+        if (size)
+            *size = fileSize(pentry->d_name);
+        if (removeThem)
+            remove(pentry->d_name);
+    }
+    closedir(dir);
+    return n;
+}
+
+/* Read the (first) rotated segment, -1 if none */
+static long readRotated(char *buf, size_t size)
+{
+    DIR *dir = opendir(".");
+    struct dirent *pentry;
+    long n = -1;
+
+    if (!dir)
+        testAbort("cannot read the current directory");
+    while (n < 0 && (pentry = readdir(dir)) != NULL) {
+        FILE *fp;
+
+        if (strncmp(pentry->d_name, PATH ".", sizeof(PATH)) != 0)
+            continue;
+        fp = fopen(pentry->d_name, "rb");
+        if (fp) {
+            n = (long)fread(buf, 1, size, fp);
+            fclose(fp);
+        }
+    }
+    closedir(dir);
+    return n;
+}
+
+static void ignorePut(void *arg, const caPutLogBinRecord *prec)
+{
+}
+
+static void testBinaryRecovery(void)
+{
+    /* MAGIC, SYNC 1, and a frame of an unknown type with the little
+       endian 5 of a DBR_LONG, then the padding */
+    static const char segment[] = "\6\0CPLB\1" "\2\2\1" "\5\143\5\0\0\0"
+        "\0\0\0\0\0\0\0\0";
+    static const size_t framed = 7 + 3 + 6;
+    caPutLogSinkList *plist;
+    caPutLogFile *pfile;
+    caPutLogBinDecoder *pdec;
+    char buf[64];
+    long n;
+    FILE *fp;
+
+    testDiag("Recovery of a binary segment");
+    fp = fopen(PATH, "wb");
+    if (fp) {
+        fwrite(segment, 1, sizeof(segment) - 1, fp);
+        fclose(fp);
+    }
+    plist = caPutLogSinkListCreate("test", 1000);
+    pfile = caPutLogFileCreate(PATH);
+    if (!pfile)
+        testAbort("cannot create " PATH);
+    caPutLogSinkAddTransport(plist, PATH, &caPutLogFileTransport, pfile);
+    n = readRotated(buf, sizeof(buf));
+    testOk(n == (long)framed && memcmp(buf, segment, framed) == 0,
+        "cut after the last whole frame, %ld bytes", n);
+
+    /* followed by the next segment */
+    if (n > 0 && (size_t)n + 7 <= sizeof(buf)) {
+        memcpy(buf + n, segment, 7);
+        n += 7;
+    }
+    pdec = caPutLogBinDecoderCreate();
+    testOk(caPutLogBinDecode(pdec, buf, (size_t)n, ignorePut, NULL) == 0,
+        "decoded back to back with the next segment");
+    caPutLogBinDecoderDestroy(pdec);
+    caPutLogSinkListDestroy(plist);
+    rotated(1, NULL);
+    remove(PATH);
+}
+
+static int startsWith(const char *name, const char *text)
+{
+    char buf[32];
+    size_t len = strlen(text);
+    FILE *fp = fopen(name, "rb");
+    int same;
+
+    if (!fp)
+        return 0;
+    same = fread(buf, 1, len, fp) == len && memcmp(buf, text, len) == 0;
+    fclose(fp);
+    return same;
+}
+
+/* Size of the rotated segment in RO_DIR, -1 if none; removes all if asked */
+static long rotatedInDir(int removeThem)
+{
+    DIR *dir = opendir(RO_DIR);
+    struct dirent *pentry;
+    char name[256];
+    long size = -1;
+
+    if (!dir)
+        return -1;
+    while ((pentry = readdir(dir)) != NULL) {
+        if (pentry->d_name[0] == '.')
+            continue;
+        sprintf(name, RO_DIR "/%.200s", pentry->d_name);
+        if (strncmp(pentry->d_name, RO_NAME ".", sizeof(RO_NAME)) == 0)
+            size = fileSize(name);
+        if (removeThem)
+            remove(name);
+    }
+    closedir(dir);
+    return size;
+}
+
+static void testReadOnly(void)
+{
+    caPutLogSinkList *plist;
+    caPutLogFile *pfile;
+    caPutLogFileStats stats;
+    char line[100];
+    size_t fits, i;
+    long size;
+
+    testDiag("Rename fails in a read-only directory");
+    chmod(RO_DIR, 0755);
+    rotatedInDir(1);
+    mkdir(RO_DIR, 0755);
+    if (geteuid() == 0) {
+        testSkip(6, "permissions do not apply to root");
+        return;
+    }
+    pfile = caPutLogFileCreate(RO_PATH);
+    if (!pfile)
+        testAbort("cannot create " RO_PATH);
+    plist = caPutLogSinkListCreate("test", 1000);
+    caPutLogSinkAddTransport(plist, RO_PATH, &caPutLogFileTransport, pfile);
+    caPutLogSinkSendText(plist, "kept\n", 5);
+    caPutLogSinkFlush(plist, 5.0);
+
+    chmod(RO_DIR, 0555);
+    memset(line, 'y', 99);
+    line[99] = '\n';
+    caPutLogFileGetStats(pfile, &stats);
+    fits = (stats.segmentSize - 5) / 100;
+    for (i = 0; i < fits + 1; i++)
+        caPutLogSinkSendText(plist, line, 100);
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogFileGetStats(pfile, &stats);
+    testOk(stats.rotations == 0 && stats.msgsDropped == 1, "not rotated, %lu dropped",
+        (unsigned long)stats.msgsDropped);
+    size = fileSize(RO_PATH);
+    testOk(size == 5 + 100 * (long)fits && startsWith(RO_PATH, "kept\n"),
+        "segment kept at its path, %ld bytes", size);
+
+    chmod(RO_DIR, 0755);
+    caPutLogSinkSendText(plist, "next\n", 5);
+    caPutLogSinkFlush(plist, 5.0);
+    size = rotatedInDir(0);
+    testOk(size == 5 + 100 * (long)fits, "renamed once possible, %ld bytes", size);
+    testOk(startsWith(RO_PATH, "next\n"), "new segment started");
+    caPutLogSinkListDestroy(plist);
+
+    testDiag("Recovery fails in a read-only directory");
+    chmod(RO_DIR, 0555);
+    eltc(0);
+    pfile = caPutLogFileCreate(RO_PATH);
+    eltc(1);
+    testOk(!pfile, "no segment started");
+    testOk(fileSize(RO_PATH) == 5 && startsWith(RO_PATH, "next\n"),
+        "left-behind segment kept");
+    if (pfile)
+        caPutLogFileTransport.destroy(pfile);
+    chmod(RO_DIR, 0755);
+}
+
+static caPutLogSinkList *start(caPutLogFile **ppfile)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 1000);
+
+    *ppfile = caPutLogFileCreate(PATH);
+    if (!*ppfile)
+        testAbort("cannot create " PATH);
+    caPutLogSinkAddTransport(plist, PATH, &caPutLogFileTransport, *ppfile);
+    return plist;
+}
+
+MAIN(caPutLogFileTest)
+{
+    caPutLogSinkList *plist;
+    caPutLogFile *pfile;
+    caPutLogFileStats stats;
+    caPutLogSinkStats sinkStats;
+    char line[101], *big;
+    FILE *fp;
+    long size = 0;
+    size_t fits, i;
+    char buf[32];
+
+    testPlan(20);
+
+    rotated(1, NULL);
+    remove(PATH);
+    caPutLogFileSegmentSize = 4096;
+    caPutLogFileSyncInterval = 0.0;
+
+    testDiag("Append");
+    plist = start(&pfile);
+    caPutLogFileGetStats(pfile, &stats);
+    testOk(fileSize(PATH) == (long)stats.segmentSize, "segment of %lu bytes allocated",
+        (unsigned long)stats.segmentSize);
+    caPutLogSinkSendText(plist, "first\n", 6);
+    caPutLogSinkSendText(plist, "second\n", 7);
+    caPutLogSinkFlush(plist, 5.0);
+    fp = fopen(PATH, "rb");
+    memset(buf, 'x', sizeof(buf));
+    if (fp) {
+        if (fread(buf, 1, 14, fp) != 14)
+            buf[0] = 0;
+        fclose(fp);
+    }
+    testOk(memcmp(buf, "first\nsecond\n", 14) == 0, "messages appended, NUL padded");
+    caPutLogFileGetStats(pfile, &stats);
+    testOk(stats.msgsWritten == 2 && stats.bytesWritten == 13 && stats.segmentUsed == 13
+        && stats.syncs > 0, "%lu messages, %lu bytes, %lu syncs",
+        (unsigned long)stats.msgsWritten, (unsigned long)stats.bytesWritten,
+        (unsigned long)stats.syncs);
+
+    testDiag("Rotation");
+    memset(line, 'y', 99);
+    line[99] = '\n';
+    fits = (stats.segmentSize - 13) / 100;
+    for (i = 0; i < fits + 2; i++)
+        caPutLogSinkSendText(plist, line, 100);
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogFileGetStats(pfile, &stats);
+    testOk(stats.rotations == 1 && stats.segmentUsed == 200,
+        "rotated, %lu bytes in the new segment", (unsigned long)stats.segmentUsed);
+    i = rotated(0, &size);
+    testOk(i == 1 && size == 13 + 100 * (long)fits, "rotated segment cut to %ld bytes", size);
+    testOk(fileSize(PATH) == (long)stats.segmentSize, "new segment allocated");
+
+    testDiag("Too large");
+    big = calloc(1, stats.segmentSize + 1);
+    memset(big, 'z', stats.segmentSize + 1);
+    caPutLogSinkSendText(plist, big, stats.segmentSize + 1);
+    free(big);
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogFileGetStats(pfile, &stats);
+    caPutLogSinkGetStats(plist, 0, &sinkStats);
+    testOk(stats.msgsDropped == 1 && sinkStats.failed == 1 && stats.segmentUsed == 200,
+        "dropped, segment unchanged");
+
+    testDiag("Shutdown");
+    caPutLogSinkListDestroy(plist);
+    testOk(fileSize(PATH) == 200, "segment cut to %ld bytes", fileSize(PATH));
+
+    testDiag("Recovery");
+    fp = fopen(PATH, "wb");
+    if (fp) {
+        fwrite("old\n\0\0\0\0\0\0", 1, 10, fp);
+        fclose(fp);
+    }
+    plist = start(&pfile);
+    testOk(rotated(0, NULL) == 2, "left-behind segment rotated");
+    caPutLogFileGetStats(pfile, &stats);
+    testOk(fileSize(PATH) == (long)stats.segmentSize && stats.segmentUsed == 0,
+        "new segment started");
+    caPutLogSinkListDestroy(plist);
+    testOk(fileSize(PATH) == 0, "empty segment left at 0 bytes");
+
+    plist = start(&pfile);
+    testOk(rotated(1, NULL) == 2, "empty segment not rotated");
+    caPutLogSinkListDestroy(plist);
+    remove(PATH);
+
+    testBinaryRecovery();
+    testReadOnly();
+    rotatedInDir(1);
+    rmdir(RO_DIR);
+    return testDone();
+}
+
+#endif
@@ -0,0 +1,179 @@
+/* File:     caPutLogFilterTest.c
+ *
+ * Unit tests for the PV filter: globs and regular expressions compiled
+ * into one DFA, first match deciding, the default with and without
+ * include rules, rules from a file, the decision cache of the trap with
+ * its hit counters, and patterns that are rejected.
+ *
+ * Works in the current directory, on the file caPutLogFilterTest.rules.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <dbDefs.h>
+#include <dbBase.h>
+#include <dbCommon.h>
+#include <dbAddr.h>
+#include <errlog.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogFilter.h"
+
+#define RULES "caPutLogFilterTest.rules"
+
+static void testNames(const char *const *names, int expect)
+{
+    while (*names) {
+        testOk(caPutLogFilterMatch(*names) == expect, "%s %s", *names,
+            expect ? "logged" : "not logged");
+        names++;
+    }
+}
+
+static void testGlobs(void)
+{
+    static const char *const skipped[] = {
+        "SR:HEARTBEAT.VAL", "LINAC:HEARTBEAT.DESC", "SR:BPM1.PROC", "COUNTER7.VAL",
+        "A*B.VAL", NULL
+    };
+    static const char *const logged[] = {
+        "SR:HEARTBEAT2.VAL", "SR:BPM1.VAL", "COUNTERX.VAL", "COUNTER7", "AxB.VAL", NULL
+    };
+
+    testDiag("Globs, a glob without a dot covers all fields");
+    caPutLogFilterClear();
+    testOk1(caPutLogFilterAdd("exclude", "*:HEARTBEAT") == 0);
+    testOk1(caPutLogFilterAdd("exclude", "*.PROC") == 0);
+    testOk1(caPutLogFilterAdd("exclude", "COUNTER[0-9]") == 0);
+    testOk1(caPutLogFilterAdd("exclude", "A\\*B") == 0);
+    testOk1(caPutLogFilterCompile() == 0);
+    testNames(skipped, 0);
+    testNames(logged, 1);
+}
+
+static void testRegex(void)
+{
+    static const char *const logged[] = {
+        "SR12:RF:CAV1.VAL", "SR1:VAC:GAUGE.HIHI", "BO:RF:AMP.VAL", NULL
+    };
+    static const char *const skipped[] = {
+        "SR12:RF:TEST.VAL", "SR:RF:CAV1.VAL", "SR1:MAG:PS.VAL", "XSR1:RF:A.VAL", "BO:RF:AMP.DESC",
+        NULL
+    };
+
+    testDiag("Regular expressions, first match decides, include rules");
+    caPutLogFilterClear();
+    testOk1(caPutLogFilterAdd("exclude", "/.*:TEST\\..*/") == 0);
+    testOk1(caPutLogFilterAdd("include", "/^SR[0-9]+:(RF|VAC):[^.]+\\..+$/") == 0);
+    testOk1(caPutLogFilterAdd("include", "BO:*.VAL") == 0);
+    testOk1(caPutLogFilterCompile() == 0);
+    testNames(logged, 1);
+    testNames(skipped, 0);
+    testOk(caPutLogFilterAdd("include", "*") == -1, "rules rejected once compiled");
+}
+
+static void testErrors(void)
+{
+    static const char *const bad[] = {
+        "COUNTER[0-9", "/(SR/", "/SR)/", "/*SR/", "/SR|+/", "[z-a]", "", NULL
+    };
+    const char *const *p;
+
+    testDiag("Invalid rules");
+    caPutLogFilterClear();
+    eltc(0);
+    for (p = bad; *p; p++)
+        testOk(caPutLogFilterAdd("exclude", *p) == -1, "\"%s\" rejected", *p);
+    testOk1(caPutLogFilterAdd("ignore", "SR:*") == -1);
+    eltc(1);
+    testOk1(caPutLogFilterCount() == 0);
+
+    /* 2^13 subsets of positions after the last 'a' */
+    testOk1(caPutLogFilterAdd("exclude", "/.*a............./") == 0);
+    eltc(0);
+    testOk(caPutLogFilterCompile() == -1, "too many DFA states");
+    eltc(1);
+    testOk(caPutLogFilterMatch("xa.VAL") == 1, "everything logged without a DFA");
+}
+
+static void testFile(void)
+{
+    FILE *fp = fopen(RULES, "w");
+
+    testDiag("Rules from a file");
+    caPutLogFilterClear();
+    if (!fp)
+        testAbort("cannot write " RULES);
+    fputs("# heartbeats and counters\n"
+        "\n"
+        "exclude   *:HB   \n"
+        "  include /SR:.*/\n"
+        "exclude\n", fp);
+    fclose(fp);
+    eltc(0);
+    testOk(caPutLogFilterLoad(RULES) == -1, "line without a pattern reported");
+    testOk1(caPutLogFilterLoad("no such file") == -1);
+    eltc(1);
+    testOk1(caPutLogFilterCount() == 2);
+    testOk1(caPutLogFilterCompile() == 0);
+    testOk1(caPutLogFilterMatch("SR:HB.VAL") == 0);
+    testOk1(caPutLogFilterMatch("SR:X.VAL") == 1);
+    testOk1(caPutLogFilterMatch("BO:X.VAL") == 0);
+    remove(RULES);
+}
+
+#define NRECORDS 10000
+
+static dbCommon records[NRECORDS];
+
+static void testCache(void)
+{
+    static dbFldDes val, desc;
+    dbAddr addr;
+    int i, round, ok = 1, count = 0;
+
+    testDiag("Decisions of the trap, cached per field");
+    caPutLogFilterClear();
+    val.name = "VAL";
+    desc.name = "DESC";
+    for (i = 0; i < NRECORDS; i++)
+        sprintf(records[i].name, "R%d:%s", i, i % 10 ? "SET" : "HB");
+    testOk1(caPutLogFilterAdd("exclude", "*:HB") == 0);
+    testOk1(caPutLogFilterAdd("exclude", "*.DESC") == 0);
+    testOk1(caPutLogFilterCompile() == 0);
+
+    memset(&addr, 0, sizeof(addr));
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < NRECORDS; i++) {
+            int logged;
+
+            addr.precord = &records[i];
+            addr.pfldDes = &val;
+            logged = caPutLogFilterPut(&addr);
+            ok &= logged == (i % 10 != 0);
+            count += logged;
+            addr.pfldDes = &desc;
+            ok &= caPutLogFilterPut(&addr) == 0;
+        }
+    }
+    testOk(ok, "%d fields decided twice", 2 * NRECORDS);
+    testOk(count == 2 * (NRECORDS - NRECORDS / 10), "%d puts logged", count);
+    testOk1(caPutLogFilterHits(0) == 4 * NRECORDS / 10);
+    testOk1(caPutLogFilterHits(1) == 2 * (NRECORDS - NRECORDS / 10));
+    testOk1(caPutLogFilterHits(-1) == 2 * (NRECORDS - NRECORDS / 10));
+    caPutLogFilterShow("caPutLogFilterTest");
+}
+
+MAIN(caPutLogFilterTest)
+{
+    testPlan(55);
+    testGlobs();
+    testRegex();
+    testErrors();
+    testFile();
+    testCache();
+    caPutLogFilterClear();
+    return testDone();
+}
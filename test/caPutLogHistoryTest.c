@@ -0,0 +1,167 @@
+/* File:     caPutLogHistoryTest.c
+ *
+ * Unit tests for the rolling history: the last messages are kept up to
+ * the given number and the size of the PV, the sequence PV counts the
+ * messages, and many messages of different lengths through a sender
+ * thread leave the same lines as a plain copy of the newest ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <dbAccess.h>
+#include <dbUnitTest.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogHistory.h"
+
+#define TEXT_PV "caPutLogHistoryTest:text"  /* waveform of 32 CHAR */
+#define SEQ_PV "caPutLogHistoryTest:seq"    /* longin */
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static void add(caPutLogHistory *phist, const char *text)
+{
+    caPutLogMsg *pmsg = caPutLogMsgCreate(text, strlen(text));
+
+    caPutLogHistoryTransport.send(phist, &pmsg, 1);
+    caPutLogMsgRelease(pmsg);
+}
+
+static const char *text(void)
+{
+    static char buf[64];
+    DBADDR addr;
+    long n = sizeof(buf) - 1;
+
+    memset(buf, 0, sizeof(buf));
+    if (dbNameToAddr(TEXT_PV, &addr))
+        testAbort("no PV " TEXT_PV);
+    if (dbGetField(&addr, DBR_CHAR, buf, NULL, &n, NULL))
+        buf[0] = 0;
+    return buf;
+}
+
+static long seq(void)
+{
+    DBADDR addr;
+    epicsInt32 value = -1;
+    long n = 1;
+
+    if (dbNameToAddr(SEQ_PV, &addr))
+        testAbort("no PV " SEQ_PV);
+    dbGetField(&addr, DBR_LONG, &value, NULL, &n, NULL);
+    return value;
+}
+
+static void testLimits(void)
+{
+    caPutLogHistory *phist = caPutLogHistoryCreate(TEXT_PV, SEQ_PV, 3);
+    caPutLogHistoryStats stats;
+    char line[16];
+    int i;
+
+    testDiag("Number of messages");
+    caPutLogHistoryMaxRate = 0.0;
+    add(phist, "a\n");
+    add(phist, "b\n");
+    testOk(strcmp(text(), "a\nb") == 0 && seq() == 2, "2 messages, sequence %ld", seq());
+    add(phist, "c\n");
+    add(phist, "d\n");
+    testOk(strcmp(text(), "b\nc\nd") == 0 && seq() == 4, "last 3 of 4 messages");
+    caPutLogHistoryTransport.destroy(phist);
+
+    testDiag("Size of the PV");
+    phist = caPutLogHistoryCreate(TEXT_PV, SEQ_PV, 100);
+    for (i = 1; i <= 10; i++) {
+        sprintf(line, "message-%02d\n", i);
+        add(phist, line);
+    }
+    caPutLogHistoryGetStats(phist, &stats);
+    testOk(strcmp(text(), "message-09\nmessage-10") == 0 && stats.msgs == 2,
+        "as many as fit into %lu characters", (unsigned long)stats.room);
+    add(phist, "0123456789012345678901234567890123456789");
+    caPutLogHistoryGetStats(phist, &stats);
+    testOk(strcmp(text(), "0123456789012345678901234567890") == 0 && stats.msgs == 1 &&
+        seq() == 11, "long message cut to %lu characters", (unsigned long)stats.chars);
+    caPutLogHistoryTransport.destroy(phist);
+}
+
+static void testRate(void)
+{
+    caPutLogHistory *phist = caPutLogHistoryCreate(TEXT_PV, NULL, 10);
+    double wait;
+
+    testDiag("Rate limit");
+    caPutLogHistoryMaxRate = 5.0;
+    add(phist, "r1");
+    testOk(strcmp(text(), "r1") == 0, "first update at once");
+    add(phist, "r2");
+    wait = caPutLogHistoryTransport.idle(phist);
+    testOk(strcmp(text(), "r1") == 0 && wait > 0.0 && wait <= 0.2,
+        "next update due in %.3f s", wait);
+    epicsThreadSleep(wait + 0.01);
+    caPutLogHistoryTransport.idle(phist);
+    testOk(strcmp(text(), "r1\nr2") == 0, "written when due");
+    add(phist, "r3");
+    caPutLogHistoryTransport.flush(phist);
+    testOk(strcmp(text(), "r1\nr2\nr3") == 0, "flush writes what is held back");
+    caPutLogHistoryTransport.destroy(phist);
+    caPutLogHistoryMaxRate = 0.0;
+}
+
+static void testMany(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 20000);
+    caPutLogHistory *phist = caPutLogHistoryCreate(TEXT_PV, SEQ_PV, 5);
+    caPutLogHistoryStats stats;
+    static char lines[10000][12];
+    char want[64];
+    int i, n, len;
+
+    testDiag("Many messages of different lengths");
+    caPutLogSinkAddTransport(plist, TEXT_PV, &caPutLogHistoryTransport, phist);
+    for (i = 0; i < 10000; i++) {
+        sprintf(lines[i], "%.*s%d", i % 7, "xxxxxxx", i);
+        caPutLogSinkSendText(plist, lines[i], strlen(lines[i]));
+    }
+    caPutLogSinkFlush(plist, 5.0);
+
+    /* the newest lines, up to 5, that fit into 31 characters */
+    for (n = 0, len = -1; n < 5 && len + 1 + (int)strlen(lines[9999 - n]) <= 31; n++)
+        len += 1 + (int)strlen(lines[9999 - n]);
+    for (want[0] = 0, i = 10000 - n; i < 10000; i++)
+        sprintf(want + strlen(want), "%s%s", i > 10000 - n ? "\n" : "", lines[i]);
+    caPutLogHistoryGetStats(phist, &stats);
+    testOk(strcmp(text(), want) == 0, "newest %d lines: '%s'", n, text());
+    testOk(seq() == 10000 && stats.seq == 10000, "sequence %ld, %lu updates", seq(),
+        (unsigned long)stats.updates);
+    caPutLogSinkListDestroy(plist);
+}
+
+MAIN(caPutLogHistoryTest)
+{
+    testPlan(12);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    eltc(0);
+    testIocInitOk();
+    testOk(caPutLogHistoryCreate("caPutLogHistoryTest:none", NULL, 10) == NULL,
+        "unknown PV");
+    testOk(caPutLogHistoryCreate(SEQ_PV, NULL, 10) == NULL, "not a char array");
+    eltc(1);
+
+    testLimits();
+    testRate();
+    testMany();
+
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
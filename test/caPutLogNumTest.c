@@ -0,0 +1,130 @@
+/* File:     caPutLogNumTest.c
+ *
+ * Unit tests for the number conversion: exact output for a set of
+ * known values and round trips through strtod() / strtof() for random
+ * bit patterns.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include <epicsMath.h>
+#include <epicsStdio.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogNum.h"
+
+#define NRANDOM 100000
+
+static void checkStr(const char *what, const char *buf, int len, const char *expected)
+{
+    int ok = strcmp(buf, expected) == 0 && len == (int)strlen(expected);
+
+    testOk(ok, "%s -> %s", what, expected);
+    if (!ok)
+        testDiag("got '%s' (length %d)", buf, len);
+}
+
+static void checkDouble(double v, int marker, const char *expected)
+{
+    char buf[caPutLogNumBufSize];
+    char what[40];
+
+    epicsSnprintf(what, sizeof(what), "%.17g%s", v, marker ? " (marker)" : "");
+    checkStr(what, buf, caPutLogFormatDouble(buf, v, marker), expected);
+}
+
+static void checkFloat(float v, int marker, const char *expected)
+{
+    char buf[caPutLogNumBufSize];
+    char what[40];
+
+    epicsSnprintf(what, sizeof(what), "%.9gf%s", v, marker ? " (marker)" : "");
+    checkStr(what, buf, caPutLogFormatFloat(buf, v, marker), expected);
+}
+
+static void testKnown(void)
+{
+    char buf[caPutLogNumBufSize];
+
+    testDiag("Known values");
+    checkDouble(0.1, 0, "0.1");
+    checkDouble(1.0, 0, "1");
+    checkDouble(1.0, 1, "1.0");
+    checkDouble(-0.0, 1, "-0.0");
+    checkDouble(123.456, 1, "123.456");
+    checkDouble(1e16, 1, "10000000000000000.0");
+    checkDouble(1e17, 1, "1e+17");
+    checkDouble(1e-4, 0, "0.0001");
+    checkDouble(1e-5, 0, "1e-05");
+    checkDouble(5e-324, 0, "5e-324");
+    checkDouble(DBL_MAX, 0, "1.7976931348623157e+308");
+    checkDouble(DBL_MIN, 0, "2.2250738585072014e-308");
+    checkDouble(epicsNAN, 0, "nan");
+    checkDouble(-epicsINF, 0, "-inf");
+    checkFloat(0.1f, 0, "0.1");
+    checkFloat(3.0f, 1, "3.0");
+    checkFloat(16777216.0f, 1, "16777216.0");
+    checkFloat(1e8f, 1, "1e+08");
+    checkFloat(FLT_MAX, 0, "3.4028235e+38");
+    checkFloat(1e-45f, 0, "1e-45");
+
+    testDiag("Integers");
+    checkStr("INT32_MIN", buf, caPutLogFormatInt32(buf, -2147483647 - 1), "-2147483648");
+    checkStr("UINT32_MAX", buf, caPutLogFormatUInt32(buf, 4294967295u), "4294967295");
+    checkStr("0", buf, caPutLogFormatUInt32(buf, 0), "0");
+    checkStr("INT64_MIN", buf, caPutLogFormatInt64(buf, -9223372036854775807LL - 1),
+        "-9223372036854775808");
+    checkStr("UINT64_MAX", buf, caPutLogFormatUInt64(buf, 18446744073709551615ULL),
+        "18446744073709551615");
+}
+
+/* xorshift64, the same sequence on every run */
+static epicsUInt64 state = 88172645463325252ULL;
+
+static epicsUInt64 next(void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void testRoundTrip(void)
+{
+    char buf[caPutLogNumBufSize];
+    int i, badDouble = 0, badFloat = 0;
+
+    testDiag("Round trips of %d random values", NRANDOM);
+    for (i = 0; i < NRANDOM; i++) {
+        epicsUInt64 bits = next();
+        epicsUInt32 bits32 = (epicsUInt32)bits;
+        double d;
+        float f;
+
+        memcpy(&d, &bits, sizeof(d));
+        memcpy(&f, &bits32, sizeof(f));
+        if (!isnan(d) && !isinf(d)) {
+            caPutLogFormatDouble(buf, d, 0);
+            if (strtod(buf, NULL) != d && badDouble++ < 5)
+                testDiag("%.17g -> %s", d, buf);
+        }
+        if (!isnan(f) && !isinf(f)) {
+            caPutLogFormatFloat(buf, f, 0);
+            if (strtof(buf, NULL) != f && badFloat++ < 5)
+                testDiag("%.9g -> %s", f, buf);
+        }
+    }
+    testOk(badDouble == 0, "double round trips (%d failed)", badDouble);
+    testOk(badFloat == 0, "float round trips (%d failed)", badFloat);
+}
+
+MAIN(caPutLogNumTest)
+{
+    testPlan(27);
+    testKnown();
+    testRoundTrip();
+    return testDone();
+}
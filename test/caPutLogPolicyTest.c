@@ -0,0 +1,110 @@
+/* File:     caPutLogPolicyTest.c
+ *
+ * Unit tests for the per record policy from info tags: records that are
+ * not logged get no LOGDATA from the trap, the others carry their mode
+ * and burst timeout to the loggers, invalid tags are ignored.
+ */
+
+#include <string.h>
+
+#include <dbAccess.h>
+#include <dbChannel.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <asTrapWrite.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLog.h"
+#include "caPutLogAs.h"
+#include "caPutLogPolicy.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static LOGDATA *captured;
+
+static void captureCallback(LOGDATA *plogData)
+{
+    captured = plogData;
+}
+
+/* Run the trap around a put to the channel, returns the LOGDATA */
+static LOGDATA *trapPut(const char *name, epicsFloat64 value)
+{
+    dbChannel *pch = dbChannelCreate(name);
+    void *pvt;
+
+    if (!pch || dbChannelOpen(pch))
+        testAbort("can't open channel %s", name);
+    captured = NULL;
+    pvt = asTrapWriteBeforeWithData("user", "host", pch, DBR_DOUBLE, 1, &value);
+    dbPutField(&pch->addr, DBR_DOUBLE, &value, 1);
+    asTrapWriteAfterWrite(pvt);
+    dbChannelDelete(pch);
+    return captured;
+}
+
+static int hasPolicy(const char *name)
+{
+    dbChannel *pch = dbChannelCreate(name);
+    int has;
+
+    if (!pch)
+        testAbort("can't create channel %s", name);
+    has = caPutLogPolicyGet(pch->addr.precord) != NULL;
+    dbChannelDelete(pch);
+    return has;
+}
+
+static void testRecord(const char *name, int logged, int mode, double timeout)
+{
+    LOGDATA *plogData = trapPut(name, 1.0);
+
+    if (!logged) {
+        testOk(!plogData, "%s: not logged", name);
+        return;
+    }
+    if (!plogData) {
+        testFail("%s: no LOGDATA", name);
+        testSkip(2, "no LOGDATA");
+        return;
+    }
+    testPass("%s: logged", name);
+    testOk(caPutLogPolicyMode(plogData, caPutLogOnChange) == mode, "%s: mode %d", name, mode);
+    testOk(caPutLogPolicyBurst(plogData, 1.0) == timeout, "%s: burst timeout %g", name, timeout);
+    caPutLogDataFree(plogData);
+}
+
+MAIN(caPutLogPolicyTest)
+{
+    testPlan(19);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutLogPolicyTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    eltc(0);
+    if (caPutLogAsInit(captureCallback, NULL))
+        testAbort("caPutLogAsInit failed");
+    eltc(1);
+
+    testOk(caPutLogPolicyCount() == 3, "3 records with a policy, the invalid tags ignored");
+    testRecord("policy:plain", 1, caPutLogOnChange, 1.0);
+    testRecord("policy:off", 0, 0, 0.0);
+    testRecord("policy:all", 1, caPutLogAll, 0.25);
+    testRecord("policy:alias", 1, caPutLogAll, 0.25);
+    testRecord("policy:nofilter", 1, caPutLogAllNoFilter, 1.0);
+    testRecord("policy:bad", 1, caPutLogOnChange, 1.0);
+    testOk(!hasPolicy("policy:plain"), "no policy without tags");
+    testOk(!hasPolicy("policy:bad"), "no policy from invalid tags");
+
+    caPutLogAsStop();
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
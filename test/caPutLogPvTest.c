@@ -0,0 +1,182 @@
+/* File:     caPutLogPvTest.c
+ *
+ * Unit tests for the log PV transport: only the newest messages are
+ * written, packed into a char array if asked to, updates are held back
+ * to the maximum rate, and a string field gets the newest message.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <dbAccess.h>
+#include <dbUnitTest.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogPv.h"
+
+#define LOG_PV "caPutLogPvTest:log"     /* waveform of 24 CHAR */
+#define STR_PV "caPutLogPvTest:str"     /* stringin */
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static void sendMsgs(caPutLogPv *ppv, unsigned count, ...)
+{
+    caPutLogMsg *pmsgs[8];
+    va_list args;
+    unsigned i;
+
+    va_start(args, count);
+    for (i = 0; i < count; i++) {
+        const char *text = va_arg(args, const char *);
+        pmsgs[i] = caPutLogMsgCreate(text, strlen(text));
+    }
+    va_end(args);
+    caPutLogPvTransport.send(ppv, pmsgs, count);
+    for (i = 0; i < count; i++)
+        caPutLogMsgRelease(pmsgs[i]);
+}
+
+static const char *value(const char *name)
+{
+    static char buf[64];
+    DBADDR addr;
+    long n = sizeof(buf) - 1;
+
+    memset(buf, 0, sizeof(buf));
+    if (dbNameToAddr(name, &addr))
+        testAbort("no PV %s", name);
+    if (addr.field_type == DBF_STRING)
+        n = 1;
+    if (dbGetField(&addr, addr.field_type == DBF_STRING ? DBR_STRING : DBR_CHAR,
+            buf, NULL, &n, NULL))
+        buf[0] = 0;
+    return buf;
+}
+
+static void testLatest(void)
+{
+    caPutLogPv *ppv = caPutLogPvCreate(LOG_PV);
+    caPutLogPvStats stats;
+    char big[31];
+
+    testDiag("Latest message");
+    caPutLogPvPack = 0;
+    caPutLogPvMaxRate = 0.0;
+    sendMsgs(ppv, 3, "a\n", "b\n", "c\n");
+    caPutLogPvGetStats(ppv, &stats);
+    testOk(strcmp(value(LOG_PV), "c") == 0, "newest message written: '%s'", value(LOG_PV));
+    testOk(stats.updates == 1 && stats.published == 1 && stats.superseded == 2,
+        "one update, 2 messages superseded");
+
+    testDiag("Packed");
+    caPutLogPvPack = 1;
+    sendMsgs(ppv, 3, "a\n", "b\n", "c\n");
+    testOk(strcmp(value(LOG_PV), "a\nb\nc") == 0, "3 messages in one update");
+    sendMsgs(ppv, 3, "first-msg\n", "second-msg\n", "third-msg\n");
+    testOk(strcmp(value(LOG_PV), "second-msg\nthird-msg") == 0,
+        "the oldest message did not fit: '%s'", value(LOG_PV));
+    memset(big, 'x', 30);
+    big[30] = 0;
+    sendMsgs(ppv, 1, big);
+    caPutLogPvGetStats(ppv, &stats);
+    testOk(strlen(value(LOG_PV)) == stats.chars && stats.chars == 23,
+        "long message cut to %lu characters", (unsigned long)stats.chars);
+    caPutLogPvTransport.destroy(ppv);
+}
+
+static void testRate(void)
+{
+    caPutLogPv *ppv = caPutLogPvCreate(LOG_PV);
+    caPutLogPvStats stats;
+    double wait;
+
+    testDiag("Rate limit");
+    caPutLogPvPack = 0;
+    caPutLogPvMaxRate = 5.0;
+    sendMsgs(ppv, 1, "r1");
+    testOk(strcmp(value(LOG_PV), "r1") == 0, "first update at once");
+    sendMsgs(ppv, 1, "r2");
+    sendMsgs(ppv, 1, "r3");
+    testOk(strcmp(value(LOG_PV), "r1") == 0, "next updates held back");
+    wait = caPutLogPvTransport.idle(ppv);
+    testOk(wait > 0.0 && wait <= 0.2, "due in %.3f s", wait);
+    epicsThreadSleep(wait + 0.01);
+    wait = caPutLogPvTransport.idle(ppv);
+    caPutLogPvGetStats(ppv, &stats);
+    testOk(wait == 0.0 && strcmp(value(LOG_PV), "r3") == 0 && stats.updates == 2 &&
+        stats.superseded == 1, "newest written when due, then nothing pending");
+
+    sendMsgs(ppv, 1, "r4");
+    caPutLogPvTransport.flush(ppv);
+    testOk(strcmp(value(LOG_PV), "r4") == 0, "flush writes what is held back");
+    caPutLogPvTransport.destroy(ppv);
+}
+
+static void testString(void)
+{
+    caPutLogPv *ppv = caPutLogPvCreate(STR_PV);
+    caPutLogPvStats stats;
+
+    testDiag("String field");
+    caPutLogPvPack = 1;
+    caPutLogPvMaxRate = 0.0;
+    sendMsgs(ppv, 2, "one\n", "two\n");
+    testOk(strcmp(value(STR_PV), "two") == 0, "not packed: '%s'", value(STR_PV));
+    sendMsgs(ppv, 1, "0123456789012345678901234567890123456789xyz");
+    caPutLogPvGetStats(ppv, &stats);
+    testOk(stats.chars == 39 && strcmp(value(STR_PV),
+        "012345678901234567890123456789012345678") == 0, "first 39 characters");
+    caPutLogPvTransport.destroy(ppv);
+}
+
+static void testSink(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 2000);
+    caPutLogPv *ppv = caPutLogPvCreate(LOG_PV);
+    caPutLogPvStats stats;
+    char text[16];
+    int i;
+
+    testDiag("Sender thread");
+    caPutLogPvPack = 0;
+    caPutLogPvMaxRate = 0.0;
+    caPutLogSinkAddTransport(plist, LOG_PV, &caPutLogPvTransport, ppv);
+    for (i = 1; i <= 1000; i++) {
+        sprintf(text, "msg %d\n", i);
+        caPutLogSinkSendText(plist, text, strlen(text));
+    }
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogPvGetStats(ppv, &stats);
+    testOk(strcmp(value(LOG_PV), "msg 1000") == 0, "last message written");
+    testOk(stats.published + stats.superseded == 1000 && stats.failed == 0,
+        "%lu updates, %lu messages superseded", (unsigned long)stats.updates,
+        (unsigned long)stats.superseded);
+    caPutLogSinkListDestroy(plist);
+}
+
+MAIN(caPutLogPvTest)
+{
+    testPlan(15);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    eltc(0);
+    testIocInitOk();
+    testOk(caPutLogPvCreate("caPutLogPvTest:none") == NULL, "unknown PV");
+    eltc(1);
+
+    testLatest();
+    testRate();
+    testString();
+    testSink();
+
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
@@ -0,0 +1,144 @@
+/* File:     caPutLogQueueBench.c
+ *
+ * Contention benchmark: hand-off of LOGDATA pointers from N producer
+ * threads to one consumer, epicsMessageQueue versus caPutLogQueue.
+ *
+ * Usage: caPutLogQueueBench [puts per producer]
+ *
+ * For each producer count the wall clock time, the mean time spent
+ * inside the send call and the number of puts dropped because the
+ * queue was full are reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsMessageQueue.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+
+#include "caPutLogQueue.h"
+
+#define QUEUE_SIZE 1000
+#define MAX_BATCH 32
+
+static const int nproducers[] = {1, 8, 64};
+
+static int useRing;
+static int nputs;
+static epicsMessageQueueId msgQ;
+static caPutLogQueue *ringQ;
+
+static epicsEventId go;
+static epicsEventId producersDone;
+static epicsEventId consumerDone;
+static int ready, running;
+static size_t dropped;
+static double sendSeconds;
+static epicsMutexId statsLock;
+
+static void producer(void *arg)
+{
+    epicsTimeStamp start, end;
+    size_t drops = 0;
+    int i;
+
+    epicsAtomicIncrIntT(&ready);
+    epicsEventMustWait(go);
+    epicsEventSignal(go);
+
+    epicsTimeGetCurrent(&start);
+    for (i = 1; i <= nputs; i++) {
+        LOGDATA *p = (LOGDATA *)(size_t)i;
+        int status = useRing ? caPutLogQueueTrySend(ringQ, p)
+                             : epicsMessageQueueTrySend(msgQ, &p, sizeof(p));
+        if (status) drops++;
+    }
+    epicsTimeGetCurrent(&end);
+
+    epicsMutexMustLock(statsLock);
+    dropped += drops;
+    sendSeconds += epicsTimeDiffInSeconds(&end, &start);
+    epicsMutexUnlock(statsLock);
+
+    if (epicsAtomicDecrIntT(&running) == 0)
+        epicsEventSignal(producersDone);
+}
+
+static void consumer(void *arg)
+{
+    LOGDATA *batch[MAX_BATCH];
+
+    while (epicsAtomicGetIntT(&running) > 0) {
+        if (useRing) {
+            caPutLogQueueReceive(ringQ, batch, MAX_BATCH, 0.01);
+        } else {
+            epicsMessageQueueReceiveWithTimeout(msgQ, batch, sizeof(LOGDATA *), 0.01);
+        }
+    }
+    epicsEventSignal(consumerDone);
+}
+
+static void run(int ring, int n)
+{
+    epicsTimeStamp start, end;
+    double wall;
+    int i;
+
+    useRing = ring;
+    ready = 0;
+    running = n;
+    dropped = 0;
+    sendSeconds = 0.0;
+    if (ring)
+        ringQ = caPutLogQueueCreate(QUEUE_SIZE);
+    else
+        msgQ = epicsMessageQueueCreate(QUEUE_SIZE, sizeof(LOGDATA *));
+
+    epicsThreadMustCreate("consumer", epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall), consumer, NULL);
+    for (i = 0; i < n; i++) {
+        epicsThreadMustCreate("producer", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall), producer, NULL);
+    }
+    while (epicsAtomicGetIntT(&ready) < n)
+        epicsThreadSleep(0.01);
+
+    epicsTimeGetCurrent(&start);
+    epicsEventSignal(go);
+    epicsEventMustWait(producersDone);
+    epicsTimeGetCurrent(&end);
+    epicsEventMustWait(consumerDone);
+    epicsEventTryWait(go);
+
+    wall = epicsTimeDiffInSeconds(&end, &start);
+    printf("%-18s %3d producers: %8.3f s wall, %8.1f ns/send, %10.0f puts/s, %lu dropped\n",
+        ring ? "caPutLogQueue" : "epicsMessageQueue", n, wall,
+        1e9 * sendSeconds / ((double)n * nputs),
+        (double)n * nputs / wall, (unsigned long)dropped);
+
+    if (ring)
+        caPutLogQueueDestroy(ringQ);
+    else
+        epicsMessageQueueDestroy(msgQ);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned i;
+
+    nputs = argc > 1 ? atoi(argv[1]) : 100000;
+    go = epicsEventMustCreate(epicsEventEmpty);
+    producersDone = epicsEventMustCreate(epicsEventEmpty);
+    consumerDone = epicsEventMustCreate(epicsEventEmpty);
+    statsLock = epicsMutexMustCreate();
+
+    for (i = 0; i < sizeof(nproducers)/sizeof(nproducers[0]); i++) {
+        run(0, nproducers[i]);
+        run(1, nproducers[i]);
+    }
+    return 0;
+}
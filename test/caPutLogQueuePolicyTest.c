@@ -0,0 +1,253 @@
+/* File:     caPutLogQueuePolicyTest.c
+ *
+ * Unit tests for the limits and overflow policies of caPutLogQueueSend.
+ * Unlike caPutLogQueueTest this needs real LOGDATA, since puts are
+ * sized, merged and freed by the queue.
+ */
+
+#include <string.h>
+
+#include <epicsThread.h>
+#include <dbAccess.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <errlog.h>
+#include <testMain.h>
+
+#include "caPutLogAs.h"
+#include "caPutLogQueue.h"
+
+#define LIMIT 4
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static epicsFloat64 fields[16];
+
+static LOGDATA *put(int field, double old_value, double new_value)
+{
+    LOGDATA *plogData = caPutLogDataAlloc((int)sizeof(epicsFloat64),
+        "user", "host", "test:pv");
+
+    if (!plogData)
+        testAbort("caPutLogDataAlloc failed");
+    plogData->pfield = &fields[field];
+    plogData->type = DBR_DOUBLE;
+    plogData->old_size = plogData->old_log_size = 1;
+    plogData->new_size = plogData->new_log_size = 1;
+    plogData->old_value->v_double = old_value;
+    plogData->new_value->value.v_double = new_value;
+    return plogData;
+}
+
+/* Receive everything, returns the number of puts */
+static unsigned receiveAll(caPutLogQueue *q, LOGDATA **buf, unsigned max)
+{
+    unsigned n = 0, i;
+
+    for (;;) {
+        unsigned got = caPutLogQueueReceive(q, buf + n, max - n, 0.0);
+        if (!got) break;
+        n += got;
+    }
+    for (i = n; i < max; i++)
+        buf[i] = NULL;
+    return n;
+}
+
+static void freeAll(LOGDATA **buf, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        caPutLogDataFree(buf[i]);
+}
+
+static void testDropNewest(void)
+{
+    caPutLogQueue *q = caPutLogQueueCreate(16);
+    caPutLogQueueStats stats;
+    LOGDATA *buf[16];
+    unsigned n;
+    int i, status = 0;
+
+    testDiag("Drop newest");
+    caPutLogQueueSetLimits(q, LIMIT, 0, caPutLogDropNewest, 0.0);
+    for (i = 0; i < LIMIT; i++)
+        status |= caPutLogQueueSend(q, put(i, i, i + 1));
+    testOk(status == 0, "%d puts accepted", LIMIT);
+    testOk(caPutLogQueueSend(q, put(LIMIT, 0, 1)) == -1, "put beyond the limit dropped");
+
+    n = receiveAll(q, buf, 16);
+    caPutLogQueueGetStats(q, &stats);
+    testOk(n == LIMIT && buf[0]->pfield == &fields[0] &&
+        buf[LIMIT - 1]->pfield == &fields[LIMIT - 1], "the first %d puts received", LIMIT);
+    testOk(stats.droppedNewest == 1 && stats.highWater == LIMIT && stats.pendingBytes == 0,
+        "statistics: %lu dropped, high water %u", (unsigned long)stats.droppedNewest,
+        stats.highWater);
+    freeAll(buf, n);
+    caPutLogQueueDestroy(q);
+}
+
+static void testDropOldest(void)
+{
+    caPutLogQueue *q = caPutLogQueueCreate(16);
+    caPutLogQueueStats stats;
+    LOGDATA *buf[16];
+    unsigned n;
+    int i, status = 0;
+
+    testDiag("Drop oldest");
+    caPutLogQueueSetLimits(q, LIMIT, 0, caPutLogDropOldest, 0.0);
+    for (i = 0; i < LIMIT + 2; i++)
+        status |= caPutLogQueueSend(q, put(i, i, i + 1));
+    testOk(status == 0, "all puts accepted");
+
+    n = receiveAll(q, buf, 16);
+    caPutLogQueueGetStats(q, &stats);
+    testOk(n == LIMIT && buf[0]->pfield == &fields[2] &&
+        buf[LIMIT - 1]->pfield == &fields[LIMIT + 1], "the last %d puts received", LIMIT);
+    testOk(stats.droppedOldest == 2, "%lu oldest puts dropped",
+        (unsigned long)stats.droppedOldest);
+    freeAll(buf, n);
+    caPutLogQueueDestroy(q);
+}
+
+static void testBytes(void)
+{
+    caPutLogQueue *q = caPutLogQueueCreate(16);
+    LOGDATA *p = put(0, 0, 1);
+    size_t size = caPutLogDataSize(p);
+    LOGDATA *buf[16];
+    unsigned n;
+
+    testDiag("Byte limit");
+    caPutLogQueueSetLimits(q, 0, 2 * size, caPutLogDropNewest, 0.0);
+    caPutLogQueueSend(q, p);
+    caPutLogQueueSend(q, put(1, 0, 1));
+    testOk(caPutLogQueueSend(q, put(2, 0, 1)) == -1,
+        "third put of %lu bytes exceeds the limit", (unsigned long)size);
+    n = receiveAll(q, buf, 16);
+    testOk(n == 2, "two puts received");
+    freeAll(buf, n);
+    caPutLogQueueDestroy(q);
+}
+
+static void testCoalesce(void)
+{
+    caPutLogQueue *q = caPutLogQueueCreate(16);
+    caPutLogQueueStats stats;
+    LOGDATA *buf[16], *p;
+    unsigned n;
+
+    testDiag("Coalesce");
+    caPutLogQueueSetLimits(q, 2, 0, caPutLogCoalesce, 0.0);
+    caPutLogQueueSend(q, put(0, 0, 1));
+    caPutLogQueueSend(q, put(1, 10, 11));
+    /* over the limit from here on */
+    caPutLogQueueSend(q, put(2, 20, 21));
+    caPutLogQueueSend(q, put(3, 30, 31));
+    /* counts of puts the rate limits dropped survive the merge */
+    p = put(2, 21, 22);
+    p->suppressed_pv = 3;
+    caPutLogQueueSend(q, p);
+    p = put(2, 22, 23);
+    p->suppressed_pv = 2;
+    p->suppressed_client = 1;
+    caPutLogQueueSend(q, p);
+    caPutLogQueueSend(q, put(3, 31, 32));
+    caPutLogQueueGetStats(q, &stats);
+    testOk(stats.pending == 4 && stats.coalesced == 3,
+        "%u puts pending, %lu coalesced", stats.pending, (unsigned long)stats.coalesced);
+
+    n = receiveAll(q, buf, 16);
+    testOk(n == 4 && buf[0]->pfield == &fields[0] && buf[1]->pfield == &fields[1] &&
+        buf[2]->pfield == &fields[2] && buf[3]->pfield == &fields[3],
+        "received in order of the first put to each field");
+    testOk(n == 4 && buf[2]->old_value->v_double == 20.0 &&
+        buf[2]->new_value->value.v_double == 23.0 &&
+        buf[3]->old_value->v_double == 30.0 &&
+        buf[3]->new_value->value.v_double == 32.0,
+        "coalesced puts keep the first old and the last new value");
+    testOk(n == 4 && buf[2]->suppressed_pv == 5 && buf[2]->suppressed_client == 1 &&
+        buf[3]->suppressed_pv == 0, "suppressed counts added up: pv %u, client %u",
+        n == 4 ? buf[2]->suppressed_pv : 0, n == 4 ? buf[2]->suppressed_client : 0);
+    freeAll(buf, n);
+
+    caPutLogQueueSend(q, put(0, 1, 2));
+    n = receiveAll(q, buf, 16);
+    testOk(n == 1 && buf[0]->old_value->v_double == 1.0,
+        "below the limit puts are queued unchanged");
+    freeAll(buf, n);
+    caPutLogQueueDestroy(q);
+}
+
+static caPutLogQueue *blockQ;
+
+static void consumer(void *arg)
+{
+    LOGDATA *buf[16];
+
+    epicsThreadSleep(0.1);
+    freeAll(buf, receiveAll(blockQ, buf, 16));
+}
+
+static void testBlock(void)
+{
+    caPutLogQueueStats stats;
+    LOGDATA *buf[16];
+    unsigned n;
+
+    testDiag("Block");
+    blockQ = caPutLogQueueCreate(16);
+    caPutLogQueueSetLimits(blockQ, 1, 0, caPutLogBlock, 0.05);
+    caPutLogQueueSend(blockQ, put(0, 0, 1));
+    testOk(caPutLogQueueSend(blockQ, put(1, 0, 1)) == -1, "put dropped after the timeout");
+
+    caPutLogQueueSetLimits(blockQ, 1, 0, caPutLogBlock, 5.0);
+    epicsThreadMustCreate("consumer", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), consumer, NULL);
+    testOk(caPutLogQueueSend(blockQ, put(2, 0, 1)) == 0, "put queued once there is room");
+
+    caPutLogQueueGetStats(blockQ, &stats);
+    testOk(stats.blocked == 2 && stats.droppedBlocked == 1,
+        "statistics: %lu blocked, %lu dropped", (unsigned long)stats.blocked,
+        (unsigned long)stats.droppedBlocked);
+    n = receiveAll(blockQ, buf, 16);
+    testOk(n == 1 && buf[0]->pfield == &fields[2], "blocked put received");
+    freeAll(buf, n);
+    caPutLogQueueDestroy(blockQ);
+}
+
+MAIN(caPutLogQueuePolicyTest)
+{
+    testPlan(19);
+
+    testOk(caPutLogQueuePolicyFromName("coalesce") == caPutLogCoalesce &&
+        caPutLogQueuePolicyFromName("bogus") == -1 &&
+        strcmp(caPutLogQueuePolicyName(caPutLogDropOldest), "drop-oldest") == 0,
+        "policy names");
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    /* sets up the LOGDATA free lists */
+    if (caPutLogAsInit(NULL, NULL))
+        testAbort("caPutLogAsInit failed");
+
+    testDropNewest();
+    testDropOldest();
+    testBytes();
+    testCoalesce();
+    testBlock();
+
+    caPutLogAsStop();
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
@@ -0,0 +1,136 @@
+/* File:     caPutLogQueueTest.c
+ *
+ * Unit tests for the lock-free queue between the access security
+ * trap and the logger threads.
+ */
+
+#include <stdlib.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogQueue.h"
+
+#define NPRODUCERS 8
+#define NPUTS 20000
+
+/* Fake LOGDATA pointers, the queue never dereferences them */
+#define ENCODE(producer, i) ((LOGDATA *)(size_t)(((producer) + 1) << 20 | (i)))
+#define PRODUCER(p) ((int)((size_t)(p) >> 20) - 1)
+#define INDEX(p) ((int)((size_t)(p) & 0xfffff))
+
+static caPutLogQueue *q;
+static epicsEventId go;
+static int started;
+
+static void producer(void *arg)
+{
+    int id = (int)(size_t)arg;
+    int i;
+
+    epicsAtomicIncrIntT(&started);
+    epicsEventMustWait(go);
+    epicsEventSignal(go);       /* pass the start signal on */
+    for (i = 0; i < NPUTS; i++) {
+        while (caPutLogQueueTrySend(q, ENCODE(id, i)))
+            epicsThreadSleep(0.0);
+    }
+}
+
+static void testSingleThread(void)
+{
+    LOGDATA *buf[32];
+    unsigned n;
+    int i, ok;
+
+    testDiag("Single thread: capacity, order and overflow");
+
+    q = caPutLogQueueCreate(10);
+    testOk1(q != NULL);
+    testOk(caPutLogQueueCapacity(q) == 16, "capacity rounded up to 16");
+
+    for (i = 0; i < 16; i++) {
+        if (caPutLogQueueTrySend(q, ENCODE(0, i))) break;
+    }
+    testOk(i == 16, "16 entries accepted");
+    testOk(caPutLogQueueTrySend(q, ENCODE(0, 16)) == -1, "17th entry rejected");
+    testOk(caPutLogQueuePending(q) == 16, "16 entries pending");
+
+    n = caPutLogQueueReceive(q, buf, 32, 0.0);
+    testOk(n == 16, "received %u entries in one batch", n);
+    for (ok = 1, i = 0; i < (int)n; i++) {
+        if (buf[i] != ENCODE(0, i)) ok = 0;
+    }
+    testOk(ok, "entries received in order");
+
+    n = caPutLogQueueReceive(q, buf, 32, 0.01);
+    testOk(n == 0, "empty queue times out");
+
+    /* wrap around a few laps with partial batches */
+    for (ok = 1, i = 0; i < 100; i++) {
+        if (caPutLogQueueTrySend(q, ENCODE(0, i)) ||
+            caPutLogQueueTrySend(q, ENCODE(0, i + 1)) ||
+            caPutLogQueueReceive(q, buf, 1, 0.0) != 1 || buf[0] != ENCODE(0, i) ||
+            caPutLogQueueReceive(q, buf, 32, 0.0) != 1 || buf[0] != ENCODE(0, i + 1))
+            ok = 0;
+    }
+    testOk(ok, "wrap-around with partial batches");
+
+    caPutLogQueueDestroy(q);
+}
+
+static void testProducers(void)
+{
+    LOGDATA *buf[32];
+    int next[NPRODUCERS] = {0};
+    int received = 0, inOrder = 1, valid = 1;
+    int i;
+
+    testDiag("%d producers, %d puts each", NPRODUCERS, NPUTS);
+
+    q = caPutLogQueueCreate(64);
+    go = epicsEventMustCreate(epicsEventEmpty);
+    for (i = 0; i < NPRODUCERS; i++) {
+        epicsThreadMustCreate("producer", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            producer, (void *)(size_t)i);
+    }
+    while (epicsAtomicGetIntT(&started) < NPRODUCERS)
+        epicsThreadSleep(0.01);
+    epicsEventSignal(go);
+
+    while (received < NPRODUCERS * NPUTS) {
+        unsigned n = caPutLogQueueReceive(q, buf, 32, 5.0);
+
+        if (!n) break;
+        for (i = 0; i < (int)n; i++) {
+            int p = PRODUCER(buf[i]);
+
+            if (p < 0 || p >= NPRODUCERS) {
+                valid = 0;
+                continue;
+            }
+            if (INDEX(buf[i]) != next[p]) inOrder = 0;
+            next[p] = INDEX(buf[i]) + 1;
+        }
+        received += n;
+    }
+    testOk(received == NPRODUCERS * NPUTS, "received %d of %d entries",
+        received, NPRODUCERS * NPUTS);
+    testOk(valid, "no corrupted entries");
+    testOk(inOrder, "entries of each producer received in order");
+
+    caPutLogQueueDestroy(q);
+    epicsEventDestroy(go);
+}
+
+MAIN(caPutLogQueueTest)
+{
+    testPlan(12);
+    testSingleThread();
+    testProducers();
+    return testDone();
+}
@@ -0,0 +1,248 @@
+/* File:     caPutLogRateTest.c
+ *
+ * Unit tests for the rate limits of the trap: token buckets per PV and
+ * per client, the counts of suppressed puts handed to the next put that
+ * is logged or else reported by the sweep, counts given back by a put
+ * that is not logged after all, and buckets shared by several threads.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <dbDefs.h>
+#include <dbAddr.h>
+#include <errlog.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogRate.h"
+
+#define NFIELDS 40
+
+static double fields[NFIELDS];
+
+static void address(int field, dbAddr *paddr, char *name)
+{
+    memset(paddr, 0, sizeof(*paddr));
+    paddr->pfield = &fields[field];
+    sprintf(name, "test:%d", field);
+}
+
+static int put(int field, const char *user, const char *host, unsigned suppressed[2])
+{
+    dbAddr addr;
+    char name[32];
+
+    address(field, &addr, name);
+    return caPutLogRatePut(&addr, name, user, host, suppressed);
+}
+
+static void giveBack(int field, const char *user, const char *host,
+    const unsigned suppressed[2])
+{
+    dbAddr addr;
+    char name[32];
+
+    address(field, &addr, name);
+    caPutLogRateReturn(&addr, name, user, host, suppressed);
+}
+
+/* n puts to the field, returns the number logged */
+static int putMany(int field, const char *user, const char *host, int n)
+{
+    unsigned suppressed[2];
+    int i, logged = 0;
+
+    for (i = 0; i < n; i++)
+        logged += put(field, user, host, suppressed);
+    return logged;
+}
+
+static void testNoLimit(void)
+{
+    unsigned suppressed[2] = {1, 1};
+
+    testDiag("Without limits every put is logged");
+    caPutLogRateClear();
+    testOk1(putMany(0, "user", "host", 1000) == 1000);
+    testOk1(put(0, "user", "host", suppressed) && !suppressed[0] && !suppressed[1]);
+    eltc(0);
+    testOk1(caPutLogRateSet("field", 10.0, 5.0) == -1);
+    eltc(1);
+    testOk1(caPutLogRateSuppressed() == 0);
+
+    caPutLogRateTrap(1);
+    eltc(0);
+    testOk(caPutLogRateClear() == -1, "no clearing while the trap is registered");
+    eltc(1);
+    caPutLogRateTrap(0);
+}
+
+static void testPv(void)
+{
+    unsigned suppressed[2];
+
+    testDiag("Bucket per PV");
+    caPutLogRateClear();
+    testOk1(caPutLogRateSet("pv", 10.0, 5.0) == 0);
+    testOk(putMany(0, "user", "host", 15) == 5, "burst of 5 puts logged");
+    testOk(putMany(1, "user", "host", 15) == 5, "other PV has a bucket of its own");
+    testOk1(caPutLogRateSuppressed() == 20);
+
+    epicsThreadSleep(0.35);
+    testOk(put(0, "user", "host", suppressed) == 1, "refilled after a while");
+    testOk(suppressed[caPutLogRatePv] == 10 && suppressed[caPutLogRateClient] == 0,
+        "10 puts reported suppressed");
+    testOk(put(0, "user", "host", suppressed) == 1 && suppressed[caPutLogRatePv] == 0,
+        "reported only once");
+
+    testOk1(caPutLogRateSet("pv", 0.0, 0.0) == 0);
+    testOk(putMany(0, "user", "host", 100) == 100, "limit lifted");
+}
+
+static void testClient(void)
+{
+    unsigned suppressed[2];
+    int i, logged = 0;
+
+    testDiag("Bucket per client, together with the PV's");
+    caPutLogRateClear();
+    testOk1(caPutLogRateSet("client", 10.0, 3.0) == 0);
+    for (i = 0; i < 10; i++)
+        logged += put(i, "user", "host1", suppressed);
+    testOk(logged == 3, "client limited over all PVs");
+    testOk(putMany(0, "user", "host2", 10) == 3, "other host has a bucket of its own");
+    testOk(putMany(0, "operator", "host1", 10) == 3, "other user has a bucket of its own");
+
+    /* puts the PV's bucket dropped survive a put the client's drops */
+    testOk1(caPutLogRateSet("pv", 10.0, 1.0) == 0);
+    testOk1(putMany(20, "user", "host3", 5) == 1);
+    epicsThreadSleep(0.15);
+    for (i = 21; i < 31; i++)           /* empty host1's bucket again */
+        put(i, "user", "host1", suppressed);
+    testOk(putMany(20, "user", "host1", 1) == 0, "dropped by the client's bucket");
+    testOk(put(20, "user", "host3", suppressed) == 1, "which gave the PV's token back");
+    testOk(suppressed[caPutLogRatePv] == 4, "4 puts to the PV suppressed (%u)",
+        suppressed[caPutLogRatePv]);
+    testOk(suppressed[caPutLogRateClient] == 0, "none from the client (%u)",
+        suppressed[caPutLogRateClient]);
+    caPutLogRateShow("caPutLogRateTest");
+}
+
+static void testReturn(void)
+{
+    unsigned suppressed[2];
+
+    testDiag("Counts given back by a put that is not logged after all");
+    caPutLogRateClear();
+    testOk1(caPutLogRateSet("pv", 10.0, 1.0) == 0);
+    testOk1(putMany(5, "user", "host", 3) == 1);
+    epicsThreadSleep(0.15);
+    testOk1(put(5, "user", "host", suppressed) == 1 && suppressed[caPutLogRatePv] == 2);
+    giveBack(5, "user", "host", suppressed);
+    epicsThreadSleep(0.15);
+    testOk(put(5, "user", "host", suppressed) == 1 && suppressed[caPutLogRatePv] == 2,
+        "handed to the next put again (%u)", suppressed[caPutLogRatePv]);
+}
+
+static int nreports;
+static unsigned reported[2];
+static char reportedPv[32];
+
+static int collect(void *arg, const char *pvname, const char *userid,
+    const char *hostid, const unsigned suppressed[2])
+{
+    nreports++;
+    if (arg)
+        return 0;       /* could not log it */
+    reported[caPutLogRatePv] += suppressed[caPutLogRatePv];
+    reported[caPutLogRateClient] += suppressed[caPutLogRateClient];
+    strncpy(reportedPv, pvname, sizeof(reportedPv) - 1);
+    return 1;
+}
+
+static void testSweep(void)
+{
+    unsigned suppressed[2];
+    int failed = 1;
+    double wait;
+
+    testDiag("Sweep of the counts no put took over");
+    caPutLogRateClear();
+    testOk1(caPutLogRateSweep(collect, NULL, 5.0) == 5.0);
+    testOk1(caPutLogRateSet("pv", 10.0, 2.0) == 0);
+    testOk1(putMany(3, "user", "host", 5) == 2);
+    wait = caPutLogRateSweep(collect, NULL, 5.0);
+    testOk(nreports == 0 && wait > 0.0 && wait <= 1.0,
+        "not reported before the bucket refilled, next sweep in %g s", wait);
+
+    epicsThreadSleep(1.1);
+    caPutLogRateSweep(collect, &failed, 5.0);
+    testOk(nreports == 1, "reported once refilled");
+    epicsThreadSleep(1.1);
+    caPutLogRateSweep(collect, NULL, 5.0);
+    testOk(nreports == 2 && reported[caPutLogRatePv] == 3 &&
+        reported[caPutLogRateClient] == 0 && strcmp(reportedPv, "test:3") == 0,
+        "kept when it could not be logged, then %u puts to %s", reported[caPutLogRatePv],
+        reportedPv);
+    testOk1(caPutLogRateSweep(collect, NULL, 5.0) == 5.0);
+    testOk(put(3, "user", "host", suppressed) == 1 && suppressed[caPutLogRatePv] == 0,
+        "not handed to the next put as well");
+}
+
+#define NTHREADS 4
+#define NPUTS 20000
+#define BURST 50
+
+static epicsEventId done[NTHREADS];
+static int threadLogged;
+
+static void putThread(void *arg)
+{
+    int id = (int)(size_t)arg;
+    int i, logged = 0;
+    unsigned suppressed[2];
+
+    /* every thread puts to all fields */
+    for (i = 0; i < NPUTS; i++)
+        logged += put(i % NFIELDS, "user", id & 1 ? "odd" : "even", suppressed);
+    epicsAtomicAddIntT(&threadLogged, logged);
+    epicsEventSignal(done[id]);
+}
+
+static void testThreads(void)
+{
+    int i;
+
+    testDiag("Shared buckets");
+    caPutLogRateClear();
+    testOk1(caPutLogRateSet("pv", 0.001, BURST) == 0);
+    for (i = 0; i < NTHREADS; i++) {
+        done[i] = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadMustCreate("putThread", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall), putThread, (void *)(size_t)i);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        epicsEventMustWait(done[i]);
+        epicsEventDestroy(done[i]);
+    }
+    testOk(threadLogged == NFIELDS * BURST, "%d puts logged, %d expected",
+        threadLogged, NFIELDS * BURST);
+    testOk1(caPutLogRateSuppressed() == NTHREADS * NPUTS - NFIELDS * BURST);
+}
+
+MAIN(caPutLogRateTest)
+{
+    testPlan(39);
+    testNoLimit();
+    testPv();
+    testClient();
+    testReturn();
+    testSweep();
+    testThreads();
+    caPutLogRateClear();
+    return testDone();
+}
@@ -0,0 +1,203 @@
+/* File:     caPutLogSinkBench.c
+ *
+ * Delivery benchmark: messages go through a sink list and its connection to a
+ * receiver on the loopback interface, for several batch settings.
+ *
+ * Usage: caPutLogSinkBench [messages] [message size]
+ *
+ * Every message carries the time it was queued, the receiver takes the
+ * difference to the time it arrives. For each setting the messages per
+ * second sending flat out and the median and 99th percentile latency
+ * are reported, flat out and paced (bursts of 10 messages per ms).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <osiSock.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+
+#include "caPutLogSink.h"
+
+static const struct {
+    int bytes;
+    double delay;       /* ms */
+} settings[] = {
+    {0, 0.0},
+    {4096, 0.0},
+    {16384, 0.0},
+    {16384, 1.0},
+    {65536, 5.0},
+};
+
+#define PACED_BURST 10
+
+static SOCKET listener;
+static epicsEventId accepted;
+static int received;
+static double *latency;
+static int nmsgs;
+
+static void receiver(void *arg)
+{
+    char buf[65536];
+    size_t used = 0;
+    SOCKET sock;
+    osiSockAddr addr;
+    osiSocklen_t addrLen = sizeof(addr);
+
+    sock = epicsSocketAccept(listener, &addr.sa, &addrLen);
+    if (sock == INVALID_SOCKET) {
+        fprintf(stderr, "accept failed\n");
+        return;
+    }
+    epicsEventSignal(accepted);
+
+    while (1) {
+        epicsTimeStamp now;
+        char *line = buf, *end;
+        int n = recv(sock, buf + used, (int)(sizeof(buf) - used), 0);
+
+        if (n <= 0)
+            break;
+        epicsTimeGetCurrent(&now);
+        used += n;
+        while ((end = memchr(line, '\n', used - (line - buf))) != NULL) {
+            epicsTimeStamp sent;
+            unsigned long sec, nsec;
+            int i = epicsAtomicGetIntT(&received);
+
+            if (sscanf(line, "%lu.%lu", &sec, &nsec) == 2 && i < nmsgs) {
+                sent.secPastEpoch = (epicsUInt32)sec;
+                sent.nsec = (epicsUInt32)nsec;
+                latency[i] = epicsTimeDiffInSeconds(&now, &sent);
+                epicsAtomicIncrIntT(&received);
+            }
+            line = end + 1;
+        }
+        used -= line - buf;
+        memmove(buf, line, used);
+    }
+    epicsSocketDestroy(sock);
+}
+
+static void sendOne(caPutLogSinkList *plist, char *text, size_t size)
+{
+    epicsTimeStamp now;
+    int len;
+
+    epicsTimeGetCurrent(&now);
+    len = sprintf(text, "%u.%09u ", now.secPastEpoch, now.nsec);
+    memset(text + len, 'x', size - len - 1);
+    text[size - 1] = '\n';
+    caPutLogSinkSendText(plist, text, size);
+}
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Send n messages, wait for them to arrive; returns the seconds taken */
+static double run(caPutLogSinkList *plist, char *text, size_t size, int paced)
+{
+    epicsTimeStamp start, end;
+    int i;
+
+    epicsAtomicSetIntT(&received, 0);
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < nmsgs; i++) {
+        sendOne(plist, text, size);
+        if (paced && i % PACED_BURST == PACED_BURST - 1)
+            epicsThreadSleep(0.001);
+    }
+    for (i = 0; i < 30000 && epicsAtomicGetIntT(&received) < nmsgs; i++)
+        epicsThreadSleep(0.001);
+    epicsTimeGetCurrent(&end);
+    qsort(latency, epicsAtomicGetIntT(&received), sizeof(double), compare);
+    return epicsTimeDiffInSeconds(&end, &start);
+}
+
+static double percentile(double p)
+{
+    int n = epicsAtomicGetIntT(&received);
+    return n ? latency[(int)(p * (n - 1))] * 1e6 : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+    caPutLogSinkList *plist;
+    caPutLogSinkStats stats;
+    osiSockAddr addr;
+    osiSocklen_t addrLen = sizeof(addr);
+    char address[32];
+    size_t size;
+    char *text;
+    unsigned i;
+
+    nmsgs = argc > 1 ? atoi(argv[1]) : 100000;
+    size = argc > 2 ? (size_t)atoi(argv[2]) : 200;
+    if (nmsgs < 1 || size < 32) {
+        fprintf(stderr, "usage: %s [messages] [message size >= 32]\n", argv[0]);
+        return 1;
+    }
+    text = malloc(size);
+    latency = malloc(nmsgs * sizeof(double));
+
+    osiSockAttach();
+    listener = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = 0;
+    if (listener == INVALID_SOCKET || bind(listener, &addr.sa, sizeof(addr.ia))
+            || listen(listener, 1) || getsockname(listener, &addr.sa, &addrLen)) {
+        fprintf(stderr, "cannot set up the receiver\n");
+        return 1;
+    }
+    accepted = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("receiver", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackBig), receiver, NULL);
+
+    plist = caPutLogSinkListCreate("bench", nmsgs);
+    sprintf(address, "127.0.0.1:%u", ntohs(addr.ia.sin_port));
+    /* the connection is opened when the first message goes out */
+    if (caPutLogSinkAdd(plist, address, 0) ||
+            (sendOne(plist, text, size), caPutLogSinkFlush(plist, 10.0)) ||
+            epicsEventWaitWithTimeout(accepted, 10.0) != epicsEventOK) {
+        fprintf(stderr, "no connection to the receiver\n");
+        return 1;
+    }
+
+    printf("%d messages of %u bytes to %s\n\n", nmsgs, (unsigned)size, address);
+    printf("%8s %8s | %10s %10s %10s | %10s %10s | %8s\n", "bytes", "delay", "msgs/s",
+        "p50 [us]", "p99 [us]", "paced p50", "paced p99", "batches");
+    for (i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        double seconds, p50, p99;
+        size_t batches;
+
+        caPutLogSinkSetBatch(plist, settings[i].bytes, settings[i].delay / 1000.0);
+        caPutLogSinkGetStats(plist, 0, &stats);
+        batches = stats.batches;
+
+        seconds = run(plist, text, size, 0);
+        p50 = percentile(0.5);
+        p99 = percentile(0.99);
+        printf("%8d %6.1fms | %10.0f %10.1f %10.1f |", settings[i].bytes, settings[i].delay,
+            epicsAtomicGetIntT(&received) / seconds, p50, p99);
+        caPutLogSinkGetStats(plist, 0, &stats);
+        batches = stats.batches - batches;
+
+        run(plist, text, size, 1);
+        printf(" %10.1f %10.1f | %8lu\n", percentile(0.5), percentile(0.99),
+            (unsigned long)batches);
+    }
+    caPutLogSinkGetStats(plist, 0, &stats);
+    printf("\ndropped %lu\n", (unsigned long)stats.dropped);
+    return 0;
+}
@@ -0,0 +1,354 @@
+/* File:     caPutLogSinkTest.c
+ *
+ * Unit tests for the per-sink queues: a blocked sink must neither hold
+ * up the other sinks nor the sender, it drops what does not fit into its
+ * queue, and all sinks get the same message buffer. Waiting for it in a
+ * flush does not hold up the sender either. Batches are sent when
+ * they are full or when the delay is up. Sharded lists send each message
+ * to as many sinks as asked for, passing over the ones that are down.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+
+#define NMSG 10
+#define QUEUE_SIZE 4
+
+typedef struct {
+    int             blocking;   /* wait for the gate in send() */
+    epicsEventId    entered;    /* send() was called */
+    epicsEventId    gate;
+    int             received;
+    const caPutLogMsg *seen[NMSG];
+    int             destroyed;
+    int             down;       /* healthy() says so */
+} testSink;
+
+static int testSend(void *ctx, caPutLogMsg * const *pmsgs, unsigned count)
+{
+    testSink *ptest = (testSink *)ctx;
+    unsigned i;
+
+    epicsEventSignal(ptest->entered);
+    if (epicsAtomicGetIntT(&ptest->blocking))
+        epicsEventMustWait(ptest->gate);
+    for (i = 0; i < count; i++) {
+        if (ptest->received < NMSG)
+            ptest->seen[ptest->received] = pmsgs[i];
+        epicsAtomicIncrIntT(&ptest->received);
+    }
+    return 0;
+}
+
+static void testDestroy(void *ctx)
+{
+    ((testSink *)ctx)->destroyed++;
+}
+
+static int testHealthy(void *ctx)
+{
+    return !epicsAtomicGetIntT(&((testSink *)ctx)->down);
+}
+
+static const caPutLogSinkTransport testTransport = {
+    testSend, NULL, NULL, testDestroy
+};
+
+static const caPutLogSinkTransport healthTransport = {
+    testSend, NULL, NULL, testDestroy, NULL, testHealthy
+};
+
+static void testSinkInit(testSink *ptest, int blocking)
+{
+    memset(ptest, 0, sizeof(*ptest));
+    ptest->blocking = blocking;
+    ptest->entered = epicsEventMustCreate(epicsEventEmpty);
+    ptest->gate = epicsEventMustCreate(epicsEventEmpty);
+}
+
+static void testRefs(void)
+{
+    caPutLogMsg *pmsg = caPutLogMsgCreate("hello world", 5);
+
+    testDiag("Reference counting");
+    testOk(pmsg->refs == 1 && pmsg->len == 5 && strcmp(pmsg->text, "hello") == 0,
+        "new message '%s'", pmsg->text);
+    caPutLogMsgAddRef(pmsg);
+    caPutLogMsgRelease(pmsg);
+    testOk1(pmsg->refs == 1);
+    caPutLogMsgRelease(pmsg);
+    caPutLogMsgRelease(NULL);
+}
+
+static void testFanOut(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", QUEUE_SIZE);
+    caPutLogSinkStats fastStats, slowStats;
+    caPutLogMsg *msgs[NMSG];
+    testSink fast, slow;
+    int i, shared, released;
+
+    testDiag("Fan out to a fast and a blocked sink");
+    testSinkInit(&fast, 0);
+    testSinkInit(&slow, 1);
+    /* one message per batch, so the slow sink only takes the first one */
+    caPutLogSinkSetBatch(plist, 0, 0.0);
+    testOk1(caPutLogSinkAddTransport(plist, "fast", &testTransport, &fast) == 0);
+    testOk1(caPutLogSinkAddTransport(plist, "slow", &testTransport, &slow) == 0);
+    testOk1(caPutLogSinkAddTransport(plist, "fast", &testTransport, &fast) == 0);
+    testOk1(caPutLogSinkCount(plist) == 2);
+
+    for (i = 0; i < NMSG; i++) {
+        char text[16];
+
+        sprintf(text, "message %d\n", i);
+        msgs[i] = caPutLogMsgCreate(text, strlen(text));
+        caPutLogSinkSend(plist, msgs[i]);
+        /* the slow sink has taken the first message and is stuck with it */
+        if (i == 0)
+            epicsEventMustWait(slow.entered);
+        /* the fast one keeps up */
+        epicsEventWaitWithTimeout(fast.entered, 5.0);
+    }
+
+    for (i = 0; i < 500 && epicsAtomicGetIntT(&fast.received) < NMSG; i++)
+        epicsThreadSleep(0.01);
+    testOk(fast.received == NMSG, "fast sink got %d of %d while the other one is blocked",
+        fast.received, NMSG);
+    caPutLogSinkGetStats(plist, 1, &slowStats);
+    testOk(slowStats.backlog == QUEUE_SIZE && slowStats.dropped == NMSG - 1 - QUEUE_SIZE,
+        "blocked sink: backlog %u, dropped %lu", slowStats.backlog,
+        (unsigned long)slowStats.dropped);
+    testOk1(caPutLogSinkFlush(plist, 0.1) == QUEUE_SIZE + 1);
+
+    epicsThreadSleep(0.05);
+    epicsAtomicSetIntT(&slow.blocking, 0);
+    epicsEventSignal(slow.gate);
+    testOk1(caPutLogSinkFlush(plist, 5.0) == 0);
+
+    caPutLogSinkGetStats(plist, 0, &fastStats);
+    caPutLogSinkGetStats(plist, 1, &slowStats);
+    testOk(fastStats.sent == NMSG && fastStats.dropped == 0, "fast sink: sent %lu",
+        (unsigned long)fastStats.sent);
+    testOk(slowStats.sent == QUEUE_SIZE + 1 && slowStats.backlog == 0
+        && slowStats.highWater == QUEUE_SIZE, "blocked sink: sent %lu, high water %u",
+        (unsigned long)slowStats.sent, slowStats.highWater);
+    testOk(slowStats.maxLag >= 0.05 && slowStats.maxLag >= fastStats.maxLag,
+        "lag fast %.3f ms, blocked %.3f ms", fastStats.maxLag * 1e3, slowStats.maxLag * 1e3);
+    testOk1(caPutLogSinkGetStats(plist, 2, &slowStats) == -1);
+
+    shared = 1;
+    for (i = 0; i < QUEUE_SIZE + 1; i++) {
+        if (fast.seen[i] != msgs[i] || slow.seen[i] != msgs[i])
+            shared = 0;
+    }
+    testOk(shared, "both sinks were handed the same buffers");
+
+    released = 1;
+    for (i = 0; i < NMSG; i++) {
+        if (msgs[i]->refs != 1)
+            released = 0;
+        caPutLogMsgRelease(msgs[i]);
+    }
+    testOk(released, "sinks have released their references");
+
+    caPutLogSinkListDestroy(plist);
+    testOk(fast.destroyed == 1 && slow.destroyed == 1, "transports destroyed");
+    for (i = 0; i < 2; i++) {
+        testSink *ptest = i ? &slow : &fast;
+
+        epicsEventDestroy(ptest->entered);
+        epicsEventDestroy(ptest->gate);
+    }
+}
+
+struct flushArgs {
+    caPutLogSinkList *plist;
+    unsigned        left;
+    int             finished;
+    epicsEventId    done;
+};
+
+static void flushThread(void *arg)
+{
+    struct flushArgs *pargs = (struct flushArgs *)arg;
+
+    pargs->left = caPutLogSinkFlush(pargs->plist, 5.0);
+    epicsAtomicSetIntT(&pargs->finished, 1);
+    epicsEventSignal(pargs->done);
+}
+
+static void testFlushBlocked(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", QUEUE_SIZE);
+    struct flushArgs args;
+    epicsTimeStamp t0, t1;
+    testSink slow;
+    double took;
+
+    testDiag("Sending while a flush waits for a blocked sink");
+    testSinkInit(&slow, 1);
+    caPutLogSinkSetBatch(plist, 0, 0.0);
+    caPutLogSinkAddTransport(plist, "slow", &testTransport, &slow);
+    caPutLogSinkSendText(plist, "first\n", 6);
+    epicsEventMustWait(slow.entered);
+
+    args.plist = plist;
+    args.finished = 0;
+    args.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("flushThread", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), flushThread, &args);
+    epicsThreadSleep(0.1);
+
+    epicsTimeGetCurrent(&t0);
+    caPutLogSinkSendText(plist, "second\n", 7);
+    caPutLogSinkCount(plist);
+    epicsTimeGetCurrent(&t1);
+    took = epicsTimeDiffInSeconds(&t1, &t0);
+    testOk(took < 0.5, "send took %.3f ms during the flush", took * 1e3);
+    testOk(!epicsAtomicGetIntT(&args.finished), "flush still waiting");
+
+    epicsAtomicSetIntT(&slow.blocking, 0);
+    epicsEventSignal(slow.gate);
+    epicsEventMustWait(args.done);
+    testOk(args.left == 0 && slow.received == 2, "flushed, %d messages sent",
+        slow.received);
+
+    caPutLogSinkListDestroy(plist);
+    epicsEventDestroy(args.done);
+    epicsEventDestroy(slow.entered);
+    epicsEventDestroy(slow.gate);
+}
+
+static void testBatch(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 0);
+    caPutLogSinkStats stats;
+    testSink batched;
+    epicsTimeStamp start, end;
+    const char text[] = "0123456789012345678901234567890123456789\n";
+    int i;
+
+    testDiag("Batches of up to 100 bytes, 0.5 s delay");
+    testSinkInit(&batched, 0);
+    caPutLogSinkSetBatch(plist, 100, 0.5);
+    caPutLogSinkAddTransport(plist, "batched", &testTransport, &batched);
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < 2; i++)
+        caPutLogSinkSendText(plist, text, sizeof(text) - 1);
+    testOk(epicsEventWaitWithTimeout(batched.entered, 0.2) == epicsEventWaitTimeout,
+        "a small batch is held back");
+    epicsEventMustWait(batched.entered);
+    epicsTimeGetCurrent(&end);
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogSinkGetStats(plist, 0, &stats);
+    testOk(stats.sent == 2 && stats.batches == 1 && epicsTimeDiffInSeconds(&end, &start) >= 0.4,
+        "sent %lu in %lu batches after %.3f s", (unsigned long)stats.sent,
+        (unsigned long)stats.batches, epicsTimeDiffInSeconds(&end, &start));
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < 5; i++)
+        caPutLogSinkSendText(plist, text, sizeof(text) - 1);
+    epicsEventMustWait(batched.entered);
+    epicsTimeGetCurrent(&end);
+    testOk(epicsTimeDiffInSeconds(&end, &start) < 0.4,
+        "a full batch goes right away (%.3f s)", epicsTimeDiffInSeconds(&end, &start));
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogSinkGetStats(plist, 0, &stats);
+    testOk(stats.sent == 7 && stats.batches == 4, "sent %lu in %lu batches",
+        (unsigned long)stats.sent, (unsigned long)stats.batches);
+
+    caPutLogSinkListDestroy(plist);
+    epicsEventDestroy(batched.entered);
+    epicsEventDestroy(batched.gate);
+}
+
+/* Send keys 0..29 and count what each of the 3 sinks got */
+static void sendKeys(caPutLogSinkList *plist, testSink *sinks, int *counts)
+{
+    unsigned key;
+    int i;
+
+    for (i = 0; i < 3; i++)
+        epicsAtomicSetIntT(&sinks[i].received, 0);
+    for (key = 0; key < 30; key++)
+        caPutLogSinkSendTextKeyed(plist, "message\n", 8, key);
+    caPutLogSinkFlush(plist, 5.0);
+    for (i = 0; i < 3; i++)
+        counts[i] = epicsAtomicGetIntT(&sinks[i].received);
+}
+
+static void testSharded(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 0);
+    caPutLogSinkStats stats;
+    testSink sinks[3];
+    int counts[3], i;
+
+    testDiag("Sharded over 3 sinks");
+    caPutLogSinkSetBatch(plist, 0, 0.0);
+    for (i = 0; i < 3; i++) {
+        char name[8];
+
+        testSinkInit(&sinks[i], 0);
+        sprintf(name, "shard%d", i);
+        caPutLogSinkAddTransport(plist, name, &healthTransport, &sinks[i]);
+    }
+    testOk(caPutLogSinkKey("test:rec.VAL") == caPutLogSinkKey("test:rec") &&
+        caPutLogSinkKey("test:rec") != caPutLogSinkKey("test:rec2"),
+        "key by record name, fields alike");
+
+    caPutLogSinkSetCopies(plist, 1);
+    sendKeys(plist, sinks, counts);
+    testOk(counts[0] == 10 && counts[1] == 10 && counts[2] == 10,
+        "one copy: %d, %d, %d messages", counts[0], counts[1], counts[2]);
+
+    epicsAtomicSetIntT(&sinks[1].down, 1);
+    sendKeys(plist, sinks, counts);
+    caPutLogSinkGetStats(plist, 2, &stats);
+    testOk(counts[0] == 10 && counts[1] == 0 && counts[2] == 20 && stats.failover == 10,
+        "second sink down: %d, %d, %d messages, %lu taken over", counts[0], counts[1],
+        counts[2], (unsigned long)stats.failover);
+
+    caPutLogSinkSetCopies(plist, 2);
+    sendKeys(plist, sinks, counts);
+    testOk(counts[0] == 30 && counts[1] == 0 && counts[2] == 30,
+        "two copies, one sink down: %d, %d, %d messages", counts[0], counts[1], counts[2]);
+
+    epicsAtomicSetIntT(&sinks[1].down, 0);
+    sendKeys(plist, sinks, counts);
+    testOk(counts[0] == 20 && counts[1] == 20 && counts[2] == 20,
+        "two copies: %d, %d, %d messages", counts[0], counts[1], counts[2]);
+
+    caPutLogSinkSetCopies(plist, 3);
+    sendKeys(plist, sinks, counts);
+    testOk(counts[0] == 30 && counts[1] == 30 && counts[2] == 30,
+        "as many copies as sinks: all get %d, %d, %d", counts[0], counts[1], counts[2]);
+
+    caPutLogSinkListDestroy(plist);
+    for (i = 0; i < 3; i++) {
+        epicsEventDestroy(sinks[i].entered);
+        epicsEventDestroy(sinks[i].gate);
+    }
+}
+
+MAIN(caPutLogSinkTest)
+{
+    testPlan(30);
+    testRefs();
+    testFanOut();
+    testFlushBlocked();
+    testBatch();
+    testSharded();
+    return testDone();
+}
@@ -0,0 +1,229 @@
+/* File:     caPutLogSpoolTest.c
+ *
+ * Unit tests for the disk spool against a stand-in log server on the
+ * loopback interface that is killed and restored: messages sent while it
+ * is gone are spooled and replayed in order, with acknowledgements the
+ * replay resumes after the last message acknowledged, the spool survives
+ * a restart, and the replay keeps to its rate.
+ *
+ * Works in the current directory, on the file caPutLogSpoolTest.spool.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <osiSock.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogTcp.h"
+
+#define SPOOL "caPutLogSpoolTest.spool"
+
+static osiSockAddr serverAddr;
+static SOCKET listener = INVALID_SOCKET;
+
+/* The stand-in server's socket comes and goes */
+static void restoreServer(void)
+{
+    osiSocklen_t len = sizeof(serverAddr);
+
+    listener = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET)
+        testAbort("socket creation failed");
+    epicsSocketEnableAddressReuseDuringTimeWaitState(listener);
+    if (bind(listener, &serverAddr.sa, sizeof(serverAddr.ia)) || listen(listener, 1)
+            || getsockname(listener, &serverAddr.sa, &len))
+        testAbort("cannot listen on the loopback interface");
+}
+
+static void killServer(SOCKET *pconn)
+{
+    if (*pconn != INVALID_SOCKET)
+        epicsSocketDestroy(*pconn);
+    *pconn = INVALID_SOCKET;
+    if (listener != INVALID_SOCKET)
+        epicsSocketDestroy(listener);
+    listener = INVALID_SOCKET;
+}
+
+static int readable(SOCKET sock, double timeout)
+{
+    fd_set fds;
+    struct timeval tv;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    tv.tv_sec = (long)timeout;
+    tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+    return select((int)sock + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+static SOCKET accept1(double timeout)
+{
+    osiSockAddr peer;
+    osiSocklen_t len = sizeof(peer);
+
+    return readable(listener, timeout) ? epicsSocketAccept(listener, &peer.sa, &len)
+        : INVALID_SOCKET;
+}
+
+/* Read until len bytes have arrived or nothing comes for a second */
+static size_t receive(SOCKET sock, char *buf, size_t len)
+{
+    size_t got = 0;
+
+    while (sock != INVALID_SOCKET && got < len && readable(sock, 1.0)) {
+        int n = recv(sock, buf + got, (int)(len - got), 0);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    buf[got] = 0;
+    return got;
+}
+
+static void ack(SOCKET sock, unsigned count)
+{
+    char line[32];
+
+    sprintf(line, "ACK %u\n", count);
+    send(sock, line, (int)strlen(line), 0);
+}
+
+static void sendMsgs(caPutLogSinkList *plist, unsigned first, unsigned last)
+{
+    char text[16];
+
+    for (; first <= last; first++) {
+        sprintf(text, "m%u\n", first);
+        caPutLogSinkSendText(plist, text, strlen(text));
+    }
+}
+
+static void expected(char *buf, unsigned first, unsigned last)
+{
+    for (buf[0] = 0; first <= last; first++)
+        sprintf(buf + strlen(buf), "m%u\n", first);
+}
+
+/* Wait until the spool holds msgs messages */
+static unsigned spooled(caPutLogTcp *ptcp, unsigned msgs)
+{
+    caPutLogTcpStats stats;
+    int i;
+
+    for (i = 0; i < 500; i++) {
+        caPutLogTcpGetStats(ptcp, &stats);
+        if (stats.spoolMsgs == msgs)
+            break;
+        epicsThreadSleep(0.01);
+    }
+    return stats.spoolMsgs;
+}
+
+static caPutLogSinkList *start(caPutLogTcp **pptcp, double rate, int ack)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 100);
+
+    *pptcp = caPutLogTcpCreate(&serverAddr.ia, "stand-in");
+    if (caPutLogTcpSetSpool(*pptcp, SPOOL, 4096, rate, ack))
+        testAbort("cannot open " SPOOL);
+    caPutLogSinkAddTransport(plist, "stand-in", &caPutLogTcpTransport, *pptcp);
+    return plist;
+}
+
+MAIN(caPutLogSpoolTest)
+{
+    caPutLogSinkList *plist;
+    caPutLogTcp *ptcp;
+    caPutLogTcpStats stats;
+    SOCKET conn = INVALID_SOCKET;
+    epicsTimeStamp t0, t1;
+    char buf[512], want[512];
+    double seconds;
+
+    testPlan(13);
+    osiSockAttach();
+    remove(SPOOL);
+
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.ia.sin_family = AF_INET;
+    serverAddr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    restoreServer();
+
+    testDiag("Acknowledged delivery");
+    plist = start(&ptcp, 0.0, 1);
+    sendMsgs(plist, 1, 3);
+    conn = accept1(5.0);
+    receive(conn, buf, 9);
+    testOk(strcmp(buf, "m1\nm2\nm3\n") == 0, "received '%s'", buf);
+    testOk(spooled(ptcp, 3) == 3, "kept until acknowledged");
+    ack(conn, 3);
+    testOk(spooled(ptcp, 0) == 0, "acknowledged messages leave the spool");
+
+    testDiag("Server killed");
+    killServer(&conn);
+    sendMsgs(plist, 4, 8);
+    testOk(spooled(ptcp, 5) == 5, "5 messages spooled");
+
+    testDiag("Server restored");
+    restoreServer();
+    conn = accept1(35.0);
+    expected(want, 4, 8);
+    receive(conn, buf, strlen(want));
+    testOk(strcmp(buf, want) == 0, "replayed in order");
+    ack(conn, 2);
+    testOk(spooled(ptcp, 3) == 3, "2 acknowledged, 3 left");
+
+    testDiag("Connection lost before the rest was acknowledged");
+    epicsSocketDestroy(conn);
+    conn = accept1(35.0);
+    expected(want, 6, 8);
+    receive(conn, buf, strlen(want));
+    testOk(strcmp(buf, want) == 0, "replay resumes after the last acknowledged message");
+    ack(conn, 3);
+    testOk(spooled(ptcp, 0) == 0, "spool empty");
+    caPutLogTcpGetStats(ptcp, &stats);
+    testOk(stats.replayed >= 8 && stats.spoolDropped == 0 && stats.msgsDropped == 0,
+        "%lu replayed, nothing dropped", (unsigned long)stats.replayed);
+
+    testDiag("IOC restart");
+    killServer(&conn);
+    sendMsgs(plist, 9, 10);
+    spooled(ptcp, 2);
+    caPutLogSinkListDestroy(plist);
+    plist = start(&ptcp, 0.0, 1);
+    caPutLogTcpGetStats(ptcp, &stats);
+    testOk(stats.spoolMsgs == 2, "%u messages still spooled", stats.spoolMsgs);
+    restoreServer();
+    conn = accept1(5.0);
+    receive(conn, buf, 8);
+    testOk(strcmp(buf, "m9\nm10\n") == 0, "replayed after the restart");
+    ack(conn, 2);
+    spooled(ptcp, 0);
+    caPutLogSinkListDestroy(plist);
+
+    testDiag("Replay rate without acknowledgements");
+    killServer(&conn);
+    plist = start(&ptcp, 50.0, 0);
+    sendMsgs(plist, 1, 20);
+    spooled(ptcp, 20);
+    restoreServer();
+    conn = accept1(35.0);
+    epicsTimeGetCurrent(&t0);
+    expected(want, 1, 20);
+    receive(conn, buf, strlen(want));
+    epicsTimeGetCurrent(&t1);
+    seconds = epicsTimeDiffInSeconds(&t1, &t0);
+    testOk(strcmp(buf, want) == 0, "replayed in order");
+    testOk(seconds > 0.25, "20 messages at 50/s took %.2f s", seconds);
+
+    caPutLogSinkListDestroy(plist);
+    killServer(&conn);
+    remove(SPOOL);
+    return testDone();
+}
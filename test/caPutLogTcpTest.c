@@ -0,0 +1,151 @@
+/* File:     caPutLogTcpTest.c
+ *
+ * Unit tests for the TCP transport against a server on the loopback
+ * interface: messages arrive in order, messages sent while the server
+ * is gone are dropped and counted, and the connection comes back when
+ * the server does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <osiSock.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogTcp.h"
+
+static osiSockAddr serverAddr;
+
+static SOCKET listenOn(void)
+{
+    SOCKET sock = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    osiSocklen_t len = sizeof(serverAddr);
+
+    if (sock == INVALID_SOCKET)
+        testAbort("socket creation failed");
+    epicsSocketEnableAddressReuseDuringTimeWaitState(sock);
+    if (bind(sock, &serverAddr.sa, sizeof(serverAddr.ia)) || listen(sock, 1)
+            || getsockname(sock, &serverAddr.sa, &len))
+        testAbort("cannot listen on the loopback interface");
+    return sock;
+}
+
+static int readable(SOCKET sock, double timeout)
+{
+    fd_set fds;
+    struct timeval tv;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    tv.tv_sec = (long)timeout;
+    tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+    return select((int)sock + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+/* Read until len bytes have arrived or nothing comes for a second */
+static size_t receive(SOCKET sock, char *buf, size_t len)
+{
+    size_t got = 0;
+
+    while (got < len && readable(sock, 1.0)) {
+        int n = recv(sock, buf + got, (int)(len - got), 0);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    buf[got] = 0;
+    return got;
+}
+
+static void sendText(caPutLogSinkList *plist, const char *text)
+{
+    caPutLogSinkSendText(plist, text, strlen(text));
+}
+
+MAIN(caPutLogTcpTest)
+{
+    caPutLogSinkList *plist;
+    caPutLogTcp *ptcp;
+    caPutLogTcpStats stats;
+    caPutLogSinkStats sinkStats;
+    SOCKET listener, conn;
+    osiSockAddr peer;
+    osiSocklen_t peerLen = sizeof(peer);
+    char buf[256];
+    const char expected[] = "first\nsecond\nthird\n";
+    int i, sent;
+
+    testPlan(10);
+    osiSockAttach();
+
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.ia.sin_family = AF_INET;
+    serverAddr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = listenOn();
+
+    plist = caPutLogSinkListCreate("test", 100);
+    ptcp = caPutLogTcpCreate(&serverAddr.ia, "loopback");
+    caPutLogSinkAddTransport(plist, "loopback", &caPutLogTcpTransport, ptcp);
+
+    testDiag("Messages go out in order");
+    sendText(plist, "first\n");
+    sendText(plist, "second\n");
+    sendText(plist, "third\n");
+    conn = readable(listener, 5.0) ? epicsSocketAccept(listener, &peer.sa, &peerLen)
+        : INVALID_SOCKET;
+    testOk(conn != INVALID_SOCKET, "connection accepted");
+    receive(conn, buf, strlen(expected));
+    testOk(strcmp(buf, expected) == 0, "received '%s'", buf);
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogTcpGetStats(ptcp, &stats);
+    testOk(stats.connected && stats.connects == 1 && stats.msgsSent == 3
+        && stats.bytesSent == strlen(expected), "%u connects, %lu messages, %lu bytes",
+        stats.connects, (unsigned long)stats.msgsSent, (unsigned long)stats.bytesSent);
+
+    testDiag("Server gone");
+    epicsSocketDestroy(conn);
+    epicsSocketDestroy(listener);
+    epicsThreadSleep(0.1);
+    sendText(plist, "lost\n");
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogTcpGetStats(ptcp, &stats);
+    testOk(!stats.connected && stats.disconnects == 1, "disconnected");
+    testOk(stats.msgsDropped == 1 && stats.bytesDropped == 5 && stats.backoff >= 0.5,
+        "dropped %lu messages, %lu bytes, retry in %g s", (unsigned long)stats.msgsDropped,
+        (unsigned long)stats.bytesDropped, stats.backoff);
+    caPutLogSinkGetStats(plist, 0, &sinkStats);
+    testOk(sinkStats.failed == 1, "sink counts %lu failed", (unsigned long)sinkStats.failed);
+
+    testDiag("Server back");
+    listener = listenOn();
+    conn = INVALID_SOCKET;
+    for (sent = 0; sent < 100 && conn == INVALID_SOCKET; sent++) {
+        sendText(plist, "again\n");
+        if (readable(listener, 0.1))
+            conn = epicsSocketAccept(listener, &peer.sa, &peerLen);
+    }
+    testOk(conn != INVALID_SOCKET, "reconnected after %d messages", sent);
+    /* idle() may have reconnected before any of them went out */
+    sendText(plist, "again\n");
+    sent++;
+    caPutLogSinkFlush(plist, 5.0);
+    caPutLogTcpGetStats(ptcp, &stats);
+    testOk(stats.connected && stats.connects == 2 && stats.backoff == 0.0, "connected again");
+
+    i = (int)receive(conn, buf, sizeof(buf) - 1);
+    testOk(i > 0 && i % 6 == 0 && strncmp(buf, "again\n", 6) == 0,
+        "received %d messages", i / 6);
+    testOk(stats.msgsSent + stats.msgsDropped == 4 + (size_t)sent
+        && stats.bytesSent + stats.bytesDropped == strlen(expected) + 5 + 6 * (size_t)sent
+        && stats.msgsSent == 3 + (size_t)i / 6,
+        "every message is either sent or dropped");
+
+    caPutLogSinkListDestroy(plist);
+    epicsSocketDestroy(conn);
+    epicsSocketDestroy(listener);
+    return testDone();
+}
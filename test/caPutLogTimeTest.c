@@ -0,0 +1,93 @@
+/* File:     caPutLogTimeTest.c
+ *
+ * Unit tests for the cached time stamp formatting: for a set of formats
+ * and time stamps within and across seconds the result must be the same
+ * as what epicsTimeToStrftime() produces.
+ */
+
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogTime.h"
+
+static const char *formats[] = {
+    "%d-%b-%y %H:%M:%S",
+    "%Y-%m-%d %H:%M:%S.%03f",
+    "%H:%M:%S.%f",
+    "%09f|%1f|%06f",
+    "100%% at %H:%M:%S.%02f%%",
+    "{\"date\":\"%Y-%m-%d\",\"time\":\"%H:%M:%S.%03f\"",
+    "%f %f %f %f %f",   /* more fractions than the cache takes */
+    "",
+};
+
+static const epicsTimeStamp stamps[] = {
+    {1000000000, 0},
+    {1000000000, 123456789},
+    {1000000000, 999999999},
+    {1000000001, 5000000},
+    {1000000001, 5000001},
+    {999999999, 500000000},
+    {1000000000, 1},
+    {1100000000, 987654321},
+};
+
+#define NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+static void testFormats(void)
+{
+    size_t i, j;
+
+    testDiag("Same result as epicsTimeToStrftime");
+    for (i = 0; i < NELEM(formats); i++) {
+        caPutLogTimeCache cache;
+        int bad = 0;
+
+        caPutLogTimeCompile(&cache, formats[i], 0);
+        for (j = 0; j < NELEM(stamps); j++) {
+            char expected[caPutLogTimeMaxLen], buf[caPutLogTimeMaxLen];
+            size_t elen = epicsTimeToStrftime(expected, sizeof(expected), formats[i], &stamps[j]);
+            size_t len = caPutLogTimeFormat(&cache, buf, sizeof(buf), &stamps[j]);
+
+            if (len != elen || memcmp(buf, expected, len) != 0) {
+                if (!bad++)
+                    testDiag("expected '%s', got '%s'", expected, buf);
+            }
+        }
+        testOk(bad == 0, "'%s'", formats[i]);
+    }
+}
+
+static void testSpecial(void)
+{
+    caPutLogTimeCache cache;
+    char buf[caPutLogTimeMaxLen];
+    char longFormat[2 * caPutLogTimeMaxLen];
+    size_t len;
+
+    testDiag("UTC, fallback and small buffers");
+    testOk1(caPutLogTimeCompile(&cache, "%Y-%m-%dT%H:%M:%S.%06fZ", 1) == 0);
+    caPutLogTimeFormat(&cache, buf, sizeof(buf), &stamps[1]);
+    testOk(strcmp(buf, "2021-09-09T01:46:40.123456Z") == 0, "UTC: %s", buf);
+
+    testOk1(caPutLogTimeCompile(&cache, formats[6], 0) == -1);
+
+    memset(longFormat, 'x', sizeof(longFormat) - 1);
+    longFormat[sizeof(longFormat) - 1] = 0;
+    testOk1(caPutLogTimeCompile(&cache, longFormat, 0) == -1);
+
+    caPutLogTimeCompile(&cache, formats[1], 0);
+    len = caPutLogTimeFormat(&cache, buf, 10, &stamps[1]);
+    testOk(len == 0, "result longer than the buffer");
+}
+
+MAIN(caPutLogTimeTest)
+{
+    testPlan((int)NELEM(formats) + 5);
+    testFormats();
+    testSpecial();
+    return testDone();
+}
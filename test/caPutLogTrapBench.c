@@ -0,0 +1,171 @@
+/* File:     caPutLogTrapBench.c
+ *
+ * Latency of the access security trap (before-put plus after-put
+ * listener calls) on the CA server thread, converting with dbGetField
+ * versus raw capture (caPutLogRawCapture). Then the load the trap puts
+ * on the queue for a GUI that re-writes all its setpoints every cycle but
+ * changes only one, with and without freeing unchanged puts in the trap.
+ *
+ * Usage: caPutLogTrapBench [iterations]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dbAccess.h>
+#include <dbChannel.h>
+#include <dbUnitTest.h>
+#include <asDbLib.h>
+#include <asTrapWrite.h>
+#include <iocInit.h>
+#include <epicsTime.h>
+#include <errlog.h>
+
+#include "caPutLog.h"
+#include "caPutLogAs.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static const char *fields[] = {
+    "ao_DBF_FLOAT",
+    "longout_DBF_LONG",
+    "stringout_DBF_LINK",
+    "waveform_DBF_DOUBLE",
+    "lso_DBF_CHAR"
+};
+
+static unsigned long sentPuts, sentBytes;
+
+static void freeCallback(LOGDATA *plogData)
+{
+    sentPuts++;
+    sentBytes += (unsigned long)caPutLogDataSize(plogData);
+    caPutLogDataFree(plogData);
+}
+
+static double run(dbChannel *pch, int raw, int n)
+{
+    epicsTimeStamp start, end;
+    int i;
+
+    caPutLogRawCapture = raw;
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < n; i++) {
+        void *pvt = asTrapWriteBeforeWithData("user", "host", pch,
+            dbChannelFinalFieldType(pch), 1, NULL);
+        asTrapWriteAfterWrite(pvt);
+    }
+    epicsTimeGetCurrent(&end);
+    caPutLogRawCapture = 0;
+    return 1e9 * epicsTimeDiffInSeconds(&end, &start) / n;
+}
+
+#define GUI_FIELDS 4
+
+/* n cycles of the GUI writing all its fields, one of them changed */
+static double runGui(dbChannel *pch[], int n)
+{
+    epicsTimeStamp start, end;
+    epicsFloat64 value;
+    int i, j;
+
+    sentPuts = sentBytes = 0;
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < GUI_FIELDS; j++) {
+            void *pvt;
+
+            value = j == i % GUI_FIELDS ? i : j;
+            pvt = asTrapWriteBeforeWithData("user", "host", pch[j], DBR_DOUBLE, 1, &value);
+            dbPutField(&pch[j]->addr, DBR_DOUBLE, &value, 1);
+            asTrapWriteAfterWrite(pvt);
+        }
+    }
+    epicsTimeGetCurrent(&end);
+    return 1e9 * epicsTimeDiffInSeconds(&end, &start) / (n * GUI_FIELDS);
+}
+
+static void benchGui(int n)
+{
+    static const char *names[GUI_FIELDS] = {
+        "ao_DBF_FLOAT", "longout_DBF_LONG", "longout_DBF_SHORT", "waveform_DBF_DOUBLE"
+    };
+    static const int modes[] = { caPutLogAll, caPutLogOnChange };
+    dbChannel *pch[GUI_FIELDS];
+    unsigned i;
+
+    for (i = 0; i < GUI_FIELDS; i++) {
+        pch[i] = dbChannelCreate(names[i]);
+        if (!pch[i] || dbChannelOpen(pch[i])) {
+            fprintf(stderr, "can't open channel %s\n", names[i]);
+            return;
+        }
+    }
+    printf("\nGUI re-writing %d fields, one changed per cycle\n", GUI_FIELDS);
+    printf("%-22s %14s %14s %14s\n", "mode", "trap", "puts queued", "bytes queued");
+    for (i = 0; i < sizeof(modes)/sizeof(modes[0]); i++) {
+        double ns;
+
+        caPutLogAsSetMode(modes[i]);
+        ns = runGui(pch, n / GUI_FIELDS);
+        printf("%-22s %11.1f ns %14lu %14lu\n", modes[i] == caPutLogAll ? "all" : "on change",
+            ns, sentPuts, sentBytes);
+    }
+    caPutLogAsSetMode(caPutLogNone);
+    for (i = 0; i < GUI_FIELDS; i++)
+        dbChannelDelete(pch[i]);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    epicsFloat64 wf[256];
+    DBADDR addr;
+    unsigned i;
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("../caPutJsonLogTest.db", NULL, NULL);
+    asSetFilename("../asg.cfg");
+    eltc(0);
+    if (iocInit()) {
+        fprintf(stderr, "iocInit failed\n");
+        return 1;
+    }
+    eltc(1);
+
+    if (caPutLogAsInit(freeCallback, NULL)) {
+        fprintf(stderr, "caPutLogAsInit failed\n");
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(wf)/sizeof(wf[0]); i++)
+        wf[i] = i;
+    if (!dbNameToAddr("waveform_DBF_DOUBLE", &addr))
+        dbPutField(&addr, DBR_DOUBLE, wf, sizeof(wf)/sizeof(wf[0]));
+    if (!dbNameToAddr("lso_DBF_CHAR", &addr))
+        dbPutField(&addr, DBR_STRING, "a string value", 1);
+
+    printf("%-22s %14s %14s\n", "field", "dbGetField", "raw capture");
+    for (i = 0; i < sizeof(fields)/sizeof(fields[0]); i++) {
+        dbChannel *pch = dbChannelCreate(fields[i]);
+        double conv, raw;
+
+        if (!pch || dbChannelOpen(pch)) {
+            fprintf(stderr, "can't open channel %s\n", fields[i]);
+            return 1;
+        }
+        run(pch, 0, n / 10 + 1);        /* warm up the free lists */
+        conv = run(pch, 0, n);
+        raw = run(pch, 1, n);
+        printf("%-22s %11.1f ns %11.1f ns\n", fields[i], conv, raw);
+        dbChannelDelete(pch);
+    }
+    benchGui(n);
+
+    caPutLogAsStop();
+    iocShutdown();
+    testdbCleanup();
+    return 0;
+}
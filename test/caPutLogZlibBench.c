@@ -0,0 +1,117 @@
+/* File:     caPutLogZlibBench.c
+ *
+ * Compression benchmark: JSON lines like the JSON logger writes go to a
+ * stand-in server on the loopback interface, plain and at several zlib
+ * levels, in batches as the sink's thread would hand them over.
+ *
+ * Usage: caPutLogZlibBench [-n messages] [-b batch size]
+ *
+ * For each setting the bytes on the wire per message, their share of the
+ * plain text, and the CPU time per message of the sending thread are
+ * reported (wall clock time where thread CPU time is not available).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <osiSock.h>
+#include <epicsTime.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogTcp.h"
+#include "caPutLogZlibServer.h"
+
+static const int levels[] = {-1, 1, 3, 6, 9};   /* -1: plain */
+
+static double cpuSeconds(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    return now.secPastEpoch + now.nsec * 1e-9;
+#endif
+}
+
+static void run(int level, caPutLogMsg **msgs, int nmsgs, int batch, size_t bytes)
+{
+    osiSockAddr addr;
+    zlibServer *psrv = zlibServerStart(&addr, level >= 0, 0);
+    caPutLogTcp *ptcp = caPutLogTcpCreate(&addr.ia, "bench");
+    caPutLogTcpStats stats;
+    double start, cpu;
+    int i;
+
+    if (level >= 0 && caPutLogTcpSetCompression(ptcp, level))
+        exit(1);
+    start = cpuSeconds();
+    for (i = 0; i < nmsgs; i += batch)
+        caPutLogTcpTransport.send(ptcp, msgs + i, nmsgs - i < batch ? nmsgs - i : batch);
+    cpu = cpuSeconds() - start;
+    zlibServerWait(psrv, bytes, 60.0);
+
+    caPutLogTcpGetStats(ptcp, &stats);
+    if (level < 0)
+        printf("%-8s", "plain");
+    else
+        printf("%-8d", level);
+    printf(" | %10.1f %8.1f%% | %10.3f | %7lu\n", (double)stats.wireBytes / nmsgs,
+        100.0 * stats.wireBytes / bytes, cpu / nmsgs * 1e6,
+        (unsigned long)stats.msgsDropped);
+    caPutLogTcpTransport.destroy(ptcp);
+    zlibServerStop(psrv);
+}
+
+int main(int argc, char *argv[])
+{
+    int nmsgs = 100000, batch = 16, i;
+    caPutLogMsg **msgs;
+    size_t bytes = 0;
+    char line[512];
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            nmsgs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            batch = atoi(argv[++i]);
+        else
+            break;
+    }
+    if (i < argc || nmsgs < 1 || batch < 1 || batch > caPutLogSinkMaxBatch) {
+        fprintf(stderr, "usage: %s [-n messages] [-b batch size, 1..%d]\n", argv[0],
+            caPutLogSinkMaxBatch);
+        return 1;
+    }
+    osiSockAttach();
+
+    msgs = calloc(nmsgs, sizeof(caPutLogMsg *));
+    for (i = 0; i < nmsgs; i++) {
+        sprintf(line, "{\"date\":\"2026-10-17\",\"time\":\"%02d:%02d:%02d.%03d\","
+            "\"host\":\"opi%02d.ctrl.example.org\",\"user\":\"operator%d\","
+            "\"pv\":\"SR%02d:RF:CAV%d:AMPL\",\"new\":%.4f,\"old\":%.4f,"
+            "\"metadata\":{\"facility\":\"example\",\"area\":\"storage ring\"}}\n",
+            i / 3600000 % 24, i / 60000 % 60, i / 1000 % 60, i % 1000, i % 17, i % 5,
+            i % 24, i % 4, 1.5 + (i % 1000) * 1e-4, 1.5 + (i % 1000 - 1) * 1e-4);
+        msgs[i] = caPutLogMsgCreate(line, strlen(line));
+        bytes += msgs[i]->len;
+    }
+
+    printf("%d messages of %.1f bytes on average, batches of %d\n\n", nmsgs,
+        (double)bytes / nmsgs, batch);
+    printf("%-8s | %10s %9s | %10s | %7s\n", "level", "wire B/msg", "of plain",
+        "CPU us/msg", "dropped");
+    for (i = 0; i < (int)(sizeof(levels) / sizeof(levels[0])); i++)
+        run(levels[i], msgs, nmsgs, batch, bytes);
+
+    for (i = 0; i < nmsgs; i++)
+        caPutLogMsgRelease(msgs[i]);
+    free(msgs);
+    return 0;
+}
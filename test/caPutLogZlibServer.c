@@ -0,0 +1,206 @@
+/* File:     caPutLogZlibServer.c
+ *
+ * Stand-in log server for zlib:// connections, see caPutLogZlibServer.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <osiSock.h>
+#include <epicsAtomic.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <cantProceed.h>
+
+#include "caPutLogZlibServer.h"
+
+struct zlibServer {
+    SOCKET          listener;
+    SOCKET          conn;
+    z_stream        z;
+    int             compressed;
+    int             keep;
+    char            *text;
+    size_t          cap;
+    int             drop;
+    int             stop;
+    epicsMutexId    lock;
+    epicsEventId    done;
+    zlibServerStats stats;
+};
+
+static int readable(SOCKET sock, double timeout)
+{
+    fd_set fds;
+    struct timeval tv;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    tv.tv_sec = (long)timeout;
+    tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+    return select((int)sock + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+static void closeConn(zlibServer *psrv)
+{
+    if (psrv->conn != INVALID_SOCKET)
+        epicsSocketDestroy(psrv->conn);
+    psrv->conn = INVALID_SOCKET;
+}
+
+static void append(zlibServer *psrv, const unsigned char *data, size_t len)
+{
+    epicsMutexMustLock(psrv->lock);
+    if (psrv->keep) {
+        if (psrv->stats.textBytes + len + 1 > psrv->cap) {
+            while (psrv->stats.textBytes + len + 1 > psrv->cap)
+                psrv->cap *= 2;
+            psrv->text = realloc(psrv->text, psrv->cap);
+            if (!psrv->text)
+                cantProceed("zlibServer: out of memory\n");
+        }
+        memcpy(psrv->text + psrv->stats.textBytes, data, len);
+        psrv->text[psrv->stats.textBytes + len] = 0;
+    }
+    psrv->stats.textBytes += len;
+    epicsMutexUnlock(psrv->lock);
+}
+
+/* Inflate what arrived, -1 if it is not a zlib stream */
+static int inflateData(zlibServer *psrv, unsigned char *data, size_t len)
+{
+    unsigned char out[16384];
+    int status;
+
+    psrv->z.next_in = data;
+    psrv->z.avail_in = (uInt)len;
+    do {
+        psrv->z.next_out = out;
+        psrv->z.avail_out = sizeof(out);
+        status = inflate(&psrv->z, Z_SYNC_FLUSH);
+        append(psrv, out, sizeof(out) - psrv->z.avail_out);
+    } while (status == Z_OK && (psrv->z.avail_in || psrv->z.avail_out == 0));
+    return status == Z_OK || status == Z_BUF_ERROR ? 0 : -1;
+}
+
+static void serve(void *arg)
+{
+    zlibServer *psrv = (zlibServer *)arg;
+    unsigned char buf[16384];
+
+    while (!epicsAtomicGetIntT(&psrv->stop)) {
+        if (epicsAtomicGetIntT(&psrv->drop)) {
+            closeConn(psrv);
+            epicsAtomicSetIntT(&psrv->drop, 0);
+        }
+        if (readable(psrv->listener, psrv->conn == INVALID_SOCKET ? 0.05 : 0.0)) {
+            osiSockAddr peer;
+            osiSocklen_t len = sizeof(peer);
+
+            closeConn(psrv);
+            psrv->conn = epicsSocketAccept(psrv->listener, &peer.sa, &len);
+            inflateReset(&psrv->z);
+            epicsMutexMustLock(psrv->lock);
+            psrv->stats.connections++;
+            epicsMutexUnlock(psrv->lock);
+        }
+        if (psrv->conn != INVALID_SOCKET && readable(psrv->conn, 0.05)) {
+            int n = recv(psrv->conn, (char *)buf, sizeof(buf), 0);
+
+            if (n <= 0) {
+                closeConn(psrv);
+                continue;
+            }
+            epicsMutexMustLock(psrv->lock);
+            psrv->stats.wireBytes += n;
+            epicsMutexUnlock(psrv->lock);
+            if (!psrv->compressed) {
+                append(psrv, buf, n);
+            } else if (inflateData(psrv, buf, n)) {
+                epicsMutexMustLock(psrv->lock);
+                psrv->stats.errors++;
+                epicsMutexUnlock(psrv->lock);
+                closeConn(psrv);
+            }
+        }
+    }
+    closeConn(psrv);
+    epicsEventSignal(psrv->done);
+}
+
+zlibServer *zlibServerStart(osiSockAddr *paddr, int compressed, int keep)
+{
+    zlibServer *psrv = callocMustSucceed(1, sizeof(zlibServer), "zlibServerStart");
+    osiSocklen_t len = sizeof(*paddr);
+
+    memset(paddr, 0, sizeof(*paddr));
+    paddr->ia.sin_family = AF_INET;
+    paddr->ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    psrv->listener = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (psrv->listener == INVALID_SOCKET
+            || bind(psrv->listener, &paddr->sa, sizeof(paddr->ia))
+            || listen(psrv->listener, 1) || getsockname(psrv->listener, &paddr->sa, &len))
+        cantProceed("zlibServer: cannot listen on the loopback interface\n");
+    psrv->conn = INVALID_SOCKET;
+    if (inflateInit(&psrv->z) != Z_OK)
+        cantProceed("zlibServer: inflateInit failed\n");
+    psrv->compressed = compressed;
+    psrv->keep = keep;
+    psrv->cap = 65536;
+    psrv->text = callocMustSucceed(1, psrv->cap, "zlibServerStart");
+    psrv->lock = epicsMutexMustCreate();
+    psrv->done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("zlibServer", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackMedium), serve, psrv);
+    return psrv;
+}
+
+void zlibServerDrop(zlibServer *psrv)
+{
+    epicsAtomicSetIntT(&psrv->drop, 1);
+    while (epicsAtomicGetIntT(&psrv->drop))
+        epicsThreadSleep(0.01);
+}
+
+size_t zlibServerWait(zlibServer *psrv, size_t bytes, double timeout)
+{
+    epicsTimeStamp start, now;
+    zlibServerStats stats;
+
+    epicsTimeGetCurrent(&start);
+    for (;;) {
+        zlibServerGetStats(psrv, &stats);
+        epicsTimeGetCurrent(&now);
+        if (stats.textBytes >= bytes || epicsTimeDiffInSeconds(&now, &start) > timeout)
+            return stats.textBytes;
+        epicsThreadSleep(0.01);
+    }
+}
+
+void zlibServerGetStats(zlibServer *psrv, zlibServerStats *pstats)
+{
+    epicsMutexMustLock(psrv->lock);
+    *pstats = psrv->stats;
+    epicsMutexUnlock(psrv->lock);
+}
+
+const char *zlibServerText(zlibServer *psrv)
+{
+    return psrv->text;
+}
+
+void zlibServerStop(zlibServer *psrv)
+{
+    epicsAtomicSetIntT(&psrv->stop, 1);
+    epicsEventMustWait(psrv->done);
+    epicsSocketDestroy(psrv->listener);
+    inflateEnd(&psrv->z);
+    epicsEventDestroy(psrv->done);
+    epicsMutexDestroy(psrv->lock);
+    free(psrv->text);
+    free(psrv);
+}
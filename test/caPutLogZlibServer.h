@@ -0,0 +1,41 @@
+/* File:     caPutLogZlibServer.h
+ *
+ * Stand-in log server for zlib:// connections, for the tests and the
+ * benchmark: a thread accepts one connection at a time on the loopback
+ * interface and inflates what arrives, starting a new stream with each
+ * connection as the transport does.
+ */
+
+#ifndef INCcaPutLogZlibServerh
+#define INCcaPutLogZlibServerh 1
+
+#include <stddef.h>
+#include <osiSock.h>
+
+typedef struct zlibServer zlibServer;
+
+typedef struct {
+    unsigned    connections;
+    size_t      wireBytes;      /* received */
+    size_t      textBytes;      /* inflated from them */
+    unsigned    errors;         /* streams that did not inflate */
+} zlibServerStats;
+
+/* Listen on a free port, written to *paddr; compressed: inflate what
+   arrives, else take it as it is; keep: collect the text */
+zlibServer *zlibServerStart(osiSockAddr *paddr, int compressed, int keep);
+
+/* Close the current connection as if the server had gone */
+void zlibServerDrop(zlibServer *psrv);
+
+/* Wait up to timeout seconds for textBytes to reach bytes; returns them */
+size_t zlibServerWait(zlibServer *psrv, size_t bytes, double timeout);
+
+void zlibServerGetStats(zlibServer *psrv, zlibServerStats *pstats);
+
+/* What was inflated so far, NUL terminated (with keep) */
+const char *zlibServerText(zlibServer *psrv);
+
+void zlibServerStop(zlibServer *psrv);
+
+#endif /*INCcaPutLogZlibServerh*/
@@ -0,0 +1,148 @@
+/* File:     caPutLogZlibTest.c
+ *
+ * Unit tests for compressed connections against a stand-in server that
+ * inflates what it receives: the lines arrive unchanged and in order,
+ * much smaller on the wire, a new stream is started after a reconnect,
+ * batches larger than the deflate buffer go out whole, and zlib://
+ * addresses select it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <osiSock.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "caPutLogSink.h"
+#include "caPutLogTcp.h"
+#include "caPutLogZlibServer.h"
+
+static char expected[1000000];
+
+/* The same keys, hosts and users on every line, as the JSON logger has */
+static void sendLines(caPutLogSinkList *plist, int first, int last)
+{
+    char line[256];
+
+    for (; first <= last; first++) {
+        sprintf(line, "{\"date\":\"2026-10-17\",\"time\":\"12:00:%02d.%03d\","
+            "\"host\":\"opi%d.example.org\",\"user\":\"operator\","
+            "\"pv\":\"SR:RF:CAV%d:AMPL\",\"new\":%d,\"old\":%d}\n",
+            first / 1000 % 60, first % 1000, first % 3, first % 8, first, first - 1);
+        caPutLogSinkSendText(plist, line, strlen(line));
+        strcat(expected, line);
+    }
+}
+
+static void testStream(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 1000);
+    osiSockAddr addr;
+    zlibServer *psrv = zlibServerStart(&addr, 1, 1);
+    caPutLogTcp *ptcp = caPutLogTcpCreate(&addr.ia, "stand-in");
+    caPutLogTcpStats stats;
+    zlibServerStats srvStats;
+
+    testDiag("Compressed stream");
+    expected[0] = 0;
+    testOk1(caPutLogTcpSetCompression(ptcp, 6) == 0);
+    caPutLogSinkAddTransport(plist, "stand-in", &caPutLogTcpTransport, ptcp);
+    sendLines(plist, 1, 200);
+    caPutLogSinkFlush(plist, 5.0);
+    zlibServerWait(psrv, strlen(expected), 5.0);
+    testOk(strcmp(zlibServerText(psrv), expected) == 0, "%lu bytes inflated as sent",
+        (unsigned long)strlen(zlibServerText(psrv)));
+    caPutLogTcpGetStats(ptcp, &stats);
+    zlibServerGetStats(psrv, &srvStats);
+    testOk(stats.msgsSent == 200 && stats.bytesSent == strlen(expected) &&
+        stats.wireBytes == srvStats.wireBytes, "sent %lu messages, %lu bytes",
+        (unsigned long)stats.msgsSent, (unsigned long)stats.bytesSent);
+    testOk(stats.wireBytes * 4 < stats.bytesSent, "%lu bytes on the wire",
+        (unsigned long)stats.wireBytes);
+
+    testDiag("Reconnect");
+    zlibServerDrop(psrv);
+    epicsThreadSleep(0.1);
+    sendLines(plist, 201, 300);
+    caPutLogSinkFlush(plist, 5.0);
+    zlibServerWait(psrv, strlen(expected), 5.0);
+    zlibServerGetStats(psrv, &srvStats);
+    testOk(srvStats.connections == 2 && srvStats.errors == 0,
+        "%u connections, %u streams that did not inflate", srvStats.connections,
+        srvStats.errors);
+    testOk(strcmp(zlibServerText(psrv), expected) == 0, "new stream after the reconnect");
+
+    caPutLogSinkListDestroy(plist);
+    zlibServerStop(psrv);
+}
+
+static void testLargeBatch(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 1000);
+    osiSockAddr addr;
+    zlibServer *psrv = zlibServerStart(&addr, 1, 1);
+    caPutLogTcp *ptcp = caPutLogTcpCreate(&addr.ia, "stand-in");
+    caPutLogSinkStats sinkStats;
+    char line[1010];
+    int i, j;
+
+    testDiag("Batches that do not compress");
+    expected[0] = 0;
+    caPutLogTcpSetCompression(ptcp, 1);
+    caPutLogSinkSetBatch(plist, 1000000, 0.2);
+    caPutLogSinkAddTransport(plist, "stand-in", &caPutLogTcpTransport, ptcp);
+    srand(1);
+    for (i = 0; i < 100; i++) {
+        for (j = 0; j < 1000; j++)
+            line[j] = 'A' + rand() % 58;
+        line[1000] = '\n';
+        line[1001] = 0;
+        caPutLogSinkSendText(plist, line, 1001);
+        strcat(expected, line);
+    }
+    caPutLogSinkFlush(plist, 5.0);
+    zlibServerWait(psrv, strlen(expected), 5.0);
+    caPutLogSinkGetStats(plist, 0, &sinkStats);
+    testOk(sinkStats.batches < 10 && strcmp(zlibServerText(psrv), expected) == 0,
+        "%lu bytes in %lu batches", (unsigned long)strlen(expected),
+        (unsigned long)sinkStats.batches);
+
+    caPutLogSinkListDestroy(plist);
+    zlibServerStop(psrv);
+}
+
+static void testScheme(void)
+{
+    caPutLogSinkList *plist = caPutLogSinkListCreate("test", 1000);
+    osiSockAddr addr;
+    zlibServer *psrv = zlibServerStart(&addr, 1, 1);
+    char address[64];
+
+    testDiag("zlib:// address");
+    expected[0] = 0;
+    caPutLogTcpZlibLevel = 9;
+    sprintf(address, "zlib://127.0.0.1:%u", ntohs(addr.ia.sin_port));
+    testOk(caPutLogSinkAdd(plist, address, 7011) == 0 && caPutLogSinkCount(plist) == 1,
+        "%s added", address);
+    sendLines(plist, 1, 10);
+    caPutLogSinkFlush(plist, 5.0);
+    zlibServerWait(psrv, strlen(expected), 5.0);
+    testOk(strcmp(zlibServerText(psrv), expected) == 0, "lines inflated as sent");
+
+    caPutLogSinkListDestroy(plist);
+    zlibServerStop(psrv);
+    caPutLogTcpZlibLevel = 6;
+}
+
+MAIN(caPutLogZlibTest)
+{
+    testPlan(9);
+    osiSockAttach();
+    testStream();
+    testLargeBatch();
+    testScheme();
+    return testDone();
+}